@@ -0,0 +1,93 @@
+/**
+ * @file      bench_log.c
+ * @brief     日志路径的微基准测试
+ * @details   模拟on_read中一次查询的处理：解析报文，打印报文字节流与结构体，再输出一条DEBUG与一条INFO日志。
+ *            分别测量不含日志调用的基线、日志被--log_mask屏蔽、日志全部开启三种情况下每次查询的平均耗时，
+ *            日志开启时输出到/dev/null。以NODNS_MIN_LOG_LEVEL >= 1编译时，三者应当没有差别。
+ *            用法：bench_log [查询次数]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/dns_config.h"
+#include "../include/dns_conversion.h"
+#include "../include/dns_log.h"
+#include "../include/dns_name.h"
+#include "../include/dns_print.h"
+
+// www.example.com IN A 的查询报文
+static const uint8_t QUERY[] = {
+        0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+        0x00, 0x01, 0x00, 0x01};
+
+static volatile uint64_t sink; // 防止编译器消除被测代码
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief 处理一次查询
+ * @param with_log 是否调用日志接口
+ */
+static void handle_query(bool with_log) {
+    char buf[DNS_STRING_MAX_SIZE];
+    memcpy(buf, QUERY, sizeof(QUERY));
+    DNSMessage *msg = (DNSMessage *) calloc(1, sizeof(DNSMessage));
+    if (!msg)
+        exit(EXIT_FAILURE);
+    string_to_dnsmsg(msg, buf);
+    if (with_log) {
+        print_dns_string(buf, sizeof(QUERY));
+        print_dns_message(buf, sizeof(QUERY));
+        log_debug("收到查询 ID: 0x%04x", msg->header->id)
+        log_info("查询类型 %d", msg->que->qtype)
+    }
+    sink += msg->header->id;
+    destroy_dnsmsg(msg);
+}
+
+/**
+ * @brief 测量每次查询的平均耗时
+ * @param count 查询次数
+ * @param with_log 是否调用日志接口
+ * @return 平均耗时（纳秒）
+ */
+static double measure(int count, bool with_log) {
+    double start = now_ns();
+    for (int i = 0; i < count; ++i)
+        handle_query(with_log);
+    return (now_ns() - start) / count;
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    init_dnsname();
+    log_file = fopen("/dev/null", "w");
+    if (!log_file)
+        return 1;
+    init_log();
+
+    measure(count / 10 + 1, false); // 预热
+    double baseline = measure(count, false);
+    LOG_MASK = 0;
+    double masked = measure(count, true);
+    LOG_MASK = 15;
+    double enabled = measure(count, true);
+    log_flush();
+
+    printf("queries=%d min_log_level=%d dns_print=%s\n", count, NODNS_MIN_LOG_LEVEL,
+           NODNS_MIN_LOG_LEVEL > LOG_DEBUG ? "stripped" : "compiled");
+    printf("%-10s %10s %10s\n", "case", "ns/op", "overhead");
+    printf("%-10s %10.2f %10.2f\n", "baseline", baseline, 0.0);
+    printf("%-10s %10.2f %10.2f\n", "masked", masked, masked - baseline);
+    printf("%-10s %10.2f %10.2f\n", "enabled", enabled, enabled - baseline);
+    printf("dropped=%llu\n", (unsigned long long) log_dropped());
+    return 0;
+}
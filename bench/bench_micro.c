@@ -0,0 +1,611 @@
+/**
+ * @file      bench_micro.c
+ * @brief     报文编解码、缓存、红黑树、hosts索引、后缀规则与序号池的微基准测试
+ * @details   每个测试项先预热，再重复BENCH_REPEATS轮，每轮运行约为设定时长的1/BENCH_REPEATS，取各轮ns/op的中位数。
+ *            分配次数通过链接选项-Wl,--wrap=malloc等截获nodns库与本文件中的malloc/calloc/realloc调用来统计，
+ *            libc与libuv内部的分配不计入。结果以JSON输出，可用bench/compare_bench.cmake与保存的基线比较。
+ *            cache/parallel项用多个线程并发查询同一缓存，ns/op为总时长除以各线程的操作总数。
+ *            用法：bench_micro [-f 名称子串] [-t 每项秒数] [-o 输出文件]
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/dns_cache.h"
+#include "../include/dns_config.h"
+#include "../include/dns_conversion.h"
+#include "../include/dns_key.h"
+#include "../include/hosts.h"
+#include "../include/index_pool.h"
+#include "../include/rbtree.h"
+#include "../include/suffix_trie.h"
+
+#define BENCH_REPEATS 5
+#define BENCH_MAX_RESULTS 64
+#define BENCH_NAME_SIZE 64
+#define CACHE_INSERT_LIMIT 20000 // 红黑树中的副本不会被淘汰，限制插入次数以控制内存
+#define RBTREE_INSERT_LIMIT 200000 // 红黑树没有销毁接口，限制插入次数以控制内存
+#define BENCH_MAX_THREADS 8
+
+// 一个测试项的结果
+typedef struct bench_result {
+    char name[BENCH_NAME_SIZE];
+    uint64_t iterations; // 所有轮的总次数
+    double ns_per_op; // 各轮的中位数
+    double allocs_per_op;
+} Bench_Result;
+
+// 被测函数：执行n次操作，ctx为测试项的数据
+typedef void (*Bench_Func)(void *ctx, uint64_t n);
+
+static atomic_uint_fast64_t alloc_count; // 并发测试项中多个线程同时分配
+static volatile uint64_t sink; // 防止编译器消除被测代码
+static const char *filter = NULL;
+static double seconds = 1.0;
+static Bench_Result results[BENCH_MAX_RESULTS];
+static int result_count;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief 运行一个测试项
+ * @param name 名称
+ * @param func 被测函数
+ * @param ctx 测试项的数据
+ * @param limit 每轮次数的上限，为0时不限；用于无法释放、内存随次数增长的测试项
+ */
+static void run(const char *name, Bench_Func func, void *ctx, uint64_t limit) {
+    if (filter && !strstr(name, filter))
+        return;
+    // 估计每轮的次数
+    uint64_t n = 1;
+    double elapsed;
+    while (true) {
+        double start = now_ns();
+        func(ctx, n);
+        elapsed = now_ns() - start;
+        if (elapsed > seconds * 1e9 / BENCH_REPEATS / 10 || n >= (1ULL << 40) || (limit && n >= limit))
+            break;
+        n *= 2;
+    }
+    n = (uint64_t) (n * (seconds * 1e9 / BENCH_REPEATS) / (elapsed > 0 ? elapsed : 1)) + 1;
+    if (limit && n > limit)
+        n = limit;
+
+    double ns[BENCH_REPEATS];
+    uint64_t allocs = 0;
+    for (int r = 0; r < BENCH_REPEATS; ++r) {
+        uint64_t before = alloc_count;
+        double start = now_ns();
+        func(ctx, n);
+        ns[r] = (now_ns() - start) / n;
+        allocs += alloc_count - before;
+    }
+    qsort(ns, BENCH_REPEATS, sizeof(double), &compare_double);
+
+    Bench_Result *result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->iterations = n * BENCH_REPEATS;
+    result->ns_per_op = ns[BENCH_REPEATS / 2];
+    result->allocs_per_op = (double) allocs / result->iterations;
+    fprintf(stderr, "%-40s %12.1f ns/op %8.2f allocs/op\n", name, result->ns_per_op, result->allocs_per_op);
+}
+
+/**
+ * @brief 写入域名的标签序列
+ * @param p 写入位置
+ * @param name 点分域名
+ * @return 写入的长度
+ */
+static size_t put_name(uint8_t *p, const char *name) {
+    size_t pos = 0;
+    while (*name) {
+        const char *dot = strchr(name, '.');
+        size_t len = dot ? (size_t) (dot - name) : strlen(name);
+        p[pos++] = len;
+        memcpy(p + pos, name, len);
+        pos += len;
+        name += len + (dot ? 1 : 0);
+    }
+    p[pos++] = 0;
+    return pos;
+}
+
+/**
+ * @brief 构造回复报文：name的CNAME指向cname，cname带有count条A记录；cname为NULL时name直接带有A记录
+ * @param p 写入位置
+ * @param name 查询的域名
+ * @param cname CNAME的目标
+ * @param count A记录数
+ * @return 报文长度
+ */
+static size_t build_response(uint8_t *p, const char *name, const char *cname, int count) {
+    memset(p, 0, 12);
+    p[0] = 0x12, p[1] = 0x34;
+    p[2] = 0x81, p[3] = 0x80;
+    p[5] = 1;
+    p[7] = count + (cname ? 1 : 0);
+    size_t pos = 12 + put_name(p + 12, name);
+    p[pos++] = 0, p[pos++] = 1, p[pos++] = 0, p[pos++] = 1;
+    uint8_t owner[2] = {0xC0, 12};
+    if (cname) {
+        memcpy(p + pos, owner, 2);
+        pos += 2;
+        uint8_t fixed[] = {0, 5, 0, 1, 0, 0, 0x0E, 0x10};
+        memcpy(p + pos, fixed, sizeof(fixed));
+        pos += sizeof(fixed);
+        size_t rdlength = put_name(p + pos + 2, cname);
+        p[pos] = rdlength >> 8, p[pos + 1] = rdlength;
+        owner[0] = 0xC0 | (pos + 2) >> 8, owner[1] = pos + 2;
+        pos += 2 + rdlength;
+    }
+    for (int i = 0; i < count; ++i) {
+        memcpy(p + pos, owner, 2);
+        pos += 2;
+        uint8_t fixed[] = {0, 1, 0, 1, 0, 0, 0x0E, 0x10, 0, 4, 10, 0, 0, i + 1};
+        memcpy(p + pos, fixed, sizeof(fixed));
+        pos += sizeof(fixed);
+    }
+    return pos;
+}
+
+/**
+ * @brief 解析报文
+ * @param data 报文
+ * @param len 报文长度
+ * @return 解析后的报文结构体
+ */
+static DNSMessage *parse(const uint8_t *data, size_t len) {
+    char buf[DNS_STRING_MAX_SIZE];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, data, len);
+    DNSMessage *msg = (DNSMessage *) calloc(1, sizeof(DNSMessage));
+    if (!msg || !string_to_dnsmsg(msg, buf)) {
+        fprintf(stderr, "测试报文解析失败\n");
+        exit(EXIT_FAILURE);
+    }
+    return msg;
+}
+
+// 报文编解码的测试数据
+typedef struct codec_ctx {
+    char data[DNS_STRING_MAX_SIZE];
+    DNSMessage *msg;
+} Codec_Ctx;
+
+static void bench_parse(void *ctx, uint64_t n) {
+    Codec_Ctx *c = (Codec_Ctx *) ctx;
+    for (uint64_t i = 0; i < n; ++i) {
+        DNSMessage *msg = (DNSMessage *) calloc(1, sizeof(DNSMessage));
+        string_to_dnsmsg(msg, c->data);
+        sink += msg->header->id;
+        destroy_dnsmsg(msg);
+    }
+}
+
+static void bench_serialize(void *ctx, uint64_t n) {
+    Codec_Ctx *c = (Codec_Ctx *) ctx;
+    char buf[DNS_STRING_MAX_SIZE];
+    for (uint64_t i = 0; i < n; ++i)
+        sink += dnsmsg_to_string(c->msg, buf);
+}
+
+static void bench_copy(void *ctx, uint64_t n) {
+    Codec_Ctx *c = (Codec_Ctx *) ctx;
+    for (uint64_t i = 0; i < n; ++i) {
+        DNSMessage *msg = copy_dnsmsg(c->msg);
+        sink += msg->header->id;
+        destroy_dnsmsg(msg);
+    }
+}
+
+static void bench_codec() {
+    static Codec_Ctx query, response;
+    uint8_t wire[DNS_STRING_MAX_SIZE];
+    size_t len = build_response(wire, "www.example.com", NULL, 0);
+    wire[2] = 0x01, wire[3] = 0; // 改为查询报文
+    memcpy(query.data, wire, len);
+    query.msg = parse(wire, len);
+    len = build_response(wire, "www.example.com", "www.example.com.cdn.example.net", 4);
+    memcpy(response.data, wire, len);
+    response.msg = parse(wire, len);
+
+    run("codec/string_to_dnsmsg/query", &bench_parse, &query, 0);
+    run("codec/string_to_dnsmsg/response", &bench_parse, &response, 0);
+    run("codec/dnsmsg_to_string/query", &bench_serialize, &query, 0);
+    run("codec/dnsmsg_to_string/response", &bench_serialize, &response, 0);
+    run("codec/copy_dnsmsg/query", &bench_copy, &query, 0);
+    run("codec/copy_dnsmsg/response", &bench_copy, &response, 0);
+}
+
+// 缓存的测试数据
+typedef struct cache_ctx {
+    Cache *cache;
+    DNSMessage **msgs; // 前size个已插入缓存，其余未插入
+    int size;
+    double hit_ratio;
+} Cache_Ctx;
+
+/**
+ * @brief 生成2 * size个不同域名的回复报文
+ * @param size 个数的一半
+ * @return 报文数组
+ */
+static DNSMessage **make_messages(int size) {
+    DNSMessage **msgs = (DNSMessage **) malloc(2 * size * sizeof(DNSMessage *));
+    uint8_t wire[DNS_STRING_MAX_SIZE];
+    char name[BENCH_NAME_SIZE];
+    for (int i = 0; i < 2 * size; ++i) {
+        snprintf(name, sizeof(name), "host%d.bench%d.example.com", i, i % 97);
+        msgs[i] = parse(wire, build_response(wire, name, NULL, 2));
+    }
+    return msgs;
+}
+
+static void bench_cache_insert(void *ctx, uint64_t n) {
+    Cache_Ctx *c = (Cache_Ctx *) ctx;
+    for (uint64_t i = 0; i < n; ++i)
+        c->cache->insert(c->cache, c->msgs[next_random() % c->size]);
+}
+
+static void bench_cache_query(void *ctx, uint64_t n) {
+    Cache_Ctx *c = (Cache_Ctx *) ctx;
+    uint64_t threshold = (uint64_t) (c->hit_ratio * 1000000);
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t r = next_random();
+        int index = (int) ((r >> 20) % c->size) + ((r & 0xFFFFF) % 1000000 < threshold ? 0 : c->size);
+        Cache_Hit hit;
+        RBTreeValue *value = c->cache->query(c->cache, c->msgs[index]->que, &hit);
+        if (value) {
+            destroy_dnsrr(value->rr);
+            free(value);
+        }
+        sink += hit;
+    }
+}
+
+static void bench_cache() {
+    static const int sizes[] = {100, 1000, 10000};
+    static const double ratios[] = {0.5, 0.9, 0.99};
+    char name[BENCH_NAME_SIZE];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        Cache_Ctx ctx = {new_cache(NULL), make_messages(sizes[s]), sizes[s], 0};
+        for (int i = 0; i < ctx.size; ++i)
+            ctx.cache->insert(ctx.cache, ctx.msgs[i]);
+        for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r) {
+            ctx.hit_ratio = ratios[r];
+            snprintf(name, sizeof(name), "cache/query/%d/hit%g", sizes[s], ratios[r]);
+            run(name, &bench_cache_query, &ctx, 0);
+        }
+        // 插入会不断增长红黑树中同一键下的链表，放在查询之后
+        snprintf(name, sizeof(name), "cache/insert/%d", sizes[s]);
+        run(name, &bench_cache_insert, &ctx, CACHE_INSERT_LIMIT);
+    }
+}
+
+// 并发查询缓存的测试数据
+typedef struct parallel_ctx {
+    Cache_Ctx *cache;
+    int threads;
+    uint64_t n; // 每个线程的操作次数
+    uint64_t seed;
+} Parallel_Ctx;
+
+static void *parallel_worker(void *arg) {
+    Parallel_Ctx *p = (Parallel_Ctx *) arg;
+    Cache_Ctx *c = p->cache;
+    uint64_t r = p->seed, hits = 0;
+    for (uint64_t i = 0; i < p->n; ++i) {
+        r ^= r << 13;
+        r ^= r >> 7;
+        r ^= r << 17;
+        Cache_Hit hit;
+        RBTreeValue *value = c->cache->query(c->cache, c->msgs[(r >> 20) % c->size]->que, &hit);
+        if (value) {
+            destroy_dnsrr(value->rr);
+            free(value);
+        }
+        hits += hit;
+    }
+    sink += hits;
+    return NULL;
+}
+
+static void bench_cache_parallel(void *ctx, uint64_t n) {
+    Parallel_Ctx *p = (Parallel_Ctx *) ctx;
+    pthread_t tids[BENCH_MAX_THREADS];
+    Parallel_Ctx args[BENCH_MAX_THREADS];
+    for (int t = 0; t < p->threads; ++t) {
+        args[t] = *p;
+        args[t].n = (n + p->threads - 1) / p->threads;
+        args[t].seed = next_random() | 1;
+        pthread_create(&tids[t], NULL, &parallel_worker, &args[t]);
+    }
+    for (int t = 0; t < p->threads; ++t)
+        pthread_join(tids[t], NULL);
+}
+
+/**
+ * @brief 不同淘汰策略与分片数下多线程查询缓存的吞吐，所有查询均命中
+ */
+static void bench_cache_parallel_shards() {
+    static const int policies[] = {CACHE_POLICY_LRU, CACHE_POLICY_CLOCK};
+    static const char *policy_names[] = {"lru", "clock"};
+    static const int shards[] = {1, 16};
+    static const int threads[] = {1, 4, 8};
+    const int size = 10000;
+    char name[BENCH_NAME_SIZE];
+    DNSMessage **msgs = make_messages(size);
+    int saved_size = CACHE_SIZE, saved_policy = CACHE_POLICY, saved_shards = CACHE_SHARDS;
+    CACHE_SIZE = size;
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p) {
+        CACHE_POLICY = policies[p];
+        for (size_t s = 0; s < sizeof(shards) / sizeof(shards[0]); ++s) {
+            CACHE_SHARDS = shards[s];
+            Cache_Ctx ctx = {new_cache(NULL), msgs, size, 1};
+            for (int i = 0; i < size; ++i)
+                ctx.cache->insert(ctx.cache, msgs[i]);
+            for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t) {
+                Parallel_Ctx args = {&ctx, threads[t], 0, 0};
+                snprintf(name, sizeof(name), "cache/parallel/%s/%dshard/%dthread", policy_names[p], shards[s],
+                         threads[t]);
+                run(name, &bench_cache_parallel, &args, 0);
+            }
+        }
+    }
+    CACHE_SIZE = saved_size;
+    CACHE_POLICY = saved_policy;
+    CACHE_SHARDS = saved_shards;
+}
+
+// 红黑树的测试数据
+typedef struct rbtree_ctx {
+    RBTree *tree;
+    uint64_t *keys;
+    int size;
+} RBTree_Ctx;
+
+static void bench_rbtree_insert(void *ctx, uint64_t n) {
+    RBTree_Ctx *c = (RBTree_Ctx *) ctx;
+    // 每次从空树开始插入size个键，旧树不释放，避免计入销毁的开销
+    for (uint64_t i = 0; i < n; ++i) {
+        int index = (int) (i % c->size);
+        if (index == 0)
+            c->tree = new_rbtree();
+        DNSRRLinkList *list = new_linklist();
+        list->expire_time = -1;
+        c->tree->insert(c->tree, c->keys[index], list);
+    }
+}
+
+static void bench_rbtree_query(void *ctx, uint64_t n) {
+    RBTree_Ctx *c = (RBTree_Ctx *) ctx;
+    for (uint64_t i = 0; i < n; ++i)
+        sink += (uintptr_t) c->tree->query(c->tree, c->keys[next_random() % c->size]);
+}
+
+static void bench_rbtree() {
+    static const int sizes[] = {1000, 10000, 100000};
+    char name[BENCH_NAME_SIZE];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        RBTree_Ctx ctx = {new_rbtree(), (uint64_t *) malloc(sizes[s] * sizeof(uint64_t)), sizes[s]};
+        for (int i = 0; i < ctx.size; ++i) {
+            ctx.keys[i] = next_random();
+            DNSRRLinkList *list = new_linklist();
+            list->expire_time = -1;
+            ctx.tree->insert(ctx.tree, ctx.keys[i], list);
+        }
+        snprintf(name, sizeof(name), "rbtree/query/%d", sizes[s]);
+        run(name, &bench_rbtree_query, &ctx, 0);
+        snprintf(name, sizeof(name), "rbtree/insert/%d", sizes[s]);
+        run(name, &bench_rbtree_insert, &ctx, RBTREE_INSERT_LIMIT);
+    }
+}
+
+// 后缀规则的测试数据
+typedef struct suffix_ctx {
+    Suffix_Trie *trie;
+    DNSKey *keys; // 一半被规则匹配
+    int size;
+} Suffix_Ctx;
+
+static void bench_suffix_match(void *ctx, uint64_t n) {
+    Suffix_Ctx *c = (Suffix_Ctx *) ctx;
+    for (uint64_t i = 0; i < n; ++i)
+        sink += c->trie->match(c->trie, &c->keys[next_random() % c->size]);
+}
+
+/**
+ * @brief 不同规则数下匹配四个标签的域名，代价应与规则数无关
+ */
+static void bench_suffix() {
+    static const int sizes[] = {1000, 100000};
+    const int query_count = 4096;
+    char name[BENCH_NAME_SIZE], text[DNS_STRING_MAX_SIZE];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        Suffix_Ctx ctx = {new_suffix_trie(), (DNSKey *) malloc(query_count * sizeof(DNSKey)), query_count};
+        for (int i = 0; i < sizes[s]; ++i) {
+            int len = snprintf(text, sizeof(text), "ads%d.example%d.com", i, i % 97);
+            ctx.trie->insert(ctx.trie, text, len, SUFFIX_MATCH_SELF | SUFFIX_MATCH_BELOW);
+        }
+        for (int i = 0; i < query_count; ++i) {
+            int rule = (int) (next_random() % sizes[s]);
+            snprintf(text, sizeof(text), "www.%s%d.example%d.com.", i % 2 ? "ads" : "cdn", rule, rule % 97);
+            dnskey_init(&ctx.keys[i], (const uint8_t *) text, DNS_TYPE_A, DNS_CLASS_IN);
+        }
+        snprintf(name, sizeof(name), "suffix/match/%d", sizes[s]);
+        run(name, &bench_suffix_match, &ctx, 0);
+        destroy_suffix_trie(ctx.trie);
+        free(ctx.keys);
+    }
+}
+
+// hosts索引的测试数据
+typedef struct hosts_ctx {
+    Hosts_Index *index;
+    DNSKey *keys;
+    int size;
+} Hosts_Ctx;
+
+static void bench_hosts_find(void *ctx, uint64_t n) {
+    Hosts_Ctx *c = (Hosts_Ctx *) ctx;
+    for (uint64_t i = 0; i < n; ++i)
+        sink += (uintptr_t) c->index->find(c->index, &c->keys[next_random() % c->size]);
+}
+
+/**
+ * @brief 查询hosts索引，miss项的域名都不在hosts中，大多被布隆过滤器直接排除
+ */
+static void bench_hosts() {
+    static const int sizes[] = {1000, 100000};
+    const int query_count = 4096;
+    char name[BENCH_NAME_SIZE], text[DNS_STRING_MAX_SIZE];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        char *buf;
+        size_t buf_size;
+        FILE *fp = open_memstream(&buf, &buf_size);
+        for (int i = 0; i < sizes[s]; ++i)
+            fprintf(fp, "host%d.example.com 10.%d.%d.%d\n", i, (i >> 16) & 255, (i >> 8) & 255, i & 255);
+        fclose(fp);
+        fp = fmemopen(buf, buf_size, "r");
+        Hosts_Ctx ctx = {new_hosts_index(fp), (DNSKey *) malloc(query_count * sizeof(DNSKey)), query_count};
+        fclose(fp);
+        free(buf);
+        for (int hit = 1; hit >= 0; --hit) {
+            for (int i = 0; i < query_count; ++i) {
+                snprintf(text, sizeof(text), "%s%d.example.com.", hit ? "host" : "miss",
+                         (int) (next_random() % sizes[s]));
+                dnskey_init(&ctx.keys[i], (const uint8_t *) text, DNS_TYPE_A, DNS_CLASS_IN);
+            }
+            snprintf(name, sizeof(name), "hosts/%s/%d", hit ? "hit" : "miss", sizes[s]);
+            run(name, &bench_hosts_find, &ctx, 0);
+        }
+        destroy_hosts_index(ctx.index);
+        free(ctx.keys);
+    }
+}
+
+// 序号池的测试数据
+typedef struct ipool_ctx {
+    Index_Pool *ipool;
+    uint16_t *live; // 在池中的序号，按插入顺序循环使用
+    int size;
+    int head;
+    Index index;
+} IPool_Ctx;
+
+static void bench_ipool_churn(void *ctx, uint64_t n) {
+    IPool_Ctx *c = (IPool_Ctx *) ctx;
+    // 每次操作删除最早插入的序号并插入一个新序号，池中始终有size个序号
+    for (uint64_t i = 0; i < n; ++i) {
+        sink += (uintptr_t) c->ipool->delete(c->ipool, c->live[c->head]);
+        c->live[c->head] = c->ipool->insert(c->ipool, &c->index);
+        c->head = (c->head + 1) % c->size;
+    }
+}
+
+static void bench_ipool() {
+    static const int sizes[] = {256, 4096, 60000};
+    char name[BENCH_NAME_SIZE];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        IPool_Ctx ctx = {new_ipool(), (uint16_t *) malloc(sizes[s] * sizeof(uint16_t)), sizes[s], 0};
+        for (int i = 0; i < ctx.size; ++i)
+            ctx.live[i] = ctx.ipool->insert(ctx.ipool, &ctx.index);
+        snprintf(name, sizeof(name), "ipool/churn/%d", sizes[s]);
+        run(name, &bench_ipool_churn, &ctx, 0);
+        ctx.ipool->destroy(ctx.ipool);
+        free(ctx.live);
+    }
+}
+
+/**
+ * @brief 以JSON输出结果
+ * @param fp 输出文件
+ */
+static void write_json(FILE *fp) {
+    fprintf(fp, "{\n  \"repeats\": %d,\n  \"seconds\": %g,\n  \"benchmarks\": [\n", BENCH_REPEATS, seconds);
+    for (int i = 0; i < result_count; ++i)
+        fprintf(fp, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}%s\n",
+                results[i].name, (unsigned long long) results[i].iterations, results[i].ns_per_op,
+                results[i].allocs_per_op, i + 1 < result_count ? "," : "");
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    const char *output = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:t:o:")) != -1) {
+        switch (opt) {
+            case 'f': filter = optarg; break;
+            case 't': seconds = atof(optarg); break;
+            case 'o': output = optarg; break;
+            default:
+                fprintf(stderr, "用法：bench_micro [-f 名称子串] [-t 每项秒数] [-o 输出文件]\n");
+                return EXIT_FAILURE;
+        }
+    }
+    if (seconds <= 0)
+        seconds = 1.0;
+    LOG_MASK = 0;
+
+    bench_codec();
+    bench_cache();
+    bench_cache_parallel_shards();
+    bench_rbtree();
+    bench_hosts();
+    bench_suffix();
+    bench_ipool();
+
+    FILE *fp = output ? fopen(output, "w") : stdout;
+    if (!fp) {
+        perror(output);
+        return EXIT_FAILURE;
+    }
+    write_json(fp);
+    if (output)
+        fclose(fp);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file      bench_name.c
+ * @brief     域名处理内核的微基准测试
+ * @details   按真实域名的长度分布生成测试集（标签数2~6，少量CDN/哈希风格的长标签，随机大小写），
+ *            对每一种可用的内核分别测量小写化、哈希、比较、标签复制与编码的平均耗时。
+ *            用法：bench_name [域名个数] [轮数]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/dns_name.h"
+#include "../include/dns_structure.h"
+
+#define NAME_BUF_SIZE DNS_KEY_NAME_MAX_SIZE
+
+// 测试用域名
+typedef struct bench_name {
+    uint8_t text[NAME_BUF_SIZE]; // 点分形式，随机大小写
+    uint8_t lower[NAME_BUF_SIZE]; // 小写形式，以0填充
+    uint8_t wire[NAME_BUF_SIZE + 2]; // 报文中的标签序列
+    size_t len;
+} BenchName;
+
+static const char *TLDS[] = {"com", "net", "org", "cn", "io", "edu.cn", "co.uk", "cloudfront.net", "akamaiedge.net"};
+
+static volatile uint64_t sink; // 防止编译器消除被测代码
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief 生成一个随机标签
+ * @param p 写入位置
+ * @return 标签长度
+ */
+static int random_label(uint8_t *p) {
+    static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+    int r = rand() % 100, len;
+    if (r < 5) len = 32 + rand() % 32; // 哈希风格的长标签
+    else if (r < 30) len = 1 + rand() % 4;
+    else len = 4 + rand() % 12;
+    for (int i = 0; i < len; ++i) {
+        char c = ALPHABET[rand() % (sizeof(ALPHABET) - 2)];
+        p[i] = (rand() & 1) ? (uint8_t) (c >= 'a' && c <= 'z' ? c - 32 : c) : (uint8_t) c;
+    }
+    return len;
+}
+
+static void make_name(BenchName *name) {
+    memset(name, 0, sizeof(*name));
+    int r = rand() % 100;
+    int labels = r < 30 ? 1 : r < 70 ? 2 : r < 90 ? 3 : 4 + rand() % 3;
+    size_t pos = 0;
+    for (int i = 0; i < labels && pos < 160; ++i) {
+        pos += random_label(name->text + pos);
+        name->text[pos++] = '.';
+    }
+    const char *tld = TLDS[rand() % (sizeof(TLDS) / sizeof(TLDS[0]))];
+    memcpy(name->text + pos, tld, strlen(tld));
+    pos += strlen(tld);
+    name->text[pos++] = '.';
+    name->len = pos;
+    for (size_t i = 0; i < pos; ++i)
+        name->lower[i] = (name->text[i] >= 'A' && name->text[i] <= 'Z') ? name->text[i] | 0x20 : name->text[i];
+    dnsname_kernels(&r)[0]->to_wire(name->wire, name->text);
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 4096;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    srand(20230624);
+    BenchName *names = calloc(count, sizeof(BenchName));
+    BenchName *copies = calloc(count, sizeof(BenchName));
+    if (!names || !copies)
+        return 1;
+    size_t total_len = 0;
+    for (int i = 0; i < count; ++i) {
+        make_name(&names[i]);
+        copies[i] = names[i];
+        total_len += names[i].len;
+    }
+    printf("names=%d rounds=%d mean_len=%.1f\n", count, rounds, (double) total_len / count);
+    printf("%-8s %10s %10s %10s %12s %10s\n", "kernel", "lower", "hash", "equal", "copy_label", "to_wire");
+
+    int kernel_count;
+    const DNSNameKernel *const *kernels = dnsname_kernels(&kernel_count);
+    uint64_t reference = 0;
+    for (int k = 0; k < kernel_count; ++k) {
+        const DNSNameKernel *kernel = kernels[k];
+        uint8_t buf[NAME_BUF_SIZE + 64];
+        double result[5];
+        uint64_t acc = 0;
+        double start = now_ns();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < count; ++i)
+                acc += kernel->lower(buf, names[i].text, DNS_NAME_TEXT_MAX_SIZE);
+        result[0] = now_ns() - start;
+
+        uint64_t hashes = 0;
+        start = now_ns();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < count; ++i)
+                hashes += kernel->hash(names[i].lower, names[i].len);
+        result[1] = now_ns() - start;
+
+        start = now_ns();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < count; ++i)
+                acc += kernel->equal(names[i].lower, copies[i].lower, names[i].len);
+        result[2] = now_ns() - start;
+
+        start = now_ns();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < count; ++i) {
+                const uint8_t *label = names[i].wire;
+                uint8_t *out = buf;
+                while (*label) { // 与string_to_rrname相同的逐标签调用方式
+                    acc += kernel->copy_label(out, label + 1, *label);
+                    out += *label;
+                    *out++ = '.';
+                    label += *label + 1;
+                }
+            }
+        result[3] = now_ns() - start;
+
+        start = now_ns();
+        for (int r = 0; r < rounds; ++r)
+            for (int i = 0; i < count; ++i)
+                acc += kernel->to_wire(buf, names[i].text);
+        result[4] = now_ns() - start;
+
+        if (k == 0)
+            reference = hashes;
+        else if (hashes != reference) {
+            fprintf(stderr, "%s: 哈希值与标量实现不一致\n", kernel->name);
+            return 1;
+        }
+        sink += acc + hashes;
+        double ops = (double) rounds * count;
+        printf("%-8s %10.2f %10.2f %10.2f %12.2f %10.2f\n", kernel->name,
+               result[0] / ops, result[1] / ops, result[2] / ops, result[3] / ops, result[4] / ops);
+    }
+    printf("(ns/op)\n");
+    free(names);
+    free(copies);
+    return 0;
+}
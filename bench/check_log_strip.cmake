@@ -0,0 +1,19 @@
+# 检查main中是否含有dns_print.c的符号
+# 用法：cmake -DNM=<nm> -DBINARY=<main> -DMIN_LOG_LEVEL=<level> -P check_log_strip.cmake
+
+execute_process(COMMAND ${NM} ${BINARY} OUTPUT_VARIABLE SYMBOLS RESULT_VARIABLE RESULT)
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "nm ${BINARY} failed")
+endif ()
+
+string(REGEX MATCHALL "[^\n]*(print_dns_|render_dns_)[^\n]*" FOUND "${SYMBOLS}")
+list(LENGTH FOUND COUNT)
+if (MIN_LOG_LEVEL GREATER 0)
+    if (COUNT GREATER 0)
+        string(REPLACE ";" "\n" FOUND "${FOUND}")
+        message(FATAL_ERROR "DEBUG logging is stripped but main still contains dns_print.c code:\n${FOUND}")
+    endif ()
+    message(STATUS "main contains no dns_print.c symbols (NODNS_MIN_LOG_LEVEL=${MIN_LOG_LEVEL})")
+else ()
+    message(STATUS "main contains ${COUNT} dns_print.c symbols (NODNS_MIN_LOG_LEVEL=${MIN_LOG_LEVEL})")
+endif ()
@@ -0,0 +1,85 @@
+# 比较两次bench_micro的JSON结果，ns/op变慢超过THRESHOLD百分比或allocs/op增加超过1% + 0.01时失败
+# 用法：cmake -DBASELINE=<基线.json> -DCURRENT=<本次.json> [-DTHRESHOLD=10] -P compare_bench.cmake
+
+cmake_minimum_required(VERSION 3.19) # string(JSON)
+
+if (NOT DEFINED THRESHOLD)
+    set(THRESHOLD 10)
+endif ()
+# 将小数转为以千分之一为单位的整数
+function(to_milli VALUE OUT)
+    string(REGEX MATCH "^-?[0-9]+" INT ${VALUE})
+    string(REGEX MATCH "\\.[0-9]+" FRAC "${VALUE}")
+    string(SUBSTRING "${FRAC}000" 1 3 FRAC)
+    math(EXPR MILLI "${INT} * 1000 + ${FRAC}")
+    set(${OUT} ${MILLI} PARENT_SCOPE)
+endfunction()
+
+file(READ ${BASELINE} BASELINE_JSON)
+file(READ ${CURRENT} CURRENT_JSON)
+
+string(JSON BASE_COUNT LENGTH "${BASELINE_JSON}" benchmarks)
+string(JSON CUR_COUNT LENGTH "${CURRENT_JSON}" benchmarks)
+if (BASE_COUNT EQUAL 0 OR CUR_COUNT EQUAL 0)
+    message(FATAL_ERROR "no benchmarks to compare")
+endif ()
+math(EXPR LIMIT "${THRESHOLD} * 10")
+math(EXPR BASE_LAST "${BASE_COUNT} - 1")
+math(EXPR CUR_LAST "${CUR_COUNT} - 1")
+
+foreach (I RANGE ${BASE_LAST})
+    string(JSON NAME GET "${BASELINE_JSON}" benchmarks ${I} name)
+    string(JSON NS GET "${BASELINE_JSON}" benchmarks ${I} ns_per_op)
+    string(JSON ALLOCS GET "${BASELINE_JSON}" benchmarks ${I} allocs_per_op)
+    set("BASE_NS_${NAME}" ${NS})
+    set("BASE_ALLOCS_${NAME}" ${ALLOCS})
+endforeach ()
+
+set(FAILED "")
+foreach (I RANGE ${CUR_LAST})
+    string(JSON NAME GET "${CURRENT_JSON}" benchmarks ${I} name)
+    string(JSON NS GET "${CURRENT_JSON}" benchmarks ${I} ns_per_op)
+    string(JSON ALLOCS GET "${CURRENT_JSON}" benchmarks ${I} allocs_per_op)
+    if (NOT DEFINED "BASE_NS_${NAME}")
+        message(STATUS "${NAME}: ${NS} ns/op ${ALLOCS} allocs/op (new)")
+        continue()
+    endif ()
+    set(BASE_NS ${BASE_NS_${NAME}})
+    set(BASE_ALLOCS ${BASE_ALLOCS_${NAME}})
+    # math只支持整数，按千分之一计算变化
+    string(REGEX REPLACE "\\..*" "" BASE_NS_INT ${BASE_NS})
+    string(REGEX REPLACE "\\..*" "" NS_INT ${NS})
+    if (BASE_NS_INT EQUAL 0)
+        set(BASE_NS_INT 1)
+    endif ()
+    math(EXPR CHANGE "(${NS_INT} - ${BASE_NS_INT}) * 1000 / ${BASE_NS_INT}")
+    set(SIGN "+")
+    if (CHANGE LESS 0)
+        set(SIGN "-")
+        math(EXPR CHANGE_ABS "-${CHANGE}")
+    else ()
+        set(CHANGE_ABS ${CHANGE})
+    endif ()
+    math(EXPR CHANGE_INT "${CHANGE_ABS} / 10")
+    math(EXPR CHANGE_FRAC "${CHANGE_ABS} % 10")
+    # string(JSON)读出的数字带有多余的小数位，输出时截断到两位
+    foreach (VAR BASE_NS NS BASE_ALLOCS ALLOCS)
+        string(REGEX REPLACE "(\\.[0-9][0-9])[0-9]+$" "\\1" ${VAR}_SHOW ${${VAR}})
+    endforeach ()
+    set(LINE "${NAME}: ${BASE_NS_SHOW} -> ${NS_SHOW} ns/op (${SIGN}${CHANGE_INT}.${CHANGE_FRAC}%), ${BASE_ALLOCS_SHOW} -> ${ALLOCS_SHOW} allocs/op")
+    # 命中率类测试项的分配次数随随机序列略有波动，允许1% + 0.01的误差
+    to_milli(${ALLOCS} ALLOCS_MILLI)
+    to_milli(${BASE_ALLOCS} BASE_ALLOCS_MILLI)
+    math(EXPR ALLOCS_LIMIT "${BASE_ALLOCS_MILLI} + ${BASE_ALLOCS_MILLI} / 100 + 10")
+    if (CHANGE GREATER LIMIT OR ALLOCS_MILLI GREATER ALLOCS_LIMIT)
+        list(APPEND FAILED "${NAME}")
+        message(STATUS "${LINE}  REGRESSION")
+    else ()
+        message(STATUS "${LINE}")
+    endif ()
+endforeach ()
+
+if (FAILED)
+    string(REPLACE ";" "\n  " FAILED "${FAILED}")
+    message(FATAL_ERROR "regressions beyond ${THRESHOLD}% or extra allocations:\n  ${FAILED}")
+endif ()
@@ -0,0 +1,364 @@
+/**
+ * @file      nodns_bench.c
+ * @brief     UDP压力测试工具
+ * @details   每个线程使用一个独立的socket，按Zipf分布从域名列表中选取域名发送A查询，以报文ID匹配回复并记录延迟。
+ *            指定总QPS时各线程按均分的速率开环发送；否则每个线程保持固定数量的在途查询，收到回复或超时后立即补发。
+ *            结束时输出发送数、回复数、丢失数、实际QPS与延迟分位数。
+ *            用法：nodns-bench [-s 地址] [-p 端口] [-c 线程数] [-w 在途数] [-q QPS] [-d 秒数] [-z Zipf指数]
+ *                              [-n 域名个数] [-f 域名文件] [-t 超时毫秒]
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../include/dns_metrics.h"
+
+#define BENCH_MAX_THREADS 256
+#define BENCH_PACKET_SIZE 512
+#define BENCH_NAME_MAX_SIZE 256
+#define BENCH_RECV_BATCH 64 // 每次poll后最多连续接收的回复数
+
+// 编码好的查询报文，ID在发送时填写
+typedef struct bench_query {
+    uint8_t data[BENCH_NAME_MAX_SIZE + 16];
+    size_t len;
+} Bench_Query;
+
+// 线程的统计
+typedef struct bench_worker {
+    pthread_t thread;
+    unsigned index;
+    uint64_t rng; // xorshift状态
+    uint64_t sent;
+    uint64_t received;
+    uint64_t timeouts;
+    uint64_t rcodes[16];
+    uint64_t truncated;
+    Metrics_Histogram latency; // 纳秒
+} Bench_Worker;
+
+static struct sockaddr_in server_addr;
+static unsigned threads = 4;
+static unsigned window = 16;
+static double qps = 0;
+static double duration = 10;
+static double zipf = 1.0;
+static unsigned name_count = 10000;
+static const char *name_file = NULL;
+static unsigned timeout_ms = 2000;
+
+static Bench_Query *queries;
+static double *cdf; // 按热度排列的累积分布
+static Bench_Worker workers[BENCH_MAX_THREADS];
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/**
+ * @brief 将点分域名编码为A查询报文
+ * @param query 输出的报文
+ * @param name 域名
+ * @return 编码成功时返回true
+ */
+static bool encode_query(Bench_Query *query, const char *name) {
+    uint8_t *p = query->data;
+    memset(p, 0, 12);
+    p[2] = 0x01; // RD
+    p[5] = 1; // QDCOUNT
+    size_t pos = 12;
+    while (*name) {
+        const char *dot = strchr(name, '.');
+        size_t len = dot ? (size_t) (dot - name) : strlen(name);
+        if (len == 0 || len > 63 || pos + len + 1 > 12 + BENCH_NAME_MAX_SIZE - 1)
+            return false;
+        p[pos++] = len;
+        memcpy(p + pos, name, len);
+        pos += len;
+        name += len + (dot ? 1 : 0);
+    }
+    p[pos++] = 0;
+    p[pos++] = 0, p[pos++] = 1; // QTYPE A
+    p[pos++] = 0, p[pos++] = 1; // QCLASS IN
+    query->len = pos;
+    return true;
+}
+
+/**
+ * @brief 读取域名文件，每行一个域名，按热度从高到低排列；未指定文件时生成name_count个域名
+ */
+static void load_names() {
+    queries = (Bench_Query *) calloc(name_count, sizeof(Bench_Query));
+    if (!queries) {
+        perror("calloc");
+        exit(1);
+    }
+    if (name_file == NULL) {
+        char name[64];
+        for (unsigned i = 0; i < name_count; ++i) {
+            snprintf(name, sizeof(name), "n%u.bench.example.com", i); // 不能落在本地区域（如test）之下，否则不经过缓存与上游
+            encode_query(&queries[i], name);
+        }
+        return;
+    }
+    FILE *fp = fopen(name_file, "r");
+    if (!fp) {
+        perror(name_file);
+        exit(1);
+    }
+    char line[BENCH_NAME_MAX_SIZE * 2];
+    unsigned n = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, " \t\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        size_t len = strlen(line);
+        if (line[len - 1] == '.')
+            line[len - 1] = '\0';
+        if (n == name_count) {
+            name_count *= 2;
+            queries = (Bench_Query *) realloc(queries, name_count * sizeof(Bench_Query));
+            if (!queries) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        if (encode_query(&queries[n], line))
+            ++n;
+    }
+    fclose(fp);
+    if (n == 0) {
+        fprintf(stderr, "%s: 没有可用的域名\n", name_file);
+        exit(1);
+    }
+    name_count = n;
+}
+
+/**
+ * @brief 计算Zipf分布的累积分布，第i个域名的概率正比于1/(i+1)^s
+ */
+static void build_cdf() {
+    cdf = (double *) malloc(name_count * sizeof(double));
+    if (!cdf) {
+        perror("malloc");
+        exit(1);
+    }
+    double sum = 0;
+    for (unsigned i = 0; i < name_count; ++i)
+        cdf[i] = sum += 1 / pow(i + 1, zipf);
+    for (unsigned i = 0; i < name_count; ++i)
+        cdf[i] /= sum;
+}
+
+/**
+ * @brief 按Zipf分布选取一个域名
+ * @param worker 线程
+ * @return 域名的下标
+ */
+static unsigned pick_name(Bench_Worker *worker) {
+    double u = (double) (next_random(&worker->rng) >> 11) / (double) (1ULL << 53);
+    unsigned lo = 0, hi = name_count - 1;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void *worker_thread(void *arg) {
+    Bench_Worker *worker = (Bench_Worker *) arg;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0) {
+        perror("socket");
+        exit(1);
+    }
+    int size = 4 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    uint64_t *sent_at = (uint64_t *) calloc(65536, sizeof(uint64_t)); // 各ID的发送时刻，为0表示不在途
+    if (!sent_at) {
+        perror("calloc");
+        exit(1);
+    }
+    uint16_t next_id = 0;
+    unsigned inflight = 0;
+    uint64_t timeout = (uint64_t) timeout_ms * 1000000;
+    uint64_t start = now_ns();
+    uint64_t stop = start + (uint64_t) (duration * 1e9);
+    uint64_t interval = qps > 0 ? (uint64_t) (1e9 * threads / qps) : 0;
+    uint64_t next_send = start + (interval ? worker->index * interval / threads : 0); // 错开各线程的发送时刻
+    uint64_t next_sweep = start + timeout;
+    uint8_t buf[BENCH_PACKET_SIZE];
+
+    while (true) {
+        uint64_t now = now_ns();
+        // 发送到期的查询
+        while (now < stop && (interval ? next_send <= now : inflight < window)) {
+            if (sent_at[next_id] != 0) { // ID仍在途，说明在途查询过多
+                ++next_id;
+                break;
+            }
+            Bench_Query *query = &queries[pick_name(worker)];
+            memcpy(buf, query->data, query->len);
+            buf[0] = next_id >> 8;
+            buf[1] = next_id;
+            if (send(fd, buf, query->len, 0) < 0 && errno != ENOBUFS && errno != EAGAIN)
+                perror("send");
+            sent_at[next_id++] = now;
+            ++inflight;
+            ++worker->sent;
+            next_send += interval;
+        }
+        // 清理超时的查询
+        if (now >= next_sweep) {
+            for (unsigned id = 0; id < 65536; ++id)
+                if (sent_at[id] != 0 && now - sent_at[id] > timeout) {
+                    sent_at[id] = 0;
+                    --inflight;
+                    ++worker->timeouts;
+                }
+            next_sweep = now + timeout / 4;
+        }
+        if (now >= stop && inflight == 0)
+            break;
+        if (now >= stop + timeout) {
+            worker->timeouts += inflight;
+            break;
+        }
+
+        // 等待回复，开环时最多等到下一次发送
+        int wait = 1;
+        if (!interval && inflight >= window)
+            wait = 10;
+        else if (interval && next_send > now)
+            wait = (int) ((next_send - now) / 1000000);
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, wait) <= 0)
+            continue;
+        for (int i = 0; i < BENCH_RECV_BATCH; ++i) {
+            ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (n < 12)
+                break;
+            uint16_t id = buf[0] << 8 | buf[1];
+            if (sent_at[id] == 0) // 超时后才到达的回复
+                continue;
+            metrics_histogram_record(&worker->latency, now_ns() - sent_at[id]);
+            sent_at[id] = 0;
+            --inflight;
+            ++worker->received;
+            ++worker->rcodes[buf[3] & 0x0F];
+            if (buf[2] & 0x02)
+                ++worker->truncated;
+        }
+    }
+    free(sent_at);
+    close(fd);
+    return NULL;
+}
+
+static void usage() {
+    fprintf(stderr, "用法：nodns-bench [-s 地址] [-p 端口] [-c 线程数] [-w 在途数] [-q QPS] [-d 秒数] [-z Zipf指数]\n"
+                    "                  [-n 域名个数] [-f 域名文件] [-t 超时毫秒]\n"
+                    "  -s  服务器地址，默认127.0.0.1\n"
+                    "  -p  服务器端口，默认53\n"
+                    "  -c  线程数，默认4\n"
+                    "  -w  未指定QPS时每个线程的在途查询数，默认16\n"
+                    "  -q  总QPS，默认0，即不限速\n"
+                    "  -d  持续时间（秒），默认10\n"
+                    "  -z  Zipf指数，0为均匀分布，默认1\n"
+                    "  -n  未指定域名文件时生成的域名个数，默认10000\n"
+                    "  -f  域名文件，每行一个域名，按热度从高到低排列\n"
+                    "  -t  超时（毫秒），默认2000\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = 53;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:c:w:q:d:z:n:f:t:")) != -1) {
+        switch (opt) {
+            case 's': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'c': threads = atoi(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            case 'q': qps = atof(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'z': zipf = atof(optarg); break;
+            case 'n': name_count = atoi(optarg); break;
+            case 'f': name_file = optarg; break;
+            case 't': timeout_ms = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (threads < 1 || threads > BENCH_MAX_THREADS || window < 1 || window > 60000 || name_count < 1 ||
+        duration <= 0 || zipf < 0 || qps < 0 || port < 1 || port > 65535 || timeout_ms < 1)
+        usage();
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr.sin_addr) != 1)
+        usage();
+
+    load_names();
+    build_cdf();
+    uint64_t start = now_ns();
+    for (unsigned i = 0; i < threads; ++i) {
+        workers[i].index = i;
+        workers[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&workers[i].thread, NULL, &worker_thread, &workers[i]);
+    }
+    Bench_Worker total;
+    memset(&total, 0, sizeof(total));
+    for (unsigned i = 0; i < threads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        total.sent += workers[i].sent;
+        total.received += workers[i].received;
+        total.timeouts += workers[i].timeouts;
+        total.truncated += workers[i].truncated;
+        for (int r = 0; r < 16; ++r)
+            total.rcodes[r] += workers[i].rcodes[r];
+        metrics_histogram_merge(&total.latency, &workers[i].latency);
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    if (elapsed > duration)
+        elapsed = duration; // 不计入最后等待在途回复的时间
+
+    printf("域名 %u 个，Zipf指数 %.2f，线程 %u，%s\n", name_count, zipf, threads, qps > 0 ? "开环" : "闭环");
+    printf("发送 %llu，回复 %llu，超时 %llu（%.2f%%），截断 %llu\n", (unsigned long long) total.sent,
+           (unsigned long long) total.received, (unsigned long long) total.timeouts,
+           total.sent ? 100.0 * total.timeouts / total.sent : 0.0, (unsigned long long) total.truncated);
+    printf("RCODE NOERROR %llu，SERVFAIL %llu，NXDOMAIN %llu\n", (unsigned long long) total.rcodes[0],
+           (unsigned long long) total.rcodes[2], (unsigned long long) total.rcodes[3]);
+    printf("QPS %.0f\n", total.received / elapsed);
+    printf("延迟 p50 %.3fms  p99 %.3fms  p999 %.3fms  max %.3fms\n",
+           metrics_histogram_quantile(&total.latency, 0.5) / 1e6,
+           metrics_histogram_quantile(&total.latency, 0.99) / 1e6,
+           metrics_histogram_quantile(&total.latency, 0.999) / 1e6,
+           metrics_histogram_quantile(&total.latency, 1) / 1e6);
+    return 0;
+}
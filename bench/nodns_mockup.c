@@ -0,0 +1,327 @@
+/**
+ * @file      nodns_mockup.c
+ * @brief     模拟上游DNS服务器
+ * @details   在本地监听UDP端口，代替真实的上游服务器回复查询，用于在没有网络的环境下测试与压测。
+ *            每个查询按设定的概率被丢弃、回复NXDOMAIN或回复截断（TC置位、不带回答），其余的A查询回复
+ *            一条地址由域名哈希得到的A记录，其他类型回复没有回答的NOERROR。回复在设定的延迟（加上均匀抖动）后发出。
+ *            使用-r时从抓包文件中读入所有回复，按问题（域名不区分大小写、QTYPE、QCLASS）索引；
+ *            查询命中时原样返回抓包中的回复，只改写ID与问题的大小写，未命中时按上述规则构造回复。
+ *            用法：nodns-mockup [-a 地址] [-p 端口] [-d 延迟毫秒] [-j 抖动毫秒] [-l 丢弃率] [-x NXDOMAIN率]
+ *                               [-t 截断率] [-T TTL] [-r 抓包文件]
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <uv.h>
+
+#include "pcap_dns.h"
+
+#define MOCK_PACKET_SIZE 4096
+#define MOCK_KEY_SIZE 300
+
+// 抓包中的回复
+typedef struct mock_answer {
+    uint8_t key[MOCK_KEY_SIZE]; // 问题的规范形式
+    size_t key_len;
+    const uint8_t *data; // 回复报文，指向抓包文件的内容
+    size_t len;
+} Mock_Answer;
+
+// 等待发出的回复
+typedef struct mock_reply {
+    uv_timer_t timer;
+    uv_udp_send_t req;
+    struct sockaddr_storage addr;
+    uv_buf_t buf;
+    uint8_t data[MOCK_PACKET_SIZE];
+} Mock_Reply;
+
+static uv_loop_t *loop;
+static uv_udp_t sock;
+static double delay_ms = 0;
+static double jitter_ms = 0;
+static double loss_rate = 0;
+static double nxdomain_rate = 0;
+static double truncate_rate = 0;
+static uint32_t ttl = 300;
+static uint64_t rng = 0x2545F4914F6CDD1DULL;
+static uint64_t received, dropped;
+static Pcap_DNS pcap;
+static Mock_Answer *answers; // 以问题的哈希为下标的开放寻址表
+static size_t answer_mask;
+static uint64_t replayed, synthesized;
+
+static double next_uniform() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (double) (rng >> 11) / (double) (1ULL << 53);
+}
+
+/**
+ * @brief 跳过报文中的域名
+ * @param data 报文
+ * @param len 报文长度
+ * @param pos 域名的起始位置
+ * @return 域名之后的位置，格式错误时返回0
+ */
+static size_t skip_name(const uint8_t *data, size_t len, size_t pos) {
+    while (pos < len && data[pos] != 0) {
+        if ((data[pos] & 0xC0) != 0) // 查询中不应出现压缩指针
+            return 0;
+        pos += data[pos] + 1;
+    }
+    return pos < len ? pos + 1 : 0;
+}
+
+static uint64_t hash_key(const uint8_t *key, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ key[i]) * 0x100000001b3ULL;
+    return hash;
+}
+
+/**
+ * @brief 在回复表中查找问题
+ * @param key 问题的规范形式
+ * @param len 长度
+ * @return 找到的回复，或应插入的空槽
+ */
+static Mock_Answer *find_answer(const uint8_t *key, size_t len) {
+    for (size_t i = hash_key(key, len) & answer_mask;; i = (i + 1) & answer_mask)
+        if (answers[i].data == NULL || (answers[i].key_len == len && memcmp(answers[i].key, key, len) == 0))
+            return &answers[i];
+}
+
+/**
+ * @brief 读入抓包文件中的回复，同一问题只保留第一个回复
+ * @param path 抓包文件
+ */
+static void load_answers(const char *path) {
+    if (!pcap_dns_open(&pcap, path))
+        exit(1);
+    size_t count = 0;
+    Pcap_DNS_Packet packet;
+    while (pcap_dns_next(&pcap, &packet))
+        count += !packet.query;
+    size_t size = 1024;
+    while (size < count * 2)
+        size *= 2;
+    answers = (Mock_Answer *) calloc(size, sizeof(Mock_Answer));
+    if (!answers) {
+        perror("calloc");
+        exit(1);
+    }
+    answer_mask = size - 1;
+    pcap_dns_close(&pcap);
+    pcap_dns_open(&pcap, path);
+    uint8_t key[MOCK_KEY_SIZE];
+    count = 0;
+    while (pcap_dns_next(&pcap, &packet)) {
+        size_t len;
+        if (packet.query || packet.len > MOCK_PACKET_SIZE ||
+            (len = pcap_dns_question(packet.dns, packet.len, key, sizeof(key))) == 0)
+            continue;
+        Mock_Answer *answer = find_answer(key, len);
+        if (answer->data != NULL)
+            continue;
+        memcpy(answer->key, key, len);
+        answer->key_len = len;
+        answer->data = packet.dns;
+        answer->len = packet.len;
+        ++count;
+    }
+    fprintf(stderr, "从%s中读入%zu个问题的回复\n", path, count);
+}
+
+/**
+ * @brief 用抓包中的回复作答
+ * @param reply 回复
+ * @param query 查询报文
+ * @param len 查询报文长度
+ * @return 抓包中有该问题的回复时返回true
+ */
+static bool replay_reply(Mock_Reply *reply, const uint8_t *query, size_t len) {
+    uint8_t key[MOCK_KEY_SIZE];
+    size_t key_len = pcap_dns_question(query, len, key, sizeof(key));
+    if (key_len == 0)
+        return false;
+    Mock_Answer *answer = find_answer(key, key_len);
+    if (answer->data == NULL)
+        return false;
+    memcpy(reply->data, answer->data, answer->len);
+    memcpy(reply->data, query, 2); // ID
+    memcpy(reply->data + 12, query + 12, key_len - 4); // 问题中的域名，保留查询的大小写
+    reply->buf = uv_buf_init((char *) reply->data, answer->len);
+    return true;
+}
+
+/**
+ * @brief 根据查询构造回复
+ * @param reply 回复
+ * @param query 查询报文
+ * @param len 查询报文长度
+ * @return 构造成功时返回true
+ */
+static bool build_reply(Mock_Reply *reply, const uint8_t *query, size_t len) {
+    if (len < 12 || (query[2] & 0x80) || query[4] != 0 || query[5] != 1)
+        return false;
+    size_t end = skip_name(query, len, 12);
+    if (end == 0 || end + 4 > len)
+        return false;
+    end += 4;
+    uint8_t *p = reply->data;
+    memcpy(p, query, end);
+    p[2] = 0x80 | (query[2] & 0x79); // QR，保留OPCODE与RD
+    p[3] = 0x80; // RA
+    memset(p + 6, 0, 6);
+
+    double u = next_uniform();
+    if (u < nxdomain_rate) {
+        p[3] |= 3;
+    } else if (u < nxdomain_rate + truncate_rate) {
+        p[2] |= 0x02;
+    } else if (query[end - 4] == 0 && query[end - 3] == 1) { // QTYPE A
+        uint32_t hash = 2166136261u;
+        for (size_t i = 12; i < end - 4; ++i)
+            hash = (hash ^ (query[i] | 0x20)) * 16777619u;
+        uint8_t answer[] = {0xC0, 12, 0, 1, 0, 1, ttl >> 24, ttl >> 16, ttl >> 8, ttl, 0, 4,
+                            10, hash >> 16, hash >> 8, hash};
+        memcpy(p + end, answer, sizeof(answer));
+        end += sizeof(answer);
+        p[7] = 1; // ANCOUNT
+    }
+    reply->buf = uv_buf_init((char *) p, end);
+    return true;
+}
+
+static void on_close(uv_handle_t *handle) {
+    free(handle->data);
+}
+
+static void on_send(uv_udp_send_t *req, int status) {
+    Mock_Reply *reply = (Mock_Reply *) req->data;
+    uv_close((uv_handle_t *) &reply->timer, &on_close);
+}
+
+static void send_reply(Mock_Reply *reply) {
+    reply->req.data = reply;
+    if (uv_udp_send(&reply->req, &sock, &reply->buf, 1, (struct sockaddr *) &reply->addr, &on_send) != 0)
+        uv_close((uv_handle_t *) &reply->timer, &on_close);
+}
+
+static void on_timer(uv_timer_t *timer) {
+    send_reply((Mock_Reply *) timer->data);
+}
+
+static void alloc_buffer(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf) {
+    static char data[MOCK_PACKET_SIZE];
+    *buf = uv_buf_init(data, sizeof(data));
+}
+
+static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const struct sockaddr *addr, unsigned flags) {
+    if (nread <= 0 || addr == NULL)
+        return;
+    ++received;
+    if (next_uniform() < loss_rate) {
+        ++dropped;
+        return;
+    }
+    Mock_Reply *reply = (Mock_Reply *) malloc(sizeof(Mock_Reply));
+    if (!reply) {
+        perror("malloc");
+        exit(1);
+    }
+    if (answers && replay_reply(reply, (const uint8_t *) buf->base, nread)) {
+        ++replayed;
+    } else if (build_reply(reply, (const uint8_t *) buf->base, nread)) {
+        ++synthesized;
+    } else {
+        free(reply);
+        return;
+    }
+    memcpy(&reply->addr, addr, addr->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+    uv_timer_init(loop, &reply->timer);
+    reply->timer.data = reply;
+    double wait = delay_ms + jitter_ms * next_uniform();
+    if (wait < 1)
+        send_reply(reply);
+    else
+        uv_timer_start(&reply->timer, &on_timer, (uint64_t) wait, 0);
+}
+
+static void on_signal(uv_signal_t *handle, int signum) {
+    fprintf(stderr, "收到 %llu 个查询，丢弃 %llu 个，回放抓包中的回复 %llu 个，构造回复 %llu 个\n",
+            (unsigned long long) received, (unsigned long long) dropped, (unsigned long long) replayed,
+            (unsigned long long) synthesized);
+    exit(0);
+}
+
+static void usage() {
+    fprintf(stderr, "用法：nodns-mockup [-a 地址] [-p 端口] [-d 延迟毫秒] [-j 抖动毫秒] [-l 丢弃率] [-x NXDOMAIN率]\n"
+                    "                   [-t 截断率] [-T TTL] [-r 抓包文件]\n"
+                    "  -a  监听地址，默认127.0.0.1\n"
+                    "  -p  监听端口，默认5353\n"
+                    "  -d  回复延迟（毫秒），默认0\n"
+                    "  -j  在延迟之上附加的均匀抖动（毫秒），默认0\n"
+                    "  -l  丢弃查询的概率，默认0\n"
+                    "  -x  回复NXDOMAIN的概率，默认0\n"
+                    "  -t  回复截断的概率，默认0\n"
+                    "  -T  A记录的TTL（秒），默认300\n"
+                    "  -r  pcap或pcapng文件，用其中的回复作答，没有对应回复的查询按以上规则构造回复\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = 5353;
+    int opt;
+    const char *capture = NULL;
+    while ((opt = getopt(argc, argv, "a:p:d:j:l:x:t:T:r:")) != -1) {
+        switch (opt) {
+            case 'a': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'd': delay_ms = atof(optarg); break;
+            case 'j': jitter_ms = atof(optarg); break;
+            case 'l': loss_rate = atof(optarg); break;
+            case 'x': nxdomain_rate = atof(optarg); break;
+            case 't': truncate_rate = atof(optarg); break;
+            case 'T': ttl = strtoul(optarg, NULL, 10); break;
+            case 'r': capture = optarg; break;
+            default: usage();
+        }
+    }
+    if (port < 1 || port > 65535 || delay_ms < 0 || jitter_ms < 0 || loss_rate < 0 || loss_rate > 1 ||
+        nxdomain_rate < 0 || truncate_rate < 0 || nxdomain_rate + truncate_rate > 1)
+        usage();
+
+    if (capture)
+        load_answers(capture);
+
+    loop = uv_default_loop();
+    struct sockaddr_storage addr;
+    if (uv_ip4_addr(host, port, (struct sockaddr_in *) &addr) != 0 &&
+        uv_ip6_addr(host, port, (struct sockaddr_in6 *) &addr) != 0)
+        usage();
+    uv_udp_init(loop, &sock);
+    int err = uv_udp_bind(&sock, (struct sockaddr *) &addr, UV_UDP_REUSEADDR);
+    if (err != 0) {
+        fprintf(stderr, "绑定%s:%d失败：%s\n", host, port, uv_strerror(err));
+        return 1;
+    }
+    int size = 4 << 20;
+    uv_recv_buffer_size((uv_handle_t *) &sock, &size);
+    uv_send_buffer_size((uv_handle_t *) &sock, &size);
+    uv_udp_recv_start(&sock, &alloc_buffer, &on_read);
+
+    uv_signal_t sigint, sigterm;
+    uv_signal_init(loop, &sigint);
+    uv_signal_start(&sigint, &on_signal, SIGINT);
+    uv_signal_init(loop, &sigterm);
+    uv_signal_start(&sigterm, &on_signal, SIGTERM);
+    fprintf(stderr, "在%s:%d上模拟上游服务器\n", host, port);
+    return uv_run(loop, UV_RUN_DEFAULT);
+}
@@ -0,0 +1,353 @@
+/**
+ * @file      nodns_replay.c
+ * @brief     抓包回放工具
+ * @details   从pcap/pcapng文件中取出所有DNS查询，按抓包时的时间间隔（可按倍数加速）原样发往服务器，
+ *            只改写报文ID，以便按ID匹配回复并记录延迟。查询轮流使用多个socket，每个socket有独立的ID空间。
+ *            指定服务器的指标端口时，回放前后各抓取一次/metrics，输出各回复来源的查询数、缓存命中率与上游查询数。
+ *            配合nodns-mockup -r使用同一抓包文件，上游回复也来自抓包。
+ *            用法：nodns-replay -f 抓包文件 [-s 地址] [-p 端口] [-x 倍速] [-n 轮数] [-c socket数] [-w 在途数]
+ *                               [-t 超时毫秒] [-D 查询的目的地址] [-m 指标端口]
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "pcap_dns.h"
+#include "../include/dns_metrics.h"
+
+#define REPLAY_MAX_SOCKETS 64
+#define REPLAY_PACKET_SIZE 4096
+#define REPLAY_HTTP_SIZE (1 << 20)
+
+// 待回放的查询
+typedef struct replay_query {
+    double time; // 相对第一个查询的时刻（秒）
+    const uint8_t *data;
+    size_t len;
+} Replay_Query;
+
+// 回放用的socket
+typedef struct replay_socket {
+    int fd;
+    uint16_t next_id;
+    unsigned inflight;
+    uint64_t sent_at[65536]; // 各ID的发送时刻，为0表示不在途
+} Replay_Socket;
+
+static Replay_Query *queries;
+static size_t query_count;
+static Replay_Socket sockets[REPLAY_MAX_SOCKETS];
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 读出抓包文件中的查询
+ * @param pcap 抓包文件
+ * @param dst 只保留目的地址为dst的查询，为NULL时保留全部
+ * @param family dst的地址族
+ */
+static void load_queries(Pcap_DNS *pcap, const uint8_t *dst, int family) {
+    size_t capacity = 1024;
+    queries = (Replay_Query *) malloc(capacity * sizeof(Replay_Query));
+    Pcap_DNS_Packet packet;
+    double first = 0;
+    while (queries && pcap_dns_next(pcap, &packet)) {
+        if (!packet.query || (packet.dns[2] & 0x78) != 0) // 只回放标准查询
+            continue;
+        if (dst && (packet.family != family || memcmp(packet.dst, dst, family == AF_INET ? 4 : 16) != 0))
+            continue;
+        if (query_count == capacity) {
+            capacity *= 2;
+            queries = (Replay_Query *) realloc(queries, capacity * sizeof(Replay_Query));
+            if (!queries)
+                break;
+        }
+        if (query_count == 0)
+            first = packet.time;
+        Replay_Query *query = &queries[query_count++];
+        query->time = packet.time - first;
+        if (query->time < 0) // 乱序的记录
+            query->time = query_count > 1 ? queries[query_count - 2].time : 0;
+        query->data = packet.dns;
+        query->len = packet.len;
+    }
+    if (!queries) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+/**
+ * @brief 抓取服务器的指标，解析各回复来源的查询数与上游查询数
+ * @param port 指标端口
+ * @param outcomes 输出，各回复来源的查询数
+ * @param upstream 输出，上游查询数
+ * @return 成功时返回true
+ */
+static bool scrape(int port, double *outcomes, double *upstream) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("连接指标端口");
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    if (write(fd, request, sizeof(request) - 1) < 0) {
+        close(fd);
+        return false;
+    }
+    char *body = (char *) malloc(REPLAY_HTTP_SIZE);
+    size_t len = 0;
+    ssize_t n;
+    while (body && len < REPLAY_HTTP_SIZE - 1 && (n = read(fd, body + len, REPLAY_HTTP_SIZE - 1 - len)) > 0)
+        len += n;
+    close(fd);
+    if (!body)
+        return false;
+    body[len] = '\0';
+
+    memset(outcomes, 0, QUERY_OUTCOME_COUNT * sizeof(double));
+    *upstream = 0;
+    for (char *line = strtok(body, "\n"); line; line = strtok(NULL, "\n")) {
+        char label[32];
+        double value;
+        if (sscanf(line, "nodns_query_duration_seconds_count{path=\"%31[^\"]\"} %lf", label, &value) == 2) {
+            for (int i = 0; i < QUERY_OUTCOME_COUNT; ++i)
+                if (strcmp(label, OUTCOME_LABEL[i]) == 0)
+                    outcomes[i] = value;
+        } else if (sscanf(line, "nodns_upstream_queries_total %lf", &value) == 1) {
+            *upstream = value;
+        }
+    }
+    free(body);
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "用法：nodns-replay -f 抓包文件 [-s 地址] [-p 端口] [-x 倍速] [-n 轮数] [-c socket数] [-w 在途数]\n"
+                    "                   [-t 超时毫秒] [-D 查询的目的地址] [-m 指标端口]\n"
+                    "  -f  pcap或pcapng文件\n"
+                    "  -s  服务器地址，默认127.0.0.1\n"
+                    "  -p  服务器端口，默认53\n"
+                    "  -x  回放速度，1为抓包时的速度，2为两倍速，0为不等待、尽快发送，默认1\n"
+                    "  -n  回放轮数，默认1\n"
+                    "  -c  socket数，默认8\n"
+                    "  -w  -x 0时每个socket的在途查询数，默认64\n"
+                    "  -t  超时（毫秒），默认2000\n"
+                    "  -D  只回放发往该地址的查询，用于从服务器上的抓包中排除其发往上游的查询\n"
+                    "  -m  服务器的指标端口（--metrics_port），用于统计缓存命中率与上游查询数\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *file = NULL, *host = "127.0.0.1", *filter = NULL;
+    int port = 53, metrics_port = 0;
+    double speed = 1;
+    unsigned rounds = 1, socket_count = 8, window = 64, timeout_ms = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:s:p:x:n:c:w:t:D:m:")) != -1) {
+        switch (opt) {
+            case 'f': file = optarg; break;
+            case 's': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'x': speed = atof(optarg); break;
+            case 'n': rounds = atoi(optarg); break;
+            case 'c': socket_count = atoi(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            case 't': timeout_ms = atoi(optarg); break;
+            case 'D': filter = optarg; break;
+            case 'm': metrics_port = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (!file || port < 1 || port > 65535 || speed < 0 || rounds < 1 || socket_count < 1 ||
+        socket_count > REPLAY_MAX_SOCKETS || window < 1 || window > 60000 || timeout_ms < 1)
+        usage();
+    struct sockaddr_in server = {.sin_family = AF_INET, .sin_port = htons(port)};
+    if (inet_pton(AF_INET, host, &server.sin_addr) != 1)
+        usage();
+    uint8_t dst[16];
+    int family = 0;
+    if (filter) {
+        family = inet_pton(AF_INET, filter, dst) == 1 ? AF_INET : inet_pton(AF_INET6, filter, dst) == 1 ? AF_INET6 : 0;
+        if (!family)
+            usage();
+    }
+
+    Pcap_DNS pcap;
+    if (!pcap_dns_open(&pcap, file))
+        return 1;
+    load_queries(&pcap, filter ? dst : NULL, family);
+    if (query_count == 0) {
+        fprintf(stderr, "%s: 没有可回放的查询\n", file);
+        return 1;
+    }
+    double span = queries[query_count - 1].time;
+    uint64_t qtypes[256] = {0}; // QTYPE小于256的查询的类型分布
+    for (size_t i = 0; i < query_count; ++i) {
+        uint8_t key[REPLAY_PACKET_SIZE];
+        size_t len = pcap_dns_question(queries[i].data, queries[i].len, key, sizeof(key));
+        if (len && key[len - 4] == 0)
+            ++qtypes[key[len - 3]];
+    }
+
+    struct pollfd pfds[REPLAY_MAX_SOCKETS];
+    for (unsigned i = 0; i < socket_count; ++i) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &server, sizeof(server)) < 0) {
+            perror("socket");
+            return 1;
+        }
+        int size = 4 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        sockets[i].fd = fd;
+        pfds[i] = (struct pollfd) {fd, POLLIN, 0};
+    }
+
+    double before[QUERY_OUTCOME_COUNT], after[QUERY_OUTCOME_COUNT], upstream_before = 0, upstream_after = 0;
+    if (metrics_port && !scrape(metrics_port, before, &upstream_before))
+        metrics_port = 0;
+
+    Metrics_Histogram latency;
+    memset(&latency, 0, sizeof(latency));
+    uint64_t sent = 0, received = 0, timeouts = 0, truncated = 0, send_errors = 0, rcodes[16] = {0};
+    uint64_t timeout = (uint64_t) timeout_ms * 1000000;
+    uint64_t total = query_count * rounds, next = 0;
+    uint64_t start = now_ns(), next_sweep = start + timeout, last_reply = start;
+    unsigned inflight = 0;
+    uint8_t buf[REPLAY_PACKET_SIZE];
+
+    while (true) {
+        uint64_t now = now_ns();
+        // 发送到期的查询
+        while (next < total) {
+            const Replay_Query *query = &queries[next % query_count];
+            Replay_Socket *sock = &sockets[next % socket_count];
+            if (speed > 0) {
+                double at = (next / query_count * (span + 1e-3) + query->time) / speed;
+                if (start + (uint64_t) (at * 1e9) > now)
+                    break;
+            } else if (sock->inflight >= window) {
+                break;
+            }
+            if (sock->sent_at[sock->next_id] != 0) { // ID仍在途
+                ++sock->next_id;
+                break;
+            }
+            size_t len = query->len < sizeof(buf) ? query->len : sizeof(buf);
+            memcpy(buf, query->data, len);
+            buf[0] = sock->next_id >> 8;
+            buf[1] = sock->next_id;
+            if (send(sock->fd, buf, len, 0) < 0 && errno != ENOBUFS && errno != EAGAIN && send_errors++ == 0)
+                perror("send"); // 服务器未启动时每个查询都会失败，只输出第一次
+            sock->sent_at[sock->next_id++] = now;
+            ++sock->inflight;
+            ++inflight;
+            ++sent;
+            ++next;
+        }
+        // 清理超时的查询
+        if (now >= next_sweep) {
+            for (unsigned i = 0; i < socket_count; ++i)
+                for (unsigned id = 0; id < 65536; ++id)
+                    if (sockets[i].sent_at[id] != 0 && now - sockets[i].sent_at[id] > timeout) {
+                        sockets[i].sent_at[id] = 0;
+                        --sockets[i].inflight;
+                        --inflight;
+                        ++timeouts;
+                    }
+            next_sweep = now + timeout / 4;
+        }
+        if (next == total && inflight == 0)
+            break;
+
+        int wait = 1;
+        if (next == total || (speed == 0 && inflight >= window * socket_count))
+            wait = 10;
+        if (poll(pfds, socket_count, wait) <= 0)
+            continue;
+        now = now_ns();
+        for (unsigned i = 0; i < socket_count; ++i) {
+            if (!(pfds[i].revents & POLLIN))
+                continue;
+            Replay_Socket *sock = &sockets[i];
+            ssize_t n;
+            while ((n = recv(sock->fd, buf, sizeof(buf), MSG_DONTWAIT)) >= 12) {
+                uint16_t id = buf[0] << 8 | buf[1];
+                if (sock->sent_at[id] == 0) // 超时后才到达的回复
+                    continue;
+                metrics_histogram_record(&latency, now - sock->sent_at[id]);
+                sock->sent_at[id] = 0;
+                --sock->inflight;
+                --inflight;
+                ++received;
+                last_reply = now;
+                ++rcodes[buf[3] & 0x0F];
+                if (buf[2] & 0x02)
+                    ++truncated;
+            }
+        }
+    }
+    double elapsed = last_reply > start ? (last_reply - start) / 1e9 : 1e-9;
+
+    printf("抓包中的查询 %zu 个，时长 %.1f 秒，回放 %u 轮，", query_count, span, rounds);
+    if (speed > 0)
+        printf("速度 %gx\n", speed);
+    else
+        printf("速度不限\n");
+    printf("查询类型");
+    static const struct { int type; const char *name; } TYPES[] = {
+            {1, "A"}, {28, "AAAA"}, {5, "CNAME"}, {65, "HTTPS"}, {12, "PTR"}, {15, "MX"}, {16, "TXT"}, {2, "NS"},
+            {6, "SOA"}, {33, "SRV"}};
+    uint64_t other = query_count;
+    for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); ++i) {
+        if (qtypes[TYPES[i].type])
+            printf(" %s %.1f%%", TYPES[i].name, 100.0 * qtypes[TYPES[i].type] / query_count);
+        other -= qtypes[TYPES[i].type];
+    }
+    printf(" 其他 %.1f%%\n", 100.0 * other / query_count);
+    printf("发送 %llu，回复 %llu，超时 %llu（%.2f%%），截断 %llu\n", (unsigned long long) sent,
+           (unsigned long long) received, (unsigned long long) timeouts, sent ? 100.0 * timeouts / sent : 0.0,
+           (unsigned long long) truncated);
+    if (send_errors)
+        printf("发送失败 %llu\n", (unsigned long long) send_errors);
+    printf("RCODE NOERROR %llu，SERVFAIL %llu，NXDOMAIN %llu，REFUSED %llu\n", (unsigned long long) rcodes[0],
+           (unsigned long long) rcodes[2], (unsigned long long) rcodes[3], (unsigned long long) rcodes[5]);
+    printf("QPS %.0f\n", received / elapsed);
+    printf("延迟 p50 %.3fms  p99 %.3fms  p999 %.3fms  max %.3fms\n",
+           metrics_histogram_quantile(&latency, 0.5) / 1e6, metrics_histogram_quantile(&latency, 0.99) / 1e6,
+           metrics_histogram_quantile(&latency, 0.999) / 1e6, metrics_histogram_quantile(&latency, 1) / 1e6);
+
+    if (metrics_port && scrape(metrics_port, after, &upstream_after)) {
+        double count = 0, hits = 0;
+        printf("回复来源");
+        for (int i = 0; i < QUERY_OUTCOME_COUNT; ++i) {
+            double delta = after[i] - before[i];
+            count += delta;
+            if (i == QUERY_HOSTS || i == QUERY_LRU || i == QUERY_TREE)
+                hits += delta;
+            if (delta > 0)
+                printf(" %s %.0f", OUTCOME_LABEL[i], delta);
+        }
+        printf("\n缓存命中率 %.2f%%，上游查询 %.0f\n", count > 0 ? 100.0 * hits / count : 0.0,
+               upstream_after - upstream_before);
+    }
+    pcap_dns_close(&pcap);
+    return 0;
+}
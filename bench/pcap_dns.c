@@ -0,0 +1,287 @@
+/**
+ * @file      pcap_dns.c
+ * @brief     从抓包文件中提取DNS报文
+ * @details   本文件的内容是pcap与pcapng格式的解析：逐条读取记录，按链路层类型剥去链路层头部，
+ *            再解析IPv4/IPv6与UDP头部，源端口或目的端口为53的UDP载荷即为DNS报文。
+*/
+
+#include "pcap_dns.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define PCAP_MAGIC_US 0xA1B2C3D4
+#define PCAP_MAGIC_NS 0xA1B23C4D
+#define PCAPNG_SHB 0x0A0D0D0A
+#define PCAPNG_IDB 1
+#define PCAPNG_SPB 3
+#define PCAPNG_EPB 6
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+
+// 链路层类型
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LOOP 108
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define DNS_PORT 53
+
+static uint16_t be16(const uint8_t *p) {
+    return p[0] << 8 | p[1];
+}
+
+static uint32_t read32(const Pcap_DNS *pcap, const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return pcap->swapped ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t read16(const Pcap_DNS *pcap, const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return pcap->swapped ? __builtin_bswap16(v) : v;
+}
+
+bool pcap_dns_open(Pcap_DNS *pcap, const char *path) {
+    memset(pcap, 0, sizeof(*pcap));
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    pcap->data = (uint8_t *) malloc(size > 0 ? size : 1);
+    if (!pcap->data || size < 24 || fread(pcap->data, 1, size, fp) != (size_t) size) {
+        fprintf(stderr, "%s: 无法读取抓包文件\n", path);
+        fclose(fp);
+        free(pcap->data);
+        return false;
+    }
+    fclose(fp);
+    pcap->size = size;
+
+    uint32_t magic;
+    memcpy(&magic, pcap->data, 4);
+    if (magic == PCAPNG_SHB) {
+        pcap->pcapng = true;
+        return true;
+    }
+    if (magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS)) {
+        pcap->swapped = true;
+        magic = __builtin_bswap32(magic);
+    }
+    if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+        fprintf(stderr, "%s: 不是pcap或pcapng文件\n", path);
+        free(pcap->data);
+        return false;
+    }
+    pcap->resolution = magic == PCAP_MAGIC_NS ? 1e-9 : 1e-6;
+    pcap->linktype = read32(pcap, pcap->data + 20) & 0x0FFFFFFF;
+    pcap->pos = 24;
+    return true;
+}
+
+void pcap_dns_close(Pcap_DNS *pcap) {
+    free(pcap->data);
+    pcap->data = NULL;
+}
+
+/**
+ * @brief 从链路层帧中提取DNS报文
+ * @param linktype 链路层类型
+ * @param frame 帧
+ * @param len 帧长度
+ * @param packet 输出的报文
+ * @return 帧中含有UDP 53端口的DNS报文时返回true
+ */
+static bool extract_dns(uint32_t linktype, const uint8_t *frame, size_t len, Pcap_DNS_Packet *packet) {
+    size_t pos;
+    switch (linktype) {
+        case LINKTYPE_NULL:
+        case LINKTYPE_LOOP:
+            pos = 4;
+            break;
+        case LINKTYPE_ETHERNET: {
+            pos = 12;
+            while (pos + 2 <= len && (be16(frame + pos) == 0x8100 || be16(frame + pos) == 0x88A8))
+                pos += 4; // VLAN标签
+            pos += 2;
+            break;
+        }
+        case LINKTYPE_LINUX_SLL:
+            pos = 16;
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            pos = 20;
+            break;
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+        case 12:
+        case 14: // 部分系统上裸IP的类型号
+            pos = 0;
+            break;
+        default:
+            return false;
+    }
+    if (pos >= len)
+        return false;
+
+    const uint8_t *ip = frame + pos;
+    size_t ip_len = len - pos, udp;
+    if (ip[0] >> 4 == 4) {
+        if (ip_len < 20 || ip[9] != 17 || (be16(ip + 6) & 0x3FFF) != 0) // 非UDP或为分片
+            return false;
+        udp = (ip[0] & 0x0F) * 4;
+        if (be16(ip + 2) < ip_len)
+            ip_len = be16(ip + 2);
+        packet->family = AF_INET;
+        memcpy(packet->src, ip + 12, 4);
+        memcpy(packet->dst, ip + 16, 4);
+    } else if (ip[0] >> 4 == 6) {
+        if (ip_len < 40)
+            return false;
+        uint8_t next = ip[6];
+        udp = 40;
+        // 跳过逐跳、路由与目的选项扩展头部
+        while ((next == 0 || next == 43 || next == 60) && udp + 8 <= ip_len) {
+            next = ip[udp];
+            udp += (ip[udp + 1] + 1) * 8;
+        }
+        if (next != 17)
+            return false;
+        if (40 + be16(ip + 4) < ip_len)
+            ip_len = 40 + be16(ip + 4);
+        packet->family = AF_INET6;
+        memcpy(packet->src, ip + 8, 16);
+        memcpy(packet->dst, ip + 24, 16);
+    } else {
+        return false;
+    }
+    if (udp + 8 > ip_len)
+        return false;
+    const uint8_t *u = ip + udp;
+    if (be16(u) != DNS_PORT && be16(u + 2) != DNS_PORT)
+        return false;
+    size_t dns_len = be16(u + 4) - 8;
+    if (be16(u + 4) < 8 || udp + 8 + dns_len > ip_len)
+        dns_len = ip_len - udp - 8; // 截断的记录
+    if (dns_len < 12)
+        return false;
+    packet->dns = u + 8;
+    packet->len = dns_len;
+    packet->query = (packet->dns[2] & 0x80) == 0;
+    return true;
+}
+
+/**
+ * @brief 读取pcapng的下一个数据包
+ * @param pcap 抓包文件
+ * @param packet 输出的报文
+ * @return 读到DNS报文时返回true，文件结束时返回false
+ */
+static bool pcapng_next(Pcap_DNS *pcap, Pcap_DNS_Packet *packet) {
+    while (pcap->pos + 12 <= pcap->size) {
+        const uint8_t *block = pcap->data + pcap->pos;
+        uint32_t type;
+        memcpy(&type, block, 4);
+        if (type == PCAPNG_SHB) { // 新的节，重新确定字节序
+            uint32_t order;
+            memcpy(&order, block + 8, 4);
+            pcap->swapped = order != PCAPNG_BYTE_ORDER;
+            pcap->ng_interfaces = 0;
+        }
+        uint32_t block_len = read32(pcap, block + 4);
+        if (block_len < 12 || pcap->pos + block_len > pcap->size)
+            return false;
+        pcap->pos += block_len;
+        type = read32(pcap, block);
+
+        if (type == PCAPNG_IDB && block_len >= 20 && pcap->ng_interfaces < 16) {
+            unsigned i = pcap->ng_interfaces++;
+            pcap->ng_linktypes[i] = read16(pcap, block + 8);
+            pcap->ng_resolutions[i] = 1e-6;
+            // 查找if_tsresol选项
+            for (size_t pos = 16; pos + 4 <= block_len - 4;) {
+                uint16_t code = read16(pcap, block + pos), len = read16(pcap, block + pos + 2);
+                if (code == 0)
+                    break;
+                if (code == 9 && len >= 1) {
+                    uint8_t res = block[pos + 4];
+                    double base = res & 0x80 ? 0.5 : 0.1, value = 1;
+                    for (int k = 0; k < (res & 0x7F); ++k)
+                        value *= base;
+                    pcap->ng_resolutions[i] = value;
+                }
+                pos += 4 + ((len + 3) & ~3u);
+            }
+        } else if (type == PCAPNG_EPB && block_len >= 32) {
+            uint32_t interface = read32(pcap, block + 8);
+            if (interface >= pcap->ng_interfaces)
+                continue;
+            uint64_t ts = (uint64_t) read32(pcap, block + 12) << 32 | read32(pcap, block + 16);
+            uint32_t caplen = read32(pcap, block + 20);
+            if (28 + caplen > block_len - 4)
+                continue;
+            if (extract_dns(pcap->ng_linktypes[interface], block + 28, caplen, packet)) {
+                packet->time = ts * pcap->ng_resolutions[interface];
+                return true;
+            }
+        } else if (type == PCAPNG_SPB && block_len >= 16 && pcap->ng_interfaces > 0) {
+            uint32_t caplen = block_len - 16;
+            if (read32(pcap, block + 8) < caplen)
+                caplen = read32(pcap, block + 8);
+            if (extract_dns(pcap->ng_linktypes[0], block + 12, caplen, packet)) {
+                packet->time = 0; // 简单数据包块不带时间戳
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool pcap_dns_next(Pcap_DNS *pcap, Pcap_DNS_Packet *packet) {
+    if (pcap->pcapng)
+        return pcapng_next(pcap, packet);
+    while (pcap->pos + 16 <= pcap->size) {
+        const uint8_t *record = pcap->data + pcap->pos;
+        uint32_t caplen = read32(pcap, record + 8);
+        if (pcap->pos + 16 + caplen > pcap->size)
+            return false;
+        pcap->pos += 16 + caplen;
+        if (extract_dns(pcap->linktype, record + 16, caplen, packet)) {
+            packet->time = read32(pcap, record) + read32(pcap, record + 4) * pcap->resolution;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t pcap_dns_question(const uint8_t *dns, size_t len, uint8_t *key, size_t size) {
+    if (len < 12 || be16(dns + 4) == 0)
+        return 0;
+    size_t pos = 12, out = 0;
+    while (pos < len && dns[pos] != 0) {
+        uint8_t label = dns[pos];
+        if (label > 63 || pos + 1 + label > len || out + 1 + label > size)
+            return 0;
+        key[out++] = label;
+        for (int i = 1; i <= label; ++i) {
+            uint8_t c = dns[pos + i];
+            key[out++] = c >= 'A' && c <= 'Z' ? c + 32 : c;
+        }
+        pos += 1 + label;
+    }
+    if (pos + 5 > len || out + 5 > size)
+        return 0;
+    memcpy(key + out, dns + pos, 5); // 结尾的0、QTYPE与QCLASS
+    return out + 5;
+}
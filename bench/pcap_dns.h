@@ -0,0 +1,77 @@
+/**
+ * @file pcap_dns.h
+ * @brief 从抓包文件中提取DNS报文
+ * @details 本文件定义了读取pcap与pcapng文件、提取其中UDP 53端口DNS报文的接口，供nodns-replay与nodns-mockup使用。
+ *          支持以太网（含VLAN）、Linux cooked（SLL与SLL2）、BSD loopback与裸IP链路层，IPv4与IPv6；
+ *          IP分片与TCP上的DNS报文被跳过。
+ */
+
+#ifndef GODNS_PCAP_DNS_H
+#define GODNS_PCAP_DNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 抓包文件
+typedef struct pcap_dns {
+    uint8_t *data; // 整个文件的内容
+    size_t size;
+    size_t pos; // 下一个块或记录的位置
+    bool pcapng;
+    bool swapped; // 字节序与本机相反
+    uint32_t linktype; // pcap的链路层类型
+    double resolution; // pcap时间戳小数部分的单位（秒）
+    uint32_t ng_linktypes[16]; // pcapng各接口的链路层类型
+    double ng_resolutions[16]; // pcapng各接口的时间戳单位（秒）
+    unsigned ng_interfaces;
+} Pcap_DNS;
+
+// 提取出的DNS报文
+typedef struct pcap_dns_packet {
+    double time; // 抓包时刻（秒）
+    const uint8_t *dns; // DNS报文，指向文件内容
+    size_t len;
+    bool query; // QR为0
+    int family; // AF_INET或AF_INET6
+    uint8_t src[16]; // 源地址，IPv4只使用前4字节
+    uint8_t dst[16]; // 目的地址
+} Pcap_DNS_Packet;
+
+/**
+ * @brief 打开抓包文件，整个文件读入内存
+ *
+ * @param pcap 抓包文件
+ * @param path 路径
+ * @return 成功时返回true，失败时输出错误信息
+ */
+bool pcap_dns_open(Pcap_DNS *pcap, const char *path);
+
+/**
+ * @brief 读取下一个DNS报文
+ *
+ * @param pcap 抓包文件
+ * @param packet 输出的报文
+ * @return 读到报文时返回true，文件结束时返回false
+ */
+bool pcap_dns_next(Pcap_DNS *pcap, Pcap_DNS_Packet *packet);
+
+/**
+ * @brief 关闭抓包文件，之前读到的报文随之失效
+ *
+ * @param pcap 抓包文件
+ */
+void pcap_dns_close(Pcap_DNS *pcap);
+
+/**
+ * @brief 取得报文中问题的规范形式，用于匹配查询与回复
+ *
+ * @param dns DNS报文
+ * @param len 报文长度
+ * @param key 输出，小写的标签序列加上QTYPE与QCLASS
+ * @param size key的大小
+ * @return key的长度，报文格式错误时返回0
+ */
+size_t pcap_dns_question(const uint8_t *dns, size_t len, uint8_t *key, size_t size);
+
+#endif //GODNS_PCAP_DNS_H
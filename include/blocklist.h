@@ -0,0 +1,99 @@
+/**
+ * @file blocklist.h
+ * @brief 编译后的屏蔽列表
+ * @details 本文件定义了屏蔽列表的二进制格式与查询接口。屏蔽列表由blocklist_compile从hosts或屏蔽列表文本离线生成，
+ *          服务器启动时只读地mmap，不解析也不分配每个域名的内存，多个进程共享同一份页缓存。
+ *          文件依次为：文件头；按哈希高BLOCKLIST_BUCKET_BITS位分桶的起始下标表，共BLOCKLIST_BUCKET_COUNT项；
+ *          所有项的域名哈希的分块布隆过滤器，见bloom_filter.h；按哈希与域名排序的项；后缀规则；域名池。后缀规则通常远少于域名，加载时建成反向标签树。
+ *          域名为小写的点分形式，以'.'结尾，与规范查询键中的域名相同。
+ *          所有整数均为小端序。文件头中记录了一个固定字符串的哈希，哈希函数改变后旧文件会被拒绝。
+ */
+
+#ifndef GODNS_BLOCKLIST_H
+#define GODNS_BLOCKLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bloom_filter.h"
+#include "dns_structure.h"
+#include "suffix_trie.h"
+
+#define BLOCKLIST_MAGIC "NODNSBL1"
+#define BLOCKLIST_VERSION 3
+#define BLOCKLIST_BUCKET_BITS 16
+#define BLOCKLIST_BUCKET_COUNT ((1 << BLOCKLIST_BUCKET_BITS) + 6) // 多出的项使布隆过滤器从64字节边界开始
+#define BLOCKLIST_HASH_CHECK_NAME "nodns.blocklist." // 文件头中记录其哈希
+
+// 文件头
+typedef struct blocklist_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count; // 项数
+    uint64_t hash_check; // BLOCKLIST_HASH_CHECK_NAME的哈希
+    uint64_t names_size; // 域名池的字节数
+    uint32_t suffix_count; // 后缀规则数
+    uint32_t bloom_blocks; // 布隆过滤器的块数
+} Blocklist_Header;
+
+// 一个被屏蔽的域名
+typedef struct blocklist_entry {
+    uint64_t hash; // 域名的哈希
+    uint32_t name_offset; // 在域名池中的偏移
+    uint32_t name_len;
+} Blocklist_Entry;
+
+// 一条后缀规则
+typedef struct blocklist_suffix {
+    uint32_t name_offset; // 在域名池中的偏移
+    uint16_t name_len;
+    uint16_t flags; // SUFFIX_MATCH_*的组合
+} Blocklist_Suffix;
+
+// 映射到内存的屏蔽列表
+typedef struct blocklist {
+    const uint8_t *base; // 映射的起始地址
+    size_t size; // 文件大小
+    const Blocklist_Header *header;
+    const uint32_t *buckets; // buckets[b]为哈希高位为b的第一项的下标
+    Bloom_Filter *filter; // 指向映射中的布隆过滤器
+    const Blocklist_Entry *entries;
+    const Blocklist_Suffix *suffix_rules;
+    const uint8_t *names;
+    Suffix_Trie *suffixes; // 由后缀规则建成
+
+    /**
+     * @brief 判断域名是否在屏蔽列表中，不含后缀规则，先查布隆过滤器
+     * @param blocklist 屏蔽列表
+     * @param key 查询的规范键，只比较域名
+     * @return 如果在屏蔽列表中，返回true
+     */
+    bool (*contains)(const struct blocklist *blocklist, const DNSKey *key);
+} Blocklist;
+
+/**
+ * @brief 映射并校验编译后的屏蔽列表
+ * @param path 文件路径
+ * @return 屏蔽列表，文件不存在或格式有误时返回NULL
+ */
+Blocklist *new_blocklist(const char *path);
+
+/**
+ * @brief 计算屏蔽列表文件中布隆过滤器的起始偏移
+ * @return 偏移
+ */
+static inline size_t blocklist_bloom_offset() {
+    return sizeof(Blocklist_Header) + BLOCKLIST_BUCKET_COUNT * sizeof(uint32_t);
+}
+
+/**
+ * @brief 计算屏蔽列表文件中项的起始偏移
+ * @param header 文件头
+ * @return 偏移
+ */
+static inline uint64_t blocklist_entries_offset(const Blocklist_Header *header) {
+    return blocklist_bloom_offset() + (uint64_t) header->bloom_blocks * BLOOM_BLOCK_SIZE;
+}
+
+#endif //GODNS_BLOCKLIST_H
@@ -0,0 +1,70 @@
+/**
+ * @file bloom_filter.h
+ * @brief 分块布隆过滤器
+ * @details 本文件定义了hosts索引与屏蔽列表前面的分块布隆过滤器。过滤器由若干64字节的块组成，每块恰为一条缓存行，
+ *          一个键只在哈希选中的一块中置位，每个64位字各置一位，查询只读一条缓存行。
+ *          每个键约BLOOM_BITS_PER_KEY位时误判率约1%，不存在的域名绝大多数在这里就被排除，不必再查索引。
+ *          块的内存可以由过滤器分配，也可以是映射的文件中的一段，布局与字节序相同。
+ */
+
+#ifndef GODNS_BLOOM_FILTER_H
+#define GODNS_BLOOM_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BLOOM_BLOCK_SIZE 64 // 块的字节数
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_SIZE / 8) // 块中64位字的个数，也是每个键置位的个数
+#define BLOOM_BITS_PER_KEY 10 // 每个键平均占用的位数
+
+// 分块布隆过滤器
+typedef struct bloom_filter {
+    uint64_t *blocks; // block_count * BLOOM_BLOCK_WORDS个字，按BLOOM_BLOCK_SIZE对齐
+    uint32_t block_count;
+    bool owned; // blocks是否由过滤器分配
+
+    /**
+     * @brief 加入一个键
+     * @param filter 布隆过滤器
+     * @param hash 键的哈希
+     */
+    void (*add)(struct bloom_filter *filter, uint64_t hash);
+
+    /**
+     * @brief 判断键是否可能存在
+     * @param filter 布隆过滤器
+     * @param hash 键的哈希
+     * @return 返回false时键一定不存在，返回true时可能存在
+     */
+    bool (*may_contain)(const struct bloom_filter *filter, uint64_t hash);
+} Bloom_Filter;
+
+/**
+ * @brief 计算容纳一定数量的键所需的块数
+ * @param keys 键的数量
+ * @return 块数，至少为1
+ */
+uint32_t bloom_block_count(uint64_t keys);
+
+/**
+ * @brief 创建空的布隆过滤器
+ * @param block_count 块数，由bloom_block_count计算
+ * @return 布隆过滤器
+ */
+Bloom_Filter *new_bloom_filter(uint32_t block_count);
+
+/**
+ * @brief 在已有的块上创建只读的布隆过滤器，不复制也不释放块
+ * @param blocks 块，按BLOOM_BLOCK_SIZE对齐
+ * @param block_count 块数
+ * @return 布隆过滤器
+ */
+Bloom_Filter *new_bloom_filter_view(const uint64_t *blocks, uint32_t block_count);
+
+/**
+ * @brief 释放布隆过滤器
+ * @param filter 布隆过滤器
+ */
+void destroy_bloom_filter(Bloom_Filter *filter);
+
+#endif //GODNS_BLOOM_FILTER_H
@@ -7,18 +7,73 @@
 #ifndef GODNS_DNS_CACHE_H
 #define GODNS_DNS_CACHE_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <uv.h>
 
+#include "blocklist.h"
+#include "frequency_sketch.h"
+#include "hosts.h"
 #include "rbtree.h"
 
-#define CACHE_SIZE 300
+// 缓存命中的位置
+typedef enum {
+    CACHE_MISS, CACHE_HIT_HOSTS, CACHE_HIT_LRU, CACHE_HIT_TREE
+} Cache_Hit;
 
-// 缓存结构体
-typedef struct cache {
-    DNSRRLinkList *head; // LRU头结点
+// LRU链表的淘汰策略
+typedef enum {
+    CACHE_POLICY_LRU, // 链表满时淘汰最久未访问的元素
+    CACHE_POLICY_TINYLFU, // W-TinyLFU：窗口LRU之后是分段LRU，元素离开窗口时按访问频次决定是否替换分段LRU中的元素
+    CACHE_POLICY_CLOCK // CLOCK：命中只设置访问位，查询不加锁，淘汰时跳过并清除访问位被设置的元素
+} Cache_Policy;
+
+// CLOCK策略的缓存项，发布后除访问位与next外不再修改，摘下后经纪元回收释放
+typedef struct cache_entry {
+    _Atomic(struct cache_entry *) next; // 同一哈希桶中的下一项
+    RBTreeValue *value;
+    time_t expire_time; // 为-1时永不过期
+    int slot; // 在时钟环中的位置
+    atomic_bool referenced; // 访问位
+} Cache_Entry;
+
+// CLOCK策略的哈希表与时钟环，读者只读哈希表，写者持有分片的锁
+typedef struct cache_clock {
+    _Atomic(Cache_Entry *) *buckets;
+    uint64_t bucket_mask;
+    Cache_Entry **ring; // 时钟环，size个位置已占用
+    int size;
+    int capacity;
+    int hand; // 时钟指针
+} Cache_Clock;
+
+// LRU链表的一段，head->next为最久未访问的元素，tail为最近访问的元素
+typedef struct cache_segment {
+    DNSRRLinkList *head; // 头结点
     DNSRRLinkList *tail;
     int size;
+    int capacity;
+} Cache_Segment;
+
+// 缓存分片，分片内的LRU链表、访问频次与红黑树由分片的锁保护；CLOCK策略的查询不加锁，插入与淘汰持有锁
+typedef struct cache_shard {
+    uv_mutex_t lock;
+    Cache_Policy policy;
+    Cache_Segment window; // LRU策略下为整个LRU链表；W-TinyLFU策略下为新插入元素所在的窗口
+    Cache_Segment probation; // W-TinyLFU分段LRU中只访问过一次的元素，替换从这里开始
+    Cache_Segment protected; // W-TinyLFU分段LRU中再次访问过的元素
+    Frequency_Sketch *sketch; // W-TinyLFU的访问频次，LRU策略下为NULL
+    Cache_Clock clock; // CLOCK策略下代替LRU链表
     RBTree *tree; // 红黑树
+} Cache_Shard;
+
+// 缓存结构体，按规范键的哈希分为2的幂个分片，不同分片上的操作可在多个线程中并行
+typedef struct cache {
+    Cache_Shard *shards;
+    unsigned shard_mask; // 分片数减一
+    _Atomic(Hosts_Index *) hosts; // hosts索引，先于分片查询，可被整体替换
+    const Blocklist *blocklist; // 屏蔽列表，在hosts之后、分片之前查询，为NULL时不使用
 
     /**
      * @brief 向缓存中插入DNS回复
@@ -31,14 +86,22 @@ typedef struct cache {
      * @brief 在缓存中查询
      * @param cache 缓存
      * @param que DNS Question Section
+     * @param hit 命中的位置
      * @return 如果查询到回复，则返回，否则返回NULL
      */
-    RBTreeValue *(*query)(struct cache *cache, const DNSQuestion *que);
+    RBTreeValue *(*query)(struct cache *cache, const DNSQuestion *que, Cache_Hit *hit);
+
+    /**
+     * @brief 替换hosts索引，旧索引在所有查询它的线程离开后释放
+     * @param cache 缓存
+     * @param hosts 新的索引，由缓存接管
+     */
+    void (*set_hosts)(struct cache *cache, Hosts_Index *hosts);
 } Cache;
 
 /**
- * @brief 创建缓存
- * @param hosts_file hosts文件路径
+ * @brief 创建缓存，LRU链表的总容量、淘汰策略与分片数由CACHE_SIZE、CACHE_POLICY与CACHE_SHARDS决定
+ * @param hosts_file hosts文件，为NULL时hosts索引为空
  * @return 新的缓存结构体
  */
 Cache *new_cache(FILE *hosts_file);
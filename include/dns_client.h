@@ -8,18 +8,21 @@
 #include <uv.h>
 
 #include "dns_structure.h"
+#include "forward_table.h"
 
 /**
- * @brief 客户端初始化
+ * @brief 客户端初始化，为转发表中的每个组打开一个socket
  * @param loop 事件循环
+ * @param table 转发表
  */
-void init_client(uv_loop_t * loop);
+void init_client(uv_loop_t * loop, Forward_Table * table);
 
 /**
  * @brief 将DNS请求报文发送至远程
  *
+ * @param group 上游服务器组，组内有多个服务器时轮流使用
  * @param msg DNS请求报文
  */
-void send_to_remote(const DNSMessage * msg);
+void send_to_remote(Upstream_Group * group, const DNSMessage * msg);
 
 #endif //GODNS_DNS_CLIENT_H
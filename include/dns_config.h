@@ -5,10 +5,30 @@
 #define GODNS_DNS_CONFIG_H
 
 extern char * REMOTE_HOST; ///< 远程DNS服务器地址
+extern int REMOTE_PORT; ///< 远程DNS服务器端口
+extern int REMOTE_TIMEOUT; ///< 远程DNS服务器的超时（毫秒）
+extern char ** FORWARD_RULES; ///< 条件转发规则，每个--forward参数一条，格式见new_forward_table
+extern int FORWARD_RULE_COUNT; ///< 条件转发规则数
+extern int LISTEN_PORT; ///< 本地DNS服务端监听的端口
 extern int LOG_MASK; ///< log打印等级，一个四位二进制数，从低位到高位依次表示DEBUG、INFO、ERROR、FATAL
 extern int CLIENT_PORT; ///< 本地DNS客户端端口
 extern char * HOSTS_PATH; ///< hosts文件路径
+extern char * BLOCKLIST_PATH; ///< 编译后的屏蔽列表路径，为NULL时不使用
+extern char ** ZONE_SPECS; ///< 权威区域，每个--zone参数一个，格式为“起点=文件路径”
+extern int ZONE_SPEC_COUNT; ///< 权威区域数
+extern char * LOCAL_ZONES; ///< 对内置本地区域的增删，格式见new_local_zones，为NULL时只用内置区域
+extern int CACHE_SIZE; ///< 缓存LRU链表的容量
+extern int CACHE_POLICY; ///< 缓存LRU链表的淘汰策略，取值见Cache_Policy
+extern int CACHE_SHARDS; ///< 缓存的分片数，为2的幂
 extern char * LOG_PATH; ///< 日志文件路径
+extern char * QLOG_PATH; ///< 二进制查询日志路径，为NULL时不记录
+extern int QLOG_SAMPLE; ///< 查询日志的采样率，每QLOG_SAMPLE个查询平均记录一个
+extern int QLOG_FILE_SIZE; ///< 单个查询日志文件的大小上限（MB）
+extern int QLOG_FILES; ///< 轮转保留的查询日志文件数，含正在写入的文件
+extern int METRICS_PORT; ///< 指标HTTP监听的本地端口，为0时不监听
+extern int STALL_THRESHOLD; ///< 事件循环卡顿的阈值（毫秒），为0时不启动看门狗
+extern int CLIENT_RATE; ///< 每个IPv4请求方每秒进入查询池的查询数上限（近似），为0时不限
+extern int TRACE_FORCE; ///< 是否强制开启所有USDT探针
 
 /**
  * @brief 解析命令行参数
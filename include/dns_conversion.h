@@ -5,6 +5,8 @@
 #ifndef GODNS_DNS_CONVERSION_H
 #define GODNS_DNS_CONVERSION_H
 
+#include <stdbool.h>
+
 #include "dns_structure.h"
 
 /**
@@ -12,9 +14,10 @@
  *
  * @param pmsg DNS报文结构体
  * @param pstring DNS报文字节流
+ * @return 如果报文中的域名均合法，返回true；否则报文结构体只包含已解析的部分，仍需用destroy_dnsmsg释放
  * @note 为Header Section、Question Section和Resource Record分配了空间
  */
-void string_to_dnsmsg(DNSMessage * pmsg, const char * pstring);
+bool string_to_dnsmsg(DNSMessage * pmsg, const char * pstring);
 
 /**
  * @brief DNS报文结构体转换到字节流
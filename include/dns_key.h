@@ -0,0 +1,63 @@
+/**
+ * @file dns_key.h
+ * @brief 规范查询键
+ * @details 本文件定义了规范查询键的构造、哈希与比较接口。域名统一转为小写，
+ *          使得大小写随机化（0x20编码）的查询与普通查询命中同一个缓存项。
+ */
+
+#ifndef GODNS_DNS_KEY_H
+#define GODNS_DNS_KEY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dns_structure.h"
+
+/**
+ * @brief 计算小写域名的64位哈希
+ *
+ * @param name 小写域名，须以0填充到DNS_NAME_HASH_STRIDE的整数倍
+ * @param len 域名长度
+ * @return 哈希值
+ */
+uint64_t dnskey_hash(const uint8_t *name, size_t len);
+
+/**
+ * @brief 构造规范查询键
+ *
+ * @param key 查询键
+ * @param name 域名，以0结尾
+ * @param qtype 查询类型
+ * @param qclass 查询类
+ * @note 超过DNS_KEY_NAME_MAX_SIZE - 1的部分会被截断
+ */
+void dnskey_init(DNSKey *key, const uint8_t *name, uint16_t qtype, uint16_t qclass);
+
+/**
+ * @brief 判断两个键的域名是否相同
+ *
+ * @param a 查询键
+ * @param b 查询键
+ * @return 如果域名相同，返回true
+ */
+bool dnskey_name_equal(const DNSKey *a, const DNSKey *b);
+
+/**
+ * @brief 判断两个键是否完全相同（域名、类型、类）
+ *
+ * @param a 查询键
+ * @param b 查询键
+ * @return 如果完全相同，返回true
+ */
+bool dnskey_equal(const DNSKey *a, const DNSKey *b);
+
+/**
+ * @brief 判断缓存项的键能否回答查询
+ *
+ * @param entry 缓存项的键，qtype为DNS_TYPE_ANY时匹配任意类型
+ * @param query 查询的键
+ * @return 如果能回答，返回true
+ */
+bool dnskey_match(const DNSKey *entry, const DNSKey *query);
+
+#endif //GODNS_DNS_KEY_H
@@ -1,64 +1,124 @@
 /**
  * @file dns_log.h
  * @brief 日志模块
- * @details 本文件定义了日志模块的接口，定义了四个日志模式
+ * @details 本文件定义了日志模块的接口，定义了四个日志模式。
+ *          日志宏不做任何格式化，只把格式串与整数参数写入一个单生产者单消费者的无锁环形队列，
+ *          由后台线程取出、格式化并写入日志文件；队列满时丢弃日志并计数。
+ *          日志参数只能是整数（最多LOG_MAX_ARGS个），格式串与__FILE__一样必须是字符串常量。
+ *          编译时定义NODNS_MIN_LOG_LEVEL可以去掉低于该等级的日志宏，被去掉的宏不产生任何代码；FATAL总会退出程序。
  */
 
 #ifndef GODNS_DNS_LOG_H
 #define GODNS_DNS_LOG_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 
 #include "dns_config.h"
 
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_ERROR 2
+#define LOG_FATAL 3
+
+#ifndef NODNS_MIN_LOG_LEVEL
+#define NODNS_MIN_LOG_LEVEL LOG_DEBUG // 编译进程序的最低日志等级
+#endif
+
+#define LOG_MAX_ARGS 4 // 每条日志最多的参数个数
+#define LOG_RING_SIZE 4096 // 环形队列的容量，必须是2的幂
+
 extern FILE * log_file;
 
+/**
+ * @brief 启动后台日志线程
+ * @note 调用者所在的线程成为唯一的生产者，其他线程的日志直接同步写入
+ */
+void init_log();
+
+/**
+ * @brief 将一条日志写入环形队列
+ *
+ * @param level 日志等级
+ * @param file 源文件名
+ * @param line 行号
+ * @param fmt 格式串
+ * @param args 整数参数
+ * @param nargs 参数个数
+ */
+void log_push(int level, const char * file, int line, const char * fmt, const uint64_t * args, int nargs);
+
+/**
+ * @brief 将一段需要由后台线程渲染的数据写入环形队列
+ *
+ * @param file 源文件名
+ * @param line 行号
+ * @param title 标题
+ * @param render 渲染函数，在后台线程中调用，向log_file输出
+ * @param data 数据，由日志模块负责释放
+ * @param len 数据长度
+ */
+void log_dump(const char * file, int line, const char * title, void (* render)(const uint8_t *, unsigned),
+              uint8_t * data, unsigned len);
+
+/**
+ * @brief 等待队列中的日志全部写出
+ */
+void log_flush();
+
+/**
+ * @brief 获取因队列满而丢弃的日志条数
+ *
+ * @return 丢弃的条数
+ */
+uint64_t log_dropped();
+
+#define log_record(level, fmt, args...) \
+    { \
+        const uint64_t log_args_[] = {0, ##args}; \
+        _Static_assert(sizeof(log_args_) / sizeof(uint64_t) - 1 <= LOG_MAX_ARGS, "日志参数过多"); \
+        log_push(level, __FILE__, __LINE__, fmt, log_args_ + 1, sizeof(log_args_) / sizeof(uint64_t) - 1); \
+    }
+
 // 输出 debug，可通过--log_mask=1开启
+#if NODNS_MIN_LOG_LEVEL > LOG_DEBUG
+#define log_debug(args...) {}
+#else
 #define log_debug(args...) \
-    if (LOG_MASK & 1) \
+    if (__builtin_expect(LOG_MASK & 1, 0)) \
     { \
-        if (log_file != stderr) \
-            fprintf(log_file, "[DEBUG] %s:%d ", __FILE__, __LINE__); \
-        else \
-            fprintf(log_file, "\x1b[37m[DEBUG]\x1b[36m %s:%d \x1b[0m", __FILE__, __LINE__); \
-        fprintf(log_file, args); \
-        fprintf(log_file, "\n"); \
+        log_record(LOG_DEBUG, args) \
     }
+#endif
 
 // 输出 info，可通过--log_mask=2开启
+#if NODNS_MIN_LOG_LEVEL > LOG_INFO
+#define log_info(args...) {}
+#else
 #define log_info(args...) \
-    if (LOG_MASK & 2) \
+    if (__builtin_expect(LOG_MASK & 2, 0)) \
     { \
-        if (log_file != stderr) \
-            fprintf(log_file, "[INFO ] %s:%d ", __FILE__, __LINE__); \
-        else \
-            fprintf(log_file, "\x1b[34m[INFO ]\x1b[36m %s:%d \x1b[0m", __FILE__, __LINE__); \
-        fprintf(log_file, args); \
-        fprintf(log_file, "\n"); \
+        log_record(LOG_INFO, args) \
     }
+#endif
 
 // 输出 error，可通过--log_mask=4开启
+#if NODNS_MIN_LOG_LEVEL > LOG_ERROR
+#define log_error(args...) {}
+#else
 #define log_error(args...) \
-    if (LOG_MASK & 4) \
+    if (__builtin_expect(LOG_MASK & 4, 0)) \
     { \
-        if (log_file != stderr) \
-            fprintf(log_file, "[ERROR] %s:%d ", __FILE__, __LINE__); \
-        else \
-            fprintf(log_file, "\x1b[33m[ERROR]\x1b[36m %s:%d \x1b[0m", __FILE__, __LINE__); \
-        fprintf(log_file, args); \
-        fprintf(log_file, "\n"); \
+        log_record(LOG_ERROR, args) \
     }
+#endif
 
-// 输出 fatal，可通过--log_mask=8开启
+// 输出 fatal，可通过--log_mask=8开启，输出前会先写出队列中的日志
 #define log_fatal(args...) \
-    if (LOG_MASK & 8) \
     { \
-        if (log_file != stderr) \
-            fprintf(log_file, "[FATAL] %s:%d ", __FILE__, __LINE__); \
-        else \
-            fprintf(log_file, "\x1b[31m[FATAL]\x1b[36m %s:%d \x1b[0m", __FILE__, __LINE__); \
-        fprintf(log_file, args); \
-        fprintf(log_file, "\n"); \
+        if (LOG_MASK & 8) \
+            log_record(LOG_FATAL, args) \
         exit(EXIT_FAILURE); \
     }
 
@@ -0,0 +1,158 @@
+/**
+ * @file dns_metrics.h
+ * @brief 运行指标
+ * @details 本文件定义了计数器、延迟直方图与Prometheus文本格式导出的接口。
+ *          每个线程在首次计数时获得自己的分片，计数只写本线程的分片，不加锁也不使用原子读改写指令；
+ *          导出时汇总所有分片。直方图按HDR方式分桶：每个2的幂区间再等分为8个子桶，相对误差不超过12.5%。
+ *          其他模块可以注册收集函数，在导出时追加自己的指标。
+ */
+
+#ifndef GODNS_DNS_METRICS_H
+#define GODNS_DNS_METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "query_pool.h"
+
+#define METRICS_HIST_SUB_BITS 3 // 每个2的幂区间的子桶数为2^METRICS_HIST_SUB_BITS
+#define METRICS_HIST_MAX_EXP 35 // 可区分的最大值为2^(METRICS_HIST_MAX_EXP + 1) - 1，更大的值计入最后一个桶
+#define METRICS_HIST_BUCKETS ((METRICS_HIST_MAX_EXP - METRICS_HIST_SUB_BITS + 2) << METRICS_HIST_SUB_BITS)
+
+// 计数器
+typedef enum {
+    METRIC_QUERIES, // 收到的查询
+    METRIC_MALFORMED_QUERIES, // 格式错误的查询
+    METRIC_RESPONSES, // 发往本地的回复
+    METRIC_UPSTREAM_QUERIES, // 发往上游的查询
+    METRIC_UPSTREAM_RESPONSES, // 上游的回复
+    METRIC_MALFORMED_RESPONSES, // 格式错误的上游回复
+    METRIC_UNKNOWN_RESPONSES, // 序号不在序号池中的上游回复
+    METRIC_CACHE_INSERTS, // 插入缓存的回复
+    METRIC_CACHE_EVICTIONS, // 因LRU链表已满被淘汰的缓存项
+    METRIC_CACHE_REJECTIONS, // W-TinyLFU策略下因访问频次低而未进入分段LRU的缓存项，也计入淘汰
+    METRIC_CACHE_LOCK_CONTENDED, // 访问缓存分片时锁已被其他线程持有的次数
+    METRIC_HOSTS_RELOADS, // hosts文件重新加载成功的次数
+    METRIC_HOSTS_RELOAD_FAILURES, // hosts文件重新加载失败的次数
+    METRIC_BLOCKLIST_HITS, // 被屏蔽列表拦截的查询
+    METRIC_SUFFIX_RULE_HITS, // 被hosts或屏蔽列表中的后缀规则拦截的查询
+    METRIC_BLOOM_FALSE_POSITIVES, // 通过了布隆过滤器但hosts或屏蔽列表中没有该域名的查找
+    METRIC_ZONE_RELOADS, // 区域文件重新加载成功的次数
+    METRIC_ZONE_RELOAD_FAILURES, // 区域文件重新加载失败的次数
+    METRIC_COUNT
+} Metric_Counter;
+
+extern const char *const OUTCOME_LABEL[QUERY_OUTCOME_COUNT]; // 各查询结果在指标与查询日志中的名称
+
+// 直方图，只能由一个线程写入
+typedef struct metrics_histogram {
+    atomic_uint_fast64_t buckets[METRICS_HIST_BUCKETS];
+    atomic_uint_fast64_t sum; // 所有值之和
+    atomic_uint_fast64_t count; // 值的个数
+} Metrics_Histogram;
+
+// 导出文本的缓冲区
+typedef struct metrics_buffer {
+    char *data;
+    size_t len;
+    size_t cap;
+} Metrics_Buffer;
+
+/**
+ * @brief 启动指标的HTTP监听，未配置--metrics_port时不做任何事
+ *
+ * @param loop 事件循环
+ */
+void init_metrics(uv_loop_t *loop);
+
+/**
+ * @brief 计数器加一
+ *
+ * @param counter 计数器
+ */
+void metrics_count(Metric_Counter counter);
+
+/**
+ * @brief 记录一个查询的延迟
+ *
+ * @param outcome 查询的结果
+ * @param latency 延迟（纳秒）
+ */
+void metrics_observe(Query_Outcome outcome, uint64_t latency);
+
+/**
+ * @brief 向直方图中加入一个值
+ *
+ * @param hist 直方图
+ * @param value 值
+ */
+void metrics_histogram_record(Metrics_Histogram *hist, uint64_t value);
+
+/**
+ * @brief 将直方图src累加到dst
+ *
+ * @param dst 目标直方图
+ * @param src 源直方图
+ */
+void metrics_histogram_merge(Metrics_Histogram *dst, const Metrics_Histogram *src);
+
+/**
+ * @brief 求直方图的分位数
+ *
+ * @param hist 直方图
+ * @param quantile 分位，0到1之间
+ * @return 分位数所在桶的上界，直方图为空时返回0
+ */
+uint64_t metrics_histogram_quantile(const Metrics_Histogram *hist, double quantile);
+
+/**
+ * @brief 以Prometheus histogram的格式输出直方图，值的单位为纳秒，输出的单位为秒
+ *
+ * @param buf 缓冲区
+ * @param name 指标名
+ * @param labels 标签，如"path=\"lru\""，没有标签时为NULL
+ * @param hist 直方图
+ * @note 调用者负责输出HELP与TYPE行
+ */
+void metrics_write_histogram(Metrics_Buffer *buf, const char *name, const char *labels, const Metrics_Histogram *hist);
+
+/**
+ * @brief 以Prometheus histogram的格式输出直方图，桶边界为2^min_exp到2^max_exp
+ *
+ * @param buf 缓冲区
+ * @param name 指标名
+ * @param labels 标签，没有标签时为NULL
+ * @param hist 直方图
+ * @param min_exp 最小的桶边界的指数
+ * @param max_exp 最大的桶边界的指数
+ * @param scale 输出时值除以scale，如纳秒转为秒时为1e9
+ */
+void metrics_write_histogram_range(Metrics_Buffer *buf, const char *name, const char *labels,
+                                   const Metrics_Histogram *hist, int min_exp, int max_exp, double scale);
+
+/**
+ * @brief 向缓冲区追加格式化的文本
+ *
+ * @param buf 缓冲区
+ * @param fmt 格式串
+ */
+void metrics_printf(Metrics_Buffer *buf, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief 注册收集函数，每次导出时在事件循环线程中调用
+ *
+ * @param collect 收集函数，向缓冲区追加指标
+ * @param data 传给收集函数的数据
+ */
+void metrics_register(void (*collect)(Metrics_Buffer *buf, void *data), void *data);
+
+/**
+ * @brief 生成全部指标的Prometheus文本
+ *
+ * @param buf 缓冲区，由调用者释放data
+ */
+void metrics_collect(Metrics_Buffer *buf);
+
+#endif //GODNS_DNS_METRICS_H
@@ -0,0 +1,82 @@
+/**
+ * @file dns_name.h
+ * @brief 域名处理内核
+ * @details 本文件定义了域名的小写化、哈希、比较、标签校验与编码的内核接口。
+ *          内核有标量、SSE2与AVX2三种实现，分别以16/32字节为步长处理，三种实现的结果完全一致。
+ *          运行时按操作选用实现：域名通常不足32字节，只有哈希与标签复制的向量实现比标量实现快，其余操作使用标量实现。向量实现会整块读写，读取不跨越页边界，写入要求目标缓冲区留有余量。
+ */
+
+#ifndef GODNS_DNS_NAME_H
+#define GODNS_DNS_NAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DNS_NAME_LABEL_MAX_SIZE 63 // 单个标签的最大长度
+#define DNS_NAME_TEXT_MAX_SIZE 255 // 点分形式域名的最大长度，不含结尾的0
+#define DNS_NAME_HASH_STRIDE 32 // 哈希与比较的步长，输入须以0填充到该长度的整数倍
+
+// 域名处理内核
+typedef struct dns_name_kernel {
+    const char *name; // 实现名称
+
+    /**
+     * @brief 复制域名并转为ASCII小写
+     * @param dst 目标缓冲区，至少为max + 1向上取整到32的倍数，结尾之后到块边界的部分被填0
+     * @param src 源域名，以0结尾
+     * @param max 最多复制的字节数
+     * @return 复制的长度
+     */
+    size_t (*lower)(uint8_t *dst, const uint8_t *src, size_t max);
+
+    /**
+     * @brief 计算域名的64位哈希
+     * @param name 域名，须以0填充到DNS_NAME_HASH_STRIDE的整数倍
+     * @param len 域名长度
+     * @return 哈希值
+     */
+    uint64_t (*hash)(const uint8_t *name, size_t len);
+
+    /**
+     * @brief 比较两个等长域名
+     * @param a 域名，须以0填充到DNS_NAME_HASH_STRIDE的整数倍
+     * @param b 域名，须以0填充到DNS_NAME_HASH_STRIDE的整数倍
+     * @param len 域名长度
+     * @return 如果相同，返回true
+     */
+    bool (*equal)(const uint8_t *a, const uint8_t *b, size_t len);
+
+    /**
+     * @brief 复制一个报文中的标签到点分形式的域名中，并校验其中不含'.'与0
+     * @param dst 目标位置，标签之后须留有32字节的余量
+     * @param src 标签内容
+     * @param len 标签长度
+     * @return 如果标签合法，返回true
+     */
+    bool (*copy_label)(uint8_t *dst, const uint8_t *src, size_t len);
+
+    /**
+     * @brief 将点分形式的域名编码为报文中的标签序列
+     * @param wire 目标位置，至少strlen(text) + 2字节，并须留有32字节的余量
+     * @param text 点分形式的域名，以0结尾
+     * @return 写入的字节数
+     */
+    size_t (*to_wire)(uint8_t *wire, const uint8_t *text);
+} DNSNameKernel;
+
+extern const DNSNameKernel *dnsname; ///< 当前使用的内核
+
+/**
+ * @brief 检测CPU特性，按操作选用实现，此前dnsname为标量实现
+ */
+void init_dnsname();
+
+/**
+ * @brief 获取所有可用的内核
+ * @param count 内核数目
+ * @return 内核数组，依次为标量、SSE2、AVX2（CPU支持时）与按操作选用的内核
+ */
+const DNSNameKernel *const *dnsname_kernels(int *count);
+
+#endif //GODNS_DNS_NAME_H
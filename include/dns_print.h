@@ -5,8 +5,17 @@
 #ifndef GODNS_DNS_PRINT_H
 #define GODNS_DNS_PRINT_H
 
+#include "dns_log.h"
 #include "dns_structure.h"
 
+#if NODNS_MIN_LOG_LEVEL > LOG_DEBUG
+
+// DEBUG日志在编译时被去掉，报文打印也一并去掉，参数不会被求值
+#define print_dns_string(pstring, len) {}
+#define print_dns_message(pstring, len) {}
+
+#else
+
 /**
  * @brief 打印DNS报文字节流
  *
@@ -16,11 +25,14 @@
 void print_dns_string(const char * pstring, unsigned int len);
 
 /**
- * @brief 打印DNS报文结构体
+ * @brief 打印DNS报文结构体，字节流交给日志后台线程解析后打印
  *
- * @param pmsg DNS报文结构体
+ * @param pstring DNS报文字节流
+ * @param len 字节流长度
  */
-void print_dns_message(const DNSMessage * pmsg);
+void print_dns_message(const char * pstring, unsigned int len);
+
+#endif
 
 
 #endif //GODNS_DNS_PRINT_H
@@ -14,6 +14,7 @@
 
 #define DNS_STRING_MAX_SIZE 8192
 #define DNS_RR_NAME_MAX_SIZE 512
+#define DNS_KEY_NAME_MAX_SIZE 256
 
 #define DNS_QR_QUERY 0
 #define DNS_QR_ANSWER 1
@@ -32,6 +33,8 @@
 #define DNS_TYPE_MX 15
 #define DNS_TYPE_TXT 16
 #define DNS_TYPE_AAAA 28
+#define DNS_TYPE_SRV 33
+#define DNS_TYPE_ANY 255
 
 #define DNS_CLASS_IN 1
 
@@ -73,11 +76,21 @@ typedef struct dns_header {
     uint16_t arcount;
 } DNSHeader;
 
+/// 规范化的查询键：小写域名 + QTYPE + QCLASS，哈希只覆盖域名，同名不同类型的记录落在同一个桶中
+typedef struct dns_key {
+    uint64_t hash; ///< 小写域名的64位哈希
+    uint16_t qtype;
+    uint16_t qclass;
+    uint16_t len; ///< 域名长度，不含结尾的0
+    uint8_t name[DNS_KEY_NAME_MAX_SIZE]; ///< 小写域名，len之后全部填0
+} DNSKey;
+
 /// 报文Question Section结构体，以链表表示
 typedef struct dns_question {
     uint8_t *qname;
     uint16_t qtype;
     uint16_t qclass;
+    DNSKey key; ///< 解析时计算一次的规范键，供缓存、hosts等所有索引复用
     struct dns_question *next;
 } DNSQuestion;
 
@@ -0,0 +1,54 @@
+/**
+ * @file dns_trace.h
+ * @brief USDT静态探针
+ * @details 本文件定义了查询处理路径上的USDT探针。以NODNS_USDT编译时探针由<sys/sdt.h>生成，
+ *          未被bpftrace等工具挂载时只是一条nop；每个探针带有信号量，参数（包括时间戳）只在挂载后才计算。
+ *          未开启NODNS_USDT时探针不产生任何代码。探针的参数约定见tools/trace/README.md。
+ */
+
+#ifndef GODNS_DNS_TRACE_H
+#define GODNS_DNS_TRACE_H
+
+// 所有探针，provider为nodns
+#define DNS_TRACE_PROBES(X) \
+    X(query__receive) \
+    X(cache__lookup) \
+    X(upstream__send) \
+    X(upstream__receive) \
+    X(upstream__answer) \
+    X(query__timeout) \
+    X(query__reply)
+
+#ifdef NODNS_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define DNS_TRACE_SEMAPHORE(name) nodns_##name##_semaphore
+#define DNS_TRACE_DECLARE(name) extern unsigned short DNS_TRACE_SEMAPHORE(name);
+DNS_TRACE_PROBES(DNS_TRACE_DECLARE)
+
+// 探针是否已被挂载
+#define dns_trace_enabled(name) __builtin_expect(DNS_TRACE_SEMAPHORE(name) != 0, 0)
+
+// 触发探针，参数只在探针被挂载时求值。STAP_PROBEV对每个参数取sizeof与__typeof，
+// 位域参数（如DNSHeader.rcode）须先转换为int，窄整数也统一转换为int
+#define dns_trace(name, args...) \
+    do { \
+        if (dns_trace_enabled(name)) \
+            STAP_PROBEV(nodns, name, ##args); \
+    } while (0)
+
+#else
+
+#define dns_trace_enabled(name) 0
+#define dns_trace(name, args...) do {} while (0)
+
+#endif
+
+/**
+ * @brief 按--trace_force强制打开所有探针的信号量，供不会设置信号量的工具（如perf）使用
+ */
+void init_trace();
+
+#endif //GODNS_DNS_TRACE_H
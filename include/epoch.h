@@ -0,0 +1,32 @@
+/**
+ * @file epoch.h
+ * @brief 基于纪元的内存回收
+ * @details 本文件定义了无锁读者与写者之间的内存回收接口。读者在epoch_enter与epoch_exit之间访问共享结构，
+ *          期间不加锁也不写共享数据；写者把元素从共享结构中摘下后交给epoch_retire，
+ *          等全局纪元前进两次、所有读者都离开过摘下时的纪元后才真正释放。
+ *          每个线程首次调用时登记一条记录，读者只写自己的记录。
+ */
+
+#ifndef GODNS_EPOCH_H
+#define GODNS_EPOCH_H
+
+/**
+ * @brief 进入读临界区，之后读到的元素在epoch_exit之前不会被释放
+ * @note 不可嵌套
+ */
+void epoch_enter(void);
+
+/**
+ * @brief 离开读临界区
+ */
+void epoch_exit(void);
+
+/**
+ * @brief 延迟释放已从共享结构中摘下的元素
+ * @details 元素记在本线程的待回收表中，并尝试推进全局纪元，顺带释放本线程中已过宽限期的元素
+ * @param free_fn 释放函数
+ * @param ptr 元素
+ */
+void epoch_retire(void (*free_fn)(void *), void *ptr);
+
+#endif //GODNS_EPOCH_H
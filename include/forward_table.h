@@ -0,0 +1,65 @@
+/**
+ * @file forward_table.h
+ * @brief 条件转发
+ * @details 本文件定义了按域名后缀选择上游服务器组的转发表。每条--forward规则定义一个组，包括若干后缀、
+ *          一个或多个上游服务器与超时时间；不匹配任何规则的查询发往由--remote_host与--remote_port指定的默认组。
+ *          后缀建成反向标签树，查询匹配最长的后缀。每个组有自己的socket、超时与统计，
+ *          内部区域的查询不会排在慢速的公网查询之后。组内有多个服务器时轮流使用。
+ *          查询池为每个组保留一部分位置，一个组的上游变慢或超时占满其余位置时，其他组的查询仍能进入查询池。
+ */
+
+#ifndef GODNS_FORWARD_TABLE_H
+#define GODNS_FORWARD_TABLE_H
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "dns_metrics.h"
+#include "dns_structure.h"
+#include "suffix_trie.h"
+
+#define FORWARD_GROUP_MAX_SERVERS 8 // 每个组的上游服务器数上限
+#define FORWARD_DEFAULT_TIMEOUT 5000 // 规则未指定超时时使用的超时（毫秒）
+
+// 上游服务器组，只在事件循环线程中访问
+typedef struct upstream_group {
+    char *name; // 组名，为第一个后缀，默认组为"default"
+    struct sockaddr_in servers[FORWARD_GROUP_MAX_SERVERS];
+    int server_count;
+    int next_server; // 下一个查询使用的服务器
+    uint64_t timeout; // 超时（毫秒）
+    uv_udp_t socket; // 本组专用的socket
+    uint64_t queries; // 发出的查询数
+    uint64_t responses; // 收到的回复数
+    uint64_t timeouts; // 超时的查询数
+    int pending; // 等待本组回复而占用查询池的查询数，含合并的查询
+    uint64_t rejected; // 查询池中可用的位置已保留给其他组而被丢弃的查询数
+    Metrics_Histogram rtt; // 发出查询到收到回复的时间（纳秒）
+} Upstream_Group;
+
+// 转发表
+typedef struct forward_table {
+    Upstream_Group *groups; // groups[0]为默认组
+    int count;
+    Suffix_Trie *trie; // 结点的value为组在groups中的下标
+
+    /**
+     * @brief 按最长后缀选择上游服务器组
+     * @param table 转发表
+     * @param key 查询的规范键
+     * @return 上游服务器组，不匹配任何规则时返回默认组
+     */
+    Upstream_Group *(*route)(const struct forward_table *table, const DNSKey *key);
+} Forward_Table;
+
+/**
+ * @brief 创建转发表，并注册各组的指标
+ * @param rules 规则，每条为“后缀[,后缀...]=地址[:端口][,地址[:端口]...][/超时毫秒]”
+ * @param rule_count 规则数
+ * @return 转发表，规则有误时返回NULL
+ */
+Forward_Table *new_forward_table(char *const *rules, int rule_count);
+
+#endif //GODNS_FORWARD_TABLE_H
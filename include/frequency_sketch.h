@@ -0,0 +1,49 @@
+/**
+ * @file frequency_sketch.h
+ * @brief 访问频次估计
+ * @details 本文件定义了TinyLFU准入策略使用的频次估计器。它是一个4位计数器的count-min sketch：
+ *          每个uint64_t存放16个计数器，每个键按哈希在FS_DEPTH个位置各选一个计数器，估计值取其中的最小值，计数器饱和于15。
+ *          累加次数达到容量的FS_SAMPLE_FACTOR倍时所有计数器减半，使估计值反映近期的频次，旧的热点会逐渐冷却。
+ *          内存约为每个缓存项8字节，与访问过的键的数量无关。
+ */
+
+#ifndef GODNS_FREQUENCY_SKETCH_H
+#define GODNS_FREQUENCY_SKETCH_H
+
+#include <stdint.h>
+
+#define FS_DEPTH 4 // 每个键的计数器数
+#define FS_COUNTER_MAX 15 // 4位计数器的上限
+#define FS_SAMPLE_FACTOR 10 // 累加容量的该倍数次后计数器减半
+
+// 频次估计器
+typedef struct frequency_sketch {
+    uint64_t *table; // 计数器，每个元素含16个4位计数器
+    uint64_t mask; // table的长度减一，长度为2的幂
+    uint64_t additions; // 上次减半后的累加次数
+    uint64_t sample_size; // 累加次数达到该值时减半
+
+    /**
+     * @brief 记录一次访问
+     * @param sketch 频次估计器
+     * @param hash 键的哈希
+     */
+    void (*increment)(struct frequency_sketch *sketch, uint64_t hash);
+
+    /**
+     * @brief 估计键的访问频次
+     * @param sketch 频次估计器
+     * @param hash 键的哈希
+     * @return 估计的频次，不超过FS_COUNTER_MAX
+     */
+    int (*frequency)(const struct frequency_sketch *sketch, uint64_t hash);
+} Frequency_Sketch;
+
+/**
+ * @brief 创建频次估计器
+ * @param capacity 缓存的容量，决定计数器数与减半的周期
+ * @return 新的频次估计器
+ */
+Frequency_Sketch *new_frequency_sketch(int capacity);
+
+#endif //GODNS_FREQUENCY_SKETCH_H
@@ -0,0 +1,91 @@
+/**
+ * @file heavy_hitters.h
+ * @brief 高频项统计
+ * @details 本文件定义了流式高频项统计的接口，用于找出查询最多的域名与请求方。
+ *          频次由count-min sketch估计：HH_SKETCH_DEPTH行计数器，每行以键的哈希选出一个计数器，
+ *          估计值取各行的最小值，只会高估不会低估；更新时只增加等于最小值的计数器（保守更新）以减小高估。
+ *          估计值最高的HH_TOP_K个键保存在按频次排列的小根堆中，另有一个以哈希为键的开放寻址索引记录键在堆中的位置。
+ *          内存固定，每次更新的开销与键的数量无关。所有计数每HH_DECAY_INTERVAL毫秒减半，估计值反映的是近期的频次。
+ *          只能在事件循环线程中使用。
+ */
+
+#ifndef GODNS_HEAVY_HITTERS_H
+#define GODNS_HEAVY_HITTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <uv.h>
+
+#define HH_SKETCH_DEPTH 4 // sketch的行数
+#define HH_SKETCH_WIDTH 4096 // sketch每行的计数器数，须为2的幂
+#define HH_TOP_K 32 // 保留的高频项数
+#define HH_INDEX_SIZE (HH_TOP_K * 4) // 堆索引的槽数，须为2的幂
+#define HH_KEY_MAX_SIZE 256 // 键的最大长度
+#define HH_DECAY_INTERVAL 10000 // 计数减半的间隔（毫秒）
+
+// 高频项
+typedef struct heavy_hitter {
+    uint64_t hash; // 键的哈希
+    uint32_t count; // 估计的频次
+    uint16_t len; // 键的长度
+    uint16_t slot; // 在堆索引中的槽
+    uint8_t key[HH_KEY_MAX_SIZE]; // 键
+} Heavy_Hitter;
+
+// 高频项统计
+typedef struct heavy_hitters {
+    uint32_t sketch[HH_SKETCH_DEPTH][HH_SKETCH_WIDTH]; // count-min sketch
+    Heavy_Hitter top[HH_TOP_K]; // 以count为序的小根堆
+    uint16_t index[HH_INDEX_SIZE]; // 堆索引，值为堆中的位置加一，为0表示空槽
+    int size; // 堆中的高频项数
+    uint64_t total; // 减半后的总频次
+    uv_timer_t timer; // 减半计时器
+
+    /**
+     * @brief 记录键出现一次
+     *
+     * @param hh 高频项统计
+     * @param key 键
+     * @param len 键的长度，超过HH_KEY_MAX_SIZE的部分被截断
+     * @param hash 键的64位哈希
+     * @return 键的估计频次
+     */
+    uint32_t (*update)(struct heavy_hitters *hh, const void *key, size_t len, uint64_t hash);
+
+    /**
+     * @brief 估计键的频次，可用于预取、限速等决策
+     *
+     * @param hh 高频项统计
+     * @param hash 键的64位哈希
+     * @return 估计频次，不会低于实际频次
+     */
+    uint32_t (*estimate)(const struct heavy_hitters *hh, uint64_t hash);
+
+    /**
+     * @brief 按频次从高到低取出高频项
+     *
+     * @param hh 高频项统计
+     * @param out 输出数组，长度不小于HH_TOP_K
+     * @return 高频项数
+     */
+    int (*sorted)(const struct heavy_hitters *hh, const Heavy_Hitter **out);
+} Heavy_Hitters;
+
+/**
+ * @brief 计算任意字节串的64位哈希
+ *
+ * @param key 键
+ * @param len 键的长度
+ * @return 哈希值
+ */
+uint64_t hh_hash(const void *key, size_t len);
+
+/**
+ * @brief 创建高频项统计
+ *
+ * @param loop 事件循环，用于定时减半
+ * @return 新的高频项统计
+ */
+Heavy_Hitters *new_heavy_hitters(uv_loop_t *loop);
+
+#endif //GODNS_HEAVY_HITTERS_H
@@ -0,0 +1,119 @@
+/**
+ * @file hosts.h
+ * @brief hosts文件
+ * @details 本文件定义了hosts文件的索引与热加载。索引是按域名哈希排序的平坦数组，建好后不再修改，
+ *          可被多个线程无锁地查询；索引前有一个布隆过滤器，不在hosts中的域名通常只读一条缓存行。
+ *          hosts文件改变时在线程池中建立新的索引，回到事件循环后原子地替换旧索引，
+ *          动态缓存、在途查询与套接字不受影响。
+ */
+
+#ifndef GODNS_HOSTS_H
+#define GODNS_HOSTS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <uv.h>
+
+#include "bloom_filter.h"
+#include "rbtree.h"
+#include "suffix_trie.h"
+
+#define HOSTS_RELOAD_DELAY 100 // 文件改变后等待的毫秒数，编辑器保存时的多次写入只触发一次加载
+#define HOSTS_CHUNK_MIN_SIZE (1 << 20) // 每个解析线程至少分到的字节数，小文件只用一个线程
+#define HOSTS_MAX_THREADS 16 // 解析线程数的上限
+#define HOSTS_ARENA_BLOCK_SIZE (1 << 20) // 记录所在内存块的大小
+#define HOSTS_LINE_MAX_TOKENS 64 // 一行中最多解析的字段数
+#define HOSTS_SORT_BITS 16 // 排序时按哈希高位分桶的位数
+#define HOSTS_REVERSE_NAME_SIZE 96 // IPv6反向域名的长度（73）加结尾的0，向上取整到32的倍数，以便按块读取
+
+// 索引中的一项，域名与回答都在内存块中
+typedef struct hosts_entry {
+    uint64_t hash; // 域名的哈希
+    uint64_t offset; // 所在行在文件中的偏移，同一哈希的项按偏移排序
+    const uint8_t *name; // 小写域名，以'.'结尾，也是回答中的域名
+    DNSResourceRecord *rr; // 回答，同一域名、同一类型的多个地址连成链表
+    uint16_t len; // 域名长度
+    uint16_t type; // 回答的类型，DNS_TYPE_ANY表示屏蔽，回答任意类型的查询；DNS_TYPE_PTR为由地址生成的反向记录
+    uint16_t ancount; // 链表的长度
+} Hosts_Entry;
+
+// 记录所在的内存块，随索引整体释放
+typedef struct hosts_arena {
+    struct hosts_arena *next;
+    size_t used;
+    uint8_t data[HOSTS_ARENA_BLOCK_SIZE];
+} Hosts_Arena;
+
+// 一次加载的统计
+typedef struct hosts_load_stats {
+    uint64_t bytes; // 文件大小
+    uint64_t lines;
+    uint64_t errors; // 有误而跳过的记录数
+    uint64_t reverse; // 生成的PTR记录数，计入索引的项数
+    uint64_t duration; // 耗时（纳秒）
+    int threads; // 解析线程数
+} Hosts_Load_Stats;
+
+// hosts索引，建好后只读
+typedef struct hosts_index {
+    Hosts_Entry *entries; // 按哈希与行号排序
+    int count;
+    Bloom_Filter *filter; // 所有项的域名哈希
+    Suffix_Trie *suffixes; // “*.域名 0.0.0.0”与“||域名^”形式的屏蔽规则
+    Hosts_Arena *arena; // 所有记录所在的内存块
+    Hosts_Load_Stats stats;
+
+    /**
+     * @brief 查询hosts中的记录，先查布隆过滤器
+     * @param index hosts索引
+     * @param key 查询的规范键
+     * @return 文件中最靠前的能回答查询的项，没有时返回NULL
+     */
+    const Hosts_Entry *(*find)(const struct hosts_index *index, const DNSKey *key);
+} Hosts_Index;
+
+/**
+ * @brief 由索引中的一项生成回答
+ * @param entry 索引中的一项
+ * @return 回答，是项中记录的副本
+ */
+RBTreeValue *hosts_entry_value(const Hosts_Entry *entry);
+
+/**
+ * @brief 解析hosts文件建立索引
+ * @details 每行为“域名 地址...”或常见hosts文件的“地址 域名...”，#之后为注释；地址为0.0.0.0的域名对任意类型的查询
+ *          都回答该地址，即屏蔽。同一域名的多个A或AAAA地址合并为一个回答，按在文件中的顺序排列。
+ *          每个A或AAAA地址同时生成in-addr.arpa或ip6.arpa下的PTR记录，指向文件中该地址的第一个域名，随索引一起重新加载。
+ *          域名为“*.example.com”或“||example.com^”时是后缀规则，见suffix_trie.h，地址只能为0.0.0.0或省略。
+ *          文件被mmap后在换行处切成若干段，由多个线程并行解析，记录分配在连续的内存块中
+ * @param hosts_file hosts文件，不能mmap时（如管道）整体读入，为NULL时返回空索引
+ * @return 新的索引，地址格式有误的行被跳过
+ */
+Hosts_Index *new_hosts_index(FILE *hosts_file);
+
+/**
+ * @brief 按指定的段数切分并解析hosts文件，结果应与new_hosts_index相同
+ * @param hosts_file hosts文件
+ * @param threads 段数，不超过HOSTS_MAX_THREADS，为0时与new_hosts_index一样按文件大小与CPU数决定
+ * @param map 是否mmap文件。为false时读入缓冲区，文件在解析中被原地改写也只会读到部分内容，热加载时使用
+ * @return 新的索引
+ */
+Hosts_Index *new_hosts_index_split(FILE *hosts_file, int threads, bool map);
+
+/**
+ * @brief 释放索引及其中的记录
+ * @param index hosts索引
+ */
+void destroy_hosts_index(Hosts_Index *index);
+
+struct cache;
+
+/**
+ * @brief 监视HOSTS_PATH，文件改变时重新加载并替换缓存中的hosts索引
+ * @details 监视的是文件所在的目录，编辑器以改名方式保存文件后仍能收到通知；加载失败时保留旧索引
+ * @param loop 事件循环
+ * @param cache 缓存
+ */
+void init_hosts_reload(uv_loop_t *loop, struct cache *cache);
+
+#endif //GODNS_HOSTS_H
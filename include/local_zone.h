@@ -0,0 +1,63 @@
+/**
+ * @file local_zone.h
+ * @brief 本地区域
+ * @details 本文件定义了在本地直接作答的区域。RFC 6303要求递归服务器在本地提供私有地址与特殊地址的反向区域，
+ *          RFC 6761等保留了localhost、invalid、local等域名，这些查询发往上游只会得到NXDOMAIN或超时。
+ *          内置的区域与--local_zones配置的区域建成反向标签树，查询匹配最长的区域：区域之下的域名回复NXDOMAIN，
+ *          区域顶点回复其SOA与NS记录，其他类型回复NODATA，否定回复在Authority Section附带SOA，均设置AA位。
+ *          localhost的顶点另有127.0.0.1与::1的A、AAAA记录。
+ */
+
+#ifndef GODNS_LOCAL_ZONE_H
+#define GODNS_LOCAL_ZONE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dns_structure.h"
+#include "suffix_trie.h"
+
+#define LOCAL_ZONE_TTL 10800 // RFC 6303 3. 空区域的SOA与NS记录的TTL，也是否定回复的缓存时间
+#define LOCAL_ZONE_MAX_RECORDS 4 // 区域顶点的记录数上限
+
+// 一个本地区域
+typedef struct local_zone {
+    char *name; // 小写的点分形式，以'.'结尾
+    int len;
+    DNSResourceRecord *soa; // 顶点的SOA记录
+    DNSResourceRecord *records[LOCAL_ZONE_MAX_RECORDS]; // 顶点的所有记录，含SOA
+    int record_count;
+    uint64_t answers; // 作答的查询数，只在事件循环线程中访问
+} Local_Zone;
+
+// 本地区域表
+typedef struct local_zones {
+    Local_Zone *zones;
+    int count;
+    int capacity;
+    Suffix_Trie *trie; // 结点的value为区域在zones中的下标
+
+    /**
+     * @brief 查找域名所在的最长的区域
+     * @param zones 本地区域表
+     * @param key 查询的规范键
+     * @return 区域，不在任何区域中时返回NULL
+     */
+    Local_Zone *(*find)(const struct local_zones *zones, const DNSKey *key);
+
+    /**
+     * @brief 把查询报文改写为区域的权威回复
+     * @param zone 区域
+     * @param msg 查询报文，其中原有的Resource Record被释放
+     */
+    void (*answer)(Local_Zone *zone, DNSMessage *msg);
+} Local_Zones;
+
+/**
+ * @brief 创建本地区域表，并注册各区域的作答计数
+ * @param spec 以逗号分隔的配置：“none”去掉所有内置区域，“-域名”去掉一个内置区域，“域名”增加一个区域；为NULL时只有内置区域
+ * @return 本地区域表，配置有误时返回NULL
+ */
+Local_Zones *new_local_zones(const char *spec);
+
+#endif //GODNS_LOCAL_ZONE_H
@@ -0,0 +1,30 @@
+/**
+ * @file loop_monitor.h
+ * @brief 事件循环监控
+ * @details 本文件定义了事件循环健康监控的接口。uv_prepare与uv_check句柄统计每轮循环的忙碌时间（扣除在poll中的空闲时间）
+ *          与回调数；看门狗线程定期向事件循环发送uv_async，若超过阈值仍未得到响应，认为事件循环卡住，
+ *          向事件循环线程发送信号，在信号处理函数中把当时的调用栈写入日志。结果以指标的形式导出。
+ */
+
+#ifndef GODNS_LOOP_MONITOR_H
+#define GODNS_LOOP_MONITOR_H
+
+#include <uv.h>
+
+extern unsigned loop_callbacks; ///< 本轮循环中已执行的回调数
+
+/**
+ * @brief 启动事件循环监控，须在uv_run之前、在运行事件循环的线程中调用
+ *
+ * @param loop 事件循环
+ */
+void init_loop_monitor(uv_loop_t *loop);
+
+/**
+ * @brief 在事件循环的回调函数入口调用，统计每轮循环的回调数
+ */
+static inline void loop_monitor_callback() {
+    ++loop_callbacks;
+}
+
+#endif //GODNS_LOOP_MONITOR_H
@@ -0,0 +1,51 @@
+/**
+ * @file query_log.h
+ * @brief 二进制查询日志
+ * @details 本文件定义了二进制查询日志的格式与接口。每个完成的查询（包括超时与被丢弃的查询）按采样率记录为一条定长头部
+ *          加变长域名的记录，批量异步写入文件，文件超过大小上限时按 path、path.1、path.2…… 轮转。
+ *
+ *          文件以8字节的文件头开始：魔数"NDQL"、版本号（uint16）、保留（uint16）。
+ *          之后是连续的记录，每条记录以uint16的长度（不含长度本身）开始，其后依次为：
+ *          时刻（uint64，Unix纳秒）、延迟（uint32，微秒）、请求方报文ID（uint16）、QTYPE（uint16）、QCLASS（uint16）、
+ *          RCODE（uint8，未回复时为QLOG_NO_RCODE）、结果（uint8，Query_Outcome）、地址族（uint8，4或6）、
+ *          地址（4或16字节）、端口（uint16）、域名长度（uint8）、域名（点分形式，不含结尾的0）。
+ *          所有整数均为小端序。解码时应跳过长度之外多出的字节，以兼容之后追加的字段。
+ */
+
+#ifndef GODNS_QUERY_LOG_H
+#define GODNS_QUERY_LOG_H
+
+#include <stdint.h>
+#include <uv.h>
+
+#include "query_pool.h"
+
+#define QLOG_MAGIC "NDQL"
+#define QLOG_VERSION 1
+#define QLOG_HEADER_SIZE 8 // 文件头的长度
+#define QLOG_RECORD_MAX_SIZE 320 // 一条记录的最大长度，含长度字段
+#define QLOG_NO_RCODE 0xFF // 未回复的查询的RCODE
+#define QLOG_FILES_MIN 2 // 轮转的文件数下限，只有一个文件时新文件会截断仍有写入在途的旧文件
+#define QLOG_FILES_MAX 32 // 轮转的文件数上限，轮转时的重命名在事件循环线程中同步进行
+
+/**
+ * @brief 初始化查询日志，未配置--qlog_path时不做任何事
+ *
+ * @param loop 事件循环
+ */
+void init_qlog(uv_loop_t *loop);
+
+/**
+ * @brief 按采样率记录一个完成的查询
+ *
+ * @param addr 请求方地址
+ * @param que 查询的Question Section
+ * @param id 请求方报文ID
+ * @param rcode 回复的RCODE，未回复时为QLOG_NO_RCODE
+ * @param outcome 查询的结果
+ * @param start_time 收到查询的时刻，uv_hrtime
+ */
+void qlog_record(const struct sockaddr *addr, const DNSQuestion *que, uint16_t id, uint8_t rcode,
+                 Query_Outcome outcome, uint64_t start_time);
+
+#endif //GODNS_QUERY_LOG_H
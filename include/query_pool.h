@@ -13,26 +13,57 @@
 #include "dns_structure.h"
 #include "index_pool.h"
 #include "dns_cache.h"
+#include "heavy_hitters.h"
 
 #define QUERY_POOL_MAX_SIZE 256
+#define QUERY_POOL_GROUP_RESERVE 16 // 每个上游组保留的查询池位置，组多时按比例减少
+
+// 查询的结果，即回复的来源
+typedef enum {
+    QUERY_HOSTS, // hosts文件
+    QUERY_LRU, // 缓存LRU链表
+    QUERY_TREE, // 缓存红黑树
+    QUERY_UPSTREAM, // 上游服务器
+    QUERY_COALESCED, // 合并到相同的在途查询，由同一个上游回复作答
+    QUERY_TIMEOUT, // 上游超时，未回复
+    QUERY_POOL_FULL, // 查询池满，被丢弃
+    QUERY_FAILED, // 序号池满或上游回复的问题不符，未回复
+    QUERY_LOCAL_ZONE, // 本地区域，不进入查询池
+    QUERY_ZONE, // 权威区域，不进入查询池
+    QUERY_RATE_LIMITED, // 请求方近期的查询过多，被丢弃
+    QUERY_OUTCOME_COUNT
+} Query_Outcome;
 
 // DNS查询结构体
 typedef struct dns_query {
     uint16_t id; // 查询ID
     uint16_t prev_id; // 原本DNS查询报文的ID
-    struct sockaddr addr; // 请求方地址
+    struct sockaddr_storage addr; // 请求方地址，可以是IPv6地址
+    uint64_t start_time; // 收到查询的时刻，uv_hrtime
     DNSMessage *msg; // DNS查询报文报文
     uv_timer_t timer; // 计时器
+    struct upstream_group *group; // 发往的上游服务器组
+    uint64_t send_time; // 发往上游的时刻，uv_hrtime
+    bool inflight; // 是否已登记在在途索引中
+    struct dns_query *inflight_next; // 在途索引同一桶中的下一个查询
+    struct dns_query *waiters; // 合并到本查询上、等待同一上游回复的查询
+    struct dns_query *next_waiter; // 等待链表中的下一个查询
 } Dns_Query;
 
 // DNS查询池
 typedef struct query_pool {
     Dns_Query *pool[QUERY_POOL_MAX_SIZE]; // 查询池
+    Dns_Query *inflight[QUERY_POOL_MAX_SIZE]; // 在途查询索引，按规范键哈希分桶，用于合并相同的上游查询
     unsigned short count; // 池内查询数量
     Queue *queue; // 未分配的查询ID的队列
     Index_Pool *ipool; // 序号池
     uv_loop_t *loop; // 事件循环
     Cache *cache; // 缓存
+    struct forward_table *forward; // 转发表
+    Heavy_Hitters *qnames; // 查询最多的域名，键为小写域名
+    Heavy_Hitters *clients; // 查询最多的请求方，键为IPv4地址
+    int group_reserve; // 每个上游组保留的查询池位置，其他组不能占用
+    uint32_t client_limit; // 请求方近期查询数的估计值上限，超过时丢弃其查询，为0时不限
 
     /**
      * @brief 判断查询池是否已满
@@ -48,8 +79,9 @@ typedef struct query_pool {
      * @param qpool 查询池
      * @param addr 请求方地址
      * @param msg 查询报文
+     * @param start_time 收到查询的时刻，uv_hrtime
      */
-    void (*insert)(struct query_pool *qpool, const struct sockaddr *addr, const DNSMessage *msg);
+    void (*insert)(struct query_pool *qpool, const struct sockaddr *addr, const DNSMessage *msg, uint64_t start_time);
 
     /**
      * @brief 结束查询
@@ -73,8 +105,9 @@ typedef struct query_pool {
  *
  * @param loop 事件循环
  * @param cache 缓存
+ * @param forward 转发表
  * @return 新的查询池
  */
-Query_Pool *new_qpool(uv_loop_t *loop, Cache *cache);
+Query_Pool *new_qpool(uv_loop_t *loop, Cache *cache, struct forward_table *forward);
 
 #endif //GODNS_QUERY_POOL_H
@@ -22,7 +22,7 @@ typedef struct rbtree_value {
     uint16_t ancount; // RR链表中Answer Section的数目
     uint16_t nscount; // RR链表中Authority Section的数目
     uint16_t arcount; // RR链表中Addition Section的数目
-    uint8_t type; // RR对应的Question的类型
+    DNSKey key; // RR对应的Question的规范键，qtype为DNS_TYPE_ANY时匹配任意类型
 } RBTreeValue;
 
 // 红黑树节点链表
@@ -50,16 +50,15 @@ typedef struct dns_rr_linklist {
      * @brief 在链表中查找特定的值
      *
      * @param list 链表起始节点
-     * @param qname NAME字段
-     * @param qtype type字段
+     * @param key 查询的规范键
      * @return 如果查找到节点，返回该节点在链表中的前驱，否则返回NULL
      */
-    struct dns_rr_linklist *(*query_next)(struct dns_rr_linklist *list, const uint8_t *qname, const uint16_t qtype);
+    struct dns_rr_linklist *(*query_next)(struct dns_rr_linklist *list, const DNSKey *key);
 } DNSRRLinkList;
 
 // 红黑树的节点
 typedef struct rbtree_node {
-    unsigned int key; // 红黑树节点的键，对应DNS查询的ID
+    uint64_t key; // 红黑树节点的键，对应规范键的哈希
     DNSRRLinkList *rr_list; // 指向当前节点对应的链表
     Color color; // 当前节点的颜色
     struct rbtree_node *left; // 指向当前节点的左子节点
@@ -78,7 +77,7 @@ typedef struct rbtree {
      * @param list 值
      * 此函数从根节点开始迭代查找插入位置，如果该键对应的节点不存在，则创建一个新节点，并且维护树的平衡；否则在原有节点的链表上插入新元素。
      */
-    void (*insert)(struct rbtree *tree, unsigned int key, DNSRRLinkList *list);
+    void (*insert)(struct rbtree *tree, uint64_t key, DNSRRLinkList *list);
 
     /**
      * @brief 在红黑树中查找键对应的值
@@ -89,7 +88,7 @@ typedef struct rbtree {
      *
      * 此函数查找给定键的节点，如果该节点存在，则删去节点链表中已经超时的部分，此时若链表不为空，则返回该链表；否则删除该节点并返回NULL。
      */
-    DNSRRLinkList *(*query)(struct rbtree *tree, unsigned int data);
+    DNSRRLinkList *(*query)(struct rbtree *tree, uint64_t data);
 } RBTree;
 
 /**
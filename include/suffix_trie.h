@@ -0,0 +1,85 @@
+/**
+ * @file suffix_trie.h
+ * @brief 域名后缀规则
+ * @details 本文件定义了通配与后缀屏蔽规则使用的反向标签树。树的每条边是一个完整的标签，从顶级域开始向下，
+ *          查询从域名的最后一个标签逐个向前走，代价只与查询域名的标签数有关，与规则数无关。
+ *          规则有两种：“*.example.com”匹配example.com的所有子域名，但不匹配其本身；
+ *          “||example.com^”（Adblock语法）匹配example.com本身及其所有子域名。
+ */
+
+#ifndef GODNS_SUFFIX_TRIE_H
+#define GODNS_SUFFIX_TRIE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dns_structure.h"
+
+#define SUFFIX_MATCH_SELF 1 // 匹配该结点对应的域名本身
+#define SUFFIX_MATCH_BELOW 2 // 匹配该结点之下的所有子域名
+
+// 树的结点，对应一个域名
+typedef struct suffix_trie_node {
+    uint8_t *label; // 从父结点到该结点的标签，小写
+    uint8_t label_len;
+    uint8_t flags; // SUFFIX_MATCH_*的组合
+    uint32_t value; // 由插入者设置，如本地区域的序号
+    uint32_t child_count;
+    uint32_t child_capacity;
+    struct suffix_trie_node **children; // 按标签长度与内容排序
+} Suffix_Trie_Node;
+
+// 反向标签树
+typedef struct suffix_trie {
+    Suffix_Trie_Node root;
+    int rules; // 规则数，同一域名的两种规则合计为一条
+
+    /**
+     * @brief 插入规则
+     * @param trie 反向标签树
+     * @param name 点分形式的域名，不含“*.”与“||”，可以'.'结尾
+     * @param len 域名的长度
+     * @param flags SUFFIX_MATCH_*的组合
+     * @return 规则所在的结点，域名格式有误时返回NULL
+     */
+    Suffix_Trie_Node *(*insert)(struct suffix_trie *trie, const char *name, int len, uint8_t flags);
+
+    /**
+     * @brief 判断域名是否匹配某条规则
+     * @param trie 反向标签树
+     * @param key 查询的规范键
+     * @return 如果匹配，返回true
+     */
+    bool (*match)(const struct suffix_trie *trie, const DNSKey *key);
+
+    /**
+     * @brief 查找匹配域名的最长的规则
+     * @param trie 反向标签树
+     * @param key 查询的规范键
+     * @return 规则所在的结点，不匹配时返回NULL
+     */
+    const Suffix_Trie_Node *(*find)(const struct suffix_trie *trie, const DNSKey *key);
+} Suffix_Trie;
+
+/**
+ * @brief 创建空的反向标签树
+ * @return 反向标签树
+ */
+Suffix_Trie *new_suffix_trie();
+
+/**
+ * @brief 释放反向标签树
+ * @param trie 反向标签树
+ */
+void destroy_suffix_trie(Suffix_Trie *trie);
+
+/**
+ * @brief 解析规则的文本形式
+ * @param text “*.example.com”或“||example.com^”
+ * @param name 输出，规则中的域名在text中的起始位置
+ * @param len 输出，域名的长度
+ * @return SUFFIX_MATCH_*的组合，text不是后缀规则时返回0
+ */
+uint8_t suffix_rule_parse(const char *text, const char **name, int *len);
+
+#endif //GODNS_SUFFIX_TRIE_H
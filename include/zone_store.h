@@ -0,0 +1,116 @@
+/**
+ * @file zone_store.h
+ * @brief 权威区域
+ * @details 本文件定义了从RFC 1035主文件加载的内存区域。每个--zone参数给出一个区域的起点与文件，
+ *          所有区域的域名放在同一个开放寻址哈希表中，区域起点建成反向标签树，查询先找到最长的起点，再查哈希表。
+ *          每个RRset在加载时转换为线路格式，只缺所有者域名，作答时把所有者写为指向问题中域名的压缩指针后直接拼接。
+ *          支持通配符（RFC 4592，按最近的祖先查找“*”）与区域内的CNAME追踪，不支持子区域委派。
+ *          文件改变后在线程池中重新加载全部区域并整体替换，旧的区域在所有读者离开后释放；加载失败时保留旧的区域。
+ */
+
+#ifndef GODNS_ZONE_STORE_H
+#define GODNS_ZONE_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uv.h>
+
+#include "dns_structure.h"
+#include "suffix_trie.h"
+
+#define ZONE_RELOAD_DELAY 100 // 文件改变后等待的毫秒数
+#define ZONE_MAX_CHAIN 8 // 区域内CNAME追踪的最大跳数
+#define ZONE_UDP_SIZE 512 // 回复的最大长度，超过时只保留问题并设置TC位
+#define ZONE_MAX_TOKENS 64 // 一条记录的最多词数
+
+// 一个RRset，wire中依次为count条记录的TYPE、CLASS、TTL、RDLENGTH与RDATA，不含所有者域名
+typedef struct zone_rrset {
+    uint16_t type;
+    uint16_t count;
+    uint32_t len;
+    uint32_t cap;
+    uint8_t *wire;
+} Zone_RRset;
+
+// 一个域名，没有RRset时为空的非终结结点，只用于区分NXDOMAIN与NODATA
+typedef struct zone_node {
+    uint64_t hash;
+    uint8_t *name; // 小写的点分形式，以'.'结尾
+    uint16_t len;
+    uint16_t rrset_count;
+    uint16_t rrset_cap;
+    Zone_RRset *rrsets;
+} Zone_Node;
+
+// 一个区域
+typedef struct zone {
+    char *origin; // 小写的点分形式，以'.'结尾
+    int origin_len;
+    const char *path; // 主文件路径
+    const Zone_RRset *soa; // 起点的SOA，否定回复附在Authority Section
+} Zone;
+
+// 加载的统计
+typedef struct zone_load_stats {
+    uint64_t records; // 加载的记录数
+    uint64_t errors; // 有误而跳过的记录数
+    uint64_t duration; // 耗时（纳秒）
+} Zone_Load_Stats;
+
+// 作答的结果
+typedef struct zone_answer {
+    uint8_t rcode;
+    uint16_t ancount;
+    uint16_t nscount;
+    unsigned len; // 回复的总长度
+    bool truncated; // 超过了最大长度，只保留问题
+} Zone_Answer;
+
+// 所有区域
+typedef struct zone_store {
+    Zone *zones;
+    int zone_count;
+    Suffix_Trie *origins; // 结点的value为区域在zones中的下标
+    Zone_Node *nodes;
+    uint32_t node_count;
+    uint32_t node_cap;
+    uint32_t *table; // 开放寻址哈希表，存nodes的下标加一，0为空
+    uint32_t table_mask;
+    Zone_Load_Stats stats;
+
+    /**
+     * @brief 在区域中作答
+     * @param store 所有区域
+     * @param key 查询的规范键
+     * @param packet 回复报文，问题已写在第12字节开始处
+     * @param offset 问题之后的位置
+     * @param cap 回复的最大长度
+     * @param result 输出，作答的结果
+     * @return 如果查询的域名属于某个区域，返回true
+     */
+    bool (*answer)(const struct zone_store *store, const DNSKey *key, uint8_t *packet, unsigned offset,
+                   unsigned cap, Zone_Answer *result);
+} Zone_Store;
+
+/**
+ * @brief 加载所有区域
+ * @param specs 区域，每个为“起点=文件路径”
+ * @param count 区域数
+ * @return 所有区域，文件无法读取、缺少SOA或参数有误时返回NULL
+ */
+Zone_Store *new_zone_store(char *const *specs, int count);
+
+/**
+ * @brief 释放所有区域
+ * @param store 所有区域
+ */
+void destroy_zone_store(Zone_Store *store);
+
+/**
+ * @brief 监视区域文件，改变时重新加载，并注册指标
+ * @param loop 事件循环
+ * @param target 当前使用的区域，重新加载后被替换
+ */
+void init_zone_reload(uv_loop_t *loop, _Atomic(Zone_Store *) *target);
+
+#endif //GODNS_ZONE_STORE_H
@@ -0,0 +1,115 @@
+/**
+ * @file      blocklist.c
+ * @brief     编译后的屏蔽列表
+ * @details   本文件的内容是屏蔽列表的映射、校验与查询。查询先由哈希的高位定位到桶，再在桶内二分查找，
+ *            最后比较域名以排除哈希冲突；之前先查布隆过滤器，不在列表中的域名通常只读一条缓存行。加载时只校验文件头与桶表，项中的偏移在查询时检查；后缀规则在加载时读出建树。
+*/
+
+#include "../include/blocklist.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/dns_key.h"
+#include "../include/dns_log.h"
+#include "../include/dns_metrics.h"
+
+static bool blocklist_contains(const Blocklist *blocklist, const DNSKey *key) {
+    if (!blocklist->filter->may_contain(blocklist->filter, key->hash))
+        return false;
+    uint32_t bucket = (uint32_t) (key->hash >> (64 - BLOCKLIST_BUCKET_BITS));
+    uint32_t lo = blocklist->buckets[bucket], hi = blocklist->buckets[bucket + 1];
+    while (lo < hi) { // 第一个哈希不小于key的项
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (blocklist->entries[mid].hash < key->hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < blocklist->header->count && blocklist->entries[lo].hash == key->hash; ++lo) {
+        const Blocklist_Entry *entry = &blocklist->entries[lo];
+        if (entry->name_len == key->len && (uint64_t) entry->name_offset + entry->name_len <=
+                                           blocklist->header->names_size &&
+            memcmp(blocklist->names + entry->name_offset, key->name, key->len) == 0)
+            return true;
+    }
+    metrics_count(METRIC_BLOOM_FALSE_POSITIVES);
+    return false;
+}
+
+/**
+ * @brief 校验文件头与桶表
+ * @param blocklist 屏蔽列表
+ * @return 如果格式正确，返回true
+ */
+static bool blocklist_valid(const Blocklist *blocklist) {
+    const Blocklist_Header *header = blocklist->header;
+    if (memcmp(header->magic, BLOCKLIST_MAGIC, sizeof(header->magic)) != 0 || header->version != BLOCKLIST_VERSION ||
+        header->bloom_blocks == 0)
+        return false;
+    DNSKey check;
+    dnskey_init(&check, (const uint8_t *) BLOCKLIST_HASH_CHECK_NAME, 0, 0);
+    if (header->hash_check != check.hash)
+        return false;
+    if (blocklist_entries_offset(header) + (uint64_t) header->count * sizeof(Blocklist_Entry) +
+        (uint64_t) header->suffix_count * sizeof(Blocklist_Suffix) + header->names_size != blocklist->size)
+        return false;
+    for (uint32_t b = 0; b < (1 << BLOCKLIST_BUCKET_BITS); ++b)
+        if (blocklist->buckets[b] > blocklist->buckets[b + 1])
+            return false;
+    return blocklist->buckets[0] == 0 && blocklist->buckets[1 << BLOCKLIST_BUCKET_BITS] == header->count;
+}
+
+Blocklist *new_blocklist(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < blocklist_bloom_offset()) {
+        close(fd);
+        return NULL;
+    }
+    // 只读的共享映射，多个进程映射同一文件时共享页缓存
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return NULL;
+    madvise(base, st.st_size, MADV_RANDOM);
+
+    Blocklist *blocklist = (Blocklist *) malloc(sizeof(Blocklist));
+    if (!blocklist)
+        log_fatal("内存分配错误")
+    blocklist->base = (const uint8_t *) base;
+    blocklist->size = st.st_size;
+    blocklist->header = (const Blocklist_Header *) base;
+    blocklist->buckets = (const uint32_t *) (blocklist->base + sizeof(Blocklist_Header));
+    blocklist->contains = &blocklist_contains;
+    if (!blocklist_valid(blocklist)) { // 先校验再计算各段的地址
+        munmap(base, st.st_size);
+        free(blocklist);
+        return NULL;
+    }
+    blocklist->entries = (const Blocklist_Entry *) (blocklist->base + blocklist_entries_offset(blocklist->header));
+    blocklist->suffix_rules = (const Blocklist_Suffix *) (blocklist->entries + blocklist->header->count);
+    blocklist->names = (const uint8_t *) (blocklist->suffix_rules + blocklist->header->suffix_count);
+    blocklist->filter = new_bloom_filter_view((const uint64_t *) (blocklist->base + blocklist_bloom_offset()),
+                                              blocklist->header->bloom_blocks);
+    blocklist->suffixes = new_suffix_trie();
+    for (uint32_t i = 0; i < blocklist->header->suffix_count; ++i) {
+        const Blocklist_Suffix *rule = &blocklist->suffix_rules[i];
+        if ((uint64_t) rule->name_offset + rule->name_len > blocklist->header->names_size ||
+            !blocklist->suffixes->insert(blocklist->suffixes, (const char *) blocklist->names + rule->name_offset,
+                                         rule->name_len, (uint8_t) rule->flags)) {
+            destroy_suffix_trie(blocklist->suffixes);
+            destroy_bloom_filter(blocklist->filter);
+            munmap(base, st.st_size);
+            free(blocklist);
+            return NULL;
+        }
+    }
+    return blocklist;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file      bloom_filter.c
+ * @brief     分块布隆过滤器
+ * @details   本文件的内容是分块布隆过滤器的实现。哈希的高32位选块，低32位分别乘以各字的奇数盐值，
+ *            取乘积的高6位作为该字中置位的位置；块数不必是2的幂，选块用乘法代替取模。
+*/
+
+#include "../include/bloom_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/dns_log.h"
+
+static const uint32_t SALTS[BLOOM_BLOCK_WORDS] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+/**
+ * @brief 求键所在的块
+ */
+static inline const uint64_t *bloom_block(const Bloom_Filter *filter, uint64_t hash) {
+    uint64_t block = ((hash >> 32) * filter->block_count) >> 32;
+    return filter->blocks + block * BLOOM_BLOCK_WORDS;
+}
+
+/**
+ * @brief 求键在第i个字中的位
+ */
+static inline uint64_t bloom_bit(uint64_t hash, int i) {
+    return 1ULL << (((uint32_t) hash * SALTS[i]) >> 26);
+}
+
+static void bloom_add(Bloom_Filter *filter, uint64_t hash) {
+    uint64_t *block = (uint64_t *) bloom_block(filter, hash);
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i)
+        block[i] |= bloom_bit(hash, i);
+}
+
+static bool bloom_may_contain(const Bloom_Filter *filter, uint64_t hash) {
+    const uint64_t *block = bloom_block(filter, hash);
+    uint64_t missing = 0;
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; ++i) // 不提前退出，便于编译器展开与向量化
+        missing |= bloom_bit(hash, i) & ~block[i];
+    return missing == 0;
+}
+
+uint32_t bloom_block_count(uint64_t keys) {
+    uint64_t blocks = (keys * BLOOM_BITS_PER_KEY + BLOOM_BLOCK_SIZE * 8 - 1) / (BLOOM_BLOCK_SIZE * 8);
+    if (blocks == 0)
+        blocks = 1;
+    return blocks > UINT32_MAX ? UINT32_MAX : (uint32_t) blocks;
+}
+
+Bloom_Filter *new_bloom_filter_view(const uint64_t *blocks, uint32_t block_count) {
+    Bloom_Filter *filter = (Bloom_Filter *) malloc(sizeof(Bloom_Filter));
+    if (!filter)
+        log_fatal("内存分配错误")
+    filter->blocks = (uint64_t *) blocks;
+    filter->block_count = block_count;
+    filter->owned = false;
+    filter->add = &bloom_add;
+    filter->may_contain = &bloom_may_contain;
+    return filter;
+}
+
+Bloom_Filter *new_bloom_filter(uint32_t block_count) {
+    uint64_t *blocks = (uint64_t *) aligned_alloc(BLOOM_BLOCK_SIZE, (size_t) block_count * BLOOM_BLOCK_SIZE);
+    if (!blocks)
+        log_fatal("内存分配错误")
+    memset(blocks, 0, (size_t) block_count * BLOOM_BLOCK_SIZE);
+    Bloom_Filter *filter = new_bloom_filter_view(blocks, block_count);
+    filter->owned = true;
+    return filter;
+}
+
+void destroy_bloom_filter(Bloom_Filter *filter) {
+    if (filter->owned)
+        free(filter->blocks);
+    free(filter);
+}
@@ -6,26 +6,17 @@
 
 #include "../include/dns_cache.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <uv.h>
 
+#include "../include/dns_config.h"
 #include "../include/dns_log.h"
 #include "../include/dns_conversion.h"
-
-/**
- * @brief 字符串哈希
- *@details 采用BKDRHash算法将字符串转换为哈希值，用于在缓存中查找
- * @param str 字符串
- * @return 该字符串的哈希值
- */
-static unsigned int BKDRHash(const uint8_t *str) {
-    unsigned int seed = 131;
-    unsigned int hash = 0;
-    while (*str)
-        hash = hash * seed + (*str++);
-    return (hash & 0x7FFFFFFF);
-}
+#include "../include/dns_key.h"
+#include "../include/dns_metrics.h"
+#include "../include/epoch.h"
 
 /**
  * @brief 获取一串RR中的最小ttl
@@ -46,14 +37,354 @@ static uint32_t get_min_ttl(const DNSResourceRecord *prr) {
     return ttl;
 }
 
+/**
+ * @brief 初始化LRU链表的一段
+ * @param seg 段
+ * @param capacity 容量
+ */
+static void segment_init(Cache_Segment *seg, int capacity) {
+    seg->head = seg->tail = new_linklist();
+    seg->size = 0;
+    seg->capacity = capacity;
+}
+
+/**
+ * @brief 从段中取下一个元素
+ * @param seg 段
+ * @param prev 要取下的元素的前驱
+ * @return 取下的元素
+ */
+static DNSRRLinkList *segment_unlink_next(Cache_Segment *seg, DNSRRLinkList *prev) {
+    DNSRRLinkList *node = prev->next;
+    prev->next = node->next;
+    node->next = NULL;
+    if (node == seg->tail)
+        seg->tail = prev;
+    --seg->size;
+    return node;
+}
+
+/**
+ * @brief 将元素放到段的尾部，即最近访问的位置
+ * @param seg 段
+ * @param node 元素
+ */
+static void segment_push(Cache_Segment *seg, DNSRRLinkList *node) {
+    seg->tail->insert(seg->tail, node);
+    seg->tail = node;
+    ++seg->size;
+}
+
+static void free_node(DNSRRLinkList *node) {
+    destroy_dnsrr(node->value->rr);
+    free(node->value);
+    free(node);
+}
+
+static bool node_expired(const DNSRRLinkList *node, time_t now) {
+    return node->expire_time != -1 && node->expire_time <= now;
+}
+
+/**
+ * @brief W-TinyLFU中离开窗口的元素决定是否进入分段LRU
+ * @details 分段LRU未满时直接进入试用段；已满时与试用段（试用段为空时为保护段）中最久未访问的元素比较访问频次，
+ *          只有频次更高时才替换它，否则丢弃离开窗口的元素。扫描随机子域名产生的元素只访问过一次，无法挤掉热点。
+ *          已过期的元素总是先被淘汰
+ * @param shard 缓存分片
+ * @param candidate 离开窗口的元素
+ */
+static void tinylfu_admit(Cache_Shard *shard, DNSRRLinkList *candidate) {
+    time_t now = time(NULL);
+    if (shard->probation.size + shard->protected.size < shard->probation.capacity + shard->protected.capacity &&
+        !node_expired(candidate, now)) {
+        segment_push(&shard->probation, candidate);
+        return;
+    }
+    metrics_count(METRIC_CACHE_EVICTIONS);
+    Cache_Segment *seg = shard->probation.size > 0 ? &shard->probation : &shard->protected;
+    DNSRRLinkList *victim = seg->head->next;
+    if (victim == NULL || node_expired(candidate, now) ||
+        (!node_expired(victim, now) && shard->sketch->frequency(shard->sketch, candidate->value->key.hash) <=
+                                       shard->sketch->frequency(shard->sketch, victim->value->key.hash))) {
+        metrics_count(METRIC_CACHE_REJECTIONS);
+        free_node(candidate);
+        return;
+    }
+    free_node(segment_unlink_next(seg, seg->head));
+    segment_push(&shard->probation, candidate);
+}
+
+/**
+ * @brief 将新元素插入LRU链表，超出容量时按淘汰策略移除元素
+ * @param shard 缓存分片
+ * @param node 新元素
+ */
+static void lru_insert(Cache_Shard *shard, DNSRRLinkList *node) {
+    segment_push(&shard->window, node);
+    if (shard->window.size <= shard->window.capacity)
+        return;
+    DNSRRLinkList *oldest = segment_unlink_next(&shard->window, shard->window.head); // 最久未访问的元素
+    if (shard->policy == CACHE_POLICY_TINYLFU) {
+        tinylfu_admit(shard, oldest);
+    } else {
+        metrics_count(METRIC_CACHE_EVICTIONS);
+        free_node(oldest);
+    }
+}
+
+/**
+ * @brief 在LRU链表的各段中查找
+ * @param shard 缓存分片
+ * @param key 查询的规范键
+ * @param seg 输出，元素所在的段
+ * @return 找到时返回元素的前驱，否则返回NULL
+ */
+static DNSRRLinkList *lru_find(Cache_Shard *shard, const DNSKey *key, Cache_Segment **seg) {
+    Cache_Segment *segments[] = {&shard->window, &shard->probation, &shard->protected};
+    for (int i = 0; i < 3; ++i) {
+        DNSRRLinkList *prev = segments[i]->head->query_next(segments[i]->head, key);
+        if (prev != NULL) {
+            *seg = segments[i];
+            return prev;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 命中的元素移到最近访问的位置，试用段中的元素晋升到保护段，保护段超出容量时最久未访问的元素降回试用段
+ * @param shard 缓存分片
+ * @param seg 元素所在的段
+ * @param prev 元素的前驱
+ * @return 命中的元素
+ */
+static DNSRRLinkList *lru_touch(Cache_Shard *shard, Cache_Segment *seg, DNSRRLinkList *prev) {
+    DNSRRLinkList *node = segment_unlink_next(seg, prev);
+    if (seg != &shard->probation) {
+        segment_push(seg, node);
+        return node;
+    }
+    segment_push(&shard->protected, node);
+    if (shard->protected.size > shard->protected.capacity)
+        segment_push(&shard->probation, segment_unlink_next(&shard->protected, shard->protected.head));
+    return node;
+}
+
+/**
+ * @brief 复制缓存中的值
+ * @param src 缓存中的值
+ * @return 副本
+ */
+static RBTreeValue *copy_value(const RBTreeValue *src) {
+    RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
+    if (!value)
+        log_fatal("内存分配错误")
+    memcpy(value, src, sizeof(RBTreeValue));
+    value->rr = copy_dnsrr(src->rr);
+    return value;
+}
+
+static void free_entry(void *ptr) {
+    Cache_Entry *entry = (Cache_Entry *) ptr;
+    destroy_dnsrr(entry->value->rr);
+    free(entry->value);
+    free(entry);
+}
+
+static bool entry_expired(const Cache_Entry *entry, time_t now) {
+    return entry->expire_time != -1 && entry->expire_time <= now;
+}
+
+/**
+ * @brief 初始化CLOCK策略的哈希表与时钟环
+ * @param clock 哈希表与时钟环
+ * @param capacity 容量
+ */
+static void clock_init(Cache_Clock *clock, int capacity) {
+    uint64_t buckets = 1;
+    while (buckets < (uint64_t) capacity)
+        buckets <<= 1;
+    clock->buckets = (_Atomic(Cache_Entry *) *) calloc(buckets, sizeof(clock->buckets[0]));
+    clock->ring = (Cache_Entry **) calloc(capacity, sizeof(Cache_Entry *));
+    if (!clock->buckets || !clock->ring)
+        log_fatal("内存分配错误")
+    clock->bucket_mask = buckets - 1;
+    clock->size = 0;
+    clock->capacity = capacity;
+    clock->hand = 0;
+}
+
+/**
+ * @brief 将缓存项从哈希桶中摘下
+ * @details 摘下只改前驱的next，正在遍历该项的读者仍能沿它的next走完，该项须经纪元回收后才能释放
+ * @param clock 哈希表与时钟环
+ * @param entry 缓存项
+ */
+static void clock_unlink(Cache_Clock *clock, Cache_Entry *entry) {
+    _Atomic(Cache_Entry *) *link = &clock->buckets[entry->value->key.hash & clock->bucket_mask];
+    while (atomic_load_explicit(link, memory_order_relaxed) != entry)
+        link = &atomic_load_explicit(link, memory_order_relaxed)->next;
+    atomic_store_explicit(link, atomic_load_explicit(&entry->next, memory_order_relaxed), memory_order_release);
+}
+
+/**
+ * @brief 转动时钟指针选出被淘汰的缓存项，将其摘下并交给纪元回收
+ * @details 访问位被设置且未过期的项清除访问位后跳过；读者可能不断重新设置访问位，扫过两圈后不再跳过
+ * @param clock 哈希表与时钟环
+ * @return 空出的位置
+ */
+static int clock_evict(Cache_Clock *clock) {
+    time_t now = time(NULL);
+    for (int scanned = 0;; ++scanned) {
+        int slot = clock->hand;
+        Cache_Entry *victim = clock->ring[slot];
+        clock->hand = (clock->hand + 1) % clock->capacity;
+        if (scanned < 2 * clock->capacity && !entry_expired(victim, now) &&
+            atomic_load_explicit(&victim->referenced, memory_order_relaxed)) {
+            atomic_store_explicit(&victim->referenced, false, memory_order_relaxed);
+            continue;
+        }
+        metrics_count(METRIC_CACHE_EVICTIONS);
+        clock_unlink(clock, victim);
+        epoch_retire(&free_entry, victim);
+        return slot;
+    }
+}
+
+/**
+ * @brief 发布新的缓存项，同一键的旧项被替换，时钟环满时淘汰一项
+ * @note 调用者持有分片的锁
+ * @param clock 哈希表与时钟环
+ * @param value 缓存的值，由缓存项接管
+ * @param expire_time 过期时间
+ */
+static void clock_insert(Cache_Clock *clock, RBTreeValue *value, time_t expire_time) {
+    Cache_Entry *entry = (Cache_Entry *) malloc(sizeof(Cache_Entry));
+    if (!entry)
+        log_fatal("内存分配错误")
+    entry->value = value;
+    entry->expire_time = expire_time;
+    atomic_init(&entry->referenced, false);
+
+    _Atomic(Cache_Entry *) *bucket = &clock->buckets[value->key.hash & clock->bucket_mask];
+    Cache_Entry *old = atomic_load_explicit(bucket, memory_order_relaxed);
+    while (old != NULL && !dnskey_match(&old->value->key, &value->key))
+        old = atomic_load_explicit(&old->next, memory_order_relaxed);
+    if (old != NULL) {
+        entry->slot = old->slot;
+        clock_unlink(clock, old);
+        epoch_retire(&free_entry, old);
+    } else if (clock->size < clock->capacity) {
+        entry->slot = clock->size++;
+    } else {
+        entry->slot = clock_evict(clock);
+    }
+    clock->ring[entry->slot] = entry;
+    // 缓存项的内容在发布前写完，读者以acquire读到桶头后即可看到
+    atomic_init(&entry->next, atomic_load_explicit(bucket, memory_order_relaxed));
+    atomic_store_explicit(bucket, entry, memory_order_release);
+}
+
+/**
+ * @brief 不加锁地在CLOCK策略的哈希表中查询
+ * @details 读者只在访问位未设置时写一次访问位，不移动元素，也不写其他共享数据
+ * @param clock 哈希表与时钟环
+ * @param key 查询的规范键
+ * @param hit 命中时输出命中的位置
+ * @return 命中时返回副本，否则返回NULL
+ */
+static RBTreeValue *clock_query(Cache_Clock *clock, const DNSKey *key, Cache_Hit *hit) {
+    time_t now = time(NULL);
+    RBTreeValue *value = NULL;
+    epoch_enter();
+    Cache_Entry *entry = atomic_load_explicit(&clock->buckets[key->hash & clock->bucket_mask], memory_order_acquire);
+    while (entry != NULL && !dnskey_match(&entry->value->key, key))
+        entry = atomic_load_explicit(&entry->next, memory_order_acquire);
+    if (entry != NULL && !entry_expired(entry, now)) {
+        if (!atomic_load_explicit(&entry->referenced, memory_order_relaxed))
+            atomic_store_explicit(&entry->referenced, true, memory_order_relaxed);
+        value = copy_value(entry->value);
+        *hit = entry->expire_time == -1 ? CACHE_HIT_HOSTS : CACHE_HIT_LRU;
+    }
+    epoch_exit();
+    return value;
+}
+
+/**
+ * @brief 生成屏蔽的回答，与hosts中地址为0.0.0.0的记录相同，由查询池回复NXDOMAIN
+ * @param que 查询的问题
+ * @return 回答
+ */
+static RBTreeValue *blocked_value(const DNSQuestion *que) {
+    DNSResourceRecord *rr = (DNSResourceRecord *) calloc(1, sizeof(DNSResourceRecord));
+    RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
+    if (!rr || !value)
+        log_fatal("内存分配错误")
+    rr->name = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
+    rr->rdata = (uint8_t *) calloc(4, sizeof(uint8_t));
+    if (!rr->name || !rr->rdata)
+        log_fatal("内存分配错误")
+    memcpy(rr->name, que->qname, strlen((const char *) que->qname));
+    rr->type = DNS_TYPE_ANY;
+    rr->class = DNS_CLASS_IN;
+    rr->ttl = -1;
+    rr->rdlength = 4;
+    value->rr = rr;
+    value->ancount = 1;
+    value->key = que->key;
+    return value;
+}
+
+/**
+ * @brief 求规范键所在的分片
+ * @param cache 缓存
+ * @param key 规范键
+ * @return 分片
+ * @note 用哈希的高位选分片，低位仍用于分片内的红黑树与频次估计
+ */
+static Cache_Shard *shard_of(Cache *cache, const DNSKey *key) {
+    return &cache->shards[(key->hash >> 40) & cache->shard_mask];
+}
+
+/**
+ * @brief 锁住分片，锁已被其他线程持有时计数
+ * @param shard 缓存分片
+ */
+static void shard_lock(Cache_Shard *shard) {
+    if (uv_mutex_trylock(&shard->lock) != 0) {
+        metrics_count(METRIC_CACHE_LOCK_CONTENDED);
+        uv_mutex_lock(&shard->lock);
+    }
+}
+
+/**
+ * @brief 按分片的淘汰策略插入LRU链表或CLOCK哈希表
+ * @note 调用者持有分片的锁
+ * @param shard 缓存分片
+ * @param value 缓存的值，由缓存接管
+ * @param expire_time 过期时间
+ */
+static void shard_insert(Cache_Shard *shard, RBTreeValue *value, time_t expire_time) {
+    if (shard->policy == CACHE_POLICY_CLOCK) {
+        clock_insert(&shard->clock, value, expire_time);
+        return;
+    }
+    DNSRRLinkList *node = new_linklist();
+    node->value = value;
+    node->expire_time = expire_time;
+    lru_insert(shard, node);
+}
+
 /**
  * @brief 将DNS报文中的资源记录插入到缓存中
+ * @details 资源记录在加锁之前复制，锁内只修改链表、哈希表与红黑树
  * @param cache
  * @param msg
  */
 static void cache_insert(Cache *cache, const DNSMessage *msg) {
     if (msg->rr == NULL) return;
     log_debug("插入缓存")
+    metrics_count(METRIC_CACHE_INSERTS);
 
     RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
     if (!value)
@@ -63,99 +394,175 @@ static void cache_insert(Cache *cache, const DNSMessage *msg) {
     value->ancount = msg->header->ancount;
     value->nscount = msg->header->nscount;
     value->arcount = msg->header->arcount;
-    value->type = msg->que->qtype;
-    DNSRRLinkList *new_list_node = new_linklist();
-    new_list_node->value = value;
-    new_list_node->expire_time = time(NULL) + get_min_ttl(value->rr); // 计算过期时间
-    if (cache->size == CACHE_SIZE) { // cache已满
-        cache->head->delete_next(cache->head); // 去除最久未访问的元素
-        --cache->size;
-    }
-    log_debug("插入cache")
-    cache->tail->insert(cache->tail, new_list_node);
-    cache->tail = cache->tail->next;
-    ++cache->size;
+    value->key = msg->que->key;
+    time_t expire_time = time(NULL) + get_min_ttl(value->rr); // 计算过期时间
 
-    value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
-    if (!value)
-        log_fatal("内存分配错误")
-    value->rr = copy_dnsrr(msg->rr);
-    value->ancount = msg->header->ancount;
-    value->nscount = msg->header->nscount;
-    value->arcount = msg->header->arcount;
-    value->type = msg->que->qtype;
-    new_list_node = new_linklist();
-    new_list_node->value = value;
-    new_list_node->expire_time = time(NULL) + get_min_ttl(value->rr);
-    cache->tree->insert(cache->tree, BKDRHash(value->rr->name), new_list_node); // 插入红黑树
+    DNSRRLinkList *tree_node = new_linklist();
+    tree_node->value = copy_value(value);
+    tree_node->expire_time = expire_time;
+
+    Cache_Shard *shard = shard_of(cache, &msg->que->key);
+    shard_lock(shard);
+    log_debug("插入cache")
+    shard->tree->insert(shard->tree, value->key.hash, tree_node); // 插入红黑树
+    shard_insert(shard, value, expire_time);
+    uv_mutex_unlock(&shard->lock);
 }
 
 /**
  * @brief 查询缓存
  * @param cache
  * @param que
- * @return 查询结果
+ * @param hit 命中的位置，hosts中的记录永不过期
+ * @return 查询结果，是缓存中资源记录的副本
  */
-static RBTreeValue *cache_query(Cache *cache, const DNSQuestion *que) {
+static RBTreeValue *cache_query(Cache *cache, const DNSQuestion *que, Cache_Hit *hit) {
     log_info("查询cache")
-    DNSRRLinkList *list = cache->head->query_next(cache->head, que->qname, que->qtype);
-    if (list != NULL) {
-        log_info("cache命中")
-        DNSRRLinkList *temp = list->next;
-        if (temp != cache->tail) { // 将命中的元素移动到链表尾部
-            list->next = list->next->next;
-            cache->tail->insert(cache->tail, temp);
-            cache->tail = cache->tail->next;
+    RBTreeValue *value = NULL;
+    epoch_enter();
+    const Hosts_Index *hosts = atomic_load_explicit(&cache->hosts, memory_order_acquire);
+    const Hosts_Entry *found = hosts->find(hosts, &que->key);
+    bool suffix = false, listed = false; // 是否被后缀规则、屏蔽列表屏蔽
+    if (found != NULL)
+        value = hosts_entry_value(found);
+    else
+        suffix = hosts->suffixes->match(hosts->suffixes, &que->key);
+    epoch_exit();
+    if (value != NULL) {
+        log_info("hosts命中")
+        *hit = CACHE_HIT_HOSTS;
+        return value;
+    }
+    if (!suffix && cache->blocklist != NULL) {
+        listed = cache->blocklist->contains(cache->blocklist, &que->key);
+        if (!listed)
+            listed = suffix = cache->blocklist->suffixes->match(cache->blocklist->suffixes, &que->key);
+    }
+    if (suffix || listed) {
+        log_info("屏蔽命中")
+        if (listed)
+            metrics_count(METRIC_BLOCKLIST_HITS);
+        if (suffix)
+            metrics_count(METRIC_SUFFIX_RULE_HITS);
+        *hit = CACHE_HIT_HOSTS;
+        return blocked_value(que);
+    }
+
+    Cache_Shard *shard = shard_of(cache, &que->key);
+    if (shard->policy == CACHE_POLICY_CLOCK) {
+        value = clock_query(&shard->clock, &que->key, hit);
+        if (value != NULL) {
+            log_info("cache命中")
+            return value;
         }
+    }
 
-        RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
-        if (!value)
-            log_fatal("内存分配错误")
-        memcpy(value, temp->value, sizeof(RBTreeValue));
-        value->rr = copy_dnsrr(temp->value->rr);
-        return value;
+    shard_lock(shard);
+    if (shard->policy != CACHE_POLICY_CLOCK) {
+        if (shard->sketch != NULL)
+            shard->sketch->increment(shard->sketch, que->key.hash);
+        Cache_Segment *seg;
+        DNSRRLinkList *list = lru_find(shard, &que->key, &seg);
+        if (list != NULL) {
+            log_info("cache命中")
+            DNSRRLinkList *temp = lru_touch(shard, seg, list); // 将命中的元素移动到链表尾部
+            value = copy_value(temp->value);
+            *hit = temp->expire_time == -1 ? CACHE_HIT_HOSTS : CACHE_HIT_LRU;
+            uv_mutex_unlock(&shard->lock);
+            return value;
+        }
     }
 
     log_info("cache未命中") // 红黑树查询
-    list = cache->tree->query(cache->tree, BKDRHash(que->qname));
+    DNSRRLinkList *list = shard->tree->query(shard->tree, que->key.hash);
     while (list != NULL) {
-        if (strcmp(list->value->rr->name, que->qname) == 0 &&
-            (list->value->type == 255 || list->value->type == que->qtype)) {
+        if (dnskey_match(&list->value->key, &que->key)) {
             log_info("红黑树命中")
-            RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
-            if (!value)
-                log_fatal("内存分配错误")
-            memcpy(value, list->value, sizeof(RBTreeValue));
-            value->rr = copy_dnsrr(list->value->rr);
-            DNSRRLinkList *new_list_node = new_linklist();
-            new_list_node->value = value;
-            new_list_node->expire_time = list->expire_time;
-            if (cache->size == CACHE_SIZE) {
-                cache->head->delete_next(cache->head); // 去除最久未访问的元素
-                --cache->size;
-            }
-            cache->tail->insert(cache->tail, new_list_node);
-            cache->tail = cache->tail->next;
-            ++cache->size;
-
-            value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
-            if (!value)
-                log_fatal("内存分配错误")
-            memcpy(value, list->value, sizeof(RBTreeValue));
-            value->rr = copy_dnsrr(list->value->rr);
+            shard_insert(shard, copy_value(list->value), list->expire_time);
+            value = copy_value(list->value);
+            *hit = list->expire_time == -1 ? CACHE_HIT_HOSTS : CACHE_HIT_TREE;
+            uv_mutex_unlock(&shard->lock);
             return value;
         }
         list = list->next;
     }
+    uv_mutex_unlock(&shard->lock);
     log_info("红黑树未命中")
+    *hit = CACHE_MISS;
     return NULL;
 }
 
+static void free_hosts(void *ptr) {
+    destroy_hosts_index((Hosts_Index *) ptr);
+}
+
+static void cache_set_hosts(Cache *cache, Hosts_Index *hosts) {
+    Hosts_Index *old = atomic_exchange_explicit(&cache->hosts, hosts, memory_order_acq_rel);
+    epoch_retire(&free_hosts, old);
+}
+
+/**
+ * @brief 导出缓存的指标，各分片的元素数合计
+ * @param buf 缓冲区
+ * @param data 缓存
+ */
+static void collect_cache(Metrics_Buffer *buf, void *data) {
+    Cache *cache = (Cache *) data;
+    int entries = 0;
+    for (unsigned i = 0; i <= cache->shard_mask; ++i) {
+        Cache_Shard *shard = &cache->shards[i];
+        uv_mutex_lock(&shard->lock);
+        entries += shard->window.size + shard->probation.size + shard->protected.size + shard->clock.size;
+        uv_mutex_unlock(&shard->lock);
+    }
+    epoch_enter();
+    int hosts = atomic_load_explicit(&cache->hosts, memory_order_acquire)->count;
+    epoch_exit();
+    metrics_printf(buf, "# HELP nodns_cache_lru_entries Entries in the cache LRU list\n"
+                        "# TYPE nodns_cache_lru_entries gauge\nnodns_cache_lru_entries %d\n"
+                        "# HELP nodns_cache_shards Number of cache shards\n"
+                        "# TYPE nodns_cache_shards gauge\nnodns_cache_shards %u\n"
+                        "# HELP nodns_hosts_entries Entries in the current hosts index\n"
+                        "# TYPE nodns_hosts_entries gauge\nnodns_hosts_entries %d\n"
+                        "# HELP nodns_blocklist_entries Names in the compiled blocklist\n"
+                        "# TYPE nodns_blocklist_entries gauge\nnodns_blocklist_entries %u\n",
+                   entries, cache->shard_mask + 1, hosts, cache->blocklist ? cache->blocklist->header->count : 0);
+}
+
+/**
+ * @brief 初始化缓存分片
+ * @param shard 缓存分片
+ * @param capacity 分片内LRU链表的容量
+ */
+static void shard_init(Cache_Shard *shard, int capacity) {
+    if (uv_mutex_init(&shard->lock) != 0)
+        log_fatal("缓存分片的锁初始化失败")
+    shard->tree = new_rbtree();
+    shard->policy = CACHE_POLICY;
+    if (shard->policy == CACHE_POLICY_TINYLFU) {
+        // 窗口占容量的1%，其余为分段LRU，其中80%为保护段
+        int window = capacity / 100 > 0 ? capacity / 100 : 1, main = capacity - window;
+        segment_init(&shard->window, window);
+        segment_init(&shard->protected, main * 4 / 5);
+        segment_init(&shard->probation, main - main * 4 / 5);
+        shard->sketch = new_frequency_sketch(capacity);
+    } else if (shard->policy == CACHE_POLICY_CLOCK) {
+        segment_init(&shard->window, 0);
+        segment_init(&shard->probation, 0);
+        segment_init(&shard->protected, 0);
+        shard->sketch = NULL;
+        clock_init(&shard->clock, capacity);
+    } else {
+        segment_init(&shard->window, capacity);
+        segment_init(&shard->probation, 0);
+        segment_init(&shard->protected, 0);
+        shard->sketch = NULL;
+    }
+}
+
 /**
  * @brief 初始化缓存
- * @details 读取hosts文件将其转换为DNS资源记录，插入红黑树以便查询，插入链表以便删除
- * 链表中的元素按照过期时间排序，最先过期的元素在链表头部，最后过期的元素在链表尾部，每次插入新元素时，将其插入链表尾部
- * 每次查询时，从链表头部开始查询，如果过期则删除，如果未过期则将其移动到链表尾部
+ * @details 读取hosts文件建立hosts索引；LRU链表的总容量平均分给各分片
  * @param hosts_file
  * @return
  */
@@ -164,58 +571,19 @@ Cache *new_cache(FILE *hosts_file) {
     Cache *cache = (Cache *) malloc(sizeof(Cache));
     if (!cache)
         log_fatal("内存分配错误")
-    RBTree *tree = new_rbtree();
-    if (hosts_file != NULL) {
-        char ip[DNS_RR_NAME_MAX_SIZE], domain[DNS_RR_NAME_MAX_SIZE];
-        while (fscanf(hosts_file, "%s %s", domain, ip) != EOF) {
-            DNSResourceRecord *rr = (DNSResourceRecord *) calloc(1, sizeof(DNSResourceRecord));
-            if (!rr)
-                log_fatal("内存分配错误")
-            rr->name = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
-            if (!rr->name)
-                log_fatal("内存分配错误")
-            memcpy(rr->name, domain, strlen(domain) + 1);
-            rr->name[strlen(domain) + 1] = 0;
-            rr->name[strlen(domain)] = '.';
-            rr->class = DNS_CLASS_IN;
-            rr->ttl = -1; // 永久有效
-            if (strchr(ip, '.') != NULL) { // ipv4
-                if (strcmp(ip, "0.0.0.0") == 0)
-                    rr->type = 255;
-                else
-                    rr->type = DNS_TYPE_A;
-                rr->rdlength = 4;
-                rr->rdata = (uint8_t *) calloc(4, sizeof(uint8_t));
-                if (!rr->rdata) {
-                    log_fatal("内存分配错误")
-                    exit(1);
-                }
-                uv_inet_pton(AF_INET, ip, rr->rdata); // 将点分十进制ip地址转换为二进制
-            } else { // ipv6
-                rr->type = DNS_TYPE_AAAA;
-                rr->rdlength = 16;
-                rr->rdata = (uint8_t *) calloc(16, sizeof(uint8_t));
-                if (!rr->rdata)
-                    log_fatal("内存分配错误")
-                uv_inet_pton(AF_INET6, ip, rr->rdata);
-            }
-            RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
-            if (!value)
-                log_fatal("内存分配错误")
-            value->rr = rr;
-            value->ancount = 1;
-            value->type = rr->type;
-            DNSRRLinkList *list = new_linklist();
-            list->value = value;
-            list->expire_time = -1;
-            tree->insert(tree, BKDRHash(rr->name), list);
-        }
-    }
+    cache->shard_mask = CACHE_SHARDS - 1;
+    cache->shards = (Cache_Shard *) calloc(CACHE_SHARDS, sizeof(Cache_Shard));
+    if (!cache->shards)
+        log_fatal("内存分配错误")
+    int capacity = (CACHE_SIZE + CACHE_SHARDS - 1) / CACHE_SHARDS;
+    for (int i = 0; i < CACHE_SHARDS; ++i)
+        shard_init(&cache->shards[i], capacity);
+    atomic_init(&cache->hosts, new_hosts_index(hosts_file));
+    cache->blocklist = NULL;
 
-    cache->tree = tree;
-    cache->head = cache->tail = new_linklist();
-    cache->size = 0;
     cache->query = &cache_query;
     cache->insert = &cache_insert;
+    cache->set_hosts = &cache_set_hosts;
+    metrics_register(&collect_cache, cache);
     return cache;
-}
\ No newline at end of file
+}
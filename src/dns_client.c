@@ -12,10 +12,10 @@
 #include "../include/dns_conversion.h"
 #include "../include/dns_print.h"
 #include "../include/query_pool.h"
+#include "../include/dns_metrics.h"
+#include "../include/loop_monitor.h"
+#include "../include/dns_trace.h"
 
-static uv_udp_t client_socket; // 客户端与远程通信的socket
-static struct sockaddr_in local_addr; // 本地地址
-static struct sockaddr send_addr; // 远程服务器地址
 extern Query_Pool *qpool; // 查询池
 
 /**
@@ -44,6 +44,7 @@ static void alloc_buffer(uv_handle_t *handle, size_t suggested_size, uv_buf_t *b
  * @param flags 标志
  */
 static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const struct sockaddr *addr, unsigned flags) {
+    loop_monitor_callback();
     if (nread < 0) { // 传输错误
         if (buf->base)
             free(buf->base);
@@ -56,12 +57,21 @@ static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const
         return;
     }
     log_info("从服务器接收到消息")
+    metrics_count(METRIC_UPSTREAM_RESPONSES);
+    ++((Upstream_Group *) handle->data)->responses;
     print_dns_string(buf->base, nread);
     DNSMessage *msg = (DNSMessage *) calloc(1, sizeof(DNSMessage));
     if (!msg)
         log_fatal("内存分配错误")
-    string_to_dnsmsg(msg, buf->base);
-    print_dns_message(msg);
+    if (!string_to_dnsmsg(msg, buf->base) || msg->que == NULL) {
+        log_error("DNS回复报文格式错误")
+        metrics_count(METRIC_MALFORMED_RESPONSES);
+        destroy_dnsmsg(msg);
+        free(buf->base);
+        return;
+    }
+    print_dns_message(buf->base, nread);
+    dns_trace(upstream__receive, (int) msg->header->id, msg->que->qname, uv_hrtime(), (int) msg->header->rcode);
     qpool->finish(qpool, msg);
     destroy_dnsmsg(msg);
     if (buf->base)
@@ -75,6 +85,7 @@ static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const
  * @param status 发送状态
  */
 static void on_send(uv_udp_send_t *req, int status) {
+    loop_monitor_callback();
     free(*(char **) req->data);
     free(req->data);
     free(req);
@@ -82,24 +93,30 @@ static void on_send(uv_udp_send_t *req, int status) {
         log_error("发送状态异常 %d", status)
 }
 
-void init_client(uv_loop_t *loop) {
+void init_client(uv_loop_t *loop, Forward_Table *table) {
     log_info("启动client")
-    uv_udp_init(loop, &client_socket);
-    // 设置本地地址，设置为 "0.0.0.0" 的作用是将客户端的 UDP socket 绑定到所有可用的网络接口上。
-    uv_ip4_addr("0.0.0.0", CLIENT_PORT, &local_addr);
-    // 绑定本地地址，启用端口复用，允许多个进程监听同一端口
-    uv_udp_bind(&client_socket, (const struct sockaddr *) &local_addr, UV_UDP_REUSEADDR);
-    uv_udp_set_broadcast(&client_socket, 1); // 允许发送广播
-    uv_ip4_addr(REMOTE_HOST, 53, (struct sockaddr_in *) &send_addr); // 设置远程服务器地址
-    uv_udp_recv_start(&client_socket, alloc_buffer, on_read); // 开始接收
+    for (int i = 0; i < table->count; ++i) {
+        Upstream_Group *group = &table->groups[i];
+        uv_udp_init(loop, &group->socket);
+        group->socket.data = group;
+        // 设置本地地址，设置为 "0.0.0.0" 的作用是将客户端的 UDP socket 绑定到所有可用的网络接口上。
+        // --client_port只用于默认组，其他组使用系统分配的端口
+        struct sockaddr_in local_addr;
+        uv_ip4_addr("0.0.0.0", i == 0 ? CLIENT_PORT : 0, &local_addr);
+        // 绑定本地地址，启用端口复用，允许多个进程监听同一端口
+        uv_udp_bind(&group->socket, (const struct sockaddr *) &local_addr, UV_UDP_REUSEADDR);
+        uv_udp_set_broadcast(&group->socket, 1); // 允许发送广播
+        uv_udp_recv_start(&group->socket, alloc_buffer, on_read); // 开始接收
+    }
 }
 
 /**
  * @brief 向远程发送报文
  *
+ * @param group 上游服务器组
  * @param msg
  */
-void send_to_remote(const DNSMessage *msg) {
+void send_to_remote(Upstream_Group *group, const DNSMessage *msg) {
     char *str = (char *) calloc(DNS_STRING_MAX_SIZE, sizeof(char));
     if (!str)
         log_fatal("内存分配错误")
@@ -114,8 +131,13 @@ void send_to_remote(const DNSMessage *msg) {
     *(char **) (req->data) = send_buf.base; // 将缓冲区的地址存入data
 
     log_info("向服务器发送消息")
-    print_dns_message(msg);
+    metrics_count(METRIC_UPSTREAM_QUERIES);
+    ++group->queries;
+    dns_trace(upstream__send, (int) msg->header->id, msg->que->qname, uv_hrtime());
+    print_dns_message(send_buf.base, len);
     print_dns_string(send_buf.base, len);
-    uv_udp_send(req, &client_socket, &send_buf, 1, &send_addr, on_send); // 发送报文
+    const struct sockaddr *send_addr = (const struct sockaddr *) &group->servers[group->next_server];
+    group->next_server = (group->next_server + 1) % group->server_count;
+    uv_udp_send(req, &group->socket, &send_buf, 1, send_addr, on_send); // 发送报文
     free(str);
 }
\ No newline at end of file
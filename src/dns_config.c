@@ -11,13 +11,35 @@
 #include <stdlib.h>
 #include <uv.h>
 
+#include "../include/dns_cache.h"
 #include "../include/dns_log.h"
+#include "../include/query_log.h"
 
 char * REMOTE_HOST = "10.3.9.44";
+int REMOTE_PORT = 53;
+int REMOTE_TIMEOUT = 5000;
+char ** FORWARD_RULES = NULL;
+int FORWARD_RULE_COUNT = 0;
+char ** ZONE_SPECS = NULL;
+int ZONE_SPEC_COUNT = 0;
+int LISTEN_PORT = 53;
 int LOG_MASK = 15;
 int CLIENT_PORT = 0;
 char * HOSTS_PATH = "../hosts.txt";
+char * BLOCKLIST_PATH = NULL;
+char * LOCAL_ZONES = NULL;
+int CACHE_SIZE = 300;
+int CACHE_POLICY = CACHE_POLICY_LRU;
+int CACHE_SHARDS = 1;
 char * LOG_PATH = NULL;
+char * QLOG_PATH = NULL;
+int QLOG_SAMPLE = 1;
+int QLOG_FILE_SIZE = 64;
+int QLOG_FILES = 8;
+int METRICS_PORT = 0;
+int STALL_THRESHOLD = 200;
+int CLIENT_RATE = 0;
+int TRACE_FORCE = 0;
 
 void init_config(int argc, char * const * argv)
 {
@@ -44,6 +66,34 @@ void init_config(int argc, char * const * argv)
             REMOTE_HOST = argv[i + 1];
             i += 2;
         }
+        else if (strcmp(field, "remote_port") == 0)
+        {
+            int port = strtol(argv[i + 1], NULL, 10);
+            if (port < 1 || port > 65535)log_fatal("命令行参数有误，端口必须是1-65535的整数")
+            REMOTE_PORT = port;
+            i += 2;
+        }
+        else if (strcmp(field, "remote_timeout") == 0)
+        {
+            int timeout = strtol(argv[i + 1], NULL, 10);
+            if (timeout < 1 || timeout > 60000)log_fatal("命令行参数有误，超时必须是1-60000的整数（毫秒）")
+            REMOTE_TIMEOUT = timeout;
+            i += 2;
+        }
+        else if (strcmp(field, "forward") == 0) // 可以出现多次
+        {
+            FORWARD_RULES = (char **) realloc(FORWARD_RULES, (FORWARD_RULE_COUNT + 1) * sizeof(char *));
+            if (!FORWARD_RULES)log_fatal("分配内存失败")
+            FORWARD_RULES[FORWARD_RULE_COUNT++] = argv[i + 1];
+            i += 2;
+        }
+        else if (strcmp(field, "listen_port") == 0)
+        {
+            int port = strtol(argv[i + 1], NULL, 10);
+            if (port < 1 || port > 65535)log_fatal("命令行参数有误，端口必须是1-65535的整数")
+            LISTEN_PORT = port;
+            i += 2;
+        }
         else if (strcmp(field, "log_mask") == 0)
         {
             int mask = strtol(argv[i + 1], NULL, 10);
@@ -63,11 +113,107 @@ void init_config(int argc, char * const * argv)
             HOSTS_PATH = argv[i + 1];
             i += 2;
         }
+        else if (strcmp(field, "blocklist_path") == 0)
+        {
+            BLOCKLIST_PATH = argv[i + 1];
+            i += 2;
+        }
+        else if (strcmp(field, "zone") == 0) // 可以出现多次
+        {
+            ZONE_SPECS = (char **) realloc(ZONE_SPECS, (ZONE_SPEC_COUNT + 1) * sizeof(char *));
+            if (!ZONE_SPECS)log_fatal("分配内存失败")
+            ZONE_SPECS[ZONE_SPEC_COUNT++] = argv[i + 1];
+            i += 2;
+        }
+        else if (strcmp(field, "local_zones") == 0)
+        {
+            LOCAL_ZONES = argv[i + 1];
+            i += 2;
+        }
+        else if (strcmp(field, "cache_size") == 0)
+        {
+            int size = strtol(argv[i + 1], NULL, 10);
+            if (size < 1 || size > 10000000)log_fatal("命令行参数有误，缓存容量必须是1-10000000的整数")
+            CACHE_SIZE = size;
+            i += 2;
+        }
+        else if (strcmp(field, "cache_policy") == 0)
+        {
+            if (strcmp(argv[i + 1], "lru") == 0)
+                CACHE_POLICY = CACHE_POLICY_LRU;
+            else if (strcmp(argv[i + 1], "tinylfu") == 0)
+                CACHE_POLICY = CACHE_POLICY_TINYLFU;
+            else if (strcmp(argv[i + 1], "clock") == 0)
+                CACHE_POLICY = CACHE_POLICY_CLOCK;
+            else log_fatal("命令行参数有误，缓存策略必须是lru、tinylfu或clock")
+            i += 2;
+        }
+        else if (strcmp(field, "cache_shards") == 0)
+        {
+            int shards = strtol(argv[i + 1], NULL, 10);
+            if (shards < 1 || shards > 1024 || (shards & (shards - 1)) != 0)
+                log_fatal("命令行参数有误，缓存分片数必须是1-1024之间的2的幂")
+            CACHE_SHARDS = shards;
+            i += 2;
+        }
         else if (strcmp(field, "log_path") == 0)
         {
             LOG_PATH = argv[i + 1];
             i += 2;
         }
+        else if (strcmp(field, "qlog_path") == 0)
+        {
+            QLOG_PATH = argv[i + 1];
+            i += 2;
+        }
+        else if (strcmp(field, "qlog_sample") == 0)
+        {
+            int sample = strtol(argv[i + 1], NULL, 10);
+            if (sample < 1)log_fatal("命令行参数有误，采样率必须是正整数")
+            QLOG_SAMPLE = sample;
+            i += 2;
+        }
+        else if (strcmp(field, "qlog_size") == 0)
+        {
+            int size = strtol(argv[i + 1], NULL, 10);
+            if (size < 1 || size > 4096)log_fatal("命令行参数有误，文件大小必须是1-4096的整数（MB）")
+            QLOG_FILE_SIZE = size;
+            i += 2;
+        }
+        else if (strcmp(field, "qlog_files") == 0)
+        {
+            int files = strtol(argv[i + 1], NULL, 10);
+            if (files < QLOG_FILES_MIN || files > QLOG_FILES_MAX)
+                log_fatal("命令行参数有误，文件数必须是2-32的整数")
+            QLOG_FILES = files;
+            i += 2;
+        }
+        else if (strcmp(field, "metrics_port") == 0)
+        {
+            int port = strtol(argv[i + 1], NULL, 10);
+            if (port < 1 || port > 65535)log_fatal("命令行参数有误，端口必须是1-65535的整数")
+            METRICS_PORT = port;
+            i += 2;
+        }
+        else if (strcmp(field, "stall_ms") == 0)
+        {
+            int threshold = strtol(argv[i + 1], NULL, 10);
+            if (threshold < 0 || threshold > 60000)log_fatal("命令行参数有误，卡顿阈值必须是0-60000的整数（毫秒）")
+            STALL_THRESHOLD = threshold;
+            i += 2;
+        }
+        else if (strcmp(field, "client_rate") == 0)
+        {
+            int rate = strtol(argv[i + 1], NULL, 10);
+            if (rate < 0 || rate > 100000)log_fatal("命令行参数有误，请求方限速必须是0-100000的整数（每秒查询数）")
+            CLIENT_RATE = rate;
+            i += 2;
+        }
+        else if (strcmp(field, "trace_force") == 0)
+        {
+            TRACE_FORCE = strtol(argv[i + 1], NULL, 10) != 0;
+            i += 2;
+        }
         else log_fatal("命令行参数有误，不合法的参数标志")
     }
 }
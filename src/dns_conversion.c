@@ -10,7 +10,9 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include "../include/dns_key.h"
 #include "../include/dns_log.h"
+#include "../include/dns_name.h"
 
 /**
  * @brief 从字节流中读入一个大端法表示的16位数字（网络字节序是大端法）
@@ -44,29 +46,43 @@ static uint32_t read_uint32(const char *pstring, unsigned *offset) {
  * @param pname NAME字段
  * @param pstring 字节流起点
  * @param offset 字节流偏移量
- * @return NAME字段总长度
- * @note 读入后，偏移量增加到NAME字段后一个位置
+ * @return 点分形式NAME字段的长度（含结尾的0）；如果NAME字段不合法，返回0
+ * @note 读入后，偏移量增加到NAME字段后一个位置；标签长度、总长度与压缩指针均经过校验，压缩指针只能指向更靠前的位置
  */
 static unsigned string_to_rrname(uint8_t *pname, const char *pstring, unsigned *offset) {
-    unsigned start_offset = *offset;
+    const uint8_t *p = (const uint8_t *) pstring;
+    uint8_t *start = pname;
+    unsigned pos = *offset;
+    unsigned limit = *offset; // 压缩指针必须指向limit之前，保证不会成环
+    bool jumped = false;
     while (true) {
-        if ((*(pstring + *offset) >> 6) & 0x3) // RFC1035 4.1.4. Message compression
+        uint8_t cur_length = p[pos];
+        if ((cur_length >> 6) & 0x3) // RFC1035 4.1.4. Message compression
         {
-            unsigned new_offset = read_uint16(pstring, offset) & 0x3fff;
-            return *offset - start_offset - 2 + string_to_rrname(pname, pstring, &new_offset);
+            unsigned new_offset = ((cur_length & 0x3f) << 8) | p[pos + 1];
+            if (!jumped) {
+                *offset = pos + 2;
+                jumped = true;
+            }
+            if (new_offset >= limit)
+                return 0;
+            limit = pos = new_offset;
+            continue;
         }
-        if (!*(pstring + *offset)) // 处理到0，表示NAME字段的结束
+        if (!cur_length) // 处理到0，表示NAME字段的结束
         {
-            ++*offset;
+            if (!jumped)
+                *offset = pos + 1;
             *pname = 0;
-            return *offset - start_offset;
+            return pname - start + 1;
         }
-        int cur_length = (int) *(pstring + *offset);
-        ++*offset;
-        memcpy(pname, pstring + *offset, cur_length);
+        if (cur_length > DNS_NAME_LABEL_MAX_SIZE || pname - start + cur_length + 1 > DNS_NAME_TEXT_MAX_SIZE)
+            return 0;
+        if (!dnsname->copy_label(pname, p + pos + 1, cur_length))
+            return 0;
         pname += cur_length;
-        *offset += cur_length;
         *pname++ = '.';
+        pos += cur_length + 1;
     }
 }
 
@@ -99,15 +115,19 @@ static void string_to_dnshead(DNSHeader *phead, const char *pstring, unsigned *o
  * @param pque Question Section
  * @param pstring 字节流起点
  * @param offset 字节流偏移量
- * @note 读入后，偏移量增加到Question Section后一个位置；为QNAME字段分配了空间
+ * @return 如果QNAME字段合法，返回true
+ * @note 读入后，偏移量增加到Question Section后一个位置；为QNAME字段分配了空间，并计算规范键
  */
-static void string_to_dnsque(DNSQuestion *pque, const char *pstring, unsigned *offset) {
+static bool string_to_dnsque(DNSQuestion *pque, const char *pstring, unsigned *offset) {
     pque->qname = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
     if (!pque->qname)
         log_fatal("内存分配错误")
-    string_to_rrname(pque->qname, pstring, offset);
+    if (!string_to_rrname(pque->qname, pstring, offset))
+        return false;
     pque->qtype = read_uint16(pstring, offset);
     pque->qclass = read_uint16(pstring, offset);
+    dnskey_init(&pque->key, pque->qname, pque->qtype, pque->qclass); // 每个报文只计算一次规范键
+    return true;
 }
 
 /**
@@ -115,22 +135,28 @@ static void string_to_dnsque(DNSQuestion *pque, const char *pstring, unsigned *o
  * @param prr Resource Record
  * @param pstring 字节流起点
  * @param offset 字节流偏移量
+ * @return 如果其中的域名均合法，返回true
  * @note 读入后，偏移量增加到Resource Record后一个位置；为NAME字段和RDATA字段分配了空间
  */
-static void string_to_dnsrr(DNSResourceRecord *prr, const char *pstring, unsigned *offset) {
+static bool string_to_dnsrr(DNSResourceRecord *prr, const char *pstring, unsigned *offset) {
     prr->name = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
     if (!prr->name)
         log_fatal("内存分配错误")
-    string_to_rrname(prr->name, pstring, offset);
+    if (!string_to_rrname(prr->name, pstring, offset))
+        return false;
     prr->type = read_uint16(pstring, offset);
     prr->class = read_uint16(pstring, offset);
     prr->ttl = read_uint32(pstring, offset);
     prr->rdlength = read_uint16(pstring, offset);
-    if (prr->type == DNS_TYPE_CNAME || prr->type == DNS_TYPE_NS) { // CNAME和NS的RDATA是一个域名
+    if (prr->type == DNS_TYPE_CNAME || prr->type == DNS_TYPE_NS || prr->type == DNS_TYPE_PTR) { // CNAME、NS和PTR的RDATA是一个域名
         uint8_t *temp = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
         if (!temp)
             log_fatal("内存分配错误")
         prr->rdlength = string_to_rrname(temp, pstring, offset);
+        if (!prr->rdlength) {
+            free(temp);
+            return false;
+        }
         prr->rdata = (uint8_t *) calloc(prr->rdlength, sizeof(uint8_t));
         if (!prr->rdata)
             log_fatal("内存分配错误")
@@ -142,6 +168,10 @@ static void string_to_dnsrr(DNSResourceRecord *prr, const char *pstring, unsigne
             log_fatal("内存分配错误")
         unsigned temp_offset = *offset + 2;
         prr->rdlength = string_to_rrname(temp, pstring, &temp_offset);
+        if (!prr->rdlength) {
+            free(temp);
+            return false;
+        }
         prr->rdata = (uint8_t *) calloc(prr->rdlength + 2, sizeof(uint8_t));
         if (!prr->rdata)
             log_fatal("内存分配错误")
@@ -154,8 +184,13 @@ static void string_to_dnsrr(DNSResourceRecord *prr, const char *pstring, unsigne
         uint8_t *temp = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
         if (!temp)
             log_fatal("内存分配错误")
-        prr->rdlength = string_to_rrname(temp, pstring, offset);
-        prr->rdlength += string_to_rrname(temp + prr->rdlength, pstring, offset);
+        unsigned mname_length = string_to_rrname(temp, pstring, offset);
+        unsigned rname_length = mname_length ? string_to_rrname(temp + mname_length, pstring, offset) : 0;
+        if (!rname_length) {
+            free(temp);
+            return false;
+        }
+        prr->rdlength = mname_length + rname_length;
         prr->rdata = (uint8_t *) calloc(prr->rdlength + 20, sizeof(uint8_t));
         if (!prr->rdata)
             log_fatal("内存分配错误")
@@ -171,9 +206,10 @@ static void string_to_dnsrr(DNSResourceRecord *prr, const char *pstring, unsigne
         memcpy(prr->rdata, pstring + *offset, prr->rdlength);
         *offset += prr->rdlength;
     }
+    return true;
 }
 
-void string_to_dnsmsg(DNSMessage *pmsg, const char *pstring) {
+bool string_to_dnsmsg(DNSMessage *pmsg, const char *pstring) {
     unsigned offset = 0;
     pmsg->header = (DNSHeader *) calloc(1, sizeof(DNSHeader));
     if (!pmsg->header)
@@ -190,7 +226,8 @@ void string_to_dnsmsg(DNSMessage *pmsg, const char *pstring) {
             que_tail->next = temp;
             que_tail = temp;
         }
-        string_to_dnsque(que_tail, pstring, &offset);
+        if (!string_to_dnsque(que_tail, pstring, &offset))
+            return false;
     }
     int tot = pmsg->header->ancount + pmsg->header->nscount + pmsg->header->arcount;
     DNSResourceRecord *rr_tail = NULL; // Resource Record链表的尾指针
@@ -204,8 +241,10 @@ void string_to_dnsmsg(DNSMessage *pmsg, const char *pstring) {
             rr_tail->next = temp;
             rr_tail = temp;
         }
-        string_to_dnsrr(rr_tail, pstring, &offset);
+        if (!string_to_dnsrr(rr_tail, pstring, &offset))
+            return false;
     }
+    return true;
 }
 
 /**
@@ -242,16 +281,7 @@ static void write_uint32(const char *pstring, unsigned *offset, uint32_t num) {
  * @note 写入后，偏移量增加到NAME字段后一个位置
  */
 static void rrname_to_string(const uint8_t *pname, char *pstring, unsigned *offset) {
-    while (true) {
-        uint8_t *loc = strchr(pname, '.');
-        if (loc == NULL)break;
-        long cur_length = loc - pname;
-        pstring[(*offset)++] = cur_length;
-        memcpy(pstring + *offset, pname, cur_length);
-        pname += cur_length + 1;
-        *offset += cur_length;
-    }
-    pstring[(*offset)++] = 0;
+    *offset += dnsname->to_wire((uint8_t *) pstring + *offset, pname);
 }
 
 /**
@@ -305,7 +335,7 @@ static void dnsrr_to_string(const DNSResourceRecord *prr, char *pstring, unsigne
     write_uint16(pstring, offset, prr->class);
     write_uint32(pstring, offset, prr->ttl);
     write_uint16(pstring, offset, prr->rdlength);
-    if (prr->type == DNS_TYPE_CNAME || prr->type == DNS_TYPE_NS)
+    if (prr->type == DNS_TYPE_CNAME || prr->type == DNS_TYPE_NS || prr->type == DNS_TYPE_PTR)
         rrname_to_string(prr->rdata, pstring, offset);
     else if (prr->type == DNS_TYPE_MX) {
         unsigned temp_offset = *offset + 2;
@@ -371,6 +401,15 @@ void destroy_dnsmsg(DNSMessage *pmsg) {
     free(pmsg);
 }
 
+/**
+ * @brief 复制RDATA时分配的大小，至少为DNS_RR_NAME_MAX_SIZE
+ * @param rr Resource Record
+ * @return 字节数
+ */
+static size_t rdata_size(const DNSResourceRecord *rr) {
+    return rr->rdlength > DNS_RR_NAME_MAX_SIZE ? rr->rdlength : DNS_RR_NAME_MAX_SIZE;
+}
+
 /**
  * @brief 复制一个Question Section
  * @param src 原Question Section
@@ -387,11 +426,11 @@ DNSResourceRecord *copy_dnsrr(const DNSResourceRecord *src) {
     new_rr->name = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
     if (!new_rr->name)
         log_fatal("内存分配错误")
-    memcpy(new_rr->name, old_rr->name, DNS_RR_NAME_MAX_SIZE);
-    new_rr->rdata = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
+    memcpy(new_rr->name, old_rr->name, strlen((const char *) old_rr->name) + 1); // 原域名可能只分配了所需的长度
+    new_rr->rdata = (uint8_t *) calloc(rdata_size(old_rr), sizeof(uint8_t));
     if (!new_rr->rdata)
         log_fatal("内存分配错误")
-    memcpy(new_rr->rdata, old_rr->rdata, DNS_RR_NAME_MAX_SIZE);
+    memcpy(new_rr->rdata, old_rr->rdata, old_rr->rdlength); // 原RDATA只分配了rdlength字节
     // 复制链表的剩余节点
     while (old_rr->next) {
         new_rr->next = (DNSResourceRecord *) calloc(1, sizeof(DNSResourceRecord));
@@ -403,11 +442,11 @@ DNSResourceRecord *copy_dnsrr(const DNSResourceRecord *src) {
         new_rr->name = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
         if (!new_rr->name)
             log_fatal("内存分配错误")
-        memcpy(new_rr->name, old_rr->name, DNS_RR_NAME_MAX_SIZE);
-        new_rr->rdata = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
+        memcpy(new_rr->name, old_rr->name, strlen((const char *) old_rr->name) + 1);
+        new_rr->rdata = (uint8_t *) calloc(rdata_size(old_rr), sizeof(uint8_t));
         if (!new_rr->rdata)
             log_fatal("内存分配错误")
-        memcpy(new_rr->rdata, old_rr->rdata, DNS_RR_NAME_MAX_SIZE);
+        memcpy(new_rr->rdata, old_rr->rdata, old_rr->rdlength);
     }
     return rr;
 }
@@ -0,0 +1,39 @@
+/**
+ * @file      dns_key.c
+ * @brief     规范查询键
+ * @details   本文件的内容是规范查询键的构造、哈希与比较的实现，具体的逐字节处理由域名处理内核完成
+*/
+
+#include "../include/dns_key.h"
+
+#include <string.h>
+
+#include "../include/dns_name.h"
+
+uint64_t dnskey_hash(const uint8_t *name, size_t len) {
+    return dnsname->hash(name, len);
+}
+
+void dnskey_init(DNSKey *key, const uint8_t *name, uint16_t qtype, uint16_t qclass) {
+    size_t len = dnsname->lower(key->name, name, DNS_KEY_NAME_MAX_SIZE - 1);
+    // 哈希与比较按条带读取，将域名之后到条带边界的部分填0
+    size_t padded = (len + DNS_NAME_HASH_STRIDE) & ~(size_t) (DNS_NAME_HASH_STRIDE - 1);
+    memset(key->name + len, 0, padded - len);
+    key->len = len;
+    key->qtype = qtype;
+    key->qclass = qclass;
+    key->hash = dnsname->hash(key->name, len);
+}
+
+bool dnskey_name_equal(const DNSKey *a, const DNSKey *b) {
+    return a->hash == b->hash && a->len == b->len && dnsname->equal(a->name, b->name, a->len);
+}
+
+bool dnskey_equal(const DNSKey *a, const DNSKey *b) {
+    return a->qtype == b->qtype && a->qclass == b->qclass && dnskey_name_equal(a, b);
+}
+
+bool dnskey_match(const DNSKey *entry, const DNSKey *query) {
+    return (entry->qtype == DNS_TYPE_ANY || entry->qtype == query->qtype) &&
+           entry->qclass == query->qclass && dnskey_name_equal(entry, query);
+}
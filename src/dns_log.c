@@ -0,0 +1,290 @@
+/**
+ * @file      dns_log.c
+ * @brief     日志模块
+ * @details   本文件的内容是异步日志的实现。生产者（事件循环线程）只向环形队列写入定长的二进制记录，
+ *            后台线程负责格式化与写文件。队列满时丢弃记录并计数，由后台线程定期报告丢弃的条数。
+*/
+
+#include "../include/dns_log.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <uv.h>
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_WAIT_TIMEOUT 100000000 // 后台线程空闲时最长的等待时间（纳秒）
+
+FILE *log_file;
+
+// 日志记录的种类
+typedef enum {
+    LOG_KIND_TEXT, LOG_KIND_DUMP
+} Log_Kind;
+
+// 定长的日志记录
+typedef struct log_entry {
+    const char *file; // 源文件名
+    const char *fmt; // 格式串，或渲染数据的标题
+    int line; // 行号
+    uint8_t level; // 日志等级
+    uint8_t kind; // 记录的种类
+    uint8_t nargs; // 参数个数
+    union {
+        uint64_t args[LOG_MAX_ARGS]; // 整数参数
+        struct {
+            void (*render)(const uint8_t *, unsigned); // 渲染函数
+            uint8_t *data; // 待渲染的数据
+            unsigned len; // 数据长度
+        } dump;
+    };
+} Log_Entry;
+
+// 单生产者单消费者环形队列
+static struct {
+    _Alignas(64) atomic_size_t head; // 消费者的读位置
+    _Alignas(64) atomic_size_t tail; // 生产者的写位置
+    _Alignas(64) atomic_int sleeping; // 消费者是否在等待
+    atomic_uint_fast64_t dropped; // 丢弃的条数
+    Log_Entry slots[LOG_RING_SIZE];
+} ring;
+
+static bool started; // 后台线程是否已启动
+static uv_thread_t producer; // 生产者线程
+static uv_thread_t consumer; // 后台线程
+static uv_mutex_t mutex;
+static uv_cond_t cond;
+static _Thread_local bool rendering; // 当前线程是否正在渲染数据，渲染期间产生的日志被忽略
+
+static const char *LEVEL_NAME[] = {"[DEBUG]", "[INFO ]", "[ERROR]", "[FATAL]"};
+static const char *LEVEL_COLOR[] = {"\x1b[37m", "\x1b[34m", "\x1b[33m", "\x1b[31m"};
+
+/**
+ * @brief 输出日志的前缀
+ * @param out 输出文件
+ * @param level 日志等级
+ * @param file 源文件名
+ * @param line 行号
+ */
+static void write_prefix(FILE *out, int level, const char *file, int line) {
+    if (out != stderr)
+        fprintf(out, "%s %s:%d ", LEVEL_NAME[level], file, line);
+    else
+        fprintf(out, "%s%s\x1b[36m %s:%d \x1b[0m", LEVEL_COLOR[level], LEVEL_NAME[level], file, line);
+}
+
+/**
+ * @brief 按格式串输出整数参数
+ * @details 逐个解析转换说明，按长度修饰符截断参数后统一以long long输出，避免可变参数的类型不匹配
+ * @param out 输出文件
+ * @param fmt 格式串
+ * @param args 参数
+ * @param nargs 参数个数
+ */
+static void write_format(FILE *out, const char *fmt, const uint64_t *args, int nargs) {
+    int used = 0;
+    while (*fmt) {
+        const char *percent = strchr(fmt, '%');
+        if (percent == NULL) {
+            fputs(fmt, out);
+            return;
+        }
+        fwrite(fmt, 1, percent - fmt, out);
+        if (percent[1] == '%') {
+            fputc('%', out);
+            fmt = percent + 2;
+            continue;
+        }
+        char spec[32] = "%";
+        size_t n = 1;
+        const char *p = percent + 1;
+        while (*p && strchr("-+ #0123456789.", *p) && n < sizeof(spec) - 4)
+            spec[n++] = *p++;
+        int width = 32; // 参数的有效位数
+        while (*p && strchr("hlzjt", *p)) {
+            if (*p == 'h') width = width == 16 ? 8 : 16;
+            else width = 64;
+            ++p;
+        }
+        char conv = *p ? *p++ : 'd';
+        uint64_t value = used < nargs ? args[used++] : 0;
+        if (conv == 'c') {
+            memcpy(spec + n, "c", 2);
+            fprintf(out, spec, (int) value);
+        } else if (conv == 'd' || conv == 'i') {
+            long long v = width == 8 ? (signed char) value : width == 16 ? (short) value :
+                          width == 32 ? (int) value : (long long) value;
+            memcpy(spec + n, "lld", 4);
+            fprintf(out, spec, v);
+        } else if (strchr("ouxX", conv)) {
+            unsigned long long v = width == 8 ? (uint8_t) value : width == 16 ? (uint16_t) value :
+                                   width == 32 ? (uint32_t) value : value;
+            char tail[4] = {'l', 'l', conv, 0};
+            memcpy(spec + n, tail, sizeof(tail));
+            fprintf(out, spec, v);
+        } else if (conv == 'p') {
+            fprintf(out, "%p", (void *) (uintptr_t) value);
+        } else { // 不支持的转换说明，原样输出
+            fwrite(percent, 1, p - percent, out);
+        }
+        fmt = p;
+    }
+}
+
+/**
+ * @brief 输出一条日志记录
+ * @param out 输出文件
+ * @param entry 日志记录
+ */
+static void write_entry(FILE *out, const Log_Entry *entry) {
+    write_prefix(out, entry->level, entry->file, entry->line);
+    if (entry->kind == LOG_KIND_TEXT) {
+        write_format(out, entry->fmt, entry->args, entry->nargs);
+        fputc('\n', out);
+    } else {
+        fputs(entry->fmt, out);
+        fputc('\n', out);
+        rendering = true;
+        entry->dump.render(entry->dump.data, entry->dump.len);
+        rendering = false;
+        free(entry->dump.data);
+    }
+}
+
+/**
+ * @brief 同步输出一条日志记录
+ * @param entry 日志记录
+ * @note 用于后台线程启动前、非生产者线程与FATAL日志
+ */
+static void write_sync(const Log_Entry *entry) {
+    FILE *out = log_file ? log_file : stderr;
+    flockfile(out);
+    write_entry(out, entry);
+    funlockfile(out);
+    fflush(out);
+}
+
+/**
+ * @brief 将记录放入环形队列
+ * @param entry 日志记录
+ * @return 如果队列已满，返回false
+ */
+static bool ring_push(const Log_Entry *entry) {
+    size_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring.head, memory_order_acquire) == LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring.dropped, 1, memory_order_relaxed);
+        return false;
+    }
+    ring.slots[tail & LOG_RING_MASK] = *entry;
+    atomic_store(&ring.tail, tail + 1);
+    if (atomic_load(&ring.sleeping)) { // 只有后台线程在等待时才需要唤醒
+        uv_mutex_lock(&mutex);
+        uv_cond_signal(&cond);
+        uv_mutex_unlock(&mutex);
+    }
+    return true;
+}
+
+/**
+ * @brief 判断当前线程能否写入环形队列
+ * @return 如果是生产者线程且后台线程已启动，返回true
+ */
+static bool is_producer() {
+    uv_thread_t self = uv_thread_self();
+    return started && uv_thread_equal(&self, &producer);
+}
+
+/**
+ * @brief 后台线程，取出并输出日志
+ * @param arg 未使用
+ */
+static void log_thread(void *arg) {
+    uint64_t reported = 0; // 已报告的丢弃条数
+    while (true) {
+        size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+        if (head == tail) {
+            uint64_t dropped = atomic_load_explicit(&ring.dropped, memory_order_relaxed);
+            if (dropped != reported) {
+                Log_Entry entry = {.file = __FILE__, .line = __LINE__, .level = LOG_ERROR, .kind = LOG_KIND_TEXT,
+                        .fmt = "日志队列已满，丢弃了%llu条日志", .nargs = 1, .args = {dropped - reported}};
+                write_entry(log_file, &entry);
+                reported = dropped;
+            }
+            fflush(log_file);
+            uv_mutex_lock(&mutex);
+            atomic_store(&ring.sleeping, 1);
+            if (atomic_load(&ring.tail) == head)
+                uv_cond_timedwait(&cond, &mutex, LOG_WAIT_TIMEOUT);
+            atomic_store(&ring.sleeping, 0);
+            uv_mutex_unlock(&mutex);
+            continue;
+        }
+        flockfile(log_file);
+        for (; head != tail; ++head) {
+            write_entry(log_file, &ring.slots[head & LOG_RING_MASK]);
+            atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+        }
+        funlockfile(log_file);
+    }
+}
+
+void log_push(int level, const char *file, int line, const char *fmt, const uint64_t *args, int nargs) {
+    if (rendering)
+        return;
+    Log_Entry entry = {.file = file, .line = line, .level = level, .kind = LOG_KIND_TEXT, .fmt = fmt,
+            .nargs = nargs};
+    memcpy(entry.args, args, nargs * sizeof(uint64_t));
+    if (level == LOG_FATAL) {
+        log_flush();
+        write_sync(&entry);
+    } else if (is_producer())
+        ring_push(&entry);
+    else
+        write_sync(&entry);
+}
+
+void log_dump(const char *file, int line, const char *title, void (*render)(const uint8_t *, unsigned),
+              uint8_t *data, unsigned len) {
+    if (rendering) {
+        free(data);
+        return;
+    }
+    Log_Entry entry = {.file = file, .line = line, .level = LOG_DEBUG, .kind = LOG_KIND_DUMP, .fmt = title,
+            .dump = {render, data, len}};
+    if (!is_producer())
+        write_sync(&entry);
+    else if (!ring_push(&entry))
+        free(data);
+}
+
+void log_flush() {
+    uv_thread_t self = uv_thread_self();
+    if (started && !uv_thread_equal(&self, &consumer)) {
+        while (atomic_load(&ring.head) != atomic_load(&ring.tail)) {
+            uv_mutex_lock(&mutex);
+            uv_cond_signal(&cond);
+            uv_mutex_unlock(&mutex);
+            uv_sleep(1);
+        }
+    }
+    fflush(log_file ? log_file : stderr);
+}
+
+uint64_t log_dropped() {
+    return atomic_load_explicit(&ring.dropped, memory_order_relaxed);
+}
+
+void init_log() {
+    if (started)
+        return;
+    uv_mutex_init(&mutex);
+    uv_cond_init(&cond);
+    producer = uv_thread_self();
+    if (uv_thread_create(&consumer, log_thread, NULL)) {
+        log_error("日志线程启动失败，改为同步输出")
+        return;
+    }
+    started = true;
+    atexit(&log_flush);
+}
@@ -0,0 +1,333 @@
+/**
+ * @file      dns_metrics.c
+ * @brief     运行指标
+ * @details   本文件的内容是计数器、直方图与Prometheus导出的实现。分片的写入者只有所属线程，
+ *            写入用relaxed的读后写代替原子加，导出线程用relaxed读取，读到的值可能略旧但不会撕裂。
+ *            HTTP监听只接受GET /metrics，每个连接回复一次后关闭。
+*/
+
+#include "../include/dns_metrics.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/dns_config.h"
+#include "../include/dns_log.h"
+
+#define METRICS_REQUEST_MAX_SIZE 4096 // HTTP请求的最大长度
+#define METRICS_COLLECTOR_MAX_COUNT 32
+#define METRICS_EXPORT_MIN_EXP 10 // 导出的最小桶边界为2^10纳秒
+#define METRICS_EXPORT_MAX_EXP 33 // 导出的最大桶边界为2^33纳秒
+
+// 一个线程的计数分片
+typedef struct metrics_shard {
+    atomic_uint_fast64_t counters[METRIC_COUNT];
+    Metrics_Histogram latency[QUERY_OUTCOME_COUNT];
+    struct metrics_shard *next;
+} Metrics_Shard;
+
+// 一个HTTP连接
+typedef struct metrics_conn {
+    uv_tcp_t handle;
+    uv_write_t req;
+    char request[METRICS_REQUEST_MAX_SIZE];
+    size_t request_len;
+    Metrics_Buffer response;
+} Metrics_Conn;
+
+// 收集函数
+typedef struct metrics_collector {
+    void (*collect)(Metrics_Buffer *buf, void *data);
+    void *data;
+} Metrics_Collector;
+
+static const char *COUNTER_NAME[METRIC_COUNT] = {
+        "nodns_queries_total", "nodns_malformed_queries_total", "nodns_responses_total",
+        "nodns_upstream_queries_total", "nodns_upstream_responses_total", "nodns_malformed_responses_total",
+        "nodns_unknown_responses_total", "nodns_cache_inserts_total", "nodns_cache_evictions_total",
+        "nodns_cache_admission_rejections_total", "nodns_cache_lock_contended_total",
+        "nodns_hosts_reloads_total", "nodns_hosts_reload_failures_total",
+        "nodns_blocklist_hits_total", "nodns_suffix_rule_hits_total",
+        "nodns_bloom_false_positives_total", "nodns_zone_reloads_total", "nodns_zone_reload_failures_total"};
+static const char *COUNTER_HELP[METRIC_COUNT] = {
+        "Queries received from clients", "Client queries that failed to parse", "Responses sent to clients",
+        "Queries forwarded upstream", "Responses received from upstream", "Upstream responses that failed to parse",
+        "Upstream responses whose ID is not in flight", "Responses inserted into the cache",
+        "Cache entries evicted from the LRU list", "Cache entries refused admission by the TinyLFU filter",
+        "Cache shard lock acquisitions that had to wait for another thread", "Successful hosts file reloads",
+        "Hosts file reloads that failed and kept the previous entries", "Queries answered from the compiled blocklist",
+        "Queries blocked by a wildcard or suffix rule",
+        "Hosts or blocklist lookups that passed the bloom filter but found no such name",
+        "Successful zone file reloads", "Zone file reloads that failed and kept the previous zones"};
+const char *const OUTCOME_LABEL[QUERY_OUTCOME_COUNT] = {
+        "hosts", "lru", "tree", "upstream", "coalesced", "timeout", "pool_full", "failed", "local_zone", "zone",
+        "rate_limited"};
+
+static uv_mutex_t shards_mutex;
+static uv_once_t shards_once = UV_ONCE_INIT;
+static Metrics_Shard *shards; // 所有线程的分片
+static _Thread_local Metrics_Shard *local_shard; // 本线程的分片
+static Metrics_Collector collectors[METRICS_COLLECTOR_MAX_COUNT];
+static int collector_count;
+static uv_tcp_t listener;
+
+static inline void bump(atomic_uint_fast64_t *p, uint64_t n) {
+    atomic_store_explicit(p, atomic_load_explicit(p, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline uint64_t read_relaxed(const atomic_uint_fast64_t *p) {
+    return atomic_load_explicit((atomic_uint_fast64_t *) p, memory_order_relaxed);
+}
+
+static void init_shards() {
+    uv_mutex_init(&shards_mutex);
+}
+
+/**
+ * @brief 获取本线程的分片，首次调用时创建
+ * @return 本线程的分片
+ */
+static Metrics_Shard *get_shard() {
+    if (__builtin_expect(local_shard != NULL, 1))
+        return local_shard;
+    uv_once(&shards_once, init_shards);
+    Metrics_Shard *shard = (Metrics_Shard *) calloc(1, sizeof(Metrics_Shard));
+    if (!shard)
+        log_fatal("内存分配错误")
+    uv_mutex_lock(&shards_mutex);
+    shard->next = shards;
+    shards = shard;
+    uv_mutex_unlock(&shards_mutex);
+    return local_shard = shard;
+}
+
+/**
+ * @brief 计算值所在的桶
+ * @param value 值
+ * @return 桶的下标
+ */
+static inline int hist_index(uint64_t value) {
+    if (value < (1 << METRICS_HIST_SUB_BITS))
+        return (int) value;
+    int exp = 63 - __builtin_clzll(value);
+    if (exp > METRICS_HIST_MAX_EXP)
+        return METRICS_HIST_BUCKETS - 1;
+    return ((exp - METRICS_HIST_SUB_BITS + 1) << METRICS_HIST_SUB_BITS) +
+           (int) ((value >> (exp - METRICS_HIST_SUB_BITS)) & ((1 << METRICS_HIST_SUB_BITS) - 1));
+}
+
+/**
+ * @brief 计算桶的上界（不含）
+ * @param index 桶的下标
+ * @return 上界
+ */
+static uint64_t hist_upper(int index) {
+    ++index;
+    if (index < (1 << METRICS_HIST_SUB_BITS))
+        return index;
+    int exp = (index >> METRICS_HIST_SUB_BITS) + METRICS_HIST_SUB_BITS - 1;
+    uint64_t mantissa = (1 << METRICS_HIST_SUB_BITS) + (index & ((1 << METRICS_HIST_SUB_BITS) - 1));
+    return mantissa << (exp - METRICS_HIST_SUB_BITS);
+}
+
+void metrics_count(Metric_Counter counter) {
+    bump(&get_shard()->counters[counter], 1);
+}
+
+void metrics_observe(Query_Outcome outcome, uint64_t latency) {
+    metrics_histogram_record(&get_shard()->latency[outcome], latency);
+}
+
+void metrics_histogram_record(Metrics_Histogram *hist, uint64_t value) {
+    bump(&hist->buckets[hist_index(value)], 1);
+    bump(&hist->sum, value);
+    bump(&hist->count, 1);
+}
+
+void metrics_histogram_merge(Metrics_Histogram *dst, const Metrics_Histogram *src) {
+    for (int i = 0; i < METRICS_HIST_BUCKETS; ++i)
+        bump(&dst->buckets[i], read_relaxed(&src->buckets[i]));
+    bump(&dst->sum, read_relaxed(&src->sum));
+    bump(&dst->count, read_relaxed(&src->count));
+}
+
+uint64_t metrics_histogram_quantile(const Metrics_Histogram *hist, double quantile) {
+    uint64_t total = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; ++i)
+        total += read_relaxed(&hist->buckets[i]);
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t) (quantile * (total - 1)) + 1, seen = 0;
+    for (int i = 0; i < METRICS_HIST_BUCKETS; ++i) {
+        seen += read_relaxed(&hist->buckets[i]);
+        if (seen >= rank)
+            return hist_upper(i);
+    }
+    return hist_upper(METRICS_HIST_BUCKETS - 1);
+}
+
+void metrics_printf(Metrics_Buffer *buf, const char *fmt, ...) {
+    va_list args;
+    while (true) {
+        va_start(args, fmt);
+        int n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+        va_end(args);
+        if (n < 0)
+            return;
+        if (buf->len + n < buf->cap) {
+            buf->len += n;
+            return;
+        }
+        buf->cap = (buf->cap ? buf->cap * 2 : 16384) + n;
+        buf->data = (char *) realloc(buf->data, buf->cap);
+        if (!buf->data)
+            log_fatal("内存分配错误")
+    }
+}
+
+void metrics_write_histogram(Metrics_Buffer *buf, const char *name, const char *labels, const Metrics_Histogram *hist) {
+    metrics_write_histogram_range(buf, name, labels, hist, METRICS_EXPORT_MIN_EXP, METRICS_EXPORT_MAX_EXP, 1e9);
+}
+
+void metrics_write_histogram_range(Metrics_Buffer *buf, const char *name, const char *labels,
+                                   const Metrics_Histogram *hist, int min_exp, int max_exp, double scale) {
+    const char *sep = labels ? "," : "";
+    labels = labels ? labels : "";
+    uint64_t cumulative = 0;
+    int index = 0;
+    for (int exp = min_exp; exp <= max_exp; ++exp) {
+        int end = hist_index((uint64_t) 1 << exp); // 2的幂恰好是桶的边界
+        for (; index < end; ++index)
+            cumulative += read_relaxed(&hist->buckets[index]);
+        metrics_printf(buf, "%s_bucket{%s%sle=\"%.9g\"} %llu\n", name, labels, sep,
+                       (double) ((uint64_t) 1 << exp) / scale, (unsigned long long) cumulative);
+    }
+    uint64_t count = read_relaxed(&hist->count);
+    metrics_printf(buf, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, (unsigned long long) count);
+    const char *open = *labels ? "{" : "", *close = *labels ? "}" : "";
+    metrics_printf(buf, "%s_sum%s%s%s %.9g\n", name, open, labels, close, (double) read_relaxed(&hist->sum) / scale);
+    metrics_printf(buf, "%s_count%s%s%s %llu\n", name, open, labels, close, (unsigned long long) count);
+}
+
+void metrics_register(void (*collect)(Metrics_Buffer *buf, void *data), void *data) {
+    if (collector_count == METRICS_COLLECTOR_MAX_COUNT) {
+        log_error("指标收集函数过多")
+        return;
+    }
+    collectors[collector_count++] = (Metrics_Collector) {collect, data};
+}
+
+void metrics_collect(Metrics_Buffer *buf) {
+    uint64_t counters[METRIC_COUNT] = {0};
+    Metrics_Histogram *latency = (Metrics_Histogram *) calloc(QUERY_OUTCOME_COUNT, sizeof(Metrics_Histogram));
+    if (!latency)
+        log_fatal("内存分配错误")
+    uv_once(&shards_once, init_shards);
+    uv_mutex_lock(&shards_mutex);
+    for (Metrics_Shard *shard = shards; shard != NULL; shard = shard->next) {
+        for (int i = 0; i < METRIC_COUNT; ++i)
+            counters[i] += read_relaxed(&shard->counters[i]);
+        for (int i = 0; i < QUERY_OUTCOME_COUNT; ++i)
+            metrics_histogram_merge(&latency[i], &shard->latency[i]);
+    }
+    uv_mutex_unlock(&shards_mutex);
+
+    for (int i = 0; i < METRIC_COUNT; ++i)
+        metrics_printf(buf, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", COUNTER_NAME[i], COUNTER_HELP[i],
+                       COUNTER_NAME[i], COUNTER_NAME[i], (unsigned long long) counters[i]);
+    metrics_printf(buf, "# HELP nodns_query_duration_seconds Time from receiving a query to answering or dropping it\n"
+                        "# TYPE nodns_query_duration_seconds histogram\n");
+    for (int i = 0; i < QUERY_OUTCOME_COUNT; ++i) {
+        char labels[32];
+        snprintf(labels, sizeof(labels), "path=\"%s\"", OUTCOME_LABEL[i]);
+        metrics_write_histogram(buf, "nodns_query_duration_seconds", labels, &latency[i]);
+    }
+    free(latency);
+    metrics_printf(buf, "# HELP nodns_log_dropped_total Log records dropped because the log ring was full\n"
+                        "# TYPE nodns_log_dropped_total counter\nnodns_log_dropped_total %llu\n",
+                   (unsigned long long) log_dropped());
+    for (int i = 0; i < collector_count; ++i)
+        collectors[i].collect(buf, collectors[i].data);
+}
+
+static void on_close(uv_handle_t *handle) {
+    Metrics_Conn *conn = (Metrics_Conn *) handle;
+    free(conn->response.data);
+    free(conn);
+}
+
+static void on_write(uv_write_t *req, int status) {
+    uv_close((uv_handle_t *) req->handle, on_close);
+}
+
+static void alloc_buffer(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf) {
+    Metrics_Conn *conn = (Metrics_Conn *) handle;
+    buf->base = conn->request + conn->request_len;
+    buf->len = METRICS_REQUEST_MAX_SIZE - 1 - conn->request_len;
+}
+
+/**
+ * @brief 读取HTTP请求，收到完整的请求头后回复
+ */
+static void on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf) {
+    Metrics_Conn *conn = (Metrics_Conn *) stream;
+    if (nread < 0) {
+        uv_close((uv_handle_t *) stream, on_close);
+        return;
+    }
+    conn->request_len += nread;
+    conn->request[conn->request_len] = 0;
+    if (strstr(conn->request, "\r\n\r\n") == NULL && strstr(conn->request, "\n\n") == NULL) {
+        if (conn->request_len == METRICS_REQUEST_MAX_SIZE - 1)
+            uv_close((uv_handle_t *) stream, on_close);
+        return;
+    }
+    uv_read_stop(stream);
+
+    Metrics_Buffer body = {0};
+    const char *status = "200 OK";
+    if (strncmp(conn->request, "GET /metrics ", 13) == 0 || strncmp(conn->request, "GET / ", 6) == 0)
+        metrics_collect(&body);
+    else {
+        status = "404 Not Found";
+        metrics_printf(&body, "not found\n");
+    }
+    metrics_printf(&conn->response, "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                    "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, body.len);
+    metrics_printf(&conn->response, "%.*s", (int) body.len, body.data);
+    free(body.data);
+    uv_buf_t out = uv_buf_init(conn->response.data, conn->response.len);
+    uv_write(&conn->req, stream, &out, 1, on_write);
+}
+
+static void on_connection(uv_stream_t *server, int status) {
+    if (status < 0) {
+        log_error("指标连接异常 %d", status)
+        return;
+    }
+    Metrics_Conn *conn = (Metrics_Conn *) calloc(1, sizeof(Metrics_Conn));
+    if (!conn)
+        log_fatal("内存分配错误")
+    uv_tcp_init(server->loop, &conn->handle);
+    if (uv_accept(server, (uv_stream_t *) &conn->handle) == 0)
+        uv_read_start((uv_stream_t *) &conn->handle, alloc_buffer, on_read);
+    else
+        uv_close((uv_handle_t *) &conn->handle, on_close);
+}
+
+void init_metrics(uv_loop_t *loop) {
+    if (METRICS_PORT == 0)
+        return;
+    log_info("启动指标监听")
+    struct sockaddr_in addr;
+    uv_ip4_addr("127.0.0.1", METRICS_PORT, &addr);
+    uv_tcp_init(loop, &listener);
+    int status = uv_tcp_bind(&listener, (const struct sockaddr *) &addr, 0);
+    if (status == 0)
+        status = uv_listen((uv_stream_t *) &listener, 16, on_connection);
+    if (status)
+        log_error("指标监听启动失败 %d", status)
+}
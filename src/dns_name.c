@@ -0,0 +1,457 @@
+/**
+ * @file      dns_name.c
+ * @brief     域名处理内核
+ * @details   本文件的内容是域名小写化、哈希、比较、标签校验与编码的标量、SSE2与AVX2实现。
+ *            哈希以32字节为一个条带，每个条带分为4个64位通道，每个通道累加 lo32(d ^ k) * hi32(d ^ k) + d，
+ *            这一运算可以直接映射到_mm_mul_epu32/_mm256_mul_epu32，因此三种实现得到相同的哈希值。
+*/
+
+#include "../include/dns_name.h"
+
+#include <string.h>
+
+#if !defined(NODNS_NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#define DNS_NAME_X86 1
+#include <immintrin.h>
+#endif
+
+#define HASH_STRIPES ((DNS_NAME_TEXT_MAX_SIZE + DNS_NAME_HASH_STRIDE) / DNS_NAME_HASH_STRIDE) // 最长域名的条带数
+
+// 每个条带每个通道的密钥
+static const uint64_t SECRET[HASH_STRIPES][4] = {
+        {0x2cb0f69f4abea221ULL, 0x9417034723148989ULL, 0xdd555950609dfe03ULL, 0xdbafb150deb12800ULL},
+        {0x7e789b2e6c442cb6ULL, 0xf41e5636c7e4f8c4ULL, 0x0959d150f8fba7e4ULL, 0xa97316f13cdb9eeaULL},
+        {0x74cd8258f9520068ULL, 0x55c74a62e116868bULL, 0xd2f4c799a2023cbdULL, 0xdf98cb79a37b51b9ULL},
+        {0x396f5885524f3905ULL, 0xaf1d56386ca3b276ULL, 0xa9ffbe6b5104e85aULL, 0x6bd0c51b9fd533b3ULL},
+        {0x980ce91c50ab4b56ULL, 0x28ac395780fe62c5ULL, 0x768912e3a6bcedc7ULL, 0x50b3e8c9332c7c88ULL},
+        {0xce3bbfe520bd47daULL, 0xcba6c8e8e0bb7c4fULL, 0xbf194db8434a346dULL, 0x7d8f2a7b60416d7fULL},
+        {0x0849d1f6e0e10a5eULL, 0x7654b590d064e22fULL, 0x16d1da9507df3af2ULL, 0xf63aef1089ea30e4ULL},
+        {0x9ade6673cc6c522bULL, 0x4c75bc274e37087cULL, 0xd35e12b49f51f27bULL, 0x22ddf2ffcee481eaULL},
+};
+
+// 累加器初值
+static const uint64_t ACC_INIT[4] = {
+        0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0x85ebca77c2b2ae63ULL
+};
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * @brief 64位哈希的最终混合（MurmurHash3 fmix64）
+ * @param h 中间哈希值
+ * @return 混合后的哈希值
+ */
+static inline uint64_t fmix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * @brief 合并4个通道的累加器
+ * @param acc 累加器
+ * @param len 域名长度
+ * @return 哈希值
+ */
+static uint64_t hash_finish(const uint64_t acc[4], size_t len) {
+    uint64_t h = len * 0x87c37b91114253d5ULL;
+    for (int i = 0; i < 4; ++i)
+        h = rotl64(h ^ fmix64(acc[i]), 27) * 0x4cf5ad432745937fULL;
+    return fmix64(h);
+}
+
+/**
+ * @brief 将点分形式的一个标签结束位置写为长度字节
+ * @param wire 目标缓冲区，wire[k]是text[k]之前的一个字节
+ * @param label_start 当前标签在text中的起点
+ * @param end 当前标签在text中的终点（'.'的位置）
+ * @return 下一个标签的起点
+ */
+static inline size_t patch_label(uint8_t *wire, size_t label_start, size_t end) {
+    wire[label_start] = (uint8_t) (end - label_start);
+    return end + 1;
+}
+
+/**
+ * @brief 补齐最后一个标签与根标签
+ * @param wire 目标缓冲区
+ * @param label_start 最后一个标签的起点
+ * @param len 点分形式域名的长度
+ * @return 写入的字节数
+ */
+static inline size_t finish_wire(uint8_t *wire, size_t label_start, size_t len) {
+    if (label_start < len) { // 域名不以'.'结尾，补上最后一个标签
+        patch_label(wire, label_start, len);
+        wire[len + 1] = 0;
+        return len + 2;
+    }
+    wire[label_start] = 0;
+    return len + 1;
+}
+
+/* ===================== 标量实现 ===================== */
+
+static size_t scalar_lower(uint8_t *dst, const uint8_t *src, size_t max) {
+    size_t len = 0;
+    while (len < max && src[len]) {
+        uint8_t c = src[len];
+        dst[len++] = (uint8_t) (c - 'A') < 26 ? c | 0x20 : c;
+    }
+    dst[len] = 0;
+    return len;
+}
+
+static uint64_t scalar_hash(const uint8_t *name, size_t len) {
+    uint64_t acc[4] = {ACC_INIT[0], ACC_INIT[1], ACC_INIT[2], ACC_INIT[3]};
+    size_t stripes = (len + DNS_NAME_HASH_STRIDE - 1) / DNS_NAME_HASH_STRIDE;
+    for (size_t s = 0; s < stripes; ++s) {
+        for (int i = 0; i < 4; ++i) {
+            uint64_t data;
+            memcpy(&data, name + s * DNS_NAME_HASH_STRIDE + i * 8, sizeof(data));
+            uint64_t dk = data ^ SECRET[s % HASH_STRIPES][i];
+            acc[i] += (dk & 0xffffffffULL) * (dk >> 32) + data;
+        }
+    }
+    return hash_finish(acc, len);
+}
+
+static bool scalar_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+    return memcmp(a, b, len) == 0;
+}
+
+static bool scalar_copy_label(uint8_t *dst, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (src[i] == '.' || src[i] == 0)
+            return false;
+        dst[i] = src[i];
+    }
+    return true;
+}
+
+static size_t scalar_to_wire(uint8_t *wire, const uint8_t *text) {
+    size_t len = strlen((const char *) text);
+    memcpy(wire + 1, text, len);
+    size_t label_start = 0;
+    const uint8_t *dot = memchr(text, '.', len);
+    while (dot != NULL) {
+        label_start = patch_label(wire, label_start, dot - text);
+        dot = memchr(dot + 1, '.', len - label_start);
+    }
+    return finish_wire(wire, label_start, len);
+}
+
+static const DNSNameKernel scalar_kernel = {
+        .name = "scalar",
+        .lower = &scalar_lower,
+        .hash = &scalar_hash,
+        .equal = &scalar_equal,
+        .copy_label = &scalar_copy_label,
+        .to_wire = &scalar_to_wire,
+};
+
+#ifdef DNS_NAME_X86
+
+/* ===================== SSE2实现 ===================== */
+
+// 从p开始读取n字节不会跨越页边界。向量实现会整块读取字符串结尾之后的字节，只要不跨页就不会触发缺页
+#define PAGE_SAFE(p, n) ((((uintptr_t) (p)) & 4095) <= 4096 - (n))
+
+/**
+ * @brief 将16个字节中的大写字母转为小写
+ * @param v 16个字节
+ * @return 转换结果
+ */
+static inline __m128i sse2_lower_block(__m128i v) {
+    // 将'A'平移到-128，再用有符号比较判断是否落在['A', 'Z']
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char) (0x80 - 'A')));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char) (0x80 - 0x100 + 26)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/**
+ * @brief 生成前n个字节为0xff、其余为0的掩码
+ * @param n 字节数，不超过16
+ * @return 掩码
+ */
+static inline __m128i sse2_prefix_mask(unsigned n) {
+    const __m128i iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return _mm_cmpgt_epi8(_mm_set1_epi8((char) n), iota);
+}
+
+static size_t sse2_lower(uint8_t *dst, const uint8_t *src, size_t max) {
+    size_t i = 0;
+    while (i < max) {
+        if (!PAGE_SAFE(src + i, 16))
+            return i + scalar_lower(dst + i, src + i, max - i);
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        unsigned zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        size_t n = zero ? __builtin_ctz(zero) : 16;
+        if (n > max - i)
+            n = max - i;
+        // 结尾之后的字节清零，顺带完成填充
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_and_si128(sse2_lower_block(v), sse2_prefix_mask(n)));
+        i += n;
+        if (n < 16)
+            return i;
+    }
+    dst[i] = 0;
+    return i;
+}
+
+static uint64_t sse2_hash(const uint8_t *name, size_t len) {
+    __m128i acc0 = _mm_loadu_si128((const __m128i *) ACC_INIT);
+    __m128i acc1 = _mm_loadu_si128((const __m128i *) (ACC_INIT + 2));
+    size_t stripes = (len + DNS_NAME_HASH_STRIDE - 1) / DNS_NAME_HASH_STRIDE;
+    for (size_t s = 0; s < stripes; ++s) {
+        const uint8_t *p = name + s * DNS_NAME_HASH_STRIDE;
+        __m128i d0 = _mm_loadu_si128((const __m128i *) p);
+        __m128i d1 = _mm_loadu_si128((const __m128i *) (p + 16));
+        __m128i k0 = _mm_xor_si128(d0, _mm_loadu_si128((const __m128i *) SECRET[s % HASH_STRIPES]));
+        __m128i k1 = _mm_xor_si128(d1, _mm_loadu_si128((const __m128i *) (SECRET[s % HASH_STRIPES] + 2)));
+        acc0 = _mm_add_epi64(acc0, _mm_add_epi64(_mm_mul_epu32(k0, _mm_srli_epi64(k0, 32)), d0));
+        acc1 = _mm_add_epi64(acc1, _mm_add_epi64(_mm_mul_epu32(k1, _mm_srli_epi64(k1, 32)), d1));
+    }
+    uint64_t acc[4];
+    _mm_storeu_si128((__m128i *) acc, acc0);
+    _mm_storeu_si128((__m128i *) (acc + 2), acc1);
+    return hash_finish(acc, len);
+}
+
+static bool sse2_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+    size_t i = 0;
+    do { // 每次比较一个条带，多数域名只需一次
+        __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + i)),
+                                   _mm_loadu_si128((const __m128i *) (b + i)));
+        __m128i x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (a + i + 16)),
+                                   _mm_loadu_si128((const __m128i *) (b + i + 16)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(x0, x1), _mm_setzero_si128())) != 0xffff)
+            return false;
+        i += DNS_NAME_HASH_STRIDE;
+    } while (i < len);
+    return true;
+}
+
+static bool sse2_copy_label(uint8_t *dst, const uint8_t *src, size_t len) {
+    if (len == 0) // 空标签不能读取src
+        return true;
+    size_t i = 0;
+    while (true) {
+        if (!PAGE_SAFE(src + i, 16))
+            return scalar_copy_label(dst + i, src + i, len - i);
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+        unsigned bad = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')),
+                                                      _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+        size_t n = len - i;
+        if (n < 16)
+            bad &= (1u << n) - 1;
+        if (bad)
+            return false;
+        _mm_storeu_si128((__m128i *) (dst + i), v); // 多写的部分会被后续的'.'与标签覆盖
+        if (n <= 16)
+            return true;
+        i += 16;
+    }
+}
+
+/**
+ * @brief 标量处理剩余部分
+ * @param wire 目标缓冲区
+ * @param text 点分形式的域名
+ * @param i 起始位置
+ * @param label_start 当前标签的起点
+ * @return 写入的字节数
+ */
+static size_t to_wire_rest(uint8_t *wire, const uint8_t *text, size_t i, size_t label_start) {
+    for (; text[i]; ++i) {
+        wire[i + 1] = text[i];
+        if (text[i] == '.')
+            label_start = patch_label(wire, label_start, i);
+    }
+    return finish_wire(wire, label_start, i);
+}
+
+static size_t sse2_to_wire(uint8_t *wire, const uint8_t *text) {
+    size_t label_start = 0;
+    for (size_t i = 0;; i += 16) {
+        if (!PAGE_SAFE(text + i, 16))
+            return to_wire_rest(wire, text, i, label_start);
+        __m128i v = _mm_loadu_si128((const __m128i *) (text + i));
+        unsigned zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        unsigned dots = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+        if (zero)
+            dots &= (1u << __builtin_ctz(zero)) - 1;
+        _mm_storeu_si128((__m128i *) (wire + 1 + i), v);
+        while (dots) {
+            label_start = patch_label(wire, label_start, i + __builtin_ctz(dots));
+            dots &= dots - 1;
+        }
+        if (zero)
+            return finish_wire(wire, label_start, i + __builtin_ctz(zero));
+    }
+}
+
+static const DNSNameKernel sse2_kernel = {
+        .name = "sse2",
+        .lower = &sse2_lower,
+        .hash = &sse2_hash,
+        .equal = &sse2_equal,
+        .copy_label = &sse2_copy_label,
+        .to_wire = &sse2_to_wire,
+};
+
+/* ===================== AVX2实现 ===================== */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i avx2_lower_block(__m256i v) {
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char) (0x80 - 'A')));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (0x80 - 0x100 + 26)), shifted);
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+AVX2 static inline __m256i avx2_prefix_mask(unsigned n) {
+    const __m256i iota = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                          16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    return _mm256_cmpgt_epi8(_mm256_set1_epi8((char) n), iota);
+}
+
+AVX2 static size_t avx2_lower(uint8_t *dst, const uint8_t *src, size_t max) {
+    size_t i = 0;
+    while (i < max) {
+        if (!PAGE_SAFE(src + i, 32))
+            return i + sse2_lower(dst + i, src + i, max - i);
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+        unsigned zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        size_t n = zero ? __builtin_ctz(zero) : 32;
+        if (n > max - i)
+            n = max - i;
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_and_si256(avx2_lower_block(v), avx2_prefix_mask(n)));
+        i += n;
+        if (n < 32)
+            return i;
+    }
+    dst[i] = 0;
+    return i;
+}
+
+AVX2 static uint64_t avx2_hash(const uint8_t *name, size_t len) {
+    __m256i acc = _mm256_loadu_si256((const __m256i *) ACC_INIT);
+    size_t stripes = (len + DNS_NAME_HASH_STRIDE - 1) / DNS_NAME_HASH_STRIDE;
+    for (size_t s = 0; s < stripes; ++s) {
+        __m256i d = _mm256_loadu_si256((const __m256i *) (name + s * DNS_NAME_HASH_STRIDE));
+        __m256i k = _mm256_xor_si256(d, _mm256_loadu_si256((const __m256i *) SECRET[s % HASH_STRIPES]));
+        acc = _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)), d));
+    }
+    uint64_t out[4];
+    _mm256_storeu_si256((__m256i *) out, acc);
+    return hash_finish(out, len);
+}
+
+AVX2 static bool avx2_equal(const uint8_t *a, const uint8_t *b, size_t len) {
+    size_t i = 0;
+    do {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (a + i)),
+                                       _mm256_loadu_si256((const __m256i *) (b + i)));
+        if ((unsigned) _mm256_movemask_epi8(eq) != 0xffffffffu)
+            return false;
+        i += DNS_NAME_HASH_STRIDE;
+    } while (i < len);
+    return true;
+}
+
+AVX2 static bool avx2_copy_label(uint8_t *dst, const uint8_t *src, size_t len) {
+    if (len == 0)
+        return true;
+    size_t i = 0;
+    while (true) {
+        if (!PAGE_SAFE(src + i, 32))
+            return sse2_copy_label(dst + i, src + i, len - i);
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+        unsigned bad = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')),
+                                                            _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+        size_t n = len - i;
+        if (n < 32)
+            bad &= (1u << n) - 1;
+        if (bad)
+            return false;
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+        if (n <= 32)
+            return true;
+        i += 32;
+    }
+}
+
+AVX2 static size_t avx2_to_wire(uint8_t *wire, const uint8_t *text) {
+    size_t label_start = 0;
+    for (size_t i = 0;; i += 32) {
+        if (!PAGE_SAFE(text + i, 32))
+            return to_wire_rest(wire, text, i, label_start);
+        __m256i v = _mm256_loadu_si256((const __m256i *) (text + i));
+        unsigned zero = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        unsigned dots = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+        if (zero)
+            dots &= (1u << __builtin_ctz(zero)) - 1;
+        _mm256_storeu_si256((__m256i *) (wire + 1 + i), v);
+        while (dots) {
+            label_start = patch_label(wire, label_start, i + __builtin_ctz(dots));
+            dots &= dots - 1;
+        }
+        if (zero)
+            return finish_wire(wire, label_start, i + __builtin_ctz(zero));
+    }
+}
+
+static const DNSNameKernel avx2_kernel = {
+        .name = "avx2",
+        .lower = &avx2_lower,
+        .hash = &avx2_hash,
+        .equal = &avx2_equal,
+        .copy_label = &avx2_copy_label,
+        .to_wire = &avx2_to_wire,
+};
+
+#endif
+
+// 按操作选用的内核，只在向量实现明显更快的操作上使用向量实现，其余使用标量实现
+static DNSNameKernel selected_kernel = {
+        .name = "selected",
+        .lower = &scalar_lower,
+        .hash = &scalar_hash,
+        .equal = &scalar_equal,
+        .copy_label = &scalar_copy_label,
+        .to_wire = &scalar_to_wire,
+};
+
+const DNSNameKernel *dnsname = &scalar_kernel;
+
+void init_dnsname() {
+#ifdef DNS_NAME_X86
+    // 依据bench_name的测量：哈希与标签复制的向量实现更快，小写化、比较与编码的向量实现持平或更慢
+    selected_kernel.hash = &sse2_hash; // x86下SSE2总是可用
+    selected_kernel.copy_label = &sse2_copy_label;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        selected_kernel.hash = &avx2_hash;
+#endif
+    dnsname = &selected_kernel;
+}
+
+const DNSNameKernel *const *dnsname_kernels(int *count) {
+    static const DNSNameKernel *kernels[4];
+    int n = 0;
+    kernels[n++] = &scalar_kernel;
+#ifdef DNS_NAME_X86
+    kernels[n++] = &sse2_kernel;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        kernels[n++] = &avx2_kernel;
+#endif
+    kernels[n++] = &selected_kernel;
+    *count = n;
+    return kernels;
+}
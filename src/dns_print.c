@@ -1,7 +1,8 @@
 /**
  * @file      dns_print.c
  * @brief     DNS报文打印
- * @details 本文件的内容是打印DNS报文字节流和结构体的实现
+ * @details 本文件的内容是打印DNS报文字节流和结构体的实现。打印接口只复制收发的报文字节流并交给日志模块，
+ *          实际的格式化输出在日志后台线程中完成。DEBUG日志在编译时被去掉时，本文件不产生任何代码。
 */
 
 #include "../include/dns_print.h"
@@ -11,11 +12,18 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../include/dns_conversion.h"
 #include "../include/dns_log.h"
 
-void print_dns_string(const char *pstring, unsigned int len) {
-    if (!(LOG_MASK & 1))return;
-    log_debug("DNS报文字节流：")
+#if NODNS_MIN_LOG_LEVEL <= LOG_DEBUG
+
+/**
+ * @brief 渲染DNS报文字节流，在日志后台线程中调用
+ *
+ * @param pstring DNS报文字节流
+ * @param len 字节流长度
+ */
+static void render_dns_string(const uint8_t *pstring, unsigned int len) {
     for (unsigned int i = 0; i < len; i++) {
         if (i % 16 == 0) {
             if (i)fprintf(log_file, "\n");
@@ -130,7 +138,7 @@ static void print_dns_rr(const DNSResourceRecord *prr) {
     fprintf(log_file, "RDATA = ");
     if (prr->type == DNS_TYPE_A)
         print_rr_A(prr->rdata);
-    else if (prr->type == DNS_TYPE_CNAME || prr->type == DNS_TYPE_NS)
+    else if (prr->type == DNS_TYPE_CNAME || prr->type == DNS_TYPE_NS || prr->type == DNS_TYPE_PTR)
         print_rr_CNAME(prr->rdata);
     else if (prr->type == DNS_TYPE_MX)
         print_rr_MX(prr->rdata);
@@ -144,9 +152,12 @@ static void print_dns_rr(const DNSResourceRecord *prr) {
     fprintf(log_file, "\n");
 }
 
-void print_dns_message(const DNSMessage *pmsg) {
-    if (!(LOG_MASK & 1))return;
-    log_debug("DNS报文内容：")
+/**
+ * @brief 渲染DNS报文结构体，在日志后台线程中调用
+ *
+ * @param pmsg DNS报文结构体
+ */
+static void render_dns_message(const DNSMessage *pmsg) {
     fprintf(log_file, "=======Header==========\n");
     print_dns_header(pmsg->header);
     fprintf(log_file, "\n");
@@ -172,3 +183,42 @@ void print_dns_message(const DNSMessage *pmsg) {
         fprintf(log_file, "\n");
     }
 }
+
+/**
+ * @brief 将DNS报文字节流解析后渲染，在日志后台线程中调用
+ *
+ * @param pstring DNS报文字节流
+ * @param len 字节流长度
+ */
+static void render_dns_message_string(const uint8_t *pstring, unsigned int len) {
+    // 解析时不检查长度，在补0的缓冲区中解析，截断的报文不会读出界
+    char *padded = (char *) calloc(DNS_STRING_MAX_SIZE, sizeof(char));
+    DNSMessage *msg = (DNSMessage *) calloc(1, sizeof(DNSMessage));
+    if (!padded || !msg)
+        log_fatal("内存分配错误")
+    memcpy(padded, pstring, len < DNS_STRING_MAX_SIZE ? len : DNS_STRING_MAX_SIZE);
+    if (string_to_dnsmsg(msg, padded))
+        render_dns_message(msg);
+    destroy_dnsmsg(msg);
+    free(padded);
+}
+
+void print_dns_string(const char *pstring, unsigned int len) {
+    if (!(LOG_MASK & 1))return;
+    uint8_t *data = (uint8_t *) malloc(len);
+    if (!data)
+        log_fatal("内存分配错误")
+    memcpy(data, pstring, len);
+    log_dump(__FILE__, __LINE__, "DNS报文字节流：", &render_dns_string, data, len);
+}
+
+void print_dns_message(const char *pstring, unsigned int len) {
+    if (!(LOG_MASK & 1))return;
+    uint8_t *data = (uint8_t *) malloc(len); // 解析与渲染都在后台线程中完成
+    if (!data)
+        log_fatal("内存分配错误")
+    memcpy(data, pstring, len);
+    log_dump(__FILE__, __LINE__, "DNS报文内容：", &render_dns_message_string, data, len);
+}
+
+#endif
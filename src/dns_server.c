@@ -11,11 +11,22 @@
 #include "../include/dns_log.h"
 #include "../include/dns_conversion.h"
 #include "../include/dns_print.h"
+#include "../include/dns_name.h"
 #include "../include/query_pool.h"
+#include "../include/query_log.h"
+#include "../include/dns_metrics.h"
+#include "../include/loop_monitor.h"
+#include "../include/dns_trace.h"
+#include "../include/epoch.h"
+#include "../include/forward_table.h"
+#include "../include/local_zone.h"
+#include "../include/zone_store.h"
 
 static uv_udp_t server_socket; // 服务端与本地通信的socket
 static struct sockaddr_in recv_addr; // 服务端收取DNS查询报文的地址
 extern Query_Pool *qpool; // 查询池
+extern Local_Zones *local_zones; // 本地区域
+extern _Atomic(Zone_Store *) zone_store; // 权威区域，未配置--zone时为NULL
 
 /**
  * @brief 为缓冲区分配空间
@@ -37,6 +48,7 @@ static void alloc_buffer(uv_handle_t *handle, size_t suggested_size, uv_buf_t *b
  * @param status 发送状态
  */
 static void on_send(uv_udp_send_t *req, int status) {
+    loop_monitor_callback();
     free(*(char **) req->data);
     free(req->data);
     free(req);
@@ -44,6 +56,111 @@ static void on_send(uv_udp_send_t *req, int status) {
         log_error("发送状态异常 %d", status)
 }
 
+/**
+ * @brief 发送已编码的回复报文
+ * @param addr 本地地址
+ * @param data 报文，由本函数接管并在发送后释放
+ * @param len 报文长度
+ */
+static void send_packet(const struct sockaddr *addr, char *data, unsigned int len) {
+    uv_udp_send_t *req = malloc(sizeof(uv_udp_send_t));
+    if (!req)
+        log_fatal("内存分配错误")
+    uv_buf_t send_buf = uv_buf_init(data, len);
+    req->data = (char **) malloc(sizeof(char **));
+    *(char **) (req->data) = send_buf.base;
+    print_dns_string(send_buf.base, len);
+
+    uv_udp_send(req, &server_socket, &send_buf, 1, addr, on_send); // 发送回复报文
+}
+
+/**
+ * @brief 判断hosts中是否有该域名，有时hosts优先
+ */
+static bool in_hosts(const DNSKey *key) {
+    epoch_enter();
+    const Hosts_Index *hosts = atomic_load_explicit(&qpool->cache->hosts, memory_order_acquire);
+    bool listed = hosts->find(hosts, key) != NULL;
+    epoch_exit();
+    return listed;
+}
+
+/**
+ * @brief 在权威区域中作答，不占用查询池
+ * @param addr 本地发送方的地址
+ * @param msg 查询报文
+ * @param start_time 收到查询的时刻
+ * @return 如果已作答，返回true
+ * @details 回复直接写成字节流：头部与问题之后拼接区域中预先编码的RRset
+ */
+static bool answer_zone(const struct sockaddr *addr, const DNSMessage *msg, uint64_t start_time) {
+    if (atomic_load_explicit(&zone_store, memory_order_relaxed) == NULL || msg->header->opcode != DNS_OPCODE_QUERY ||
+        msg->header->qdcount != 1 || msg->que->qclass != DNS_CLASS_IN)
+        return false;
+    epoch_enter();
+    const Zone_Store *store = atomic_load_explicit(&zone_store, memory_order_acquire);
+    bool in_zone = store->origins->find(store->origins, &msg->que->key) != NULL;
+    epoch_exit();
+    if (!in_zone || in_hosts(&msg->que->key)) // 先确定属于某个区域，区域外的查询不必查hosts
+        return false;
+    uint8_t *packet = (uint8_t *) calloc(DNS_STRING_MAX_SIZE, sizeof(uint8_t));
+    if (!packet)
+        log_fatal("内存分配错误")
+    unsigned offset = 12 + dnsname->to_wire(packet + 12, (const uint8_t *) msg->que->qname);
+    packet[offset++] = msg->que->qtype >> 8;
+    packet[offset++] = msg->que->qtype;
+    packet[offset++] = msg->que->qclass >> 8;
+    packet[offset++] = msg->que->qclass;
+    Zone_Answer result;
+    epoch_enter();
+    store = atomic_load_explicit(&zone_store, memory_order_acquire);
+    bool answered = store->answer(store, &msg->que->key, packet, offset, ZONE_UDP_SIZE, &result);
+    epoch_exit();
+    if (!answered) {
+        free(packet);
+        return false;
+    }
+    log_info("权威区域命中")
+    packet[0] = msg->header->id >> 8;
+    packet[1] = msg->header->id;
+    packet[2] = 0x84 | result.truncated << 1 | msg->header->rd; // QR、AA
+    packet[3] = msg->header->rd << 7 | result.rcode; // RA
+    packet[5] = 1;
+    packet[6] = result.ancount >> 8;
+    packet[7] = result.ancount;
+    packet[8] = result.nscount >> 8;
+    packet[9] = result.nscount;
+    metrics_count(METRIC_RESPONSES);
+    dns_trace(query__reply, (int) msg->header->id, msg->que->qname, uv_hrtime(), (int) result.rcode);
+    send_packet(addr, (char *) packet, result.len);
+    metrics_observe(QUERY_ZONE, uv_hrtime() - start_time);
+    qlog_record(addr, msg->que, msg->header->id, result.rcode, QUERY_ZONE, start_time);
+    return true;
+}
+
+/**
+ * @brief 在本地区域中作答，不占用查询池
+ * @param addr 本地发送方的地址
+ * @param msg 查询报文，作答时被改写为回复
+ * @param start_time 收到查询的时刻
+ * @return 如果已作答，返回true
+ */
+static bool answer_local_zone(const struct sockaddr *addr, DNSMessage *msg, uint64_t start_time) {
+    if (msg->header->opcode != DNS_OPCODE_QUERY || msg->header->qdcount != 1 || msg->que->qclass != DNS_CLASS_IN)
+        return false; // 与权威区域相同，只回答标准的单问题IN类查询
+    Local_Zone *zone = local_zones->find(local_zones, &msg->que->key);
+    if (zone == NULL || qpool->forward->route(qpool->forward, &msg->que->key) != qpool->forward->groups)
+        return false; // 转发规则优先，如把私有地址的反向区域转发给内部服务器
+    if (in_hosts(&msg->que->key)) // hosts中的记录优先，如其生成的PTR记录
+        return false;
+    log_info("本地区域命中")
+    local_zones->answer(zone, msg);
+    send_to_local(addr, msg);
+    metrics_observe(QUERY_LOCAL_ZONE, uv_hrtime() - start_time);
+    qlog_record(addr, msg->que, msg->header->id, msg->header->rcode, QUERY_LOCAL_ZONE, start_time);
+    return true;
+}
+
 /**
  * @brief 从本地接收查询报文的回调函数
  * @param handle 查询句柄
@@ -53,6 +170,7 @@ static void on_send(uv_udp_send_t *req, int status) {
  * @param flags 标志
  */
 static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const struct sockaddr *addr, unsigned flags) {
+    loop_monitor_callback();
     if (nread < 0) {
         if (buf->base)
             free(buf->base);
@@ -64,18 +182,34 @@ static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const
             free(buf->base);
         return;
     }
+    uint64_t start_time = uv_hrtime();
+    metrics_count(METRIC_QUERIES);
     log_debug("收到本地DNS查询报文")
     print_dns_string(buf->base, nread);
     DNSMessage *msg = (DNSMessage *) calloc(1, sizeof(DNSMessage));
     if (!msg)
         log_fatal("内存分配错误")
-    string_to_dnsmsg(msg, buf->base); // 将字节序列转化为结构体
-    print_dns_message(msg);
+    if (!string_to_dnsmsg(msg, buf->base) || msg->que == NULL) { // 将字节序列转化为结构体
+        log_error("DNS查询报文格式错误")
+        metrics_count(METRIC_MALFORMED_QUERIES);
+        destroy_dnsmsg(msg);
+        free(buf->base);
+        return;
+    }
+    print_dns_message(buf->base, nread);
+    dns_trace(query__receive, (int) msg->header->id, msg->que->qname, start_time, (int) msg->que->qtype);
 
+    if (answer_zone(addr, msg, start_time) || answer_local_zone(addr, msg, start_time)) {
+        destroy_dnsmsg(msg);
+        free(buf->base);
+        return;
+    }
     if (qpool->full(qpool)) {
         log_error("查询池满")
+        metrics_observe(QUERY_POOL_FULL, uv_hrtime() - start_time);
+        qlog_record(addr, msg->que, msg->header->id, QLOG_NO_RCODE, QUERY_POOL_FULL, start_time);
     } else
-        qpool->insert(qpool, addr, msg); // 将DNS查询加入查询池
+        qpool->insert(qpool, addr, msg, start_time); // 将DNS查询加入查询池
     destroy_dnsmsg(msg);
     if (buf->base)
         free(buf->base);
@@ -84,7 +218,7 @@ static void on_read(uv_udp_t *handle, ssize_t nread, const uv_buf_t *buf, const
 void init_server(uv_loop_t *loop) {
     log_info("启动server")
     uv_udp_init(loop, &server_socket); // 将server_docket绑定到事件循环
-    uv_ip4_addr("0.0.0.0", 53, &recv_addr); // 初始化recv_addr为0.0.0.0:53，能够接收所有本地发送到53端口的报文
+    uv_ip4_addr("0.0.0.0", LISTEN_PORT, &recv_addr); // 初始化recv_addr为0.0.0.0:LISTEN_PORT，能够接收所有本地发送到该端口的报文
     uv_udp_bind(&server_socket, (struct sockaddr *) &recv_addr, UV_UDP_REUSEADDR); // 启用端口复用，允许多个进程监听同一端口
     uv_udp_recv_start(&server_socket, alloc_buffer, on_read); // 当收到DNS查询报文时，分配缓冲区并调用回调函数
 }
@@ -96,21 +230,18 @@ void init_server(uv_loop_t *loop) {
  */
 void send_to_local(const struct sockaddr *addr, const DNSMessage *msg) {
     log_info("发送DNS回复报文到本地")
-    print_dns_message(msg);
+    metrics_count(METRIC_RESPONSES);
+    dns_trace(query__reply, (int) msg->header->id, msg->que ? msg->que->qname : NULL, uv_hrtime(),
+              (int) msg->header->rcode);
     char *str = (char *) calloc(DNS_STRING_MAX_SIZE, sizeof(char)); // 将DNS结构体转化成字节流
     if (!str)
         log_fatal("内存分配错误")
     unsigned int len = dnsmsg_to_string(msg, str);
-    uv_udp_send_t *req = malloc(sizeof(uv_udp_send_t));
-    if (!req)
+    print_dns_message(str, len);
+    char *data = (char *) malloc(len);
+    if (!data)
         log_fatal("内存分配错误")
-
-    uv_buf_t send_buf = uv_buf_init((char *) malloc(len), len);
-    memcpy(send_buf.base, str, len); // 将字节序列存入发送缓冲区中
-    req->data = (char **) malloc(sizeof(char **));
-    *(char **) (req->data) = send_buf.base;
-    print_dns_string(send_buf.base, len);
-
-    uv_udp_send(req, &server_socket, &send_buf, 1, addr, on_send); // 发送回复报文
+    memcpy(data, str, len); // 将字节序列存入发送缓冲区中
+    send_packet(addr, data, len);
     free(str);
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+/**
+ * @file      dns_trace.c
+ * @brief     USDT静态探针
+ * @details   本文件定义了探针的信号量。信号量位于.probes段，挂载探针的工具通过ELF中的USDT note找到并递增它们。
+*/
+
+#include "../include/dns_trace.h"
+
+#include "../include/dns_config.h"
+#include "../include/dns_log.h"
+
+#ifdef NODNS_USDT
+
+#define DNS_TRACE_DEFINE(name) \
+    __extension__ unsigned short DNS_TRACE_SEMAPHORE(name) __attribute__((unused, section(".probes")));
+DNS_TRACE_PROBES(DNS_TRACE_DEFINE)
+
+#define DNS_TRACE_FORCE(name) DNS_TRACE_SEMAPHORE(name) = 1;
+
+void init_trace() {
+    if (!TRACE_FORCE)
+        return;
+    log_info("强制开启USDT探针")
+    DNS_TRACE_PROBES(DNS_TRACE_FORCE)
+}
+
+#else
+
+void init_trace() {
+    if (TRACE_FORCE)
+        log_error("未以NODNS_USDT编译，--trace_force无效")
+}
+
+#endif
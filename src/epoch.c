@@ -0,0 +1,116 @@
+/**
+ * @file      epoch.c
+ * @brief     基于纪元的内存回收
+ * @details   每个线程的记录中保存它进入临界区时看到的全局纪元。只有所有在临界区中的线程都已看到当前纪元时，
+ *            全局纪元才能前进；因此在纪元e时摘下的元素，到纪元e + 2时已不可能被任何读者持有。
+ *            待回收的元素按摘下时的纪元从新到旧挂在摘下它的线程的记录上，只由该线程释放，无需同步。
+*/
+
+#include "../include/epoch.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <uv.h>
+
+#include "../include/dns_log.h"
+
+// 一个待回收的元素
+typedef struct epoch_retired {
+    void (*free_fn)(void *);
+    void *ptr;
+    uint64_t epoch; // 摘下时的全局纪元
+    struct epoch_retired *next;
+} Epoch_Retired;
+
+// 一个线程的记录
+typedef struct epoch_record {
+    _Alignas(64) atomic_uint_fast64_t state; // 在临界区中时为(纪元 << 1) | 1，否则为0
+    uint64_t reclaimed; // 上次回收时的全局纪元
+    Epoch_Retired *retired; // 待回收的元素，从新到旧
+    struct epoch_record *next;
+} Epoch_Record;
+
+static atomic_uint_fast64_t global_epoch;
+static uv_mutex_t records_mutex;
+static uv_once_t records_once = UV_ONCE_INIT;
+static _Atomic(Epoch_Record *) records; // 所有线程的记录，只在头部插入
+static _Thread_local Epoch_Record *local_record; // 本线程的记录
+
+static void init_records() {
+    uv_mutex_init(&records_mutex);
+}
+
+/**
+ * @brief 获取本线程的记录，首次调用时登记
+ * @return 本线程的记录
+ */
+static Epoch_Record *get_record() {
+    if (__builtin_expect(local_record != NULL, 1))
+        return local_record;
+    uv_once(&records_once, init_records);
+    Epoch_Record *record = (Epoch_Record *) aligned_alloc(64, sizeof(Epoch_Record));
+    if (!record)
+        log_fatal("内存分配错误")
+    atomic_init(&record->state, 0);
+    record->reclaimed = 0;
+    record->retired = NULL;
+    uv_mutex_lock(&records_mutex);
+    record->next = atomic_load_explicit(&records, memory_order_relaxed);
+    atomic_store_explicit(&records, record, memory_order_release);
+    uv_mutex_unlock(&records_mutex);
+    return local_record = record;
+}
+
+void epoch_enter(void) {
+    Epoch_Record *record = get_record();
+    // seq_cst的写保证之后对共享结构的读不会早于登记，推进纪元的线程一定能看到本线程
+    atomic_store(&record->state, (atomic_load(&global_epoch) << 1) | 1);
+}
+
+void epoch_exit(void) {
+    atomic_store_explicit(&local_record->state, 0, memory_order_release);
+}
+
+/**
+ * @brief 所有在临界区中的线程都已看到当前纪元时将其加一
+ * @return 当前的全局纪元
+ */
+static uint64_t try_advance() {
+    uint64_t epoch = atomic_load(&global_epoch);
+    for (Epoch_Record *r = atomic_load_explicit(&records, memory_order_acquire); r != NULL; r = r->next) {
+        uint64_t state = atomic_load(&r->state);
+        if ((state & 1) && (state >> 1) != epoch)
+            return epoch;
+    }
+    if (atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1))
+        return epoch + 1;
+    return epoch; // 其他线程已推进，epoch为新值
+}
+
+void epoch_retire(void (*free_fn)(void *), void *ptr) {
+    Epoch_Record *record = get_record();
+    uint64_t epoch = try_advance();
+    if (epoch != record->reclaimed) {
+        record->reclaimed = epoch;
+        Epoch_Retired **link = &record->retired;
+        while (*link != NULL && epoch - (*link)->epoch < 2)
+            link = &(*link)->next;
+        Epoch_Retired *old = *link; // 之后的元素都已过宽限期
+        *link = NULL;
+        while (old != NULL) {
+            Epoch_Retired *next = old->next;
+            old->free_fn(old->ptr);
+            free(old);
+            old = next;
+        }
+    }
+    Epoch_Retired *retired = (Epoch_Retired *) malloc(sizeof(Epoch_Retired));
+    if (!retired)
+        log_fatal("内存分配错误")
+    retired->free_fn = free_fn;
+    retired->ptr = ptr;
+    retired->epoch = epoch;
+    retired->next = record->retired;
+    record->retired = retired;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file      forward_table.c
+ * @brief     条件转发
+ * @details   本文件的内容是转发表的建立与查找。规则在启动时解析，各组的socket由客户端在init_client中打开。
+*/
+
+#include "../include/forward_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/dns_config.h"
+#include "../include/dns_log.h"
+#include "../include/dns_name.h"
+
+static Upstream_Group *table_route(const Forward_Table *table, const DNSKey *key) {
+    const Suffix_Trie_Node *node = table->trie->find(table->trie, key);
+    return &table->groups[node ? node->value : 0];
+}
+
+/**
+ * @brief 判断后缀是否只含域名中的字符
+ */
+static bool valid_suffix(const char *name, int len) {
+    for (int i = 0; i < len; ++i) {
+        char c = name[i];
+        if (!((uint8_t) ((c | 0x20) - 'a') < 26 || (uint8_t) (c - '0') < 10 || c == '-' || c == '_' || c == '.'))
+            return false;
+    }
+    return len > 0;
+}
+
+/**
+ * @brief 解析组内的上游服务器
+ * @param group 上游服务器组
+ * @param text “地址[:端口][,地址[:端口]...]”
+ * @param len 文本长度
+ * @return 有误时返回false
+ */
+static bool parse_servers(Upstream_Group *group, const char *text, int len) {
+    while (len > 0) {
+        const char *end = memchr(text, ',', len);
+        int item_len = end ? (int) (end - text) : len;
+        char host[INET_ADDRSTRLEN];
+        const char *colon = memchr(text, ':', item_len);
+        int host_len = colon ? (int) (colon - text) : item_len;
+        if (host_len <= 0 || host_len >= (int) sizeof(host) || group->server_count == FORWARD_GROUP_MAX_SERVERS)
+            return false;
+        memcpy(host, text, host_len);
+        host[host_len] = 0;
+        int port = 53;
+        if (colon) {
+            char *port_end;
+            port = (int) strtol(colon + 1, &port_end, 10);
+            if (port_end != text + item_len || port < 1 || port > 65535)
+                return false;
+        }
+        if (uv_ip4_addr(host, port, &group->servers[group->server_count]))
+            return false;
+        ++group->server_count;
+        text += item_len + (end != NULL);
+        len -= item_len + (end != NULL);
+    }
+    return group->server_count > 0;
+}
+
+/**
+ * @brief 解析一条规则，生成一个组
+ * @param table 转发表
+ * @param rule 规则
+ * @return 有误时返回false
+ */
+static bool parse_rule(Forward_Table *table, const char *rule) {
+    const char *eq = strchr(rule, '=');
+    if (eq == NULL)
+        return false;
+    const char *servers = eq + 1, *slash = strchr(servers, '/');
+    int index = table->count;
+    Upstream_Group *group = &table->groups[index];
+    group->timeout = FORWARD_DEFAULT_TIMEOUT;
+    if (slash) {
+        char *end;
+        long timeout = strtol(slash + 1, &end, 10);
+        if (*end != 0 || timeout < 1 || timeout > 60000)
+            return false;
+        group->timeout = timeout;
+    }
+    if (!parse_servers(group, servers, slash ? (int) (slash - servers) : (int) strlen(servers)))
+        return false;
+    for (const char *suffix = rule; suffix < eq;) {
+        const char *end = memchr(suffix, ',', eq - suffix);
+        int len = end ? (int) (end - suffix) : (int) (eq - suffix);
+        if (!valid_suffix(suffix, len))
+            return false;
+        Suffix_Trie_Node *node = table->trie->insert(table->trie, suffix, len, SUFFIX_MATCH_SELF | SUFFIX_MATCH_BELOW);
+        if (node == NULL || node->value != 0) // 格式有误或已属于其他组
+            return false;
+        node->value = index;
+        if (group->name == NULL) {
+            group->name = strndup(suffix, len);
+            if (!group->name)
+                log_fatal("内存分配错误")
+        }
+        suffix += len + (end != NULL);
+    }
+    if (group->name == NULL)
+        return false;
+    ++table->count;
+    return true;
+}
+
+/**
+ * @brief 导出各组的指标
+ */
+static void collect_forward(Metrics_Buffer *buf, void *data) {
+    const Forward_Table *table = (const Forward_Table *) data;
+    static const char *COUNTERS[][2] = {
+            {"nodns_upstream_group_queries_total", "Queries sent to each upstream group"},
+            {"nodns_upstream_group_responses_total", "Responses received from each upstream group"},
+            {"nodns_upstream_group_timeouts_total", "Queries to each upstream group that timed out"},
+            {"nodns_upstream_group_rejected_total",
+             "Queries dropped because the free query pool slots were reserved for other upstream groups"}};
+    for (int c = 0; c < 4; ++c) {
+        metrics_printf(buf, "# HELP %s %s\n# TYPE %s counter\n", COUNTERS[c][0], COUNTERS[c][1], COUNTERS[c][0]);
+        for (int i = 0; i < table->count; ++i) {
+            const Upstream_Group *group = &table->groups[i];
+            uint64_t value = c == 0 ? group->queries : c == 1 ? group->responses : c == 2 ? group->timeouts
+                                                                                          : group->rejected;
+            metrics_printf(buf, "%s{group=\"%s\"} %llu\n", COUNTERS[c][0], group->name, (unsigned long long) value);
+        }
+    }
+    metrics_printf(buf, "# HELP nodns_upstream_group_pending Query pool slots held by queries waiting on each group\n"
+                        "# TYPE nodns_upstream_group_pending gauge\n");
+    for (int i = 0; i < table->count; ++i)
+        metrics_printf(buf, "nodns_upstream_group_pending{group=\"%s\"} %d\n", table->groups[i].name,
+                       table->groups[i].pending);
+    metrics_printf(buf, "# HELP nodns_upstream_group_rtt_seconds Round-trip time of each upstream group\n"
+                        "# TYPE nodns_upstream_group_rtt_seconds histogram\n");
+    for (int i = 0; i < table->count; ++i) {
+        char labels[DNS_NAME_TEXT_MAX_SIZE + 16];
+        snprintf(labels, sizeof(labels), "group=\"%s\"", table->groups[i].name);
+        metrics_write_histogram(buf, "nodns_upstream_group_rtt_seconds", labels, &table->groups[i].rtt);
+    }
+}
+
+Forward_Table *new_forward_table(char *const *rules, int rule_count) {
+    Forward_Table *table = (Forward_Table *) calloc(1, sizeof(Forward_Table));
+    if (!table)
+        log_fatal("内存分配错误")
+    table->groups = (Upstream_Group *) calloc(rule_count + 1, sizeof(Upstream_Group));
+    if (!table->groups)
+        log_fatal("内存分配错误")
+    table->trie = new_suffix_trie();
+    table->route = &table_route;
+
+    Upstream_Group *group = &table->groups[table->count++]; // 默认组
+    group->name = "default";
+    group->timeout = REMOTE_TIMEOUT;
+    uv_ip4_addr(REMOTE_HOST, REMOTE_PORT, &group->servers[group->server_count++]);
+    for (int i = 0; i < rule_count; ++i) {
+        if (!parse_rule(table, rules[i])) {
+            log_error("第%d条转发规则有误", i + 1)
+            return NULL;
+        }
+    }
+    metrics_register(&collect_forward, table);
+    return table;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file      frequency_sketch.c
+ * @brief     访问频次估计
+ * @details   本文件的内容是4位计数器的count-min sketch，用于TinyLFU准入策略
+*/
+
+#include "../include/frequency_sketch.h"
+
+#include <stdlib.h>
+
+#include "../include/dns_log.h"
+
+static const uint64_t SEEDS[FS_DEPTH] = {
+        0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+
+/**
+ * @brief 求键的第i个计数器的位置
+ * @param sketch 频次估计器
+ * @param hash 键的哈希
+ * @param i 第几个计数器
+ * @param shift 输出，计数器在table元素中的位移
+ * @return table中的下标
+ */
+static uint64_t counter_index(const Frequency_Sketch *sketch, uint64_t hash, int i, int *shift) {
+    uint64_t h = (hash + SEEDS[i]) * SEEDS[i];
+    h ^= h >> 32;
+    *shift = (int) (h & 15) << 2;
+    return (h >> 4) & sketch->mask;
+}
+
+static int sketch_frequency(const Frequency_Sketch *sketch, uint64_t hash) {
+    int frequency = FS_COUNTER_MAX, shift;
+    for (int i = 0; i < FS_DEPTH; ++i) {
+        uint64_t index = counter_index(sketch, hash, i, &shift);
+        int count = (int) (sketch->table[index] >> shift) & 15;
+        if (count < frequency)
+            frequency = count;
+    }
+    return frequency;
+}
+
+/**
+ * @brief 所有计数器减半
+ * @param sketch 频次估计器
+ */
+static void sketch_reset(Frequency_Sketch *sketch) {
+    for (uint64_t i = 0; i <= sketch->mask; ++i)
+        sketch->table[i] = (sketch->table[i] >> 1) & 0x7777777777777777ULL;
+    sketch->additions /= 2;
+}
+
+static void sketch_increment(Frequency_Sketch *sketch, uint64_t hash) {
+    int shift;
+    for (int i = 0; i < FS_DEPTH; ++i) {
+        uint64_t index = counter_index(sketch, hash, i, &shift);
+        if (((sketch->table[index] >> shift) & 15) < FS_COUNTER_MAX)
+            sketch->table[index] += 1ULL << shift;
+    }
+    if (++sketch->additions >= sketch->sample_size)
+        sketch_reset(sketch);
+}
+
+Frequency_Sketch *new_frequency_sketch(int capacity) {
+    Frequency_Sketch *sketch = (Frequency_Sketch *) malloc(sizeof(Frequency_Sketch));
+    if (!sketch)
+        log_fatal("内存分配错误")
+    uint64_t size = 1;
+    while (size < (uint64_t) capacity)
+        size <<= 1;
+    sketch->table = (uint64_t *) calloc(size, sizeof(uint64_t));
+    if (!sketch->table)
+        log_fatal("内存分配错误")
+    sketch->mask = size - 1;
+    sketch->additions = 0;
+    sketch->sample_size = (uint64_t) capacity * FS_SAMPLE_FACTOR;
+    sketch->increment = &sketch_increment;
+    sketch->frequency = &sketch_frequency;
+    return sketch;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file      heavy_hitters.c
+ * @brief     高频项统计
+ * @details   本文件的内容是count-min sketch与top-K小根堆的实现。sketch的各行以键哈希的高低32位做双重哈希选出计数器；
+ *            键已在堆中时更新其频次并下沉，否则在估计值超过堆顶时替换堆顶。堆索引使用线性探测，删除时后移填补空槽。
+*/
+
+#include "../include/heavy_hitters.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/dns_log.h"
+
+#define HH_INDEX_MASK (HH_INDEX_SIZE - 1)
+
+/**
+ * @brief 在堆索引中查找哈希
+ * @param hh 高频项统计
+ * @param hash 键的哈希
+ * @return 所在的槽，不存在时返回-1
+ */
+static int index_find(const Heavy_Hitters *hh, uint64_t hash) {
+    for (unsigned i = hash & HH_INDEX_MASK; hh->index[i]; i = (i + 1) & HH_INDEX_MASK)
+        if (hh->top[hh->index[i] - 1].hash == hash)
+            return (int) i;
+    return -1;
+}
+
+/**
+ * @brief 将堆中的项登记到堆索引
+ * @param hh 高频项统计
+ * @param pos 项在堆中的位置
+ */
+static void index_insert(Heavy_Hitters *hh, int pos) {
+    unsigned i = hh->top[pos].hash & HH_INDEX_MASK;
+    while (hh->index[i])
+        i = (i + 1) & HH_INDEX_MASK;
+    hh->index[i] = pos + 1;
+    hh->top[pos].slot = i;
+}
+
+/**
+ * @brief 删除堆索引中的槽，并将之后同一探测链上的项前移
+ * @param hh 高频项统计
+ * @param slot 待删除的槽
+ */
+static void index_remove(Heavy_Hitters *hh, unsigned slot) {
+    unsigned i = slot;
+    for (unsigned j = (i + 1) & HH_INDEX_MASK; hh->index[j]; j = (j + 1) & HH_INDEX_MASK) {
+        unsigned home = hh->top[hh->index[j] - 1].hash & HH_INDEX_MASK;
+        // home不在(i, j]之间时，j上的项可以移到i
+        if (((j - home) & HH_INDEX_MASK) >= ((j - i) & HH_INDEX_MASK)) {
+            hh->index[i] = hh->index[j];
+            hh->top[hh->index[i] - 1].slot = i;
+            i = j;
+        }
+    }
+    hh->index[i] = 0;
+}
+
+/**
+ * @brief 交换堆中的两项，并更新堆索引
+ * @param hh 高频项统计
+ * @param a 位置
+ * @param b 位置
+ */
+static void heap_swap(Heavy_Hitters *hh, int a, int b) {
+    Heavy_Hitter tmp = hh->top[a];
+    hh->top[a] = hh->top[b];
+    hh->top[b] = tmp;
+    hh->index[hh->top[a].slot] = a + 1;
+    hh->index[hh->top[b].slot] = b + 1;
+}
+
+/**
+ * @brief 上浮
+ * @param hh 高频项统计
+ * @param pos 位置
+ */
+static void heap_up(Heavy_Hitters *hh, int pos) {
+    while (pos > 0 && hh->top[(pos - 1) / 2].count > hh->top[pos].count) {
+        heap_swap(hh, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+/**
+ * @brief 下沉
+ * @param hh 高频项统计
+ * @param pos 位置
+ */
+static void heap_down(Heavy_Hitters *hh, int pos) {
+    while (true) {
+        int min = pos, left = pos * 2 + 1, right = pos * 2 + 2;
+        if (left < hh->size && hh->top[left].count < hh->top[min].count)
+            min = left;
+        if (right < hh->size && hh->top[right].count < hh->top[min].count)
+            min = right;
+        if (min == pos)
+            return;
+        heap_swap(hh, pos, min);
+        pos = min;
+    }
+}
+
+/**
+ * @brief 在堆中的位置写入新的键
+ * @param hh 高频项统计
+ * @param pos 位置
+ * @param key 键
+ * @param len 键的长度
+ * @param hash 键的哈希
+ * @param count 估计频次
+ */
+static void heap_set(Heavy_Hitters *hh, int pos, const void *key, size_t len, uint64_t hash, uint32_t count) {
+    Heavy_Hitter *item = &hh->top[pos];
+    item->hash = hash;
+    item->count = count;
+    item->len = len < HH_KEY_MAX_SIZE ? len : HH_KEY_MAX_SIZE;
+    memcpy(item->key, key, item->len);
+    index_insert(hh, pos);
+}
+
+static uint32_t hh_update(Heavy_Hitters *hh, const void *key, size_t len, uint64_t hash) {
+    uint32_t lo = (uint32_t) hash, hi = (uint32_t) (hash >> 32) | 1;
+    uint32_t *counters[HH_SKETCH_DEPTH];
+    uint32_t count = UINT32_MAX;
+    for (int d = 0; d < HH_SKETCH_DEPTH; ++d) {
+        counters[d] = &hh->sketch[d][(lo + d * hi) & (HH_SKETCH_WIDTH - 1)];
+        if (*counters[d] < count)
+            count = *counters[d];
+    }
+    ++count;
+    for (int d = 0; d < HH_SKETCH_DEPTH; ++d)
+        if (*counters[d] < count)
+            *counters[d] = count;
+    ++hh->total;
+
+    int slot = index_find(hh, hash);
+    if (slot >= 0) {
+        int pos = hh->index[slot] - 1;
+        hh->top[pos].count = count;
+        heap_down(hh, pos);
+    } else if (hh->size < HH_TOP_K) {
+        int pos = hh->size++;
+        heap_set(hh, pos, key, len, hash, count);
+        heap_up(hh, pos);
+    } else if (count > hh->top[0].count) {
+        index_remove(hh, hh->top[0].slot);
+        heap_set(hh, 0, key, len, hash, count);
+        heap_down(hh, 0);
+    }
+    return count;
+}
+
+static uint32_t hh_estimate(const Heavy_Hitters *hh, uint64_t hash) {
+    uint32_t lo = (uint32_t) hash, hi = (uint32_t) (hash >> 32) | 1;
+    uint32_t count = UINT32_MAX;
+    for (int d = 0; d < HH_SKETCH_DEPTH; ++d) {
+        uint32_t c = hh->sketch[d][(lo + d * hi) & (HH_SKETCH_WIDTH - 1)];
+        if (c < count)
+            count = c;
+    }
+    return count;
+}
+
+/**
+ * @brief 按频次从高到低比较两个高频项
+ * @param a 高频项指针的指针
+ * @param b 高频项指针的指针
+ * @return 比较结果
+ */
+static int compare_count(const void *a, const void *b) {
+    uint32_t x = (*(const Heavy_Hitter **) a)->count, y = (*(const Heavy_Hitter **) b)->count;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int hh_sorted(const Heavy_Hitters *hh, const Heavy_Hitter **out) {
+    for (int i = 0; i < hh->size; ++i)
+        out[i] = &hh->top[i];
+    qsort(out, hh->size, sizeof(*out), &compare_count);
+    return hh->size;
+}
+
+/**
+ * @brief 减半计时器的回调函数，减半后堆的顺序不变
+ * @param timer 计时器
+ */
+static void decay_cb(uv_timer_t *timer) {
+    Heavy_Hitters *hh = (Heavy_Hitters *) timer->data;
+    for (int d = 0; d < HH_SKETCH_DEPTH; ++d)
+        for (int i = 0; i < HH_SKETCH_WIDTH; ++i)
+            hh->sketch[d][i] >>= 1;
+    for (int i = 0; i < hh->size; ++i)
+        hh->top[i].count >>= 1;
+    hh->total >>= 1;
+}
+
+uint64_t hh_hash(const void *key, size_t len) {
+    const uint8_t *p = (const uint8_t *) key;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+Heavy_Hitters *new_heavy_hitters(uv_loop_t *loop) {
+    Heavy_Hitters *hh = (Heavy_Hitters *) calloc(1, sizeof(Heavy_Hitters));
+    if (!hh)
+        log_fatal("内存分配错误")
+    hh->update = &hh_update;
+    hh->estimate = &hh_estimate;
+    hh->sorted = &hh_sorted;
+    uv_timer_init(loop, &hh->timer);
+    hh->timer.data = hh;
+    uv_timer_start(&hh->timer, &decay_cb, HH_DECAY_INTERVAL, HH_DECAY_INTERVAL);
+    uv_unref((uv_handle_t *) &hh->timer);
+    return hh;
+}
@@ -0,0 +1,733 @@
+/**
+ * @file      hosts.c
+ * @brief     hosts文件
+ * @details   本文件的内容是hosts索引的建立、查询与热加载。文件被切成若干段并行解析，各段排好序后归并；
+ *            错误只记下位置，归并后再换算为行号输出。热加载在libuv的线程池中进行，
+ *            只有替换索引在事件循环线程中进行；旧索引交给纪元回收，正在查询它的线程不受影响。
+*/
+
+#include "../include/hosts.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/dns_cache.h"
+#include "../include/dns_config.h"
+#include "../include/dns_conversion.h"
+#include "../include/dns_key.h"
+#include "../include/dns_log.h"
+#include "../include/dns_metrics.h"
+#include "../include/dns_name.h"
+#include "../include/epoch.h"
+
+// 热加载的状态，只在事件循环线程中访问（work中的字段除外）
+static struct {
+    uv_fs_event_t watcher;
+    uv_timer_t delay;
+    uv_work_t work;
+    struct cache *cache;
+    char *dir; // HOSTS_PATH所在的目录
+    const char *base; // HOSTS_PATH的文件名
+    bool running; // 是否正在加载
+    bool pending; // 加载期间文件又改变了
+    Hosts_Index *result; // 线程池中建立的索引，打开文件失败时为NULL
+} reload;
+
+// 解析出的后缀规则，等所有线程结束后再插入反向标签树
+typedef struct hosts_rule {
+    const char *name; // 在文件中的位置
+    int len;
+    uint8_t flags;
+} Hosts_Rule;
+
+// 有误的记录
+typedef enum {
+    HOSTS_BAD_ADDRESS, HOSTS_BAD_NAME, HOSTS_BAD_RULE
+} Hosts_Error_Kind;
+
+typedef struct hosts_error {
+    const char *pos; // 在文件中的位置，加载结束后换算为行号
+    Hosts_Error_Kind kind;
+} Hosts_Error;
+
+// 一个线程解析的一段文件，begin与end都在行首
+typedef struct hosts_chunk {
+    const char *text; // 文件的起始地址
+    const char *begin;
+    const char *end;
+    Hosts_Entry *entries;
+    int count, capacity;
+    Hosts_Rule *rules;
+    int rule_count, rule_capacity;
+    Hosts_Error *errors;
+    int error_count, error_capacity;
+    Hosts_Arena *arena;
+    uint64_t lines;
+    uv_thread_t thread;
+    bool threaded; // 是否在新线程中解析
+} Hosts_Chunk;
+
+/**
+ * @brief 比较两项的哈希与偏移
+ */
+static int compare_entry(const void *a, const void *b) {
+    const Hosts_Entry *x = (const Hosts_Entry *) a, *y = (const Hosts_Entry *) b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int compare_error(const void *a, const void *b) {
+    const Hosts_Error *x = (const Hosts_Error *) a, *y = (const Hosts_Error *) b;
+    return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/**
+ * @brief 判断项与查询的域名是否相同
+ */
+static bool entry_name_equal(const Hosts_Entry *entry, const DNSKey *key) {
+    return entry->len == key->len && memcmp(entry->name, key->name, key->len) == 0;
+}
+
+static const Hosts_Entry *hosts_find(const Hosts_Index *index, const DNSKey *key) {
+    if (!index->filter->may_contain(index->filter, key->hash))
+        return NULL;
+    int lo = 0, hi = index->count;
+    while (lo < hi) { // 第一个哈希不小于key的项
+        int mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].hash < key->hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    bool named = false; // 是否有该域名的项，类型不符不算误判
+    for (; lo < index->count && index->entries[lo].hash == key->hash; ++lo) {
+        const Hosts_Entry *entry = &index->entries[lo];
+        if (entry_name_equal(entry, key)) {
+            if ((entry->type == DNS_TYPE_ANY || entry->type == key->qtype) && key->qclass == DNS_CLASS_IN)
+                return entry;
+            named = true;
+        }
+    }
+    if (!named)
+        metrics_count(METRIC_BLOOM_FALSE_POSITIVES);
+    return NULL;
+}
+
+/**
+ * @brief 数组已满时扩容
+ * @param array 数组
+ * @param count 元素个数
+ * @param capacity 容量，扩容后更新
+ * @param size 元素大小
+ * @return 扩容后的数组
+ */
+static void *grow(void *array, int count, int *capacity, size_t size) {
+    if (count < *capacity)
+        return array;
+    *capacity = *capacity ? *capacity * 2 : 64;
+    array = realloc(array, *capacity * size);
+    if (!array)
+        log_fatal("内存分配错误")
+    return array;
+}
+
+/**
+ * @brief 从内存块中分配，按8字节对齐
+ * @param arena 内存块链表的表头，当前块不足时在表头加入新块
+ * @param size 字节数，不超过HOSTS_ARENA_BLOCK_SIZE
+ * @return 分配的内存，内容为0，块由calloc分配，不再逐次清零
+ */
+static void *arena_alloc(Hosts_Arena **arena, size_t size) {
+    size = (size + 7) & ~(size_t) 7;
+    if (*arena == NULL || (*arena)->used + size > HOSTS_ARENA_BLOCK_SIZE) {
+        Hosts_Arena *block = (Hosts_Arena *) calloc(1, sizeof(Hosts_Arena));
+        if (!block)
+            log_fatal("内存分配错误")
+        block->next = *arena;
+        block->used = 0;
+        *arena = block;
+    }
+    void *ptr = (*arena)->data + (*arena)->used;
+    (*arena)->used += size;
+    return ptr;
+}
+
+static void add_error(Hosts_Chunk *chunk, const char *pos, Hosts_Error_Kind kind) {
+    chunk->errors = (Hosts_Error *) grow(chunk->errors, chunk->error_count, &chunk->error_capacity,
+                                         sizeof(Hosts_Error));
+    chunk->errors[chunk->error_count++] = (Hosts_Error) {pos, kind};
+}
+
+/**
+ * @brief 解析文本形式的地址
+ * @param token 地址，不以0结尾
+ * @param len 长度
+ * @param addr 输出，二进制的地址
+ * @return 地址的字节数，IPv4为4，IPv6为16，格式有误时返回0
+ */
+static int parse_address(const char *token, int len, uint8_t *addr) {
+    char ip[INET6_ADDRSTRLEN];
+    if (len >= (int) sizeof(ip) || !((token[0] >= '0' && token[0] <= '9') || memchr(token, ':', len) != NULL))
+        return 0; // 域名通常在这里就被排除
+    memcpy(ip, token, len);
+    ip[len] = 0;
+    if (memchr(token, '.', len) != NULL && uv_inet_pton(AF_INET, ip, addr) == 0)
+        return 4;
+    if (memchr(token, ':', len) != NULL && uv_inet_pton(AF_INET6, ip, addr) == 0)
+        return 16;
+    return 0;
+}
+
+/**
+ * @brief 判断地址是否表示屏蔽，即0.0.0.0
+ */
+static bool is_block_address(const uint8_t *addr, int addr_len) {
+    return addr_len == 4 && addr[0] == 0 && addr[1] == 0 && addr[2] == 0 && addr[3] == 0;
+}
+
+/**
+ * @brief 加入一项，记录分配在内存块中
+ * @param chunk 所在的段
+ * @param line 所在行的行首
+ * @param key 小写的域名与哈希
+ * @param type 类型
+ * @param rdata RDATA，直接引用而不复制，须在内存块中
+ * @param rdlength RDATA的长度
+ * @return 项中记录的域名
+ */
+static const uint8_t *add_entry(Hosts_Chunk *chunk, const char *line, const DNSKey *key, uint16_t type,
+                                uint8_t *rdata, int rdlength) {
+    DNSResourceRecord *rr = (DNSResourceRecord *) arena_alloc(&chunk->arena, sizeof(DNSResourceRecord));
+    rr->name = (uint8_t *) arena_alloc(&chunk->arena, key->len + 1);
+    memcpy(rr->name, key->name, key->len + 1);
+    rr->type = type;
+    rr->class = DNS_CLASS_IN;
+    rr->ttl = -1; // 永久有效
+    rr->rdlength = rdlength;
+    rr->rdata = rdata;
+    chunk->entries = (Hosts_Entry *) grow(chunk->entries, chunk->count, &chunk->capacity, sizeof(Hosts_Entry));
+    chunk->entries[chunk->count++] = (Hosts_Entry) {key->hash, (uint64_t) (line - chunk->text), rr->name, rr,
+                                                    key->len, type, 1};
+    return rr->name;
+}
+
+/**
+ * @brief 生成地址的反向域名，如“4.3.2.1.in-addr.arpa.”
+ * @param dst 目标缓冲区，至少HOSTS_REVERSE_NAME_SIZE字节
+ * @param addr 二进制的地址
+ * @param addr_len 地址的字节数
+ */
+static void reverse_name(uint8_t *dst, const uint8_t *addr, int addr_len) {
+    static const char HEX[] = "0123456789abcdef";
+    if (addr_len == 4) {
+        for (int i = 3; i >= 0; --i) {
+            if (addr[i] >= 100)
+                *dst++ = '0' + addr[i] / 100;
+            if (addr[i] >= 10)
+                *dst++ = '0' + addr[i] / 10 % 10;
+            *dst++ = '0' + addr[i] % 10;
+            *dst++ = '.';
+        }
+        strcpy((char *) dst, "in-addr.arpa.");
+    } else {
+        for (int i = 15; i >= 0; --i) { // 每个半字节一个标签，低位在前
+            *dst++ = HEX[addr[i] & 15];
+            *dst++ = '.';
+            *dst++ = HEX[addr[i] >> 4];
+            *dst++ = '.';
+        }
+        strcpy((char *) dst, "ip6.arpa.");
+    }
+}
+
+/**
+ * @brief 将一个域名与地址转换为记录，A与AAAA记录同时生成反向的PTR记录
+ * @param chunk 所在的段
+ * @param line 所在行的行首
+ * @param name 域名，不以0结尾
+ * @param len 域名长度
+ * @param addr 二进制的地址
+ * @param addr_len 地址的字节数
+ */
+static void add_record(Hosts_Chunk *chunk, const char *line, const char *name, int len, const uint8_t *addr,
+                       int addr_len) {
+    uint8_t text[DNS_KEY_NAME_MAX_SIZE];
+    bool dotted = name[len - 1] == '.';
+    if (len + (dotted ? 1 : 2) > DNS_KEY_NAME_MAX_SIZE) {
+        add_error(chunk, line, HOSTS_BAD_NAME);
+        return;
+    }
+    memcpy(text, name, len);
+    text[len] = '.';
+    text[len + !dotted] = 0;
+    DNSKey key; // 只用于小写与哈希，索引中只保存小写的域名
+    dnskey_init(&key, text, 0, 0);
+    uint8_t *rdata = (uint8_t *) arena_alloc(&chunk->arena, addr_len);
+    memcpy(rdata, addr, addr_len);
+    if (is_block_address(addr, addr_len)) {
+        add_entry(chunk, line, &key, DNS_TYPE_ANY, rdata, addr_len);
+        return;
+    }
+    const uint8_t *owner = add_entry(chunk, line, &key, addr_len == 4 ? DNS_TYPE_A : DNS_TYPE_AAAA, rdata, addr_len);
+    uint8_t reverse[HOSTS_REVERSE_NAME_SIZE];
+    reverse_name(reverse, addr, addr_len);
+    dnskey_init(&key, reverse, 0, 0);
+    add_entry(chunk, line, &key, DNS_TYPE_PTR, (uint8_t *) owner, (int) strlen((const char *) owner) + 1);
+}
+
+/**
+ * @brief 记录后缀规则
+ * @return 如果name是后缀规则，返回true
+ */
+static bool add_rule(Hosts_Chunk *chunk, const char *line, const char *name, int len, bool blocking) {
+    char text[DNS_NAME_TEXT_MAX_SIZE + 4];
+    if (len < 3 || (name[0] != '*' && name[0] != '|')) // 绝大多数域名在这里返回
+        return false;
+    if (len >= (int) sizeof(text)) {
+        add_error(chunk, line, HOSTS_BAD_RULE);
+        return true;
+    }
+    memcpy(text, name, len);
+    text[len] = 0;
+    const char *suffix;
+    int suffix_len;
+    uint8_t flags = suffix_rule_parse(text, &suffix, &suffix_len);
+    if (flags == 0)
+        return false;
+    if (!blocking) { // 后缀规则只用于屏蔽
+        add_error(chunk, line, HOSTS_BAD_RULE);
+        return true;
+    }
+    chunk->rules = (Hosts_Rule *) grow(chunk->rules, chunk->rule_count, &chunk->rule_capacity, sizeof(Hosts_Rule));
+    chunk->rules[chunk->rule_count++] = (Hosts_Rule) {name + (suffix - text), suffix_len, flags};
+    return true;
+}
+
+/**
+ * @brief 解析一行
+ * @param chunk 所在的段
+ * @param line 行首
+ * @param end 行尾，不含换行符
+ */
+static void parse_line(Hosts_Chunk *chunk, const char *line, const char *end) {
+    const char *comment = (const char *) memchr(line, '#', end - line);
+    if (comment != NULL)
+        end = comment;
+    const char *tokens[HOSTS_LINE_MAX_TOKENS];
+    int lens[HOSTS_LINE_MAX_TOKENS], count = 0;
+    for (const char *p = line; p < end && count < HOSTS_LINE_MAX_TOKENS;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        const char *start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+            ++p;
+        if (p > start) {
+            tokens[count] = start;
+            lens[count++] = (int) (p - start);
+        }
+    }
+    if (count == 0)
+        return;
+    uint8_t addr[16];
+    int addr_len = parse_address(tokens[0], lens[0], addr);
+    if (addr_len != 0) { // 地址 域名...
+        bool blocking = is_block_address(addr, addr_len);
+        for (int i = 1; i < count; ++i)
+            if (!add_rule(chunk, line, tokens[i], lens[i], blocking))
+                add_record(chunk, line, tokens[i], lens[i], addr, addr_len);
+        return;
+    }
+    // 域名 地址...，后缀规则可以不写地址
+    if (tokens[0][0] == '*' || tokens[0][0] == '|') {
+        bool blocking = true;
+        for (int i = 1; i < count && blocking; ++i)
+            blocking = parse_address(tokens[i], lens[i], addr) == 4 && is_block_address(addr, 4);
+        if (add_rule(chunk, line, tokens[0], lens[0], blocking))
+            return;
+    }
+    for (int i = 1; i < count; ++i) {
+        addr_len = parse_address(tokens[i], lens[i], addr);
+        if (addr_len == 0)
+            add_error(chunk, line, HOSTS_BAD_ADDRESS);
+        else
+            add_record(chunk, line, tokens[0], lens[0], addr, addr_len);
+    }
+}
+
+/**
+ * @brief 按哈希与偏移排序
+ * @details 先按哈希的高HOSTS_SORT_BITS位一趟分桶，哈希均匀时每桶只有几项，再在桶内插入排序
+ * @param entries 项
+ * @param count 项数
+ */
+static void sort_entries(Hosts_Entry *entries, int count) {
+    if (count < 2)
+        return;
+    int *ends = (int *) calloc(1 << HOSTS_SORT_BITS, sizeof(int));
+    Hosts_Entry *sorted = (Hosts_Entry *) malloc(count * sizeof(Hosts_Entry));
+    if (!ends || !sorted)
+        log_fatal("内存分配错误")
+    for (int i = 0; i < count; ++i)
+        ++ends[entries[i].hash >> (64 - HOSTS_SORT_BITS)];
+    for (int b = 0, start = 0; b < 1 << HOSTS_SORT_BITS; ++b) { // 先记下每桶的起点，分桶写完后恰为终点
+        int n = ends[b];
+        ends[b] = start;
+        start += n;
+    }
+    for (int i = 0; i < count; ++i)
+        sorted[ends[entries[i].hash >> (64 - HOSTS_SORT_BITS)]++] = entries[i];
+    for (int b = 0; b < 1 << HOSTS_SORT_BITS; ++b) {
+        int start = b ? ends[b - 1] : 0;
+        for (int i = start + 1; i < ends[b]; ++i) {
+            Hosts_Entry entry = sorted[i];
+            int j = i;
+            for (; j > start && compare_entry(&sorted[j - 1], &entry) > 0; --j)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = entry;
+        }
+    }
+    memcpy(entries, sorted, count * sizeof(Hosts_Entry));
+    free(sorted);
+    free(ends);
+}
+
+/**
+ * @brief 解析一段文件并按哈希与偏移排序，在解析线程中运行
+ */
+static void parse_chunk(void *arg) {
+    Hosts_Chunk *chunk = (Hosts_Chunk *) arg;
+    for (const char *line = chunk->begin; line < chunk->end; ++chunk->lines) {
+        const char *end = (const char *) memchr(line, '\n', chunk->end - line); // 由libc向量化
+        if (end == NULL)
+            end = chunk->end;
+        parse_line(chunk, line, end);
+        line = end + 1;
+    }
+    sort_entries(chunk->entries, chunk->count);
+}
+
+/**
+ * @brief 读取整个文件，允许且能mmap时直接映射
+ * @param hosts_file hosts文件
+ * @param map 是否允许映射。映射的文件在解析中被原地改写变短时，访问超出文件末尾的页会触发SIGBUS
+ * @param size 输出，文件大小
+ * @param mapped 输出，是否为映射
+ * @return 文件内容，读取失败或文件为空时返回NULL
+ */
+static char *read_hosts(FILE *hosts_file, bool map, size_t *size, bool *mapped) {
+    struct stat st;
+    int fd = fileno(hosts_file);
+    size_t capacity = 0;
+    *size = 0;
+    *mapped = false;
+    if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0)
+            return NULL;
+        capacity = st.st_size + 1; // 读入缓冲区时通常一次读完，多出的一字节用于发现文件在读取中变长
+    }
+    if (map && capacity != 0) {
+        void *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text != MAP_FAILED) {
+            madvise(text, st.st_size, MADV_SEQUENTIAL);
+            *size = st.st_size;
+            *mapped = true;
+            return (char *) text;
+        }
+    }
+    char *text = capacity ? (char *) malloc(capacity) : NULL;
+    if (capacity && !text)
+        log_fatal("内存分配错误")
+    for (size_t n = 1; n > 0; *size += n) {
+        if (*size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            text = (char *) realloc(text, capacity);
+            if (!text)
+                log_fatal("内存分配错误")
+        }
+        n = fread(text + *size, 1, capacity - *size, hosts_file);
+    }
+    if (*size == 0) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/**
+ * @brief 合并各段中已排序的项，并把同一域名、同一类型的项合并为一个回答
+ * @param index hosts索引
+ * @param chunks 各段
+ * @param count 段数
+ */
+static void merge_chunks(Hosts_Index *index, Hosts_Chunk *chunks, int count) {
+    int total = 0, next[HOSTS_MAX_THREADS] = {0};
+    for (int i = 0; i < count; ++i)
+        total += chunks[i].count;
+    index->entries = (Hosts_Entry *) malloc((total ? total : 1) * sizeof(Hosts_Entry));
+    if (!index->entries)
+        log_fatal("内存分配错误")
+    int run = 0; // 当前哈希相同的项的起点
+    while (true) {
+        int min = -1;
+        for (int i = 0; i < count; ++i)
+            if (next[i] < chunks[i].count &&
+                (min < 0 || compare_entry(&chunks[i].entries[next[i]], &chunks[min].entries[next[min]]) < 0))
+                min = i;
+        if (min < 0)
+            break;
+        Hosts_Entry *entry = &chunks[min].entries[next[min]++];
+        if (index->count == 0 || index->entries[index->count - 1].hash != entry->hash)
+            run = index->count;
+        int same = run;
+        while (same < index->count && (index->entries[same].type != entry->type ||
+                                       index->entries[same].len != entry->len ||
+                                       memcmp(index->entries[same].name, entry->name, entry->len) != 0))
+            ++same;
+        if (same == index->count) {
+            index->entries[index->count++] = *entry;
+            index->stats.reverse += entry->type == DNS_TYPE_PTR;
+            continue;
+        }
+        // 已有同一域名、同一类型的项，屏蔽项只保留第一个，同一地址只回答文件中的第一个域名，相同的地址去重
+        Hosts_Entry *first = &index->entries[same];
+        if (first->type == DNS_TYPE_ANY || first->type == DNS_TYPE_PTR || first->ancount == UINT16_MAX)
+            continue;
+        DNSResourceRecord *tail = first->rr;
+        bool duplicate = memcmp(tail->rdata, entry->rr->rdata, tail->rdlength) == 0;
+        for (; tail->next != NULL && !duplicate; tail = tail->next)
+            duplicate = memcmp(tail->next->rdata, entry->rr->rdata, tail->next->rdlength) == 0;
+        if (!duplicate) {
+            tail->next = entry->rr;
+            ++first->ancount;
+        }
+    }
+}
+
+Hosts_Index *new_hosts_index(FILE *hosts_file) {
+    return new_hosts_index_split(hosts_file, 0, true);
+}
+
+Hosts_Index *new_hosts_index_split(FILE *hosts_file, int threads, bool map) {
+    uint64_t start = uv_hrtime();
+    Hosts_Index *index = (Hosts_Index *) calloc(1, sizeof(Hosts_Index));
+    if (!index)
+        log_fatal("内存分配错误")
+    index->find = &hosts_find;
+    index->suffixes = new_suffix_trie();
+    size_t size = 0;
+    bool mapped = false;
+    char *text = hosts_file ? read_hosts(hosts_file, map, &size, &mapped) : NULL;
+
+    // 按字节数平均切分，每段的边界移到下一行的行首
+    if (threads <= 0) {
+        threads = (int) ((size + HOSTS_CHUNK_MIN_SIZE - 1) / HOSTS_CHUNK_MIN_SIZE);
+        if (threads > (int) uv_available_parallelism())
+            threads = (int) uv_available_parallelism();
+    }
+    if (threads > HOSTS_MAX_THREADS)
+        threads = HOSTS_MAX_THREADS;
+    if (threads < 1)
+        threads = 1;
+    Hosts_Chunk chunks[HOSTS_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    const char *begin = text;
+    for (int i = 0; i < threads; ++i) {
+        const char *end = text + size * (i + 1) / threads;
+        if (end < begin)
+            end = begin;
+        if (i < threads - 1 && end > text) {
+            const char *newline = (const char *) memchr(end - 1, '\n', text + size - (end - 1));
+            end = newline ? newline + 1 : text + size;
+        }
+        chunks[i].text = text;
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+    for (int i = 1; i < threads; ++i) {
+        chunks[i].threaded = uv_thread_create(&chunks[i].thread, &parse_chunk, &chunks[i]) == 0;
+        if (!chunks[i].threaded) // 无法创建线程时在当前线程解析
+            parse_chunk(&chunks[i]);
+    }
+    parse_chunk(&chunks[0]);
+    for (int i = 1; i < threads; ++i)
+        if (chunks[i].threaded)
+            uv_thread_join(&chunks[i].thread);
+
+    merge_chunks(index, chunks, threads);
+    uint64_t line = 1;
+    const char *cursor = text;
+    for (int i = 0; i < threads; ++i) {
+        Hosts_Chunk *chunk = &chunks[i];
+        for (int r = 0; r < chunk->rule_count; ++r)
+            if (!index->suffixes->insert(index->suffixes, chunk->rules[r].name, chunk->rules[r].len,
+                                         chunk->rules[r].flags))
+                add_error(chunk, chunk->rules[r].name, HOSTS_BAD_RULE);
+        if (chunk->error_count > 1)
+            qsort(chunk->errors, chunk->error_count, sizeof(Hosts_Error), &compare_error);
+        for (int e = 0; e < chunk->error_count; ++e) { // 换算行号，位置单调递增，整个文件只扫描一遍
+            for (const char *p; (p = (const char *) memchr(cursor, '\n', chunk->errors[e].pos - cursor)) != NULL;
+                 cursor = p + 1)
+                ++line;
+            if (chunk->errors[e].kind == HOSTS_BAD_ADDRESS) {
+                log_error("hosts文件第%llu行的地址有误", (unsigned long long) line)
+            } else if (chunk->errors[e].kind == HOSTS_BAD_NAME) {
+                log_error("hosts文件第%llu行的域名有误", (unsigned long long) line)
+            } else {
+                log_error("hosts文件第%llu行的后缀规则有误，只支持屏蔽", (unsigned long long) line)
+            }
+        }
+        index->stats.lines += chunk->lines;
+        index->stats.errors += chunk->error_count;
+        while (chunk->arena != NULL) { // 内存块转交给索引
+            Hosts_Arena *block = chunk->arena;
+            chunk->arena = block->next;
+            block->next = index->arena;
+            index->arena = block;
+        }
+        free(chunk->entries);
+        free(chunk->rules);
+        free(chunk->errors);
+    }
+    if (mapped)
+        munmap(text, size);
+    else
+        free(text);
+
+    index->filter = new_bloom_filter(bloom_block_count(index->count));
+    for (int i = 0; i < index->count; ++i)
+        index->filter->add(index->filter, index->entries[i].hash);
+    index->stats.bytes = size;
+    index->stats.threads = threads;
+    index->stats.duration = uv_hrtime() - start;
+    return index;
+}
+
+RBTreeValue *hosts_entry_value(const Hosts_Entry *entry) {
+    RBTreeValue *value = (RBTreeValue *) calloc(1, sizeof(RBTreeValue));
+    if (!value)
+        log_fatal("内存分配错误")
+    value->rr = copy_dnsrr(entry->rr);
+    value->ancount = entry->ancount;
+    dnskey_init(&value->key, entry->name, entry->type, DNS_CLASS_IN);
+    return value;
+}
+
+void destroy_hosts_index(Hosts_Index *index) {
+    while (index->arena != NULL) {
+        Hosts_Arena *next = index->arena->next;
+        free(index->arena);
+        index->arena = next;
+    }
+    free(index->entries);
+    destroy_bloom_filter(index->filter);
+    destroy_suffix_trie(index->suffixes);
+    free(index);
+}
+
+/**
+ * @brief 在线程池中读取hosts文件并建立索引
+ */
+static void reload_work(uv_work_t *req) {
+    FILE *hosts_file = fopen(HOSTS_PATH, "r");
+    // 读入缓冲区而不映射：文件可能正被原地改写（如cat new > hosts.txt），映射的页在文件变短后访问会触发SIGBUS
+    reload.result = hosts_file ? new_hosts_index_split(hosts_file, 0, false) : NULL;
+    if (hosts_file)
+        fclose(hosts_file);
+}
+
+static void start_reload();
+
+/**
+ * @brief 回到事件循环线程后替换索引
+ */
+static void reload_done(uv_work_t *req, int status) {
+    reload.running = false;
+    if (status == 0 && reload.result != NULL) {
+        metrics_count(METRIC_HOSTS_RELOADS);
+        log_info("hosts文件已重新加载，%d项，后缀规则%d条，%d线程，耗时%lluus", reload.result->count,
+                 reload.result->suffixes->rules, reload.result->stats.threads,
+                 (unsigned long long) (reload.result->stats.duration / 1000))
+        reload.cache->set_hosts(reload.cache, reload.result);
+    } else {
+        metrics_count(METRIC_HOSTS_RELOAD_FAILURES);
+        log_error("hosts文件重新加载失败，继续使用旧的记录")
+    }
+    reload.result = NULL;
+    if (reload.pending) {
+        reload.pending = false;
+        start_reload();
+    }
+}
+
+static void start_reload() {
+    if (reload.running) {
+        reload.pending = true;
+        return;
+    }
+    reload.running = true;
+    uv_queue_work(reload.watcher.loop, &reload.work, &reload_work, &reload_done);
+}
+
+static void on_delay(uv_timer_t *timer) {
+    start_reload();
+}
+
+static void on_hosts_change(uv_fs_event_t *handle, const char *filename, int events, int status) {
+    if (status < 0) {
+        log_error("hosts文件监视异常 %d", status)
+        return;
+    }
+    if (filename != NULL && strcmp(filename, reload.base) != 0)
+        return;
+    uv_timer_start(&reload.delay, &on_delay, HOSTS_RELOAD_DELAY, 0);
+}
+
+/**
+ * @brief 导出hosts热加载的指标
+ */
+static void collect_hosts(Metrics_Buffer *buf, void *data) {
+    epoch_enter();
+    const Hosts_Load_Stats *stats = &atomic_load_explicit(&reload.cache->hosts, memory_order_acquire)->stats;
+    metrics_printf(buf, "# HELP nodns_hosts_reload_duration_seconds Time taken by the last successful hosts load\n"
+                        "# TYPE nodns_hosts_reload_duration_seconds gauge\n"
+                        "nodns_hosts_reload_duration_seconds %.6f\n"
+                        "# HELP nodns_hosts_load_bytes Size of the hosts file at the last successful load\n"
+                        "# TYPE nodns_hosts_load_bytes gauge\nnodns_hosts_load_bytes %llu\n"
+                        "# HELP nodns_hosts_load_lines Lines in the hosts file at the last successful load\n"
+                        "# TYPE nodns_hosts_load_lines gauge\nnodns_hosts_load_lines %llu\n"
+                        "# HELP nodns_hosts_load_errors Records skipped as malformed at the last successful load\n"
+                        "# TYPE nodns_hosts_load_errors gauge\nnodns_hosts_load_errors %llu\n"
+                        "# HELP nodns_hosts_load_threads Parser threads used by the last successful load\n"
+                        "# TYPE nodns_hosts_load_threads gauge\nnodns_hosts_load_threads %d\n"
+                        "# HELP nodns_hosts_reverse_entries PTR records generated from hosts addresses\n"
+                        "# TYPE nodns_hosts_reverse_entries gauge\nnodns_hosts_reverse_entries %llu\n",
+                   stats->duration / 1e9, (unsigned long long) stats->bytes, (unsigned long long) stats->lines,
+                   (unsigned long long) stats->errors, stats->threads, (unsigned long long) stats->reverse);
+    epoch_exit();
+}
+
+void init_hosts_reload(uv_loop_t *loop, struct cache *cache) {
+    reload.cache = cache;
+    reload.dir = strdup(HOSTS_PATH);
+    if (!reload.dir)
+        log_fatal("内存分配错误")
+    char *slash = strrchr(reload.dir, '/');
+    if (slash == NULL) {
+        reload.base = HOSTS_PATH;
+        strcpy(reload.dir, ".");
+    } else {
+        reload.base = HOSTS_PATH + (slash - reload.dir) + 1;
+        slash[slash == reload.dir] = 0; // 根目录保留"/"
+    }
+    uv_timer_init(loop, &reload.delay);
+    uv_fs_event_init(loop, &reload.watcher);
+    int status = uv_fs_event_start(&reload.watcher, &on_hosts_change, reload.dir, 0);
+    if (status != 0)
+        log_error("无法监视hosts文件所在的目录 %d", status)
+    metrics_register(&collect_hosts, NULL);
+}
@@ -0,0 +1,275 @@
+/**
+ * @file      local_zone.c
+ * @brief     本地区域
+ * @details   本文件的内容是本地区域表的建立与作答。各区域顶点的记录在建表时生成，作答时复制；
+ *            区域名按标签建成反向标签树，查找代价只与查询域名的标签数有关。
+*/
+
+#include "../include/local_zone.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/dns_conversion.h"
+#include "../include/dns_log.h"
+#include "../include/dns_metrics.h"
+#include "../include/dns_name.h"
+
+#define LOCAL_ZONE_RNAME "nobody.invalid." // RFC 6303 3. SOA的RNAME
+
+// 内置区域
+static const char *DEFAULT_ZONES[] = {
+        // RFC 6303 4.2. RFC 1918私有地址
+        "10.in-addr.arpa", "16.172.in-addr.arpa", "17.172.in-addr.arpa", "18.172.in-addr.arpa", "19.172.in-addr.arpa",
+        "20.172.in-addr.arpa", "21.172.in-addr.arpa", "22.172.in-addr.arpa", "23.172.in-addr.arpa",
+        "24.172.in-addr.arpa", "25.172.in-addr.arpa", "26.172.in-addr.arpa", "27.172.in-addr.arpa",
+        "28.172.in-addr.arpa", "29.172.in-addr.arpa", "30.172.in-addr.arpa", "31.172.in-addr.arpa",
+        "168.192.in-addr.arpa",
+        // RFC 6303 4.3. 本网络、环回、链路本地、文档与广播地址
+        "0.in-addr.arpa", "127.in-addr.arpa", "254.169.in-addr.arpa", "2.0.192.in-addr.arpa",
+        "100.51.198.in-addr.arpa", "113.0.203.in-addr.arpa", "255.255.255.255.in-addr.arpa",
+        // RFC 6303 4.4.-4.8. IPv6未指定、环回、唯一本地、链路本地与文档地址
+        "0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.ip6.arpa",
+        "1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.ip6.arpa",
+        "d.f.ip6.arpa", "8.e.f.ip6.arpa", "9.e.f.ip6.arpa", "a.e.f.ip6.arpa", "b.e.f.ip6.arpa",
+        "8.b.d.0.1.0.0.2.ip6.arpa",
+        // RFC 7793 运营商级NAT共享地址
+        "64.100.in-addr.arpa", "65.100.in-addr.arpa", "66.100.in-addr.arpa", "67.100.in-addr.arpa",
+        "68.100.in-addr.arpa", "69.100.in-addr.arpa", "70.100.in-addr.arpa", "71.100.in-addr.arpa",
+        "72.100.in-addr.arpa", "73.100.in-addr.arpa", "74.100.in-addr.arpa", "75.100.in-addr.arpa",
+        "76.100.in-addr.arpa", "77.100.in-addr.arpa", "78.100.in-addr.arpa", "79.100.in-addr.arpa",
+        "80.100.in-addr.arpa", "81.100.in-addr.arpa", "82.100.in-addr.arpa", "83.100.in-addr.arpa",
+        "84.100.in-addr.arpa", "85.100.in-addr.arpa", "86.100.in-addr.arpa", "87.100.in-addr.arpa",
+        "88.100.in-addr.arpa", "89.100.in-addr.arpa", "90.100.in-addr.arpa", "91.100.in-addr.arpa",
+        "92.100.in-addr.arpa", "93.100.in-addr.arpa", "94.100.in-addr.arpa", "95.100.in-addr.arpa",
+        "96.100.in-addr.arpa", "97.100.in-addr.arpa", "98.100.in-addr.arpa", "99.100.in-addr.arpa",
+        "100.100.in-addr.arpa", "101.100.in-addr.arpa", "102.100.in-addr.arpa", "103.100.in-addr.arpa",
+        "104.100.in-addr.arpa", "105.100.in-addr.arpa", "106.100.in-addr.arpa", "107.100.in-addr.arpa",
+        "108.100.in-addr.arpa", "109.100.in-addr.arpa", "110.100.in-addr.arpa", "111.100.in-addr.arpa",
+        "112.100.in-addr.arpa", "113.100.in-addr.arpa", "114.100.in-addr.arpa", "115.100.in-addr.arpa",
+        "116.100.in-addr.arpa", "117.100.in-addr.arpa", "118.100.in-addr.arpa", "119.100.in-addr.arpa",
+        "120.100.in-addr.arpa", "121.100.in-addr.arpa", "122.100.in-addr.arpa", "123.100.in-addr.arpa",
+        "124.100.in-addr.arpa", "125.100.in-addr.arpa", "126.100.in-addr.arpa", "127.100.in-addr.arpa",
+        // RFC 6761、RFC 6762、RFC 7686、RFC 8375与ICANN保留的特殊用途域名
+        "localhost", "invalid", "test", "onion", "local", "internal", "home.arpa"};
+
+/**
+ * @brief 把区域名规范为小写、以'.'结尾的形式
+ * @param dst 目标缓冲区，至少DNS_NAME_TEXT_MAX_SIZE + 1字节
+ * @param name 区域名
+ * @param len 区域名的长度
+ * @return 规范后的长度，为空、含有空标签、过长的标签或不能用于域名的字符时返回0
+ */
+static int normalize_name(char *dst, const char *name, int len) {
+    if (len > 0 && name[len - 1] == '.')
+        --len;
+    if (len <= 0 || len > DNS_NAME_TEXT_MAX_SIZE - 1)
+        return 0;
+    for (int i = 0, label = 0; i < len; ++i) {
+        char c = name[i];
+        label = c == '.' ? 0 : label + 1;
+        if (label > DNS_NAME_LABEL_MAX_SIZE || (c == '.' && (i == 0 || name[i - 1] == '.')))
+            return 0;
+        if ((uint8_t) (c - 'A') < 26)
+            c |= 0x20;
+        if (!((uint8_t) (c - 'a') < 26 || (uint8_t) (c - '0') < 10 || c == '-' || c == '_' || c == '.'))
+            return 0;
+        dst[i] = c;
+    }
+    dst[len] = '.';
+    dst[len + 1] = 0;
+    return len + 1;
+}
+
+/**
+ * @brief 生成区域顶点的一条记录
+ * @param zone 区域
+ * @param type 记录类型
+ * @param rdata RDATA
+ * @param rdlength RDATA的字节数
+ */
+static void add_record(Local_Zone *zone, uint16_t type, const uint8_t *rdata, uint16_t rdlength) {
+    DNSResourceRecord *rr = (DNSResourceRecord *) calloc(1, sizeof(DNSResourceRecord));
+    if (!rr)
+        log_fatal("内存分配错误")
+    rr->name = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t));
+    rr->rdata = (uint8_t *) calloc(DNS_RR_NAME_MAX_SIZE, sizeof(uint8_t)); // 与复制时相同，按块读取域名时不越界
+    if (!rr->name || !rr->rdata)
+        log_fatal("内存分配错误")
+    memcpy(rr->name, zone->name, zone->len + 1);
+    memcpy(rr->rdata, rdata, rdlength);
+    rr->type = type;
+    rr->class = DNS_CLASS_IN;
+    rr->ttl = LOCAL_ZONE_TTL;
+    rr->rdlength = rdlength;
+    zone->records[zone->record_count++] = rr;
+    if (type == DNS_TYPE_SOA)
+        zone->soa = rr;
+}
+
+static void write_uint32_be(uint8_t *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/**
+ * @brief 生成区域顶点的记录：RFC 6303 3.中的SOA与NS，localhost另有A与AAAA
+ * @param zone 区域
+ */
+static void init_records(Local_Zone *zone) {
+    uint8_t rdata[DNS_RR_NAME_MAX_SIZE];
+    int len = zone->len + 1;
+    memcpy(rdata, zone->name, len); // MNAME为区域本身
+    memcpy(rdata + len, LOCAL_ZONE_RNAME, sizeof(LOCAL_ZONE_RNAME));
+    len += sizeof(LOCAL_ZONE_RNAME);
+    const uint32_t soa[5] = {1, 3600, 1200, 604800, LOCAL_ZONE_TTL}; // SERIAL、REFRESH、RETRY、EXPIRE、MINIMUM
+    for (int i = 0; i < 5; ++i, len += 4)
+        write_uint32_be(rdata + len, soa[i]);
+    add_record(zone, DNS_TYPE_SOA, rdata, len);
+    add_record(zone, DNS_TYPE_NS, (const uint8_t *) zone->name, zone->len + 1);
+    if (strcmp(zone->name, "localhost.") == 0) { // RFC 6761 6.3.
+        const uint8_t v4[4] = {127, 0, 0, 1}, v6[16] = {[15] = 1};
+        add_record(zone, DNS_TYPE_A, v4, sizeof(v4));
+        add_record(zone, DNS_TYPE_AAAA, v6, sizeof(v6));
+    }
+}
+
+static Local_Zone *zones_find(const Local_Zones *zones, const DNSKey *key) {
+    const Suffix_Trie_Node *node = zones->trie->find(zones->trie, key);
+    return node ? &zones->zones[node->value] : NULL;
+}
+
+static void zones_answer(Local_Zone *zone, DNSMessage *msg) {
+    const DNSQuestion *que = msg->que;
+    bool apex = que->key.len == zone->len;
+    destroy_dnsrr(msg->rr);
+    msg->rr = NULL;
+    DNSResourceRecord **tail = &msg->rr;
+    uint16_t ancount = 0, nscount = 0;
+    for (int i = 0; apex && i < zone->record_count; ++i) {
+        if (que->qtype != DNS_TYPE_ANY && que->qtype != zone->records[i]->type)
+            continue;
+        *tail = copy_dnsrr(zone->records[i]);
+        tail = &(*tail)->next;
+        ++ancount;
+    }
+    if (ancount == 0) { // NXDOMAIN或NODATA，RFC 2308 3. 附带SOA供否定缓存
+        *tail = copy_dnsrr(zone->soa);
+        ++nscount;
+    }
+    msg->header->qr = DNS_QR_ANSWER;
+    msg->header->aa = 1;
+    msg->header->tc = 0;
+    msg->header->ra = msg->header->rd;
+    msg->header->rcode = apex ? DNS_RCODE_OK : DNS_RCODE_NXDOMAIN;
+    msg->header->ancount = ancount;
+    msg->header->nscount = nscount;
+    msg->header->arcount = 0;
+    ++zone->answers;
+}
+
+/**
+ * @brief 导出各区域的作答计数
+ */
+static void collect_local_zones(Metrics_Buffer *buf, void *data) {
+    const Local_Zones *zones = (const Local_Zones *) data;
+    metrics_printf(buf, "# HELP nodns_local_zone_answers_total Queries answered from a local zone\n"
+                        "# TYPE nodns_local_zone_answers_total counter\n");
+    for (int i = 0; i < zones->count; ++i)
+        metrics_printf(buf, "nodns_local_zone_answers_total{zone=\"%.*s\"} %llu\n", zones->zones[i].len - 1,
+                       zones->zones[i].name, (unsigned long long) zones->zones[i].answers);
+}
+
+/**
+ * @brief 在区域表中查找区域名
+ * @return 下标，不存在时返回-1
+ */
+static int index_of(const Local_Zones *zones, const char *name) {
+    for (int i = 0; i < zones->count; ++i)
+        if (strcmp(zones->zones[i].name, name) == 0)
+            return i;
+    return -1;
+}
+
+static void add_zone(Local_Zones *zones, const char *name, int len) {
+    if (zones->count == zones->capacity) {
+        zones->capacity = zones->capacity ? zones->capacity * 2 : 64;
+        zones->zones = (Local_Zone *) realloc(zones->zones, zones->capacity * sizeof(Local_Zone));
+        if (!zones->zones)
+            log_fatal("内存分配错误")
+    }
+    Local_Zone *zone = &zones->zones[zones->count++];
+    memset(zone, 0, sizeof(Local_Zone));
+    zone->name = strdup(name);
+    if (!zone->name)
+        log_fatal("内存分配错误")
+    zone->len = len;
+}
+
+static void remove_zone(Local_Zones *zones, int i) {
+    free(zones->zones[i].name);
+    memmove(zones->zones + i, zones->zones + i + 1, (zones->count - i - 1) * sizeof(Local_Zone));
+    --zones->count;
+}
+
+/**
+ * @brief 按配置增删区域
+ * @param zones 本地区域表，其中只有区域名
+ * @param spec 配置
+ * @return 配置有误时返回false
+ */
+static bool apply_spec(Local_Zones *zones, const char *spec) {
+    char name[DNS_NAME_TEXT_MAX_SIZE + 1];
+    for (int n = 1; *spec; ++n) {
+        const char *end = strchr(spec, ',');
+        int len = end ? (int) (end - spec) : (int) strlen(spec);
+        if (len == 4 && strncmp(spec, "none", 4) == 0) {
+            while (zones->count > 0)
+                remove_zone(zones, zones->count - 1);
+        } else {
+            bool removing = len > 0 && spec[0] == '-';
+            int name_len = normalize_name(name, spec + removing, len - removing);
+            if (name_len == 0) {
+                log_error("第%d个本地区域有误", n)
+                return false;
+            }
+            int i = index_of(zones, name);
+            if (removing && i >= 0)
+                remove_zone(zones, i);
+            else if (!removing && i < 0)
+                add_zone(zones, name, name_len);
+        }
+        spec += len + (end != NULL);
+    }
+    return true;
+}
+
+Local_Zones *new_local_zones(const char *spec) {
+    Local_Zones *zones = (Local_Zones *) calloc(1, sizeof(Local_Zones));
+    if (!zones)
+        log_fatal("内存分配错误")
+    char name[DNS_NAME_TEXT_MAX_SIZE + 1];
+    for (size_t i = 0; i < sizeof(DEFAULT_ZONES) / sizeof(DEFAULT_ZONES[0]); ++i)
+        add_zone(zones, name, normalize_name(name, DEFAULT_ZONES[i], (int) strlen(DEFAULT_ZONES[i])));
+    if (spec != NULL && !apply_spec(zones, spec)) {
+        for (int i = 0; i < zones->count; ++i)
+            free(zones->zones[i].name);
+        free(zones->zones);
+        free(zones);
+        return NULL;
+    }
+    zones->trie = new_suffix_trie();
+    for (int i = 0; i < zones->count; ++i) {
+        Local_Zone *zone = &zones->zones[i];
+        init_records(zone);
+        Suffix_Trie_Node *node = zones->trie->insert(zones->trie, zone->name, zone->len,
+                                                     SUFFIX_MATCH_SELF | SUFFIX_MATCH_BELOW);
+        node->value = i;
+    }
+    zones->find = &zones_find;
+    zones->answer = &zones_answer;
+    metrics_register(&collect_local_zones, zones);
+    return zones;
+}
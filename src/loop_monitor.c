@@ -0,0 +1,197 @@
+/**
+ * @file      loop_monitor.c
+ * @brief     事件循环监控
+ * @details   本文件的内容是事件循环健康监控的实现。每轮循环在prepare阶段结束：本轮的忙碌时间等于两次prepare之间的
+ *            时间减去期间在poll中的空闲时间（uv_metrics_idle_time），I/O回调在poll阶段执行，因此也计入忙碌时间；
+ *            check阶段紧跟在poll之后，prepare到check之间扣除空闲的部分即为执行I/O回调的时间。
+ *            看门狗线程每隔阈值的四分之一发送一次uv_async，等待事件循环响应；超过阈值仍未响应时记一次卡顿，
+ *            并向事件循环线程发送SIGUSR2，由信号处理函数用backtrace_symbols_fd把卡住时的调用栈直接写入日志文件。
+*/
+
+#include "../include/loop_monitor.h"
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/dns_config.h"
+#include "../include/dns_log.h"
+#include "../include/dns_metrics.h"
+
+#define LOOP_BACKTRACE_MAX_DEPTH 64
+#define LOOP_STALL_SIGNAL SIGUSR2
+
+unsigned loop_callbacks;
+
+static uv_prepare_t prepare_handle;
+static uv_check_t check_handle;
+static uv_async_t ping_handle;
+static uv_thread_t watchdog;
+static pthread_t loop_thread; // 运行事件循环的线程
+
+static uint64_t last_prepare; // 上一次prepare的时刻
+static uint64_t last_idle; // 上一次prepare时的累计空闲时间
+static Metrics_Histogram busy_hist; // 每轮循环的忙碌时间（纳秒）
+static Metrics_Histogram io_hist; // 每轮循环中poll阶段执行I/O回调的时间（纳秒）
+static Metrics_Histogram callback_hist; // 每轮循环的回调数
+static Metrics_Histogram lag_hist; // 看门狗的探测延迟（纳秒）
+static atomic_uint_fast64_t iterations;
+static atomic_uint_fast64_t max_busy; // 最长的一轮忙碌时间（纳秒）
+
+static atomic_uint_fast64_t ping_sent; // 最近一次探测的发送时刻，为0表示没有未响应的探测
+static atomic_uint_fast64_t stalls; // 卡顿次数
+static atomic_uint_fast64_t max_lag; // 最长的探测延迟（纳秒）
+
+/**
+ * @brief prepare阶段的回调函数，结束一轮循环的统计
+ * @param handle prepare句柄
+ */
+static void on_prepare(uv_prepare_t *handle) {
+    uint64_t now = uv_hrtime();
+    uint64_t idle = uv_metrics_idle_time(handle->loop);
+    if (last_prepare != 0) {
+        uint64_t busy = now - last_prepare - (idle - last_idle);
+        metrics_histogram_record(&busy_hist, busy);
+        metrics_histogram_record(&callback_hist, loop_callbacks);
+        atomic_store_explicit(&iterations, atomic_load_explicit(&iterations, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        if (busy > atomic_load_explicit(&max_busy, memory_order_relaxed))
+            atomic_store_explicit(&max_busy, busy, memory_order_relaxed);
+    }
+    last_prepare = now;
+    last_idle = idle;
+    loop_callbacks = 0;
+}
+
+/**
+ * @brief check阶段的回调函数，poll中执行的I/O回调到此结束
+ * @param handle check句柄
+ */
+static void on_check(uv_check_t *handle) {
+    if (last_prepare == 0)
+        return;
+    uint64_t idle = uv_metrics_idle_time(handle->loop);
+    metrics_histogram_record(&io_hist, uv_hrtime() - last_prepare - (idle - last_idle));
+}
+
+/**
+ * @brief 响应看门狗的探测
+ * @param handle async句柄
+ */
+static void on_ping(uv_async_t *handle) {
+    uint64_t sent = atomic_exchange(&ping_sent, 0);
+    if (sent == 0)
+        return;
+    uint64_t lag = uv_hrtime() - sent;
+    metrics_histogram_record(&lag_hist, lag);
+    if (lag > atomic_load_explicit(&max_lag, memory_order_relaxed))
+        atomic_store_explicit(&max_lag, lag, memory_order_relaxed);
+}
+
+/**
+ * @brief 卡顿信号的处理函数，在事件循环线程中输出调用栈
+ * @param sig 信号
+ * @note 只使用write与backtrace_symbols_fd，backtrace在启动时预先调用过一次，避免在此处加载libgcc
+ */
+static void on_stall_signal(int sig) {
+    void *frames[LOOP_BACKTRACE_MAX_DEPTH];
+    int depth = backtrace(frames, LOOP_BACKTRACE_MAX_DEPTH);
+    int fd = fileno(log_file ? log_file : stderr);
+    static const char title[] = "事件循环卡顿时的调用栈：\n";
+    if (write(fd, title, sizeof(title) - 1) < 0)
+        return;
+    backtrace_symbols_fd(frames, depth, fd);
+}
+
+/**
+ * @brief 看门狗线程
+ * @param arg 未使用
+ */
+static void watchdog_thread(void *arg) {
+    uint64_t threshold = (uint64_t) STALL_THRESHOLD * 1000000;
+    unsigned interval = STALL_THRESHOLD / 4 ? STALL_THRESHOLD / 4 : 1;
+    bool reported = false; // 本次卡顿是否已报告
+    while (true) {
+        uv_sleep(interval);
+        uint64_t sent = atomic_load(&ping_sent);
+        uint64_t now = uv_hrtime();
+        if (sent == 0) {
+            reported = false;
+            atomic_store(&ping_sent, now);
+            uv_async_send(&ping_handle);
+        } else if (!reported && now - sent > threshold) {
+            reported = true;
+            atomic_fetch_add_explicit(&stalls, 1, memory_order_relaxed);
+            log_error("事件循环卡顿超过%u毫秒", STALL_THRESHOLD)
+            log_flush();
+            pthread_kill(loop_thread, LOOP_STALL_SIGNAL);
+        }
+    }
+}
+
+/**
+ * @brief 导出事件循环的指标
+ * @param buf 缓冲区
+ * @param data 未使用
+ */
+static void collect_loop(Metrics_Buffer *buf, void *data) {
+    metrics_printf(buf, "# HELP nodns_loop_iterations_total Event loop iterations\n"
+                        "# TYPE nodns_loop_iterations_total counter\nnodns_loop_iterations_total %llu\n",
+                   (unsigned long long) atomic_load_explicit(&iterations, memory_order_relaxed));
+    metrics_printf(buf, "# HELP nodns_loop_busy_seconds Time per event loop iteration spent outside the poll wait\n"
+                        "# TYPE nodns_loop_busy_seconds histogram\n");
+    metrics_write_histogram(buf, "nodns_loop_busy_seconds", NULL, &busy_hist);
+    metrics_printf(buf, "# HELP nodns_loop_io_seconds Time per event loop iteration spent in I/O callbacks\n"
+                        "# TYPE nodns_loop_io_seconds histogram\n");
+    metrics_write_histogram(buf, "nodns_loop_io_seconds", NULL, &io_hist);
+    metrics_printf(buf, "# HELP nodns_loop_busy_max_seconds Longest event loop iteration\n"
+                        "# TYPE nodns_loop_busy_max_seconds gauge\nnodns_loop_busy_max_seconds %.9g\n",
+                   (double) atomic_load_explicit(&max_busy, memory_order_relaxed) / 1e9);
+    metrics_printf(buf, "# HELP nodns_loop_callbacks Callbacks run per event loop iteration\n"
+                        "# TYPE nodns_loop_callbacks histogram\n");
+    metrics_write_histogram_range(buf, "nodns_loop_callbacks", NULL, &callback_hist, 0, 10, 1);
+    if (STALL_THRESHOLD == 0)
+        return;
+    metrics_printf(buf, "# HELP nodns_loop_lag_seconds Delay before the event loop answered a watchdog probe\n"
+                        "# TYPE nodns_loop_lag_seconds histogram\n");
+    metrics_write_histogram(buf, "nodns_loop_lag_seconds", NULL, &lag_hist);
+    metrics_printf(buf, "# HELP nodns_loop_lag_max_seconds Longest watchdog probe delay\n"
+                        "# TYPE nodns_loop_lag_max_seconds gauge\nnodns_loop_lag_max_seconds %.9g\n",
+                   (double) atomic_load_explicit(&max_lag, memory_order_relaxed) / 1e9);
+    metrics_printf(buf, "# HELP nodns_loop_stalls_total Watchdog probes unanswered for longer than the threshold\n"
+                        "# TYPE nodns_loop_stalls_total counter\nnodns_loop_stalls_total %llu\n",
+                   (unsigned long long) atomic_load_explicit(&stalls, memory_order_relaxed));
+}
+
+void init_loop_monitor(uv_loop_t *loop) {
+    log_info("启动事件循环监控")
+    uv_loop_configure(loop, UV_METRICS_IDLE_TIME);
+    uv_prepare_init(loop, &prepare_handle);
+    uv_prepare_start(&prepare_handle, on_prepare);
+    uv_unref((uv_handle_t *) &prepare_handle);
+    uv_check_init(loop, &check_handle);
+    uv_check_start(&check_handle, on_check);
+    uv_unref((uv_handle_t *) &check_handle);
+    metrics_register(&collect_loop, NULL);
+    if (STALL_THRESHOLD == 0)
+        return;
+
+    loop_thread = pthread_self();
+    void *frames[1];
+    backtrace(frames, 1); // 预先加载backtrace依赖的库，信号处理函数中不能分配内存
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stall_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(LOOP_STALL_SIGNAL, &action, NULL);
+
+    uv_async_init(loop, &ping_handle, on_ping);
+    uv_unref((uv_handle_t *) &ping_handle);
+    if (uv_thread_create(&watchdog, watchdog_thread, NULL))
+        log_error("看门狗线程启动失败")
+}
@@ -7,14 +7,24 @@
 #include <uv.h>
 
 #include "../include/dns_log.h"
+#include "../include/dns_name.h"
 #include "../include/dns_client.h"
 #include "../include/dns_server.h"
 #include "../include/query_pool.h"
+#include "../include/query_log.h"
+#include "../include/dns_metrics.h"
+#include "../include/loop_monitor.h"
+#include "../include/dns_trace.h"
+#include "../include/hosts.h"
+#include "../include/local_zone.h"
+#include "../include/forward_table.h"
+#include "../include/zone_store.h"
 
 uv_loop_t *loop;
 Cache *cache;
 Query_Pool *qpool;
-FILE *log_file;
+Local_Zones *local_zones;
+_Atomic(Zone_Store *) zone_store;
 
 int main(int argc, char *argv[]) {
     init_config(argc, argv);
@@ -27,6 +37,7 @@ int main(int argc, char *argv[]) {
             exit(1);
         }
     }
+    init_log();
 
     FILE *hosts_file = fopen(HOSTS_PATH, "r");
     if (!hosts_file) {
@@ -35,10 +46,55 @@ int main(int argc, char *argv[]) {
     }
 
     log_info("启动DNS中继服务器")
+    init_dnsname();
     loop = uv_default_loop();
     cache = new_cache(hosts_file);
-    qpool = new_qpool(loop, cache);
-    init_client(loop);
+    fclose(hosts_file);
+    const Hosts_Index *hosts = atomic_load(&cache->hosts);
+    log_info("hosts文件已加载，%d项，后缀规则%d条，%d线程，耗时%lluus", hosts->count, hosts->suffixes->rules,
+             hosts->stats.threads, (unsigned long long) (hosts->stats.duration / 1000))
+    if (BLOCKLIST_PATH) {
+        uint64_t start = uv_hrtime();
+        cache->blocklist = new_blocklist(BLOCKLIST_PATH);
+        if (!cache->blocklist) {
+            log_fatal("屏蔽列表打开失败或格式有误")
+            exit(1);
+        }
+        log_info("屏蔽列表已映射，%u项，耗时%lluus", cache->blocklist->header->count,
+                 (unsigned long long) ((uv_hrtime() - start) / 1000))
+    }
+    if (ZONE_SPEC_COUNT > 0) {
+        Zone_Store *store = new_zone_store(ZONE_SPECS, ZONE_SPEC_COUNT);
+        if (!store) {
+            log_fatal("区域文件有误")
+            exit(1);
+        }
+        log_info("区域%d个，%llu条记录，%llu条有误，耗时%lluus", store->zone_count,
+                 (unsigned long long) store->stats.records, (unsigned long long) store->stats.errors,
+                 (unsigned long long) (store->stats.duration / 1000))
+        atomic_store(&zone_store, store);
+    }
+    local_zones = new_local_zones(LOCAL_ZONES);
+    if (!local_zones) {
+        log_fatal("本地区域配置有误")
+        exit(1);
+    }
+    log_info("本地区域%d个", local_zones->count)
+    Forward_Table *forward = new_forward_table(FORWARD_RULES, FORWARD_RULE_COUNT);
+    if (!forward) {
+        log_fatal("转发规则有误")
+        exit(1);
+    }
+    log_info("转发规则%d条", forward->count - 1)
+    qpool = new_qpool(loop, cache, forward);
+    init_qlog(loop);
+    init_metrics(loop);
+    init_loop_monitor(loop);
+    init_trace();
+    init_hosts_reload(loop, cache);
+    if (ZONE_SPEC_COUNT > 0)
+        init_zone_reload(loop, &zone_store);
+    init_client(loop, forward);
     init_server(loop);
     return uv_run(loop, UV_RUN_DEFAULT);
 }
@@ -0,0 +1,265 @@
+/**
+ * @file      query_log.c
+ * @brief     二进制查询日志
+ * @details   本文件的内容是二进制查询日志的实现。记录先编码到内存中的批缓冲区，缓冲区写满或定时器到期时
+ *            整块交给uv_fs_write在线程池中写入，每次写入使用显式的文件偏移，多个写入并发完成也不会乱序。
+ *            轮转时旧文件在其写入全部完成后关闭；打开与重命名文件只在轮转时同步进行。
+*/
+
+#include "../include/query_log.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+
+#include "../include/dns_config.h"
+#include "../include/dns_log.h"
+#include "../include/dns_name.h"
+
+#define QLOG_BUFFER_SIZE 65536 // 批缓冲区的大小
+#define QLOG_FLUSH_INTERVAL 1000 // 定时写出的间隔（毫秒）
+#define QLOG_PATH_MAX_SIZE 4096
+
+// 一个查询日志文件
+typedef struct qlog_file {
+    uv_file fd;
+    int64_t size; // 已分配的写入偏移
+    int pending; // 未完成的写入数
+    bool retired; // 是否已被轮转，写入全部完成后关闭
+} QLog_File;
+
+// 一次批量写入
+typedef struct qlog_write {
+    uv_fs_t req;
+    QLog_File *file;
+    uv_buf_t buf;
+} QLog_Write;
+
+static bool enabled; // 是否开启查询日志
+static uv_loop_t *qlog_loop;
+static uv_timer_t flush_timer;
+static QLog_File *current; // 正在写入的文件
+static uint8_t *batch; // 批缓冲区
+static size_t batch_used;
+static uint64_t wall_offset; // Unix时间与uv_hrtime之差（纳秒）
+static uint64_t sample_state; // 采样用的随机数状态
+
+static inline uint8_t *put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t *put32(uint8_t *p, uint32_t v) {
+    p = put16(p, v);
+    return put16(p, v >> 16);
+}
+
+static inline uint8_t *put64(uint8_t *p, uint64_t v) {
+    p = put32(p, v);
+    return put32(p, v >> 32);
+}
+
+/**
+ * @brief 关闭文件
+ * @param file 查询日志文件
+ */
+static void close_file(QLog_File *file) {
+    uv_fs_t req;
+    uv_fs_close(qlog_loop, &req, file->fd, NULL);
+    uv_fs_req_cleanup(&req);
+    free(file);
+}
+
+/**
+ * @brief 写入完成的回调函数
+ * @param req 写入请求
+ */
+static void on_write(uv_fs_t *req) {
+    QLog_Write *write = (QLog_Write *) req;
+    if (req->result < 0)
+        log_error("查询日志写入失败 %d", (int) req->result)
+    QLog_File *file = write->file;
+    if (--file->pending == 0 && file->retired)
+        close_file(file);
+    uv_fs_req_cleanup(req);
+    free(write->buf.base);
+    free(write);
+}
+
+/**
+ * @brief 将一段数据异步写入文件末尾
+ * @param file 查询日志文件
+ * @param data 数据，由写入完成的回调函数释放
+ * @param len 数据长度
+ */
+static void submit(QLog_File *file, uint8_t *data, size_t len) {
+    QLog_Write *write = (QLog_Write *) malloc(sizeof(QLog_Write));
+    if (!write)
+        log_fatal("内存分配错误")
+    write->file = file;
+    write->buf = uv_buf_init((char *) data, len);
+    int64_t offset = file->size;
+    file->size += len;
+    file->pending++;
+    int status = uv_fs_write(qlog_loop, &write->req, file->fd, &write->buf, 1, offset, on_write);
+    if (status < 0) {
+        log_error("查询日志写入失败 %d", status)
+        file->pending--;
+        free(data);
+        free(write);
+    }
+}
+
+/**
+ * @brief 轮转文件：path.i依次重命名为path.(i+1)，path重命名为path.1，再打开新的path
+ * @return 如果新文件打开成功，返回true
+ */
+static bool rotate() {
+    uv_fs_t req;
+    char from[QLOG_PATH_MAX_SIZE], to[QLOG_PATH_MAX_SIZE];
+    if (current != NULL) {
+        current->retired = true;
+        if (current->pending == 0)
+            close_file(current);
+        current = NULL;
+    }
+    for (int i = QLOG_FILES - 1; i > 0; --i) {
+        if (i == 1) snprintf(from, sizeof(from), "%s", QLOG_PATH);
+        else snprintf(from, sizeof(from), "%s.%d", QLOG_PATH, i - 1);
+        snprintf(to, sizeof(to), "%s.%d", QLOG_PATH, i);
+        uv_fs_rename(qlog_loop, &req, from, to, NULL); // 文件不存在时失败，忽略
+        uv_fs_req_cleanup(&req);
+    }
+    int fd = uv_fs_open(qlog_loop, &req, QLOG_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644, NULL);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0) {
+        log_error("查询日志文件打开失败 %d", fd)
+        return false;
+    }
+    current = (QLog_File *) calloc(1, sizeof(QLog_File));
+    if (!current)
+        log_fatal("内存分配错误")
+    current->fd = fd;
+
+    uint8_t *header = (uint8_t *) malloc(QLOG_HEADER_SIZE);
+    if (!header)
+        log_fatal("内存分配错误")
+    memcpy(header, QLOG_MAGIC, 4);
+    put16(put16(header + 4, QLOG_VERSION), 0);
+    submit(current, header, QLOG_HEADER_SIZE);
+    return true;
+}
+
+/**
+ * @brief 将批缓冲区交给线程池写入，必要时先轮转文件
+ */
+static void flush_batch() {
+    if (batch_used == 0)
+        return;
+    if (current == NULL || current->size + batch_used > (int64_t) QLOG_FILE_SIZE * 1024 * 1024)
+        if (!rotate()) { // 无法打开文件时丢弃本批记录
+            batch_used = 0;
+            return;
+        }
+    uint8_t *full = batch;
+    size_t len = batch_used;
+    batch = (uint8_t *) malloc(QLOG_BUFFER_SIZE);
+    if (!batch)
+        log_fatal("内存分配错误")
+    batch_used = 0;
+    submit(current, full, len);
+}
+
+/**
+ * @brief 定时写出的回调函数
+ * @param timer 计时器
+ */
+static void flush_cb(uv_timer_t *timer) {
+    flush_batch();
+}
+
+/**
+ * @brief 程序退出时同步写出批缓冲区
+ */
+static void flush_at_exit() {
+    if (batch_used == 0 || current == NULL)
+        return;
+    uv_fs_t req;
+    uv_buf_t buf = uv_buf_init((char *) batch, batch_used);
+    uv_fs_write(qlog_loop, &req, current->fd, &buf, 1, current->size, NULL);
+    uv_fs_req_cleanup(&req);
+    batch_used = 0;
+}
+
+/**
+ * @brief 判断本次查询是否被采样
+ * @return 以1/QLOG_SAMPLE的概率返回true
+ */
+static bool sampled() {
+    if (QLOG_SAMPLE <= 1)
+        return true;
+    sample_state ^= sample_state << 13; // xorshift64
+    sample_state ^= sample_state >> 7;
+    sample_state ^= sample_state << 17;
+    return sample_state % QLOG_SAMPLE == 0;
+}
+
+void qlog_record(const struct sockaddr *addr, const DNSQuestion *que, uint16_t id, uint8_t rcode,
+                 Query_Outcome outcome, uint64_t start_time) {
+    if (!enabled || !sampled())
+        return;
+    if (batch_used + QLOG_RECORD_MAX_SIZE > QLOG_BUFFER_SIZE)
+        flush_batch();
+
+    uint64_t now = uv_hrtime();
+    uint8_t *record = batch + batch_used;
+    uint8_t *p = put64(record + 2, now + wall_offset);
+    p = put32(p, (now - start_time) / 1000);
+    p = put16(p, id);
+    p = put16(p, que->qtype);
+    p = put16(p, que->qclass);
+    *p++ = rcode;
+    *p++ = outcome;
+    if (addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *) addr;
+        *p++ = 6;
+        memcpy(p, &in6->sin6_addr, 16);
+        p = put16(p + 16, ntohs(in6->sin6_port));
+    } else {
+        const struct sockaddr_in *in = (const struct sockaddr_in *) addr;
+        *p++ = 4;
+        memcpy(p, &in->sin_addr, 4);
+        p = put16(p + 4, ntohs(in->sin_port));
+    }
+    size_t name_len = strnlen((const char *) que->qname, DNS_NAME_TEXT_MAX_SIZE);
+    *p++ = name_len;
+    memcpy(p, que->qname, name_len);
+    p += name_len;
+    put16(record, p - record - 2);
+    batch_used = p - batch;
+}
+
+void init_qlog(uv_loop_t *loop) {
+    if (QLOG_PATH == NULL)
+        return;
+    log_info("初始化查询日志")
+    qlog_loop = loop;
+    batch = (uint8_t *) malloc(QLOG_BUFFER_SIZE);
+    if (!batch)
+        log_fatal("内存分配错误")
+    uv_timeval64_t tv;
+    uv_gettimeofday(&tv);
+    wall_offset = (uint64_t) tv.tv_sec * 1000000000 + tv.tv_usec * 1000 - uv_hrtime();
+    sample_state = uv_hrtime() | 1;
+    if (!rotate())
+        log_fatal("查询日志文件打开失败")
+    uv_timer_init(loop, &flush_timer);
+    uv_timer_start(&flush_timer, flush_cb, QLOG_FLUSH_INTERVAL, QLOG_FLUSH_INTERVAL);
+    uv_unref((uv_handle_t *) &flush_timer); // 定时器不阻止事件循环退出
+    atexit(&flush_at_exit);
+    enabled = true;
+}
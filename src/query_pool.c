@@ -6,22 +6,63 @@
 
 #include "../include/query_pool.h"
 
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #include "../include/dns_log.h"
+#include "../include/dns_config.h"
 #include "../include/dns_conversion.h"
+#include "../include/dns_key.h"
 #include "../include/dns_client.h"
 #include "../include/dns_server.h"
+#include "../include/query_log.h"
+#include "../include/dns_metrics.h"
+#include "../include/loop_monitor.h"
+#include "../include/dns_trace.h"
+#include "../include/forward_table.h"
+
+/**
+ * @brief 记录一个完成的查询
+ * @param query 查询请求
+ * @param outcome 查询的结果
+ * @param rcode 回复的RCODE，未回复时为QLOG_NO_RCODE
+ */
+static void qpool_complete(const Dns_Query *query, Query_Outcome outcome, uint8_t rcode) {
+    metrics_observe(outcome, uv_hrtime() - query->start_time);
+    qlog_record((const struct sockaddr *) &query->addr, query->msg->que, query->prev_id, rcode, outcome, query->start_time);
+}
+
+/**
+ * @brief 记录一个未得到回复的查询，合并到其上的查询一并记录
+ * @param query 查询请求
+ * @param outcome 查询的结果
+ */
+static void qpool_abandon(const Dns_Query *query, Query_Outcome outcome) {
+    qpool_complete(query, outcome, QLOG_NO_RCODE);
+    for (const Dns_Query *waiter = query->waiters; waiter != NULL; waiter = waiter->next_waiter)
+        qpool_complete(waiter, outcome, QLOG_NO_RCODE);
+}
 
 /**
  * @brief 超时回调函数
  * @param timer 超时的计时器
  */
 static void timeout_cb(uv_timer_t *timer) {
+    loop_monitor_callback();
     log_info("超时")
     uv_timer_stop(timer);
     Query_Pool *qpool = *(Query_Pool **) (timer->data + sizeof(uint16_t));
-    qpool->delete(qpool, *(uint16_t *) timer->data);
+    uint16_t id = *(uint16_t *) timer->data;
+    Dns_Query *query = qpool->pool[id % QUERY_POOL_MAX_SIZE];
+    if (query != NULL && query->id == id) {
+        ++query->group->timeouts;
+        dns_trace(query__timeout, (int) query->prev_id, query->msg->que->qname, uv_hrtime(), query->start_time);
+        qpool_abandon(query, QUERY_TIMEOUT);
+    }
+    qpool->delete(qpool, id);
 }
 
 // 检查查询池是否已满
@@ -29,8 +70,52 @@ static bool qpool_full(Query_Pool *this) {
     return this->count == QUERY_POOL_MAX_SIZE;
 }
 
+/**
+ * @brief 判断上游组能否再占用一个查询池位置
+ * @param qpool 查询池，调用时新查询已计入count
+ * @param group 上游服务器组
+ * @return 本组未用完保留的位置，或占用后剩余的位置仍够其他组未用完的保留位置时，返回true
+ */
+static bool group_admit(const Query_Pool *qpool, const Upstream_Group *group) {
+    if (group->pending < qpool->group_reserve)
+        return true;
+    int reserved = 0;
+    for (int i = 0; i < qpool->forward->count; ++i) {
+        const Upstream_Group *other = &qpool->forward->groups[i];
+        if (other != group && other->pending < qpool->group_reserve)
+            reserved += qpool->group_reserve - other->pending;
+    }
+    return QUERY_POOL_MAX_SIZE - qpool->count >= reserved;
+}
+
+// 在在途索引中查找与规范键相同的上游查询
+static Dns_Query *inflight_find(Query_Pool *qpool, const DNSKey *key) {
+    Dns_Query *query = qpool->inflight[key->hash % QUERY_POOL_MAX_SIZE];
+    while (query != NULL && !dnskey_equal(&query->msg->que->key, key))
+        query = query->inflight_next;
+    return query;
+}
+
+// 将上游查询登记到在途索引
+static void inflight_add(Query_Pool *qpool, Dns_Query *query) {
+    Dns_Query **bucket = &qpool->inflight[query->msg->que->key.hash % QUERY_POOL_MAX_SIZE];
+    query->inflight_next = *bucket;
+    *bucket = query;
+    query->inflight = true;
+}
+
+// 将上游查询从在途索引中移除
+static void inflight_remove(Query_Pool *qpool, Dns_Query *query) {
+    Dns_Query **p = &qpool->inflight[query->msg->que->key.hash % QUERY_POOL_MAX_SIZE];
+    while (*p != NULL && *p != query)
+        p = &(*p)->inflight_next;
+    if (*p != NULL)
+        *p = query->inflight_next;
+    query->inflight = false;
+}
+
 // 向查询池中插入查询请求
-static void qpool_insert(Query_Pool *qpool, const struct sockaddr *addr, const DNSMessage *msg) {
+static void qpool_insert(Query_Pool *qpool, const struct sockaddr *addr, const DNSMessage *msg, uint64_t start_time) {
     log_debug("添加新查询请求")
     // 为新的查询请求分配内存并初始化
     Dns_Query *query = (Dns_Query *) calloc(1, sizeof(Dns_Query));
@@ -42,11 +127,28 @@ static void qpool_insert(Query_Pool *qpool, const struct sockaddr *addr, const D
 
     query->id = id;
     query->prev_id = msg->header->id;
-    query->addr = *addr;
+    memcpy(&query->addr, addr, addr->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+    query->start_time = start_time;
     query->msg = copy_dnsmsg(msg);
 
+    // 统计高频域名与请求方
+    const DNSKey *key = &query->msg->que->key;
+    qpool->qnames->update(qpool->qnames, key->name, key->len, key->hash);
+    if (addr->sa_family == AF_INET) {
+        const struct in_addr *ip = &((const struct sockaddr_in *) addr)->sin_addr;
+        uint32_t recent = qpool->clients->update(qpool->clients, ip, sizeof(*ip), hh_hash(ip, sizeof(*ip)));
+        if (qpool->client_limit != 0 && recent > qpool->client_limit) { // 近期查询过多的请求方，不再占用缓存与上游
+            log_debug("请求方查询过多，丢弃查询 ID: 0x%04x", query->prev_id)
+            qpool_abandon(query, QUERY_RATE_LIMITED);
+            qpool->delete(qpool, id);
+            return;
+        }
+    }
+
     // 在cache中查询
-    RBTreeValue *value = qpool->cache->query(qpool->cache, query->msg->que);
+    Cache_Hit hit;
+    RBTreeValue *value = qpool->cache->query(qpool->cache, query->msg->que, &hit);
+    dns_trace(cache__lookup, (int) query->prev_id, query->msg->que->qname, uv_hrtime(), (int) hit);
     if (value != NULL) { // cache命中
         query->msg->header->qr = DNS_QR_ANSWER; // 设置为响应报文
         if (query->msg->header->rd == 1)query->msg->header->ra = 1; // 如果原报文rd为1，则设置ra为1
@@ -64,11 +166,31 @@ static void qpool_insert(Query_Pool *qpool, const struct sockaddr *addr, const D
         }
 
         send_to_local(addr, query->msg);
+        qpool_complete(query, hit == CACHE_HIT_HOSTS ? QUERY_HOSTS : hit == CACHE_HIT_LRU ? QUERY_LRU : QUERY_TREE,
+                       query->msg->header->rcode);
         free(value);
         qpool->delete(qpool, query->id);
     } else { // cache未命中，交给远程服务器
+        Upstream_Group *group = qpool->forward->route(qpool->forward, &query->msg->que->key); // 按最长后缀选择上游
+        if (!group_admit(qpool, group)) { // 不占用保留给其他组的位置，慢速的组不会挤掉其他组的查询
+            log_error("上游组占用的查询池位置已达上限")
+            ++group->rejected;
+            qpool_abandon(query, QUERY_POOL_FULL);
+            qpool->delete(qpool, id);
+            return;
+        }
+        query->group = group;
+        ++group->pending;
+        Dns_Query *leader = inflight_find(qpool, &query->msg->que->key);
+        if (leader != NULL) { // 相同的查询已在途，等待同一个上游回复
+            log_debug("合并在途查询 ID: 0x%04x -> 0x%04x", id, leader->id)
+            query->next_waiter = leader->waiters;
+            leader->waiters = query;
+            return;
+        }
         if (qpool->ipool->full(qpool->ipool)) {
             log_error("序号池满")
+            qpool_abandon(query, QUERY_FAILED);
             qpool->delete(qpool, id);
             return;
         }
@@ -85,8 +207,10 @@ static void qpool_insert(Query_Pool *qpool, const struct sockaddr *addr, const D
             log_fatal("内存分配错误")
         *(uint16_t *) query->timer.data = query->id;
         *(Query_Pool **) (query->timer.data + sizeof(uint16_t)) = qpool;
-        uv_timer_start(&query->timer, timeout_cb, 5000, 5000);
-        send_to_remote(query->msg);
+        uv_timer_start(&query->timer, timeout_cb, query->group->timeout, query->group->timeout);
+        inflight_add(qpool, query);
+        query->send_time = uv_hrtime();
+        send_to_remote(query->group, query->msg);
     }
 }
 
@@ -100,6 +224,7 @@ static void qpool_finish(Query_Pool *qpool, const DNSMessage *msg) {
     uint16_t uid = msg->header->id;
     if (!qpool->ipool->query(qpool->ipool, uid)) {
         log_error("序号池中不存在此序号")
+        metrics_count(METRIC_UNKNOWN_RESPONSES);
         return;
     }
     Index *index = qpool->ipool->delete(qpool->ipool, uid); // 从序号池中删除
@@ -107,7 +232,10 @@ static void qpool_finish(Query_Pool *qpool, const DNSMessage *msg) {
         Dns_Query *query = qpool->pool[index->prev_id % QUERY_POOL_MAX_SIZE];
         log_debug("结束查询 ID: 0x%04x", query->id)
 
-        if (strcmp(msg->que->qname, query->msg->que->qname) == 0) { // 如果查询报文的域名与响应报文的域名相同
+        if (dnskey_equal(&msg->que->key, &query->msg->que->key)) { // 如果响应报文的问题与查询报文相同
+            metrics_histogram_record(&query->group->rtt, uv_hrtime() - query->send_time);
+            dns_trace(upstream__answer, (int) query->prev_id, msg->que->qname, uv_hrtime(), query->start_time,
+                      (int) uid, (int) msg->header->rcode);
             destroy_dnsmsg(query->msg); // 销毁查询报文
             query->msg = copy_dnsmsg(msg); // 将响应报文复制到查询报文中
             query->msg->header->id = query->prev_id; // 设置响应报文的id为查询报文的id
@@ -115,13 +243,38 @@ static void qpool_finish(Query_Pool *qpool, const DNSMessage *msg) {
                 (msg->que->qtype == DNS_TYPE_A || msg->que->qtype == DNS_TYPE_CNAME ||
                  msg->que->qtype == DNS_TYPE_AAAA))  // 如果响应报文的rcode为0且查询报文的qtype为A、CNAME或AAAA
                 qpool->cache->insert(qpool->cache, msg); // 将响应报文插入cache
-            send_to_local(&query->addr, query->msg); // 发送响应报文
-        }
+            send_to_local((const struct sockaddr *) &query->addr, query->msg); // 发送响应报文
+            qpool_complete(query, QUERY_UPSTREAM, msg->header->rcode);
+            for (Dns_Query *waiter = query->waiters; waiter != NULL; waiter = waiter->next_waiter) {
+                // 合并的查询使用各自的Question Section作答，保留请求方的大小写
+                waiter->msg->header->qr = DNS_QR_ANSWER;
+                if (waiter->msg->header->rd == 1)waiter->msg->header->ra = 1;
+                waiter->msg->header->rcode = msg->header->rcode;
+                waiter->msg->header->ancount = msg->header->ancount;
+                waiter->msg->header->nscount = msg->header->nscount;
+                waiter->msg->header->arcount = msg->header->arcount;
+                destroy_dnsrr(waiter->msg->rr); // 请求自带的记录（如EDNS的OPT）被回复中的记录取代
+                waiter->msg->rr = copy_dnsrr(msg->rr);
+                send_to_local((const struct sockaddr *) &waiter->addr, waiter->msg);
+                qpool_complete(waiter, QUERY_COALESCED, msg->header->rcode);
+            }
+        } else
+            qpool_abandon(query, QUERY_FAILED);
         qpool->delete(qpool, query->id);
     }
     free(index);
 }
 
+/**
+ * @brief 计时器关闭后释放查询请求
+ * @param handle 查询请求中的计时器
+ */
+static void on_timer_close(uv_handle_t *handle) {
+    Dns_Query *query = (Dns_Query *) ((char *) handle - offsetof(Dns_Query, timer));
+    free(handle->data); // 释放定时器数据
+    free(query);
+}
+
 // 从查询池中删除查询请求
 static void qpool_delete(Query_Pool *qpool, uint16_t id) {
     if (!qpool_query(qpool, id)) {
@@ -130,16 +283,82 @@ static void qpool_delete(Query_Pool *qpool, uint16_t id) {
     }
     log_debug("删除查询 ID: 0x%04x", id)
     Dns_Query *query = qpool->pool[id % QUERY_POOL_MAX_SIZE]; // 获取查询请求
+    if (query->inflight)
+        inflight_remove(qpool, query);
+    Dns_Query *waiter = query->waiters; // 等待本查询的合并查询随之结束
+    query->waiters = NULL;
+    while (waiter != NULL) {
+        Dns_Query *next = waiter->next_waiter;
+        qpool_delete(qpool, waiter->id);
+        waiter = next;
+    }
     qpool->queue->push(qpool->queue, id + QUERY_POOL_MAX_SIZE); // 将id放回序号池
     qpool->pool[id % QUERY_POOL_MAX_SIZE] = NULL; // 将查询池中的查询请求置空
     qpool->count--; // 查询池中的查询请求数量减一
-    uv_timer_stop(&query->timer); // 停止定时器
+    if (query->group != NULL)
+        --query->group->pending;
     destroy_dnsmsg(query->msg); // 销毁查询报文
-    free(query->timer.data); // 释放定时器数据
-    free(query); // 释放查询请求
+    query->msg = NULL;
+    if (query->timer.data != NULL) // 计时器登记在事件循环中，关闭后才能释放查询请求
+        uv_close((uv_handle_t *) &query->timer, on_timer_close);
+    else
+        free(query); // 释放查询请求
+}
+
+/**
+ * @brief 以Prometheus标签值的格式输出高频项
+ * @param buf 缓冲区
+ * @param name 指标名
+ * @param label 标签名
+ * @param hh 高频项统计
+ * @param is_addr 键是否为IPv4地址，否则为域名
+ */
+static void write_top(Metrics_Buffer *buf, const char *name, const char *label, const Heavy_Hitters *hh, bool is_addr) {
+    const Heavy_Hitter *top[HH_TOP_K];
+    int n = hh->sorted(hh, top);
+    for (int i = 0; i < n; ++i) {
+        char value[HH_KEY_MAX_SIZE * 2 + 1];
+        if (is_addr) {
+            inet_ntop(AF_INET, top[i]->key, value, sizeof(value));
+        } else {
+            // 转义引号与反斜杠，不可打印的字节替换为'?'
+            size_t len = 0;
+            for (int j = 0; j < top[i]->len; ++j) {
+                uint8_t c = top[i]->key[j];
+                if (c == '"' || c == '\\')
+                    value[len++] = '\\';
+                value[len++] = c >= 0x20 && c < 0x7f ? (char) c : '?';
+            }
+            value[len] = '\0';
+        }
+        metrics_printf(buf, "%s{%s=\"%s\"} %u\n", name, label, value, top[i]->count);
+    }
+}
+
+/**
+ * @brief 导出查询池的指标
+ * @param buf 缓冲区
+ * @param data 查询池
+ */
+static void collect_qpool(Metrics_Buffer *buf, void *data) {
+    Query_Pool *qpool = (Query_Pool *) data;
+    int inflight = 0;
+    for (int i = 0; i < QUERY_POOL_MAX_SIZE; ++i)
+        for (Dns_Query *query = qpool->inflight[i]; query != NULL; query = query->inflight_next)
+            ++inflight;
+    metrics_printf(buf, "# HELP nodns_qpool_queries Queries in the query pool\n# TYPE nodns_qpool_queries gauge\n"
+                        "nodns_qpool_queries %d\n", qpool->count);
+    metrics_printf(buf, "# HELP nodns_qpool_inflight Distinct questions waiting for upstream\n"
+                        "# TYPE nodns_qpool_inflight gauge\nnodns_qpool_inflight %d\n", inflight);
+    metrics_printf(buf, "# HELP nodns_top_qname_queries Estimated recent queries for the most queried names\n"
+                        "# TYPE nodns_top_qname_queries gauge\n");
+    write_top(buf, "nodns_top_qname_queries", "qname", qpool->qnames, false);
+    metrics_printf(buf, "# HELP nodns_top_client_queries Estimated recent queries from the most active clients\n"
+                        "# TYPE nodns_top_client_queries gauge\n");
+    write_top(buf, "nodns_top_client_queries", "client", qpool->clients, true);
 }
 
-Query_Pool *new_qpool(uv_loop_t *loop, Cache *cache) {
+Query_Pool *new_qpool(uv_loop_t *loop, Cache *cache, Forward_Table *forward) {
     log_info("初始化查询池")
     Query_Pool *qpool = (Query_Pool *) calloc(1, sizeof(Query_Pool));
     if (!qpool)
@@ -151,10 +370,19 @@ Query_Pool *new_qpool(uv_loop_t *loop, Cache *cache) {
     qpool->ipool = new_ipool();
     qpool->loop = loop;
     qpool->cache = cache;
+    qpool->forward = forward;
+    qpool->qnames = new_heavy_hitters(loop);
+    qpool->clients = new_heavy_hitters(loop);
+    // 估计值每HH_DECAY_INTERVAL毫秒减半，以速率r持续查询时在r*T与2r*T之间，超过2r*T说明近期速率高于r
+    qpool->client_limit = (uint32_t) CLIENT_RATE * HH_DECAY_INTERVAL / 1000 * 2;
+    qpool->group_reserve = QUERY_POOL_MAX_SIZE / (2 * forward->count); // 保留的位置合计不超过一半
+    if (qpool->group_reserve > QUERY_POOL_GROUP_RESERVE)
+        qpool->group_reserve = QUERY_POOL_GROUP_RESERVE;
 
     qpool->full = &qpool_full;
     qpool->insert = &qpool_insert;
     qpool->delete = &qpool_delete;
     qpool->finish = &qpool_finish;
+    metrics_register(&collect_qpool, qpool);
     return qpool;
 }
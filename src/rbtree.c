@@ -10,6 +10,7 @@
 #include <string.h>
 
 #include "../include/dns_conversion.h"
+#include "../include/dns_key.h"
 #include "../include/dns_log.h"
 
 static RBTreeNode *NIL; // 叶节点
@@ -29,14 +30,13 @@ static void linklist_delete_next(DNSRRLinkList *list) {
     free(temp);
 }
 
-static DNSRRLinkList *linklist_query_next(DNSRRLinkList *list, const uint8_t *qname, uint16_t qtype) {
+static DNSRRLinkList *linklist_query_next(DNSRRLinkList *list, const DNSKey *key) {
     log_debug("在链表中查找元素")
     time_t now_time = time(NULL);
     while (list->next != NULL) {
         if (list->next->expire_time != -1 && list->next->expire_time <= now_time)
             list = list->next;
-        else if (strcmp(list->next->value->rr->name, qname) == 0 &&
-                 (list->next->value->type == 255 || list->next->value->type == qtype))
+        else if (dnskey_match(&list->next->value->key, key))
             return list;
         else
             list = list->next;
@@ -218,7 +218,7 @@ static void insert_case(RBTree *tree, RBTreeNode *node) {
  * @param fa 节点的父亲节点
  * @return 指向新节点的指针
  */
-static RBTreeNode *node_init(unsigned int key, DNSRRLinkList *list, RBTreeNode *fa) {
+static RBTreeNode *node_init(uint64_t key, DNSRRLinkList *list, RBTreeNode *fa) {
     RBTreeNode *node = (RBTreeNode *) calloc(1, sizeof(RBTreeNode));
     if (!node)
         log_fatal("内存分配错误")
@@ -238,7 +238,7 @@ static RBTreeNode *node_init(unsigned int key, DNSRRLinkList *list, RBTreeNode *
  * @param key 节点的键
  * @param list 节点的值
  */
-void rbtree_insert(RBTree *tree, unsigned int key, DNSRRLinkList *list) {
+void rbtree_insert(RBTree *tree, uint64_t key, DNSRRLinkList *list) {
     log_debug("插入红黑树")
     RBTreeNode *node = tree->root;
     if (node == NULL) {
@@ -276,7 +276,7 @@ void rbtree_insert(RBTree *tree, unsigned int key, DNSRRLinkList *list) {
  * @param key 键
  * @return 如果找到了这样的节点，返回指向该节点的指针，否则返回NULL
  */
-static RBTreeNode *rbtree_find(RBTreeNode *node, unsigned int key) {
+static RBTreeNode *rbtree_find(RBTreeNode *node, uint64_t key) {
     if (node->key > key) {
         if (node->left == NIL)return NULL;
         return rbtree_find(node->left, key);
@@ -361,7 +361,7 @@ static void rbtree_delete(RBTree *tree, RBTreeNode *node) {
         DNSRRLinkList *temp = node->rr_list;
         node->rr_list = smallest->rr_list;
         smallest->rr_list = temp;
-        unsigned int temp1 = node->key;
+        uint64_t temp1 = node->key;
         node->key = smallest->key;
         smallest->key = temp1;
         node = smallest;
@@ -399,8 +399,9 @@ static void rbtree_delete(RBTree *tree, RBTreeNode *node) {
  * @param key
  * @return
  */
-DNSRRLinkList *rbtree_query(RBTree *tree, unsigned int key) {
+DNSRRLinkList *rbtree_query(RBTree *tree, uint64_t key) {
     log_debug("查询红黑树")
+    if (tree->root == NULL)return NULL;
     RBTreeNode *node = rbtree_find(tree->root, key);
     if (node == NULL)return NULL;
     time_t now_time = time(NULL);
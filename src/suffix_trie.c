@@ -0,0 +1,181 @@
+/**
+ * @file      suffix_trie.c
+ * @brief     域名后缀规则
+ * @details   本文件的内容是反向标签树的实现。子结点按标签排序存放在数组中，查找一个标签用二分查找；
+ *            查询只读，建好后可被多个线程同时查询。
+*/
+
+#include "../include/suffix_trie.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/dns_log.h"
+#include "../include/dns_name.h"
+
+/**
+ * @brief 比较标签，先比长度再比内容
+ */
+static int compare_label(const uint8_t *a, int a_len, const uint8_t *b, int b_len) {
+    if (a_len != b_len)
+        return a_len < b_len ? -1 : 1;
+    return memcmp(a, b, a_len);
+}
+
+/**
+ * @brief 查找子结点
+ * @param node 结点
+ * @param label 标签
+ * @param len 标签长度
+ * @param pos 输出，找不到时为应插入的位置
+ * @return 子结点，找不到时返回NULL
+ */
+static Suffix_Trie_Node *find_child(const Suffix_Trie_Node *node, const uint8_t *label, int len, uint32_t *pos) {
+    uint32_t lo = 0, hi = node->child_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = compare_label(node->children[mid]->label, node->children[mid]->label_len, label, len);
+        if (cmp == 0) {
+            *pos = mid;
+            return node->children[mid];
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *pos = lo;
+    return NULL;
+}
+
+static Suffix_Trie_Node *add_child(Suffix_Trie_Node *node, const uint8_t *label, int len, uint32_t pos) {
+    Suffix_Trie_Node *child = (Suffix_Trie_Node *) calloc(1, sizeof(Suffix_Trie_Node));
+    if (!child)
+        log_fatal("内存分配错误")
+    child->label = (uint8_t *) malloc(len);
+    if (!child->label)
+        log_fatal("内存分配错误")
+    for (int i = 0; i < len; ++i)
+        child->label[i] = (uint8_t) (label[i] - 'A') < 26 ? label[i] | 0x20 : label[i];
+    child->label_len = (uint8_t) len;
+    if (node->child_count == node->child_capacity) {
+        node->child_capacity = node->child_capacity ? node->child_capacity * 2 : 2;
+        node->children = (Suffix_Trie_Node **) realloc(node->children,
+                                                       node->child_capacity * sizeof(Suffix_Trie_Node *));
+        if (!node->children)
+            log_fatal("内存分配错误")
+    }
+    memmove(node->children + pos + 1, node->children + pos, (node->child_count - pos) * sizeof(Suffix_Trie_Node *));
+    node->children[pos] = child;
+    ++node->child_count;
+    return child;
+}
+
+static Suffix_Trie_Node *trie_insert(Suffix_Trie *trie, const char *name, int len, uint8_t flags) {
+    if (len > 0 && name[len - 1] == '.')
+        --len;
+    if (len <= 0 || len > DNS_NAME_TEXT_MAX_SIZE - 1)
+        return NULL;
+    Suffix_Trie_Node *node = &trie->root;
+    int end = len;
+    while (end > 0) { // 从最后一个标签开始
+        int start = end;
+        while (start > 0 && name[start - 1] != '.')
+            --start;
+        int label_len = end - start;
+        if (label_len == 0 || label_len > DNS_NAME_LABEL_MAX_SIZE)
+            return NULL;
+        uint8_t lower[DNS_NAME_LABEL_MAX_SIZE];
+        for (int i = 0; i < label_len; ++i) {
+            uint8_t c = (uint8_t) name[start + i];
+            lower[i] = (uint8_t) (c - 'A') < 26 ? c | 0x20 : c;
+        }
+        uint32_t pos;
+        Suffix_Trie_Node *child = find_child(node, lower, label_len, &pos);
+        node = child ? child : add_child(node, lower, label_len, pos);
+        end = start - 1;
+    }
+    if (node->flags == 0)
+        ++trie->rules;
+    node->flags |= flags;
+    return node;
+}
+
+static bool trie_match(const Suffix_Trie *trie, const DNSKey *key) {
+    const Suffix_Trie_Node *node = &trie->root;
+    int end = key->len;
+    if (end > 0 && key->name[end - 1] == '.')
+        --end;
+    while (end > 0) {
+        int start = end;
+        while (start > 0 && key->name[start - 1] != '.')
+            --start;
+        uint32_t pos;
+        node = find_child(node, key->name + start, end - start, &pos);
+        if (node == NULL)
+            return false;
+        end = start - 1;
+        if (end > 0 && (node->flags & SUFFIX_MATCH_BELOW)) // 还有未走过的标签，即为子域名
+            return true;
+    }
+    return (node->flags & SUFFIX_MATCH_SELF) != 0;
+}
+
+static const Suffix_Trie_Node *trie_find(const Suffix_Trie *trie, const DNSKey *key) {
+    const Suffix_Trie_Node *node = &trie->root, *found = NULL;
+    int end = key->len;
+    if (end > 0 && key->name[end - 1] == '.')
+        --end;
+    while (end > 0) {
+        int start = end;
+        while (start > 0 && key->name[start - 1] != '.')
+            --start;
+        uint32_t pos;
+        node = find_child(node, key->name + start, end - start, &pos);
+        if (node == NULL)
+            return found;
+        end = start - 1;
+        if (node->flags & (end > 0 ? SUFFIX_MATCH_BELOW : SUFFIX_MATCH_SELF))
+            found = node;
+    }
+    return found;
+}
+
+Suffix_Trie *new_suffix_trie() {
+    Suffix_Trie *trie = (Suffix_Trie *) calloc(1, sizeof(Suffix_Trie));
+    if (!trie)
+        log_fatal("内存分配错误")
+    trie->insert = &trie_insert;
+    trie->match = &trie_match;
+    trie->find = &trie_find;
+    return trie;
+}
+
+static void destroy_node(Suffix_Trie_Node *node) {
+    for (uint32_t i = 0; i < node->child_count; ++i) {
+        destroy_node(node->children[i]);
+        free(node->children[i]->label);
+        free(node->children[i]);
+    }
+    free(node->children);
+}
+
+void destroy_suffix_trie(Suffix_Trie *trie) {
+    destroy_node(&trie->root);
+    free(trie);
+}
+
+uint8_t suffix_rule_parse(const char *text, const char **name, int *len) {
+    size_t n = strlen(text);
+    if (n > 2 && text[0] == '*' && text[1] == '.') {
+        *name = text + 2;
+        *len = (int) n - 2;
+        return SUFFIX_MATCH_BELOW;
+    }
+    if (n > 3 && text[0] == '|' && text[1] == '|' && text[n - 1] == '^') {
+        *name = text + 2;
+        *len = (int) n - 3;
+        return SUFFIX_MATCH_SELF | SUFFIX_MATCH_BELOW;
+    }
+    return 0;
+}
@@ -0,0 +1,952 @@
+/**
+ * @file      zone_store.c
+ * @brief     权威区域
+ * @details   本文件的内容是主文件的解析、区域的索引、作答与热加载。解析支持$ORIGIN、$TTL、“@”、相对域名、
+ *            省略的所有者、TTL与类、括号续行、注释与带引号的字符串，记录类型支持A、AAAA、NS、CNAME、PTR、MX、TXT、SRV与SOA。
+ *            有误的记录被跳过并记录行号，其他记录照常加载。
+*/
+
+#include "../include/zone_store.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "../include/dns_config.h"
+#include "../include/dns_key.h"
+#include "../include/dns_log.h"
+#include "../include/dns_metrics.h"
+#include "../include/dns_name.h"
+#include "../include/epoch.h"
+
+#define ZONE_ENTRY_MAX_SIZE 8192 // 一条记录（含续行）中所有词的总长度上限
+
+// 热加载的状态，只在事件循环线程中访问（work中的字段除外）
+static struct {
+    uv_fs_event_t *watchers; // 每个区域文件所在的目录一个
+    const char **bases; // 各区域文件的文件名
+    uv_timer_t delay;
+    uv_work_t work;
+    _Atomic(Zone_Store *) *target;
+    bool running; // 是否正在加载
+    bool pending; // 加载期间文件又改变了
+    Zone_Store *result; // 线程池中加载的区域，失败时为NULL
+} reload;
+
+// 一个词
+typedef struct zone_token {
+    char *text; // 以0结尾，带引号的字符串已去掉引号并处理转义
+    int len;
+    bool quoted;
+} Zone_Token;
+
+// 解析一个主文件的状态
+typedef struct zone_parser {
+    Zone_Store *store;
+    int zone; // 区域的下标
+    const char *p; // 当前位置
+    uint64_t line; // 当前行号
+    char origin[DNS_NAME_TEXT_MAX_SIZE + 1]; // $ORIGIN，以'.'结尾
+    int origin_len;
+    char owner[DNS_NAME_TEXT_MAX_SIZE + 1]; // 上一条记录的所有者，小写
+    int owner_len;
+    uint32_t default_ttl; // $TTL
+    bool has_default_ttl;
+    uint32_t last_ttl; // 上一条记录的TTL
+    bool has_last_ttl;
+    bool blank_owner; // 本条记录以空白开头，省略了所有者
+    Zone_Token tokens[ZONE_MAX_TOKENS];
+    int token_count;
+    char text[ZONE_ENTRY_MAX_SIZE + ZONE_MAX_TOKENS]; // 词的存储，每个词后有一个0
+} Zone_Parser;
+
+// 向回复报文写入
+typedef struct zone_writer {
+    uint8_t *packet;
+    unsigned len;
+    unsigned cap;
+    bool overflow; // 超过了cap
+} Zone_Writer;
+
+/* ===================== 索引 ===================== */
+
+/**
+ * @brief 在哈希表中查找域名
+ * @return nodes的下标加一，不存在时返回0
+ */
+static uint32_t find_node(const Zone_Store *store, const DNSKey *key) {
+    for (uint32_t i = key->hash & store->table_mask;; i = (i + 1) & store->table_mask) {
+        uint32_t slot = store->table[i];
+        if (slot == 0)
+            return 0;
+        const Zone_Node *node = &store->nodes[slot - 1];
+        if (node->hash == key->hash && node->len == key->len && memcmp(node->name, key->name, key->len) == 0)
+            return slot;
+    }
+}
+
+/**
+ * @brief 由不以0结尾的域名生成规范键
+ * @param key 输出
+ * @param prefix 加在域名之前的文本，如"*."，可以为NULL
+ * @param name 小写的点分域名
+ * @param len 域名长度
+ * @return 域名过长时返回false
+ */
+static bool init_key(DNSKey *key, const char *prefix, const uint8_t *name, int len) {
+    uint8_t text[DNS_KEY_NAME_MAX_SIZE + 32]; // 按块读取时不越界
+    int prefix_len = prefix ? (int) strlen(prefix) : 0;
+    if (prefix_len + len >= DNS_KEY_NAME_MAX_SIZE)
+        return false;
+    if (prefix_len > 0)
+        memcpy(text, prefix, prefix_len);
+    memcpy(text + prefix_len, name, len);
+    text[prefix_len + len] = 0;
+    dnskey_init(key, text, 0, 0);
+    return true;
+}
+
+/**
+ * @brief 查找不以0结尾的域名，参数同init_key
+ * @return nodes的下标加一，不存在时返回0
+ */
+static uint32_t find_name(const Zone_Store *store, const char *prefix, const uint8_t *name, int len) {
+    DNSKey key;
+    return init_key(&key, prefix, name, len) ? find_node(store, &key) : 0;
+}
+
+static void grow_table(Zone_Store *store) {
+    uint32_t size = (store->table_mask + 1) * 2;
+    uint32_t *table = (uint32_t *) calloc(size, sizeof(uint32_t));
+    if (!table)
+        log_fatal("内存分配错误")
+    for (uint32_t n = 0; n < store->node_count; ++n) {
+        uint32_t i = store->nodes[n].hash & (size - 1);
+        while (table[i] != 0)
+            i = (i + 1) & (size - 1);
+        table[i] = n + 1;
+    }
+    free(store->table);
+    store->table = table;
+    store->table_mask = size - 1;
+}
+
+/**
+ * @brief 查找域名，不存在时加入
+ * @return 结点，再次加入结点后失效
+ */
+static Zone_Node *add_node(Zone_Store *store, const DNSKey *key) {
+    uint32_t slot = find_node(store, key);
+    if (slot != 0)
+        return &store->nodes[slot - 1];
+    if ((store->node_count + 1) * 2 > store->table_mask + 1)
+        grow_table(store);
+    if (store->node_count == store->node_cap) {
+        store->node_cap *= 2;
+        store->nodes = (Zone_Node *) realloc(store->nodes, store->node_cap * sizeof(Zone_Node));
+        if (!store->nodes)
+            log_fatal("内存分配错误")
+    }
+    Zone_Node *node = &store->nodes[store->node_count];
+    memset(node, 0, sizeof(Zone_Node));
+    node->hash = key->hash;
+    node->len = key->len;
+    node->name = (uint8_t *) malloc(key->len + 1);
+    if (!node->name)
+        log_fatal("内存分配错误")
+    memcpy(node->name, key->name, key->len + 1);
+    uint32_t i = key->hash & store->table_mask;
+    while (store->table[i] != 0)
+        i = (i + 1) & store->table_mask;
+    store->table[i] = ++store->node_count;
+    return node;
+}
+
+static void put_uint16(uint8_t *p, uint16_t value) {
+    p[0] = value >> 8;
+    p[1] = value;
+}
+
+static void put_uint32(uint8_t *p, uint32_t value) {
+    put_uint16(p, value >> 16);
+    put_uint16(p + 2, value);
+}
+
+/**
+ * @brief 加入一条记录，所有者与区域起点之间的域名作为空的非终结结点加入
+ * @param store 所有区域
+ * @param zone 区域
+ * @param key 所有者的规范键
+ * @return 与已有记录冲突时返回false：CNAME与其他类型共存、多条CNAME、不在起点的SOA或多条SOA
+ */
+static bool add_record(Zone_Store *store, const Zone *zone, const DNSKey *key, uint16_t type, uint32_t ttl,
+                       const uint8_t *rdata, uint16_t rdlength) {
+    if (type == DNS_TYPE_SOA && key->len != zone->origin_len)
+        return false;
+    for (int i = 0;;) {
+        while (key->name[i] != '.')
+            ++i;
+        ++i;
+        if (key->len - i <= zone->origin_len)
+            break;
+        DNSKey ancestor;
+        init_key(&ancestor, NULL, key->name + i, key->len - i);
+        add_node(store, &ancestor);
+    }
+    Zone_Node *node = add_node(store, key);
+    Zone_RRset *rrset = NULL;
+    for (int i = 0; i < node->rrset_count; ++i) {
+        if (node->rrsets[i].type == type)
+            rrset = &node->rrsets[i];
+        else if (type == DNS_TYPE_CNAME || node->rrsets[i].type == DNS_TYPE_CNAME)
+            return false;
+    }
+    if (rrset != NULL && (type == DNS_TYPE_CNAME || type == DNS_TYPE_SOA))
+        return false;
+    if (rrset == NULL) {
+        if (node->rrset_count == node->rrset_cap) {
+            node->rrset_cap = node->rrset_cap ? node->rrset_cap * 2 : 2;
+            node->rrsets = (Zone_RRset *) realloc(node->rrsets, node->rrset_cap * sizeof(Zone_RRset));
+            if (!node->rrsets)
+                log_fatal("内存分配错误")
+        }
+        rrset = &node->rrsets[node->rrset_count++];
+        memset(rrset, 0, sizeof(Zone_RRset));
+        rrset->type = type;
+    }
+    uint32_t size = 10 + rdlength;
+    if (rrset->len + size > rrset->cap) {
+        rrset->cap = rrset->cap * 2 > rrset->len + size ? rrset->cap * 2 : rrset->len + size;
+        rrset->wire = (uint8_t *) realloc(rrset->wire, rrset->cap);
+        if (!rrset->wire)
+            log_fatal("内存分配错误")
+    }
+    uint8_t *p = rrset->wire + rrset->len;
+    put_uint16(p, type);
+    put_uint16(p + 2, DNS_CLASS_IN);
+    put_uint32(p + 4, ttl);
+    put_uint16(p + 8, rdlength);
+    memcpy(p + 10, rdata, rdlength);
+    rrset->len += size;
+    ++rrset->count;
+    return true;
+}
+
+/* ===================== 主文件解析 ===================== */
+
+/**
+ * @brief 读出一条记录的所有词，括号内的换行不结束记录
+ * @param zp 解析状态
+ * @return 记录格式有误时返回false，此时已跳过整条记录
+ */
+static bool read_entry(Zone_Parser *zp) {
+    const char *p = zp->p;
+    int depth = 0, used = 0;
+    bool ok = true;
+    zp->token_count = 0;
+    zp->blank_owner = *p == ' ' || *p == '\t';
+    while (*p != 0) {
+        char c = *p;
+        if (c == '\n') {
+            ++zp->line;
+            ++p;
+            if (depth == 0)
+                break;
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\r') {
+            ++p;
+            continue;
+        }
+        if (c == ';') {
+            while (*p != 0 && *p != '\n')
+                ++p;
+            continue;
+        }
+        if (c == '(' || c == ')') {
+            depth += c == '(' ? 1 : -1;
+            ok = ok && depth >= 0;
+            ++p;
+            continue;
+        }
+        bool quoted = c == '"';
+        char *start = zp->text + used;
+        int len = 0;
+        if (quoted) {
+            for (++p; *p != 0 && *p != '"' && *p != '\n'; ++len) {
+                if (used + len >= ZONE_ENTRY_MAX_SIZE) {
+                    ok = false;
+                    break;
+                }
+                if (*p == '\\' && p[1] >= '0' && p[1] <= '9' && p[2] >= '0' && p[2] <= '9' && p[3] >= '0' &&
+                    p[3] <= '9') { // \DDD
+                    int value = (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+                    ok = ok && value < 256;
+                    start[len] = (char) value;
+                    p += 4;
+                } else {
+                    p += *p == '\\' && p[1] != 0 && p[1] != '\n';
+                    start[len] = *p++;
+                }
+            }
+            if (*p == '"')
+                ++p;
+            else
+                ok = false;
+        } else {
+            for (; *p != 0 && strchr(" \t\r\n;()\"", *p) == NULL; ++p, ++len) {
+                if (used + len >= ZONE_ENTRY_MAX_SIZE) {
+                    ok = false;
+                    break;
+                }
+                start[len] = *p;
+            }
+        }
+        if (!ok || zp->token_count == ZONE_MAX_TOKENS) {
+            ok = false;
+            while (*p != 0 && *p != '\n') // 跳过本行的剩余部分，之后按括号深度继续跳过
+                ++p;
+            continue;
+        }
+        start[len] = 0;
+        zp->tokens[zp->token_count++] = (Zone_Token) {start, len, quoted};
+        used += len + 1;
+    }
+    zp->p = p;
+    return ok && depth == 0;
+}
+
+/**
+ * @brief 把文本中的域名转为绝对的点分形式
+ * @param zp 解析状态，相对域名接在$ORIGIN之后
+ * @param token 词
+ * @param out 输出，至少DNS_NAME_TEXT_MAX_SIZE + 1字节，以'.'与0结尾
+ * @param lower 是否转为小写
+ * @return 长度，有误时返回0
+ */
+static int resolve_name(const Zone_Parser *zp, const Zone_Token *token, char *out, bool lower) {
+    int len;
+    if (token->len == 1 && token->text[0] == '@') {
+        memcpy(out, zp->origin, zp->origin_len + 1);
+        len = zp->origin_len;
+    } else if (token->len == 1 && token->text[0] == '.') {
+        strcpy(out, ".");
+        return 1;
+    } else {
+        bool absolute = token->text[token->len - 1] == '.';
+        int suffix = absolute ? 0 : zp->origin_len == 1 ? 1 : zp->origin_len + 1; // 起点为根时只补'.'
+        len = token->len + suffix;
+        if (token->quoted || strchr(token->text, '\\') != NULL || len > DNS_NAME_TEXT_MAX_SIZE - 1)
+            return 0;
+        memcpy(out, token->text, token->len);
+        if (suffix > 0) {
+            out[token->len] = '.';
+            memcpy(out + token->len + 1, zp->origin, suffix - 1);
+        }
+        out[len] = 0;
+    }
+    for (int i = 0, label = 0; i < len; ++i) {
+        label = out[i] == '.' ? 0 : label + 1;
+        if (label > DNS_NAME_LABEL_MAX_SIZE || (out[i] == '.' && (i == 0 || out[i - 1] == '.')))
+            return 0;
+        if (lower && (uint8_t) (out[i] - 'A') < 26)
+            out[i] |= 0x20;
+    }
+    return len;
+}
+
+/**
+ * @brief 把绝对的点分域名转为线路格式，不压缩
+ * @return 写入的字节数
+ */
+static int name_to_wire(uint8_t *wire, const char *name, int len) {
+    int out = 0, start = 0;
+    for (int i = 0; i < len && len > 1; ++i) {
+        if (name[i] != '.')
+            continue;
+        wire[out++] = (uint8_t) (i - start);
+        memcpy(wire + out, name + start, i - start);
+        out += i - start;
+        start = i + 1;
+    }
+    wire[out++] = 0;
+    return out;
+}
+
+/**
+ * @brief 解析不大于max的十进制整数
+ */
+static bool parse_number(const Zone_Token *token, uint32_t max, uint32_t *value) {
+    uint64_t result = 0;
+    if (token->len == 0 || token->len > 10)
+        return false;
+    for (int i = 0; i < token->len; ++i) {
+        if ((uint8_t) (token->text[i] - '0') >= 10)
+            return false;
+        result = result * 10 + (token->text[i] - '0');
+    }
+    *value = (uint32_t) result;
+    return result <= max;
+}
+
+/**
+ * @brief 解析TTL，可以带单位，如“3600”“1h30m”“2d”
+ */
+static bool parse_ttl(const Zone_Token *token, uint32_t *ttl) {
+    uint64_t total = 0, number = 0;
+    bool digits = false;
+    for (int i = 0; i < token->len; ++i) {
+        char c = token->text[i];
+        if ((uint8_t) (c - '0') < 10) {
+            number = number * 10 + (c - '0');
+            digits = true;
+        } else {
+            const char *units = "smhdw";
+            const uint32_t seconds[] = {1, 60, 3600, 86400, 604800};
+            const char *unit = strchr(units, c | 0x20);
+            if (!digits || unit == NULL || c == 0)
+                return false;
+            total += number * seconds[unit - units];
+            number = 0;
+            digits = false;
+        }
+        if (number > INT32_MAX || total > INT32_MAX)
+            return false;
+    }
+    total += number;
+    *ttl = (uint32_t) total;
+    return token->len > 0 && total <= INT32_MAX && (digits || (uint8_t) (token->text[token->len - 1] - '0') >= 10);
+}
+
+static uint16_t type_code(const Zone_Token *token) {
+    static const struct {
+        const char *name;
+        uint16_t type;
+    } TYPES[] = {{"A", DNS_TYPE_A}, {"NS", DNS_TYPE_NS}, {"CNAME", DNS_TYPE_CNAME}, {"SOA", DNS_TYPE_SOA},
+                 {"PTR", DNS_TYPE_PTR}, {"MX", DNS_TYPE_MX}, {"TXT", DNS_TYPE_TXT}, {"AAAA", DNS_TYPE_AAAA},
+                 {"SRV", DNS_TYPE_SRV}};
+    for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); ++i)
+        if (strcasecmp(token->text, TYPES[i].name) == 0)
+            return TYPES[i].type;
+    return 0;
+}
+
+/**
+ * @brief 把一个域名类型的词写入RDATA
+ * @return 写入的字节数，有误时返回0
+ */
+static int put_name(const Zone_Parser *zp, const Zone_Token *token, uint8_t *rdata) {
+    char name[DNS_NAME_TEXT_MAX_SIZE + 1];
+    int len = resolve_name(zp, token, name, false);
+    return len ? name_to_wire(rdata, name, len) : 0;
+}
+
+/**
+ * @brief 按类型把RDATA的文本转为线路格式
+ * @param zp 解析状态
+ * @param type 记录类型
+ * @param t RDATA的第一个词
+ * @param n RDATA的词数
+ * @param rdata 输出
+ * @return RDATA的字节数，有误时返回-1
+ */
+static int build_rdata(const Zone_Parser *zp, uint16_t type, const Zone_Token *t, int n, uint8_t *rdata) {
+    uint32_t v[5];
+    int len;
+    switch (type) {
+        case DNS_TYPE_A:
+            return n == 1 && uv_inet_pton(AF_INET, t[0].text, rdata) == 0 ? 4 : -1;
+        case DNS_TYPE_AAAA:
+            return n == 1 && uv_inet_pton(AF_INET6, t[0].text, rdata) == 0 ? 16 : -1;
+        case DNS_TYPE_NS:
+        case DNS_TYPE_CNAME:
+        case DNS_TYPE_PTR:
+            return n == 1 && (len = put_name(zp, &t[0], rdata)) ? len : -1;
+        case DNS_TYPE_MX: // RFC 1035 3.3.9.
+            if (n != 2 || !parse_number(&t[0], UINT16_MAX, &v[0]) || !(len = put_name(zp, &t[1], rdata + 2)))
+                return -1;
+            put_uint16(rdata, v[0]);
+            return 2 + len;
+        case DNS_TYPE_SRV: // RFC 2782
+            if (n != 4 || !parse_number(&t[0], UINT16_MAX, &v[0]) || !parse_number(&t[1], UINT16_MAX, &v[1]) ||
+                !parse_number(&t[2], UINT16_MAX, &v[2]) || !(len = put_name(zp, &t[3], rdata + 6)))
+                return -1;
+            for (int i = 0; i < 3; ++i)
+                put_uint16(rdata + 2 * i, v[i]);
+            return 6 + len;
+        case DNS_TYPE_TXT: // RFC 1035 3.3.14. 每个词是一个字符串
+            len = 0;
+            for (int i = 0; i < n; ++i) {
+                if (t[i].len > 255)
+                    return -1;
+                rdata[len++] = (uint8_t) t[i].len;
+                memcpy(rdata + len, t[i].text, t[i].len);
+                len += t[i].len;
+            }
+            return n > 0 && len <= UINT16_MAX ? len : -1;
+        case DNS_TYPE_SOA: { // RFC 1035 3.3.13.
+            int mname, rname;
+            if (n != 7 || !(mname = put_name(zp, &t[0], rdata)) || !(rname = put_name(zp, &t[1], rdata + mname)) ||
+                !parse_number(&t[2], UINT32_MAX, &v[0]))
+                return -1;
+            for (int i = 1; i < 5; ++i)
+                if (!parse_ttl(&t[i + 2], &v[i]))
+                    return -1;
+            len = mname + rname;
+            for (int i = 0; i < 5; ++i, len += 4)
+                put_uint32(rdata + len, v[i]);
+            return len;
+        }
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief 处理一条记录或指令
+ * @return 有误时返回false
+ */
+static bool parse_entry(Zone_Parser *zp) {
+    const Zone_Token *t = zp->tokens;
+    int n = zp->token_count, i = 0;
+    if (n == 0)
+        return true;
+    if (!zp->blank_owner && t[0].text[0] == '$') {
+        if (n == 2 && strcasecmp(t[0].text, "$ORIGIN") == 0) {
+            char origin[DNS_NAME_TEXT_MAX_SIZE + 1];
+            int len = resolve_name(zp, &t[1], origin, true);
+            if (len == 0)
+                return false;
+            memcpy(zp->origin, origin, len + 1);
+            zp->origin_len = len;
+            return true;
+        }
+        if (n == 2 && strcasecmp(t[0].text, "$TTL") == 0)
+            return zp->has_default_ttl = parse_ttl(&t[1], &zp->default_ttl);
+        return false; // 不支持$INCLUDE
+    }
+    if (!zp->blank_owner) {
+        zp->owner_len = resolve_name(zp, &t[i++], zp->owner, true);
+    }
+    if (zp->owner_len == 0)
+        return false;
+
+    uint32_t ttl = 0;
+    bool has_ttl = false;
+    for (int k = 0; k < 2 && i < n; ++k) { // TTL与类可以省略，顺序任意
+        if ((uint8_t) (t[i].text[0] - '0') < 10) {
+            if (has_ttl || !parse_ttl(&t[i++], &ttl))
+                return false;
+            has_ttl = true;
+        } else if (strcasecmp(t[i].text, "IN") == 0) {
+            ++i;
+        } else
+            break;
+    }
+    uint16_t type = i < n ? type_code(&t[i++]) : 0;
+    if (type == 0)
+        return false;
+    if (!has_ttl) { // RFC 2308 4. 依次使用$TTL与上一条记录的TTL
+        if (!zp->has_default_ttl && !zp->has_last_ttl)
+            return false;
+        ttl = zp->has_default_ttl ? zp->default_ttl : zp->last_ttl;
+    }
+    zp->last_ttl = ttl;
+    zp->has_last_ttl = true;
+
+    uint8_t rdata[ZONE_ENTRY_MAX_SIZE + 2 * ZONE_MAX_TOKENS];
+    int rdlength = build_rdata(zp, type, t + i, n - i, rdata);
+    if (rdlength < 0)
+        return false;
+
+    DNSKey key;
+    init_key(&key, NULL, (const uint8_t *) zp->owner, zp->owner_len);
+    const Suffix_Trie_Node *origin = zp->store->origins->find(zp->store->origins, &key);
+    if (origin == NULL || (int) origin->value != zp->zone) // 不在本区域中，或属于更长的另一个区域
+        return false;
+    if (!add_record(zp->store, &zp->store->zones[zp->zone], &key, type, ttl, rdata, (uint16_t) rdlength))
+        return false;
+    ++zp->store->stats.records;
+    return true;
+}
+
+/**
+ * @brief 读取并解析一个区域的主文件
+ * @return 文件无法读取时返回false
+ */
+static bool load_zone(Zone_Store *store, int zone) {
+    FILE *file = fopen(store->zones[zone].path, "rb");
+    if (!file)
+        return false;
+    size_t size = 0, cap = 4096;
+    char *data = (char *) malloc(cap);
+    if (!data)
+        log_fatal("内存分配错误")
+    for (size_t n; (n = fread(data + size, 1, cap - size - 1, file)) > 0;) {
+        size += n;
+        if (size + 1 == cap) {
+            cap *= 2;
+            data = (char *) realloc(data, cap);
+            if (!data)
+                log_fatal("内存分配错误")
+        }
+    }
+    fclose(file);
+    data[size] = 0;
+
+    Zone_Parser *zp = (Zone_Parser *) calloc(1, sizeof(Zone_Parser));
+    if (!zp)
+        log_fatal("内存分配错误")
+    zp->store = store;
+    zp->zone = zone;
+    zp->p = data;
+    zp->line = 1;
+    zp->origin_len = store->zones[zone].origin_len;
+    memcpy(zp->origin, store->zones[zone].origin, zp->origin_len + 1);
+    while (*zp->p != 0) {
+        uint64_t line = zp->line;
+        bool ok = read_entry(zp);
+        if (!ok || !parse_entry(zp)) {
+            ++store->stats.errors;
+            log_error("第%d个区域文件第%llu行有误", zone + 1, (unsigned long long) line)
+        }
+    }
+    free(zp);
+    free(data);
+    return true;
+}
+
+/* ===================== 作答 ===================== */
+
+static void write_bytes(Zone_Writer *w, const void *data, unsigned len) {
+    if (w->overflow || w->len + len > w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->packet + w->len, data, len);
+    w->len += len;
+}
+
+/**
+ * @brief 写入一个RRset，所有者为指向报文中owner处域名的压缩指针
+ * @return 写入的记录数
+ */
+static uint16_t write_rrset(Zone_Writer *w, const Zone_RRset *rrset, unsigned owner) {
+    const uint8_t *p = rrset->wire;
+    uint8_t pointer[2] = {0xC0 | (owner >> 8), owner & 0xFF};
+    for (int i = 0; i < rrset->count; ++i) {
+        unsigned size = 10 + (p[8] << 8 | p[9]);
+        write_bytes(w, pointer, 2);
+        write_bytes(w, p, size);
+        p += size;
+    }
+    return rrset->count;
+}
+
+/**
+ * @brief 写入否定回复的SOA，RFC 2308 3. TTL取SOA本身的TTL与MINIMUM中较小的一个
+ * @return 写入的记录数
+ */
+static uint16_t write_negative_soa(Zone_Writer *w, const Zone_RRset *soa, unsigned owner) {
+    unsigned start = w->len;
+    uint16_t count = write_rrset(w, soa, owner);
+    if (!w->overflow) {
+        uint8_t *ttl = w->packet + start + 2 + 4; // 跳过所有者指针、TYPE与CLASS
+        const uint8_t *minimum = w->packet + w->len - 4; // RDATA的最后一个字段
+        if (memcmp(minimum, ttl, 4) < 0) // 都是网络字节序，按字节比较即按数值比较
+            memcpy(ttl, minimum, 4);
+    }
+    return count;
+}
+
+/**
+ * @brief 查找域名，不存在时按RFC 4592用最近祖先之下的“*”合成
+ * @return 结点，域名不存在时返回NULL
+ */
+static const Zone_Node *lookup(const Zone_Store *store, const Zone *zone, const DNSKey *key) {
+    uint32_t slot = find_node(store, key);
+    if (slot != 0)
+        return &store->nodes[slot - 1];
+    for (int i = 0; key->len - i > zone->origin_len;) {
+        while (key->name[i] != '.')
+            ++i;
+        ++i;
+        if (find_name(store, NULL, key->name + i, key->len - i) != 0) { // 最近的祖先
+            slot = find_name(store, "*.", key->name + i, key->len - i);
+            return slot ? &store->nodes[slot - 1] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 把线路格式的域名转为点分形式，以'.'与0结尾
+ */
+static void wire_to_name(uint8_t *text, const uint8_t *wire) {
+    int len = 0;
+    for (; *wire != 0; wire += *wire + 1) {
+        memcpy(text + len, wire + 1, *wire);
+        len += *wire;
+        text[len++] = '.';
+    }
+    if (len == 0)
+        text[len++] = '.';
+    text[len] = 0;
+}
+
+static bool store_answer(const Zone_Store *store, const DNSKey *key, uint8_t *packet, unsigned offset, unsigned cap,
+                         Zone_Answer *result) {
+    const Suffix_Trie_Node *origin = store->origins->find(store->origins, key);
+    if (origin == NULL)
+        return false;
+    const Zone *zone = &store->zones[origin->value];
+    Zone_Writer w = {packet, offset, cap, false};
+    DNSKey chased;
+    const DNSKey *name = key;
+    unsigned owner = 12; // 当前域名在报文中的位置，开始时为问题中的域名
+    bool negative = true;
+    memset(result, 0, sizeof(Zone_Answer));
+    for (int hop = 0; hop <= ZONE_MAX_CHAIN; ++hop) {
+        const Zone_Node *node = lookup(store, zone, name);
+        if (node == NULL) {
+            result->rcode = DNS_RCODE_NXDOMAIN;
+            break;
+        }
+        const Zone_RRset *cname = NULL;
+        for (int i = 0; i < node->rrset_count; ++i) {
+            const Zone_RRset *rrset = &node->rrsets[i];
+            if (key->qtype == DNS_TYPE_ANY || rrset->type == key->qtype) {
+                result->ancount += write_rrset(&w, rrset, owner);
+                negative = false;
+            } else if (rrset->type == DNS_TYPE_CNAME)
+                cname = rrset;
+        }
+        if (!negative || cname == NULL) // 有答案，或者NODATA
+            break;
+        // RFC 1034 3.4.2. 写入CNAME后继续查找目标，目标的所有者指向CNAME的RDATA
+        unsigned target = w.len + 2 + 10;
+        result->ancount += write_rrset(&w, cname, owner);
+        uint8_t text[DNS_KEY_NAME_MAX_SIZE + 32]; // 按块读取时不越界
+        wire_to_name(text, cname->wire + 10);
+        dnskey_init(&chased, text, key->qtype, key->qclass);
+        origin = store->origins->find(store->origins, &chased);
+        if (origin == NULL || hop == ZONE_MAX_CHAIN || w.overflow) { // 目标不在本地区域中，由客户端继续解析
+            negative = false;
+            break;
+        }
+        zone = &store->zones[origin->value];
+        name = &chased;
+        owner = target;
+    }
+    if (negative) // RFC 2308 3. 否定回复在Authority Section附上区域的SOA，所有者为当前域名的后缀
+        result->nscount = write_negative_soa(&w, zone->soa, owner + name->len - zone->origin_len);
+    if (w.overflow) {
+        result->ancount = result->nscount = 0;
+        result->truncated = true;
+        w.len = offset;
+    }
+    result->len = w.len;
+    return true;
+}
+
+Zone_Store *new_zone_store(char *const *specs, int count) {
+    uint64_t start = uv_hrtime();
+    Zone_Store *store = (Zone_Store *) calloc(1, sizeof(Zone_Store));
+    if (!store)
+        log_fatal("内存分配错误")
+    store->zones = (Zone *) calloc(count, sizeof(Zone));
+    store->node_cap = 64;
+    store->nodes = (Zone_Node *) malloc(store->node_cap * sizeof(Zone_Node));
+    store->table_mask = 127;
+    store->table = (uint32_t *) calloc(store->table_mask + 1, sizeof(uint32_t));
+    if (!store->zones || !store->nodes || !store->table)
+        log_fatal("内存分配错误")
+    store->origins = new_suffix_trie();
+    store->answer = &store_answer;
+
+    for (int i = 0; i < count; ++i) {
+        const char *eq = strchr(specs[i], '=');
+        Zone_Parser *zp = (Zone_Parser *) calloc(1, sizeof(Zone_Parser)); // 借用其中的$ORIGIN解析起点
+        if (!zp)
+            log_fatal("内存分配错误")
+        strcpy(zp->origin, ".");
+        zp->origin_len = 1;
+        char origin[DNS_NAME_TEXT_MAX_SIZE + 1];
+        int len = 0;
+        if (eq != NULL && eq > specs[i] && eq - specs[i] <= DNS_NAME_TEXT_MAX_SIZE - 1) {
+            char text[DNS_NAME_TEXT_MAX_SIZE + 1];
+            memcpy(text, specs[i], eq - specs[i]);
+            text[eq - specs[i]] = 0;
+            Zone_Token token = {text, (int) (eq - specs[i]), false};
+            len = resolve_name(zp, &token, origin, true);
+        }
+        free(zp);
+        bool duplicate = false;
+        for (int j = 0; j < i && len > 1; ++j)
+            duplicate = duplicate || strcmp(store->zones[j].origin, origin) == 0;
+        if (len <= 1 || duplicate || eq[1] == 0) { // 不支持根区域
+            log_error("第%d个区域有误", i + 1)
+            store->zone_count = i;
+            destroy_zone_store(store);
+            return NULL;
+        }
+        Zone *zone = &store->zones[i];
+        zone->origin = strdup(origin);
+        if (!zone->origin)
+            log_fatal("内存分配错误")
+        zone->origin_len = len;
+        zone->path = eq + 1;
+        store->origins->insert(store->origins, origin, len, SUFFIX_MATCH_SELF | SUFFIX_MATCH_BELOW)->value = i;
+        store->zone_count = i + 1;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!load_zone(store, i)) {
+            log_error("第%d个区域文件无法读取", i + 1)
+            destroy_zone_store(store);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < count; ++i) { // 所有记录加入后结点不再移动，可以保存指针
+        Zone *zone = &store->zones[i];
+        uint32_t slot = find_name(store, NULL, (const uint8_t *) zone->origin, zone->origin_len);
+        for (int r = 0; slot != 0 && r < store->nodes[slot - 1].rrset_count; ++r)
+            if (store->nodes[slot - 1].rrsets[r].type == DNS_TYPE_SOA)
+                zone->soa = &store->nodes[slot - 1].rrsets[r];
+        if (zone->soa == NULL) {
+            log_error("第%d个区域缺少SOA记录", i + 1)
+            destroy_zone_store(store);
+            return NULL;
+        }
+    }
+    store->stats.duration = uv_hrtime() - start;
+    return store;
+}
+
+void destroy_zone_store(Zone_Store *store) {
+    for (uint32_t n = 0; n < store->node_count; ++n) {
+        for (int r = 0; r < store->nodes[n].rrset_count; ++r)
+            free(store->nodes[n].rrsets[r].wire);
+        free(store->nodes[n].rrsets);
+        free(store->nodes[n].name);
+    }
+    for (int i = 0; i < store->zone_count; ++i)
+        free(store->zones[i].origin);
+    free(store->zones);
+    free(store->nodes);
+    free(store->table);
+    destroy_suffix_trie(store->origins);
+    free(store);
+}
+
+/* ===================== 热加载 ===================== */
+
+static void free_store(void *store) {
+    destroy_zone_store((Zone_Store *) store);
+}
+
+/**
+ * @brief 在线程池中重新加载全部区域
+ */
+static void reload_work(uv_work_t *req) {
+    reload.result = new_zone_store(ZONE_SPECS, ZONE_SPEC_COUNT);
+}
+
+static void start_reload();
+
+/**
+ * @brief 回到事件循环线程后替换区域，旧的区域在所有读者离开后释放
+ */
+static void reload_done(uv_work_t *req, int status) {
+    reload.running = false;
+    if (status == 0 && reload.result != NULL) {
+        metrics_count(METRIC_ZONE_RELOADS);
+        log_info("区域已重新加载，%llu条记录，%llu条有误，耗时%lluus", (unsigned long long) reload.result->stats.records,
+                 (unsigned long long) reload.result->stats.errors,
+                 (unsigned long long) (reload.result->stats.duration / 1000))
+        Zone_Store *old = atomic_exchange_explicit(reload.target, reload.result, memory_order_acq_rel);
+        epoch_retire(&free_store, old);
+    } else {
+        metrics_count(METRIC_ZONE_RELOAD_FAILURES);
+        log_error("区域重新加载失败，继续使用旧的记录")
+    }
+    reload.result = NULL;
+    if (reload.pending) {
+        reload.pending = false;
+        start_reload();
+    }
+}
+
+static void start_reload() {
+    if (reload.running) {
+        reload.pending = true;
+        return;
+    }
+    reload.running = true;
+    uv_queue_work(reload.delay.loop, &reload.work, &reload_work, &reload_done);
+}
+
+static void on_delay(uv_timer_t *timer) {
+    start_reload();
+}
+
+static void on_zone_change(uv_fs_event_t *handle, const char *filename, int events, int status) {
+    int zone = (int) (handle - reload.watchers);
+    if (status < 0) {
+        log_error("第%d个区域文件监视异常 %d", zone + 1, status)
+        return;
+    }
+    if (filename != NULL && strcmp(filename, reload.bases[zone]) != 0)
+        return;
+    uv_timer_start(&reload.delay, &on_delay, ZONE_RELOAD_DELAY, 0);
+}
+
+/**
+ * @brief 导出区域的指标
+ */
+static void collect_zones(Metrics_Buffer *buf, void *data) {
+    epoch_enter();
+    const Zone_Store *store = atomic_load_explicit(reload.target, memory_order_acquire);
+    metrics_printf(buf, "# HELP nodns_zone_count Authoritative zones loaded from zone files\n"
+                        "# TYPE nodns_zone_count gauge\nnodns_zone_count %d\n"
+                        "# HELP nodns_zone_records Records loaded from zone files at the last successful load\n"
+                        "# TYPE nodns_zone_records gauge\nnodns_zone_records %llu\n"
+                        "# HELP nodns_zone_load_errors Records skipped as malformed at the last successful load\n"
+                        "# TYPE nodns_zone_load_errors gauge\nnodns_zone_load_errors %llu\n"
+                        "# HELP nodns_zone_reload_duration_seconds Time taken by the last successful zone load\n"
+                        "# TYPE nodns_zone_reload_duration_seconds gauge\nnodns_zone_reload_duration_seconds %.6f\n",
+                   store->zone_count, (unsigned long long) store->stats.records,
+                   (unsigned long long) store->stats.errors, store->stats.duration / 1e9);
+    epoch_exit();
+}
+
+void init_zone_reload(uv_loop_t *loop, _Atomic(Zone_Store *) *target) {
+    const Zone_Store *store = atomic_load_explicit(target, memory_order_acquire);
+    reload.target = target;
+    reload.watchers = (uv_fs_event_t *) calloc(store->zone_count, sizeof(uv_fs_event_t));
+    reload.bases = (const char **) calloc(store->zone_count, sizeof(char *));
+    if (!reload.watchers || !reload.bases)
+        log_fatal("内存分配错误")
+    uv_timer_init(loop, &reload.delay);
+    for (int i = 0; i < store->zone_count; ++i) {
+        const char *path = store->zones[i].path;
+        char *dir = strdup(path);
+        if (!dir)
+            log_fatal("内存分配错误")
+        char *slash = strrchr(dir, '/');
+        if (slash == NULL) {
+            reload.bases[i] = path;
+            strcpy(dir, ".");
+        } else {
+            reload.bases[i] = path + (slash - dir) + 1;
+            slash[slash == dir] = 0; // 根目录保留"/"
+        }
+        uv_fs_event_init(loop, &reload.watchers[i]);
+        int status = uv_fs_event_start(&reload.watchers[i], &on_zone_change, dir, 0);
+        if (status != 0)
+            log_error("无法监视第%d个区域文件所在的目录 %d", i + 1, status)
+        free(dir);
+    }
+    metrics_register(&collect_zones, NULL);
+}
@@ -0,0 +1,21 @@
+# 把样例文本编译为屏蔽列表，检查两次编译的结果相同，再用parser_test检查映射后的内容
+# 用法：cmake -DCOMPILE=<blocklist_compile> -DTEST=<parser_test> -DINPUT=<文本> -DOUTPUT=<输出前缀> -P check_blocklist.cmake
+
+foreach (RUN 1 2)
+    execute_process(COMMAND ${COMPILE} -o ${OUTPUT}.${RUN}.bin ${INPUT}
+            RESULT_VARIABLE RESULT OUTPUT_VARIABLE LOG ERROR_VARIABLE LOG)
+    if (NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "blocklist_compile ${INPUT} failed:\n${LOG}")
+    endif ()
+endforeach ()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT}.1.bin ${OUTPUT}.2.bin RESULT_VARIABLE RESULT)
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "blocklist_compile is not deterministic for ${INPUT}")
+endif ()
+
+execute_process(COMMAND ${TEST} blocklist ${OUTPUT}.1.bin RESULT_VARIABLE RESULT)
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "parser_test blocklist ${OUTPUT}.1.bin failed")
+endif ()
+message(STATUS "${INPUT} compiles to a blocklist with the expected entries")
@@ -0,0 +1,391 @@
+/**
+ * @file      parser_test.c
+ * @brief     解析器测试
+ * @details   用tests/fixtures中的小样例检查各解析器的结果，由ctest运行，有检查失败时返回非0。
+ *            用法：parser_test blocklist 编译后的屏蔽列表
+ *                  parser_test hosts hosts文件
+ *                  parser_test zone 样例所在的目录
+ *                  parser_test reload 临时hosts文件
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/blocklist.h"
+#include "../include/dns_key.h"
+#include "../include/dns_name.h"
+#include "../include/hosts.h"
+#include "../include/zone_store.h"
+
+static int failures;
+
+#define CHECK(cond) check(cond, __LINE__, #cond, NULL)
+#define CHECK_NAME(cond, name) check(cond, __LINE__, #cond, name)
+
+static void check(bool ok, int line, const char *what, const char *name) {
+    if (ok)
+        return;
+    ++failures;
+    fprintf(stderr, "parser_test.c:%d: 检查失败：%s%s%s\n", line, what, name ? "，域名：" : "", name ? name : "");
+}
+
+/**
+ * @brief 由点分形式的域名生成规范键
+ * @param key 输出，规范键
+ * @param name 以'.'结尾的域名
+ * @param qtype 查询类型
+ */
+static void make_key(DNSKey *key, const char *name, uint16_t qtype) {
+    uint8_t text[DNS_KEY_NAME_MAX_SIZE + 32] = {0}; // dnskey_init按块读取
+    strncpy((char *) text, name, DNS_KEY_NAME_MAX_SIZE - 1);
+    dnskey_init(key, text, qtype, DNS_CLASS_IN);
+}
+
+/* ===================== 屏蔽列表 ===================== */
+
+static bool blocked(const Blocklist *blocklist, const char *name) {
+    DNSKey key;
+    make_key(&key, name, DNS_TYPE_A);
+    return blocklist->contains(blocklist, &key) || blocklist->suffixes->match(blocklist->suffixes, &key);
+}
+
+// fixtures/blocklist.txt由blocklist_compile编译后再映射，结果应与文本中的规则一致
+static void test_blocklist(const char *path) {
+    Blocklist *blocklist = new_blocklist(path);
+    CHECK(blocklist != NULL);
+    if (blocklist == NULL)
+        return;
+    CHECK(blocklist->header->version == BLOCKLIST_VERSION);
+    CHECK(blocklist->header->count == 6); // ads.example.com重复一次
+    CHECK(blocklist->header->suffix_count == 2);
+    CHECK(blocklist->suffixes->rules == 2);
+
+    static const char *LISTED[] = {"ads.example.com.", "tracker.example.com.", "mixed.case.example.net.",
+                                   "v6.example.com.", "hosted.example.org.", "plain.example.org.",
+                                   "a.wild.example.com.", "a.b.wild.example.com.", "adnet.example.",
+                                   "x.adnet.example."};
+    static const char *NOT_LISTED[] = {"kept.example.com.", "localhost.", "example.com.", "wild.example.com.",
+                                       "allowed.example.", "options.example.", "sub.ads.example.com.",
+                                       "xadnet.example."};
+    for (size_t i = 0; i < sizeof(LISTED) / sizeof(LISTED[0]); ++i)
+        CHECK_NAME(blocked(blocklist, LISTED[i]), LISTED[i]);
+    for (size_t i = 0; i < sizeof(NOT_LISTED) / sizeof(NOT_LISTED[0]); ++i)
+        CHECK_NAME(!blocked(blocklist, NOT_LISTED[i]), NOT_LISTED[i]);
+}
+
+/* ===================== hosts文件 ===================== */
+
+/**
+ * @brief 检查hosts中的回答
+ * @param index hosts索引
+ * @param name 域名
+ * @param qtype 查询类型
+ * @param type 期望的项的类型，为0时期望没有回答
+ * @param rdata 期望的各条记录的RDATA，依次排列
+ * @param rdlength 每条记录的RDATA长度
+ * @param count 期望的记录数
+ */
+static void expect_hosts(const Hosts_Index *index, const char *name, uint16_t qtype, uint16_t type,
+                         const void *rdata, int rdlength, int count) {
+    DNSKey key;
+    make_key(&key, name, qtype);
+    const Hosts_Entry *entry = index->find(index, &key);
+    if (type == 0) {
+        CHECK_NAME(entry == NULL, name);
+        return;
+    }
+    CHECK_NAME(entry != NULL, name);
+    if (entry == NULL)
+        return;
+    CHECK_NAME(entry->type == type, name);
+    CHECK_NAME(entry->ancount == count, name);
+    const DNSResourceRecord *rr = entry->rr;
+    for (int i = 0; i < count && rr != NULL; ++i, rr = rr->next) {
+        CHECK_NAME(rr->rdlength == rdlength, name);
+        CHECK_NAME(memcmp(rr->rdata, (const uint8_t *) rdata + i * rdlength, rdlength) == 0, name);
+    }
+    CHECK_NAME(rr == NULL, name);
+}
+
+static bool hosts_rule(const Hosts_Index *index, const char *name) {
+    DNSKey key;
+    make_key(&key, name, DNS_TYPE_A);
+    return index->suffixes->match(index->suffixes, &key);
+}
+
+// fixtures/hosts.txt切成不同的段数解析，每种切分的结果都应相同，段边界会落在行中、注释中与地址中
+static void test_hosts(const char *path) {
+    static const uint8_t EXAMPLE[] = {192, 0, 2, 1, 192, 0, 2, 2, 192, 0, 2, 3};
+    static const uint8_t EXAMPLE6[] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+    static const uint8_t BLOCKED[] = {0, 0, 0, 0};
+    for (int threads = 1; threads <= HOSTS_MAX_THREADS; ++threads) {
+        FILE *file = fopen(path, "r");
+        CHECK(file != NULL);
+        if (file == NULL)
+            return;
+        Hosts_Index *index = new_hosts_index_split(file, threads, true);
+        fclose(file);
+        CHECK(index->stats.threads == threads);
+        CHECK(index->stats.lines == 17);
+        CHECK(index->stats.errors == 1); // bad.test的地址有误
+
+        expect_hosts(index, "example.test.", DNS_TYPE_A, DNS_TYPE_A, EXAMPLE, 4, 3); // 重复的地址只保留一个
+        expect_hosts(index, "example.test.", DNS_TYPE_AAAA, DNS_TYPE_AAAA, EXAMPLE6, 16, 1);
+        expect_hosts(index, "EXAMPLE.test.", DNS_TYPE_A, DNS_TYPE_A, EXAMPLE, 4, 3);
+        expect_hosts(index, "example.test.", DNS_TYPE_MX, 0, NULL, 0, 0);
+        expect_hosts(index, "multi.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 3}, 4, 1);
+        expect_hosts(index, "alias.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 3}, 4, 1);
+        expect_hosts(index, "upper.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 4}, 4, 1);
+        expect_hosts(index, "indented.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 5}, 4, 1);
+        expect_hosts(index, "tab.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 6}, 4, 1);
+        expect_hosts(index, "last.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 8}, 4, 1);
+        expect_hosts(index, "nonl.test.", DNS_TYPE_A, DNS_TYPE_A, (const uint8_t[]) {192, 0, 2, 9}, 4, 1);
+        // 屏蔽项回答任意类型，同一域名之后的地址被忽略
+        expect_hosts(index, "blocked.test.", DNS_TYPE_A, DNS_TYPE_ANY, BLOCKED, 4, 1);
+        expect_hosts(index, "blocked.test.", DNS_TYPE_AAAA, DNS_TYPE_ANY, BLOCKED, 4, 1);
+        expect_hosts(index, "bad.test.", DNS_TYPE_A, 0, NULL, 0, 0);
+        expect_hosts(index, "test.", DNS_TYPE_A, 0, NULL, 0, 0);
+        // 反向记录指向文件中该地址的第一个域名
+        expect_hosts(index, "1.2.0.192.in-addr.arpa.", DNS_TYPE_PTR, DNS_TYPE_PTR, "example.test.", 14, 1);
+        expect_hosts(index, "3.2.0.192.in-addr.arpa.", DNS_TYPE_PTR, DNS_TYPE_PTR, "example.test.", 14, 1);
+        expect_hosts(index, "1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.8.b.d.0.1.0.0.2.ip6.arpa.", DNS_TYPE_PTR,
+                     DNS_TYPE_PTR, "example.test.", 14, 1);
+        expect_hosts(index, "4.2.0.192.in-addr.arpa.", DNS_TYPE_PTR, DNS_TYPE_PTR, "upper.test.", 12, 1);
+
+        CHECK(index->suffixes->rules == 2);
+        CHECK(hosts_rule(index, "a.wild.test."));
+        CHECK(!hosts_rule(index, "wild.test."));
+        CHECK(hosts_rule(index, "ads.test."));
+        CHECK(hosts_rule(index, "x.ads.test."));
+        CHECK(!hosts_rule(index, "example.test."));
+        destroy_hosts_index(index);
+    }
+}
+
+#define RELOAD_LINES 100000 // 临时hosts文件的行数，约3.5MB，解析一次的时间足以与改写交错
+#define RELOAD_ROUNDS 20 // 解析的次数
+
+// 原地改写临时hosts文件的线程
+typedef struct rewriter {
+    const char *path;
+    const char *text;
+    size_t size;
+    atomic_bool stop;
+} Rewriter;
+
+// 反复截断并重写文件，模拟cat new > hosts.txt式的原地改写
+static void *rewrite_hosts(void *arg) {
+    Rewriter *rewriter = (Rewriter *) arg;
+    int fd = open(rewriter->path, O_WRONLY);
+    if (fd < 0)
+        return NULL;
+    while (!atomic_load(&rewriter->stop)) {
+        if (ftruncate(fd, 0) != 0)
+            break;
+        for (size_t done = 0; done < rewriter->size;) {
+            ssize_t n = pwrite(fd, rewriter->text + done, rewriter->size - done, (off_t) done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+// 热加载时文件可能正被原地改写，读入缓冲区解析只会读到部分内容，不应像mmap那样因文件变短而SIGBUS
+static void test_reload(const char *path) {
+    size_t size = (size_t) RELOAD_LINES * 48;
+    char *text = (char *) malloc(size);
+    CHECK(text != NULL);
+    if (text == NULL)
+        return;
+    size_t length = 0;
+    for (int i = 0; i < RELOAD_LINES; ++i)
+        length += snprintf(text + length, size - length, "10.%d.%d.%d host%d.reload.test\n",
+                           i >> 16, (i >> 8) & 0xff, i & 0xff, i);
+    FILE *file = fopen(path, "w");
+    CHECK(file != NULL);
+    if (file == NULL) {
+        free(text);
+        return;
+    }
+    CHECK(fwrite(text, 1, length, file) == length);
+    fclose(file);
+
+    Rewriter rewriter = {path, text, length};
+    atomic_init(&rewriter.stop, false);
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, rewrite_hosts, &rewriter) == 0);
+    for (int round = 0; round < RELOAD_ROUNDS; ++round) {
+        file = fopen(path, "r");
+        CHECK(file != NULL);
+        if (file == NULL)
+            break;
+        Hosts_Index *index = new_hosts_index_split(file, 0, false);
+        fclose(file);
+        CHECK(index->stats.lines <= RELOAD_LINES);
+        destroy_hosts_index(index);
+    }
+    atomic_store(&rewriter.stop, true);
+    pthread_join(thread, NULL);
+    free(text);
+    remove(path);
+}
+
+/* ===================== 区域文件 ===================== */
+
+// 回复中的一条记录
+typedef struct test_rr {
+    uint16_t type;
+    uint32_t ttl;
+    uint16_t rdlength;
+    const uint8_t *rdata;
+} Test_RR;
+
+/**
+ * @brief 在区域中作答并拆出回复中的记录
+ * @param store 所有区域
+ * @param name 域名
+ * @param qtype 查询类型
+ * @param packet 回复报文，至少ZONE_UDP_SIZE字节
+ * @param result 输出，作答的结果
+ * @param rrs 输出，Answer与Authority Section中的记录，至少ZONE_MAX_CHAIN + 2项
+ * @return 如果域名属于某个区域，返回true
+ */
+static bool zone_query(const Zone_Store *store, const char *name, uint16_t qtype, uint8_t *packet,
+                       Zone_Answer *result, Test_RR *rrs) {
+    uint8_t text[DNS_KEY_NAME_MAX_SIZE + 32] = {0}; // to_wire按块读取
+    strncpy((char *) text, name, DNS_KEY_NAME_MAX_SIZE - 1);
+    unsigned offset = 12 + dnsname->to_wire(packet + 12, text);
+    packet[offset++] = qtype >> 8;
+    packet[offset++] = qtype;
+    packet[offset++] = 0;
+    packet[offset++] = DNS_CLASS_IN;
+    DNSKey key;
+    make_key(&key, name, qtype);
+    if (!store->answer(store, &key, packet, offset, ZONE_UDP_SIZE, result))
+        return false;
+    const uint8_t *p = packet + offset;
+    for (int i = 0; i < result->ancount + result->nscount && i < ZONE_MAX_CHAIN + 2; ++i) {
+        while (*p != 0 && (*p & 0xC0) != 0xC0) // 所有者通常是压缩指针
+            p += *p + 1;
+        p += *p == 0 ? 1 : 2;
+        rrs[i].type = p[0] << 8 | p[1];
+        rrs[i].ttl = (uint32_t) p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+        rrs[i].rdlength = p[8] << 8 | p[9];
+        rrs[i].rdata = p + 10;
+        p += 10 + rrs[i].rdlength;
+    }
+    CHECK_NAME(p == packet + result->len, name);
+    return true;
+}
+
+static bool rdata_equal(const Test_RR *rr, const void *rdata, uint16_t rdlength) {
+    return rr->rdlength == rdlength && memcmp(rr->rdata, rdata, rdlength) == 0;
+}
+
+// fixtures/example.zone与other.zone作为两个区域加载，查询覆盖直接回答、CNAME链、通配符与否定回复
+static void test_zone(const char *dir) {
+    char example[4096], other[4096];
+    snprintf(example, sizeof(example), "example.test=%s/example.zone", dir);
+    snprintf(other, sizeof(other), "other.test.=%s/other.zone", dir);
+    char *specs[] = {example, other};
+    Zone_Store *store = new_zone_store(specs, 2);
+    CHECK(store != NULL);
+    if (store == NULL)
+        return;
+    CHECK(store->stats.records == 19);
+    CHECK(store->stats.errors == 1); // bad.example.test的地址有误
+
+    uint8_t packet[ZONE_UDP_SIZE];
+    Zone_Answer result;
+    Test_RR rrs[ZONE_MAX_CHAIN + 2];
+
+    // 括号跨行与注释，SOA本身的TTL取$TTL
+    CHECK(zone_query(store, "example.test.", DNS_TYPE_SOA, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_OK && result.ancount == 1 && result.nscount == 0);
+    CHECK(rrs[0].type == DNS_TYPE_SOA && rrs[0].ttl == 3600);
+    CHECK(rdata_equal(&rrs[0], "\3ns1\7example\4test\0\12hostmaster\7example\4test\0"
+                               "\x78\xa3\xf1\x75\0\0\x1c\x20\0\0\x0e\x10\0\x09\x3a\x80\0\0\1\x2c", 63));
+
+    // 显式的TTL与类，省略的所有者沿用上一条
+    CHECK(zone_query(store, "ns1.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rrs[0].ttl == 300 && rdata_equal(&rrs[0], "\300\0\2\1", 4));
+    CHECK(zone_query(store, "mail.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rrs[0].ttl == 600);
+    CHECK(zone_query(store, "mail.example.test.", DNS_TYPE_AAAA, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rrs[0].type == DNS_TYPE_AAAA && rrs[0].ttl == 3600);
+
+    // CNAME链经过$ORIGIN切换后的相对域名，不区分大小写
+    CHECK(zone_query(store, "WWW.Example.TEST.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_OK && result.ancount == 3 && result.nscount == 0);
+    CHECK(rrs[0].type == DNS_TYPE_CNAME && rdata_equal(&rrs[0], "\3web\7example\4test\0", 18));
+    CHECK(rrs[1].type == DNS_TYPE_CNAME && rdata_equal(&rrs[1], "\4host\3sub\7example\4test\0", 23));
+    CHECK(rrs[2].type == DNS_TYPE_A && rdata_equal(&rrs[2], "\300\0\2\3", 4));
+    // 目标在另一个区域中时继续追踪，不在任何区域中时停止
+    CHECK(zone_query(store, "ext.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == 2 && rrs[1].type == DNS_TYPE_A && rdata_equal(&rrs[1], "\306\63\144\1", 4));
+    CHECK(zone_query(store, "far.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_OK && result.ancount == 1 && result.nscount == 0);
+    CHECK(zone_query(store, "loop1.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == ZONE_MAX_CHAIN + 1 && result.nscount == 0);
+
+    // 通配符：$ORIGIN下的“*”与多级的“*.wild”，显式的域名优先
+    CHECK(zone_query(store, "any.sub.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rdata_equal(&rrs[0], "\300\0\2\11", 4));
+    CHECK(zone_query(store, "host.sub.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rdata_equal(&rrs[0], "\300\0\2\3", 4));
+    CHECK(zone_query(store, "x.y.wild.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rdata_equal(&rrs[0], "\300\0\2\12", 4));
+
+    // 多个字符串、转义的引号与跨行的括号
+    CHECK(zone_query(store, "sub.example.test.", DNS_TYPE_TXT, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rdata_equal(&rrs[0], "\10sub zone\15with \"quotes\"", 23));
+    CHECK(zone_query(store, "txt.example.test.", DNS_TYPE_TXT, packet, &result, rrs));
+    CHECK(result.ancount == 1 && rdata_equal(&rrs[0], "\5multi\4line", 11));
+
+    // 否定回复附上SOA，TTL不超过MINIMUM；空的非终结结点为NODATA
+    CHECK(zone_query(store, "nope.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_NXDOMAIN && result.ancount == 0 && result.nscount == 1);
+    CHECK(rrs[0].type == DNS_TYPE_SOA && rrs[0].ttl == 300);
+    CHECK(zone_query(store, "b.c.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_OK && result.ancount == 0 && result.nscount == 1);
+    CHECK(zone_query(store, "web.example.test.", DNS_TYPE_MX, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_OK && result.ancount == 1 && rrs[0].type == DNS_TYPE_CNAME);
+    CHECK(zone_query(store, "nope.other.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_NXDOMAIN && result.nscount == 1 && rrs[0].ttl == 60);
+    CHECK(zone_query(store, "bad.example.test.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(result.rcode == DNS_RCODE_NXDOMAIN);
+
+    CHECK(!zone_query(store, "www.example.org.", DNS_TYPE_A, packet, &result, rrs));
+    CHECK(!zone_query(store, "test.", DNS_TYPE_A, packet, &result, rrs));
+    destroy_zone_store(store);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "blocklist") == 0)
+        test_blocklist(argv[2]);
+    else if (argc == 3 && strcmp(argv[1], "hosts") == 0)
+        test_hosts(argv[2]);
+    else if (argc == 3 && strcmp(argv[1], "zone") == 0)
+        test_zone(argv[2]);
+    else if (argc == 3 && strcmp(argv[1], "reload") == 0)
+        test_reload(argv[2]);
+    else {
+        fprintf(stderr, "用法：parser_test blocklist 编译后的屏蔽列表\n"
+                        "      parser_test hosts hosts文件\n"
+                        "      parser_test zone 样例所在的目录\n"
+                        "      parser_test reload 临时hosts文件\n");
+        return EXIT_FAILURE;
+    }
+    if (failures > 0)
+        fprintf(stderr, "%d项检查失败\n", failures);
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
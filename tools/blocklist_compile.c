@@ -0,0 +1,353 @@
+/**
+ * @file      blocklist_compile.c
+ * @brief     屏蔽列表编译工具
+ * @details   读取hosts或屏蔽列表文本，生成服务器用--blocklist_path映射的二进制屏蔽列表，格式见include/blocklist.h。
+ *            每行可以是本项目hosts文件的“域名 地址”、常见hosts文件的“地址 域名...”或单独的域名，#之后为注释。
+ *            域名写作“*.example.com”或“||example.com^”时为后缀规则（见include/suffix_trie.h）；
+ *            Adblock列表中的!注释、[...]标题与@@例外规则被跳过，带$选项的规则视为无效。
+ *            地址为0.0.0.0或::的域名被屏蔽；“地址 域名”形式中127.0.0.1与::1也视为屏蔽，其他地址的记录应留在hosts文件中，
+ *            此处跳过并计数。localhost等本机名称总是跳过。输出先写入临时文件再改名，正在映射旧文件的服务器不受影响。
+ *            用法：blocklist_compile -o 输出文件 输入文件...
+*/
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../include/blocklist.h"
+#include "../include/bloom_filter.h"
+#include "../include/dns_key.h"
+#include "../include/dns_name.h"
+#include "../include/suffix_trie.h"
+
+#define LINE_MAX_SIZE 4096
+
+static Blocklist_Entry *entries;
+static size_t entry_count, entry_capacity;
+static Blocklist_Suffix *suffixes;
+static size_t suffix_count, suffix_capacity;
+static uint8_t *arena; // 域名池
+static size_t arena_size, arena_capacity;
+static uint64_t lines, skipped_records, invalid_names;
+
+static const char *LOCAL_NAMES[] = {"localhost", "localhost.localdomain", "local", "broadcasthost",
+                                    "ip6-localhost", "ip6-loopback", "0.0.0.0"};
+
+static void usage(void) {
+    fprintf(stderr, "用法：blocklist_compile -o 输出文件 输入文件...\n"
+                    "  -o  输出的二进制屏蔽列表，供--blocklist_path使用\n"
+                    "  输入为hosts或屏蔽列表文本，可指定多个，合并后去重\n");
+    exit(EXIT_FAILURE);
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool is_address(const char *s) {
+    uint8_t buf[16];
+    return inet_pton(AF_INET, s, buf) == 1 || inet_pton(AF_INET6, s, buf) == 1;
+}
+
+/**
+ * @brief 判断地址是否表示屏蔽
+ * @param ip 地址
+ * @param leading 地址是否在域名之前（常见hosts文件的形式）
+ */
+static bool is_block_address(const char *ip, bool leading) {
+    if (strcmp(ip, "0.0.0.0") == 0 || strcmp(ip, "::") == 0)
+        return true;
+    return leading && (strcmp(ip, "127.0.0.1") == 0 || strcmp(ip, "::1") == 0);
+}
+
+/**
+ * @brief 校验域名并转换为以'.'结尾的点分形式，标签只能含字母、数字、'-'与'_'
+ * @param dst 目标缓冲区，至少DNS_NAME_TEXT_MAX_SIZE + 2字节
+ * @param src 域名，可以'.'结尾
+ * @return 如果域名合法，返回true
+ */
+static bool normalize_name(char *dst, const char *src) {
+    size_t len = strlen(src);
+    if (len > 0 && src[len - 1] == '.')
+        --len;
+    if (len == 0 || len > DNS_NAME_TEXT_MAX_SIZE - 2)
+        return false;
+    size_t label = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char c = src[i];
+        if (c == '.') {
+            if (label == 0)
+                return false;
+            label = 0;
+        } else if (++label > DNS_NAME_LABEL_MAX_SIZE || !(isalnum((unsigned char) c) || c == '-' || c == '_')) {
+            return false;
+        }
+        dst[i] = c;
+    }
+    if (label == 0)
+        return false;
+    dst[len] = '.';
+    dst[len + 1] = 0;
+    return true;
+}
+
+/**
+ * @brief 将域名追加到域名池
+ * @return 在域名池中的偏移
+ */
+static uint32_t arena_append(const uint8_t *name, size_t len) {
+    while (arena_size + len > arena_capacity) {
+        arena_capacity = arena_capacity ? arena_capacity * 2 : 65536;
+        arena = (uint8_t *) realloc(arena, arena_capacity);
+        if (!arena) {
+            fprintf(stderr, "内存分配错误\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(arena + arena_size, name, len);
+    arena_size += len;
+    return (uint32_t) (arena_size - len);
+}
+
+static void add_name(const char *name) {
+    for (size_t i = 0; i < sizeof(LOCAL_NAMES) / sizeof(LOCAL_NAMES[0]); ++i)
+        if (strcasecmp(name, LOCAL_NAMES[i]) == 0)
+            return;
+    const char *suffix;
+    int suffix_len;
+    uint8_t flags = suffix_rule_parse(name, &suffix, &suffix_len);
+    char text[DNS_NAME_TEXT_MAX_SIZE + 2], rule[DNS_NAME_TEXT_MAX_SIZE + 2];
+    if (flags != 0) {
+        if (suffix_len > DNS_NAME_TEXT_MAX_SIZE) {
+            ++invalid_names;
+            return;
+        }
+        memcpy(rule, suffix, suffix_len);
+        rule[suffix_len] = 0;
+        name = rule;
+    }
+    if (!normalize_name(text, name)) {
+        ++invalid_names;
+        return;
+    }
+    DNSKey key;
+    dnskey_init(&key, (const uint8_t *) text, 0, 0);
+    if (flags != 0) {
+        if (suffix_count == suffix_capacity) {
+            suffix_capacity = suffix_capacity ? suffix_capacity * 2 : 256;
+            suffixes = (Blocklist_Suffix *) realloc(suffixes, suffix_capacity * sizeof(Blocklist_Suffix));
+            if (!suffixes) {
+                fprintf(stderr, "内存分配错误\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        suffixes[suffix_count++] = (Blocklist_Suffix) {arena_append(key.name, key.len), (uint16_t) key.len, flags};
+        return;
+    }
+    if (entry_count == entry_capacity) {
+        entry_capacity = entry_capacity ? entry_capacity * 2 : 4096;
+        entries = (Blocklist_Entry *) realloc(entries, entry_capacity * sizeof(Blocklist_Entry));
+        if (!entries) {
+            fprintf(stderr, "内存分配错误\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    uint32_t offset = arena_append(key.name, key.len);
+    entries[entry_count++] = (Blocklist_Entry) {key.hash, offset, (uint32_t) key.len};
+}
+
+static bool load_text(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    char line[LINE_MAX_SIZE];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        ++lines;
+        if (line[0] == '!' || line[0] == '[' || (line[0] == '@' && line[1] == '@')) // Adblock的注释、标题与例外规则
+            continue;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = 0;
+        char *tokens[LINE_MAX_SIZE / 2];
+        int count = 0;
+        for (char *t = strtok(line, " \t\r\n"); t; t = strtok(NULL, " \t\r\n"))
+            tokens[count++] = t;
+        if (count == 0)
+            continue;
+        if (count == 1) { // 单独的域名
+            add_name(tokens[0]);
+        } else if (is_address(tokens[0])) { // 地址 域名...
+            if (!is_block_address(tokens[0], true)) {
+                ++skipped_records;
+                continue;
+            }
+            for (int i = 1; i < count; ++i)
+                add_name(tokens[i]);
+        } else if (is_block_address(tokens[1], false)) { // 域名 地址
+            add_name(tokens[0]);
+        } else {
+            ++skipped_records;
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+static int compare_entry(const void *a, const void *b) {
+    const Blocklist_Entry *x = (const Blocklist_Entry *) a, *y = (const Blocklist_Entry *) b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    if (x->name_len != y->name_len)
+        return x->name_len < y->name_len ? -1 : 1;
+    return memcmp(arena + x->name_offset, arena + y->name_offset, x->name_len);
+}
+
+static int compare_suffix(const void *a, const void *b) {
+    const Blocklist_Suffix *x = (const Blocklist_Suffix *) a, *y = (const Blocklist_Suffix *) b;
+    if (x->name_len != y->name_len)
+        return x->name_len < y->name_len ? -1 : 1;
+    return memcmp(arena + x->name_offset, arena + y->name_offset, x->name_len);
+}
+
+/**
+ * @brief 排序去重，并按项的顺序重排域名池，使同一桶的域名相邻；同一域名的后缀规则合并
+ * @return 去除的重复项数
+ */
+static size_t sort_entries(uint8_t **names, size_t *names_size) {
+    qsort(entries, entry_count, sizeof(Blocklist_Entry), &compare_entry);
+    size_t unique = 0;
+    for (size_t i = 0; i < entry_count; ++i)
+        if (unique == 0 || compare_entry(&entries[unique - 1], &entries[i]) != 0)
+            entries[unique++] = entries[i];
+    size_t duplicates = entry_count - unique;
+    entry_count = unique;
+    qsort(suffixes, suffix_count, sizeof(Blocklist_Suffix), &compare_suffix);
+    unique = 0;
+    for (size_t i = 0; i < suffix_count; ++i) {
+        if (unique > 0 && compare_suffix(&suffixes[unique - 1], &suffixes[i]) == 0) {
+            suffixes[unique - 1].flags |= suffixes[i].flags;
+            ++duplicates;
+        } else {
+            suffixes[unique++] = suffixes[i];
+        }
+    }
+    suffix_count = unique;
+
+    *names = (uint8_t *) malloc(arena_size ? arena_size : 1);
+    if (!*names) {
+        fprintf(stderr, "内存分配错误\n");
+        exit(EXIT_FAILURE);
+    }
+    *names_size = 0;
+    for (size_t i = 0; i < entry_count; ++i) {
+        memcpy(*names + *names_size, arena + entries[i].name_offset, entries[i].name_len);
+        entries[i].name_offset = (uint32_t) *names_size;
+        *names_size += entries[i].name_len;
+    }
+    for (size_t i = 0; i < suffix_count; ++i) {
+        memcpy(*names + *names_size, arena + suffixes[i].name_offset, suffixes[i].name_len);
+        suffixes[i].name_offset = (uint32_t) *names_size;
+        *names_size += suffixes[i].name_len;
+    }
+    return duplicates;
+}
+
+static bool write_blocklist(const char *path, const uint8_t *names, size_t names_size) {
+    Blocklist_Header header = {0};
+    memcpy(header.magic, BLOCKLIST_MAGIC, sizeof(header.magic));
+    header.version = BLOCKLIST_VERSION;
+    header.count = (uint32_t) entry_count;
+    DNSKey check;
+    dnskey_init(&check, (const uint8_t *) BLOCKLIST_HASH_CHECK_NAME, 0, 0);
+    header.hash_check = check.hash;
+    header.names_size = names_size;
+    header.suffix_count = (uint32_t) suffix_count;
+
+    static uint32_t buckets[BLOCKLIST_BUCKET_COUNT];
+    size_t next = 0;
+    for (uint32_t b = 0; b <= (1u << BLOCKLIST_BUCKET_BITS); ++b) {
+        while (next < entry_count && (entries[next].hash >> (64 - BLOCKLIST_BUCKET_BITS)) < b)
+            ++next;
+        buckets[b] = (uint32_t) next;
+    }
+    for (uint32_t b = (1u << BLOCKLIST_BUCKET_BITS) + 1; b < BLOCKLIST_BUCKET_COUNT; ++b)
+        buckets[b] = (uint32_t) entry_count;
+    Bloom_Filter *filter = new_bloom_filter(bloom_block_count(entry_count));
+    for (size_t i = 0; i < entry_count; ++i)
+        filter->add(filter, entries[i].hash);
+    header.bloom_blocks = filter->block_count;
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        perror(tmp);
+        destroy_bloom_filter(filter);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(buckets, sizeof(buckets), 1, fp) == 1 &&
+              fwrite(filter->blocks, BLOOM_BLOCK_SIZE, filter->block_count, fp) == filter->block_count &&
+              fwrite(entries, sizeof(Blocklist_Entry), entry_count, fp) == entry_count &&
+              fwrite(suffixes, sizeof(Blocklist_Suffix), suffix_count, fp) == suffix_count &&
+              fwrite(names, 1, names_size, fp) == names_size;
+    ok = fclose(fp) == 0 && ok;
+    destroy_bloom_filter(filter);
+    if (!ok || rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (output == NULL || optind == argc)
+        usage();
+    init_dnsname();
+
+    double start = now_ms();
+    for (int i = optind; i < argc; ++i)
+        if (!load_text(argv[i]))
+            return EXIT_FAILURE;
+    if (entry_count > UINT32_MAX || arena_size > UINT32_MAX) {
+        fprintf(stderr, "域名过多\n");
+        return EXIT_FAILURE;
+    }
+    uint8_t *names;
+    size_t names_size;
+    size_t duplicates = sort_entries(&names, &names_size);
+    if (!write_blocklist(output, names, names_size))
+        return EXIT_FAILURE;
+
+    size_t file_size = blocklist_bloom_offset() + (size_t) bloom_block_count(entry_count) * BLOOM_BLOCK_SIZE +
+                       entry_count * sizeof(Blocklist_Entry) + suffix_count * sizeof(Blocklist_Suffix) + names_size;
+    fprintf(stderr, "读取%llu行，屏蔽%zu个域名与%zu条后缀规则（去除重复%zu个），跳过非屏蔽记录%llu条、无效域名%llu个\n"
+                    "输出%s，%zu字节，耗时%.1fms\n",
+            (unsigned long long) lines, entry_count, suffix_count, duplicates, (unsigned long long) skipped_records,
+            (unsigned long long) invalid_names, output, file_size, now_ms() - start);
+    free(names);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,643 @@
+/**
+ * @file      cache_sim.c
+ * @brief     离线缓存模拟工具
+ * @details   读取二进制查询日志或抓包文件，按服务器缓存的规则模拟查询序列，一遍求出各容量下LRU链表的命中率（命中率曲线）。
+ *            服务器的缓存由容量为--cache_size的LRU链表与不限容量的红黑树组成：命中或从上游取得回复时元素移到LRU链表尾部，
+ *            过期的元素不再命中，但仍占据LRU链表的位置直到被淘汰。因此容量为C的LRU链表命中，当且仅当该元素未过期、
+ *            且上次访问后访问过的不同元素（含已过期的旧元素）少于C个，即Mattson栈距离小于C；未过期但栈距离不小于C时由红黑树命中。
+ *            栈距离用树状数组统计：每个元素在其最近一次访问的位置上记1，栈距离即该位置之后的1的个数。
+ *            使用-S时按域名的哈希值采样（SHARDS），只模拟比例为R的元素，栈距离按1/R放大，用于内存放不下全部查询的长日志。
+ *            使用-P时还按服务器的W-TinyLFU策略（--cache_policy tinylfu）逐个容量直接模拟，与LRU的命中率对比。
+ *            用法：cache_sim [-p 抓包文件 | -q 查询日志] [-D 地址] [-T TTL] [-S 采样率] [-c 容量,...] [-P] [-C]
+*/
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "../bench/pcap_dns.h"
+#include "../include/frequency_sketch.h"
+#include "../include/query_log.h"
+
+#define KEY_MAX_SIZE 264 // 规范形式的问题的最大长度
+#define MAX_CAPACITIES 64
+#define SHARDS_MODULUS (1u << 24)
+
+// 一个缓存元素，即一个问题（域名、QTYPE与QCLASS）
+typedef struct sim_object {
+    uint64_t hash;
+    size_t key; // 规范形式的问题在key_arena中的偏移
+    uint16_t key_len;
+    double ttl; // 回复中的最小TTL（秒），hosts中的记录为INFINITY，回复中没有资源记录时为负数
+    bool ttl_known;
+    int64_t marker; // 最近一次访问在树状数组中的位置，-1表示不在缓存中
+    double expire; // 过期时刻
+} Sim_Object;
+
+// 一次访问
+typedef struct sim_access {
+    uint32_t object;
+    bool cacheable; // 为false时这次查询未得到回复，不插入缓存
+    double time; // 秒
+} Sim_Access;
+
+static Sim_Object *objects;
+static size_t object_count, object_capacity;
+static uint32_t *table; // 开放寻址的哈希表，存放object下标加1
+static size_t table_size;
+static uint8_t *key_arena;
+static size_t arena_size, arena_capacity;
+static Sim_Access *accesses;
+static size_t access_count, access_capacity;
+
+static double default_ttl = 300;
+
+static void *xrealloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        fprintf(stderr, "内存分配错误\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint64_t hash_key(const uint8_t *key, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i)
+        h = (h ^ key[i]) * 1099511628211ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void table_grow(void) {
+    free(table);
+    table_size = table_size ? table_size * 2 : 1024;
+    table = (uint32_t *) calloc(table_size, sizeof(uint32_t));
+    if (!table) {
+        fprintf(stderr, "内存分配错误\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < object_count; ++i) {
+        size_t pos = objects[i].hash & (table_size - 1);
+        while (table[pos])
+            pos = (pos + 1) & (table_size - 1);
+        table[pos] = i + 1;
+    }
+}
+
+/**
+ * @brief 查找问题对应的元素，不存在时创建
+ * @param key 规范形式的问题
+ * @param len 长度
+ * @return 元素的下标
+ */
+static uint32_t find_object(const uint8_t *key, size_t len) {
+    if ((object_count + 1) * 2 > table_size)
+        table_grow();
+    uint64_t hash = hash_key(key, len);
+    size_t pos = hash & (table_size - 1);
+    while (table[pos]) {
+        Sim_Object *o = &objects[table[pos] - 1];
+        if (o->hash == hash && o->key_len == len && memcmp(key_arena + o->key, key, len) == 0)
+            return table[pos] - 1;
+        pos = (pos + 1) & (table_size - 1);
+    }
+    if (object_count == object_capacity) {
+        object_capacity = object_capacity ? object_capacity * 2 : 1024;
+        objects = (Sim_Object *) xrealloc(objects, object_capacity * sizeof(Sim_Object));
+    }
+    while (arena_size + len > arena_capacity) {
+        arena_capacity = arena_capacity ? arena_capacity * 2 : 65536;
+        key_arena = (uint8_t *) xrealloc(key_arena, arena_capacity);
+    }
+    memcpy(key_arena + arena_size, key, len);
+    objects[object_count] = (Sim_Object) {.hash = hash, .key = arena_size, .key_len = len, .marker = -1};
+    arena_size += len;
+    table[pos] = object_count + 1;
+    return object_count++;
+}
+
+static void add_access(uint32_t object, bool cacheable, double time) {
+    if (access_count == access_capacity) {
+        access_capacity = access_capacity ? access_capacity * 2 : 65536;
+        accesses = (Sim_Access *) xrealloc(accesses, access_capacity * sizeof(Sim_Access));
+    }
+    accesses[access_count++] = (Sim_Access) {object, cacheable, time};
+}
+
+static uint16_t be16(const uint8_t *p) {
+    return p[0] << 8 | p[1];
+}
+
+/**
+ * @brief 跳过报文中的一个域名
+ * @return 域名之后的位置，格式错误时返回0
+ */
+static size_t skip_name(const uint8_t *dns, size_t len, size_t pos) {
+    while (pos < len) {
+        if (dns[pos] == 0)
+            return pos + 1;
+        if ((dns[pos] & 0xC0) == 0xC0)
+            return pos + 2 <= len ? pos + 2 : 0;
+        pos += 1 + dns[pos];
+    }
+    return 0;
+}
+
+/**
+ * @brief 求回复中所有资源记录的最小TTL，与服务器一致，附加段中的OPT记录也参与计算
+ * @param dns 回复报文
+ * @param len 报文长度
+ * @param ttl 输出，最小TTL
+ * @return 如果回复中有资源记录，返回true
+ */
+static bool response_min_ttl(const uint8_t *dns, size_t len, double *ttl) {
+    size_t pos = 12;
+    for (unsigned i = be16(dns + 4); i > 0; --i) {
+        if (!(pos = skip_name(dns, len, pos)) || pos + 4 > len)
+            return false;
+        pos += 4;
+    }
+    unsigned count = be16(dns + 6) + be16(dns + 8) + be16(dns + 10);
+    bool found = false;
+    for (unsigned i = 0; i < count; ++i) {
+        if (!(pos = skip_name(dns, len, pos)) || pos + 10 > len)
+            break;
+        double value = (uint32_t) (dns[pos + 4] << 24 | dns[pos + 5] << 16 | dns[pos + 6] << 8 | dns[pos + 7]);
+        if (!found || value < *ttl)
+            *ttl = value;
+        found = true;
+        pos += 10 + be16(dns + pos + 8);
+    }
+    return found;
+}
+
+/**
+ * @brief 读取抓包文件，查询作为访问，回复确定元素的TTL
+ * @details 同一问题的多个回复中取最大的TTL，以免上游缓存中剩余的TTL低估了记录的有效期
+ * @param path 抓包文件
+ * @param dst 只读取发往该地址的查询，为NULL时不过滤
+ * @return 成功时返回true
+ */
+static bool load_pcap(const char *path, const Pcap_DNS_Packet *dst) {
+    Pcap_DNS pcap;
+    if (!pcap_dns_open(&pcap, path))
+        return false;
+    Pcap_DNS_Packet packet;
+    uint8_t key[KEY_MAX_SIZE];
+    while (pcap_dns_next(&pcap, &packet)) {
+        size_t len = pcap_dns_question(packet.dns, packet.len, key, sizeof(key));
+        if (len == 0)
+            continue;
+        if (packet.query) {
+            if (dst && (packet.family != dst->family ||
+                        memcmp(packet.dst, dst->dst, packet.family == AF_INET ? 4 : 16) != 0))
+                continue;
+            add_access(find_object(key, len), true, packet.time);
+            continue;
+        }
+        Sim_Object *o = &objects[find_object(key, len)];
+        double ttl;
+        if (!response_min_ttl(packet.dns, packet.len, &ttl))
+            ttl = -1; // 服务器不缓存没有资源记录的回复
+        if (!o->ttl_known || ttl > o->ttl)
+            o->ttl = ttl;
+        o->ttl_known = true;
+    }
+    pcap_dns_close(&pcap);
+    return true;
+}
+
+static uint16_t le16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+/**
+ * @brief 读取二进制查询日志，格式见query_log.h
+ * @details 日志中没有TTL，来自hosts的记录永不过期，其余按-T指定的TTL；超时、被丢弃与失败的查询不插入缓存
+ * @param path 日志文件
+ * @return 成功时返回true
+ */
+static bool load_qlog(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "%s: 无法打开\n", path);
+        return false;
+    }
+    uint8_t header[QLOG_HEADER_SIZE], body[UINT16_MAX], key[KEY_MAX_SIZE];
+    if (fread(header, 1, QLOG_HEADER_SIZE, file) != QLOG_HEADER_SIZE || memcmp(header, QLOG_MAGIC, 4) != 0 ||
+        le16(header + 4) != QLOG_VERSION) {
+        fprintf(stderr, "%s: 不是查询日志文件或版本不支持\n", path);
+        fclose(file);
+        return false;
+    }
+    uint8_t prefix[2];
+    while (fread(prefix, 1, 2, file) == 2) {
+        size_t len = le16(prefix);
+        if (fread(body, 1, len, file) != len || len < 22)
+            break; // 写入中断时最后一条记录可能不完整
+        uint64_t time = 0;
+        for (int i = 7; i >= 0; --i)
+            time = time << 8 | body[i];
+        uint8_t outcome = body[19];
+        const uint8_t *p = body + 21 + (body[20] == 6 ? 16 : 4) + 2;
+        if (p >= body + len || p + 1 + *p > body + len)
+            break;
+        // 点分形式的域名转换为小写的标签序列
+        size_t name_len = *p++, out = 0, label = 0;
+        for (size_t i = 0; i <= name_len; ++i) {
+            if (i == name_len || p[i] == '.') {
+                if (i > label) {
+                    key[out++] = i - label;
+                    for (size_t j = label; j < i; ++j)
+                        key[out++] = p[j] >= 'A' && p[j] <= 'Z' ? p[j] + 32 : p[j];
+                }
+                label = i + 1;
+            }
+        }
+        key[out++] = 0;
+        // QTYPE与QCLASS，日志中为小端序
+        key[out] = body[15], key[out + 1] = body[14], key[out + 2] = body[17], key[out + 3] = body[16];
+        out += 4;
+
+        uint32_t object = find_object(key, out);
+        if (outcome == QUERY_HOSTS || outcome == QUERY_LOCAL_ZONE || outcome == QUERY_ZONE) {
+            objects[object].ttl = INFINITY;
+            objects[object].ttl_known = true;
+        }
+        add_access(object, outcome != QUERY_TIMEOUT && outcome != QUERY_POOL_FULL && outcome != QUERY_FAILED &&
+                                   outcome != QUERY_RATE_LIMITED,
+                   time / 1e9);
+    }
+    fclose(file);
+    return true;
+}
+
+static uint32_t *fenwick;
+static size_t fenwick_size;
+
+static void fenwick_add(size_t pos, int delta) {
+    for (++pos; pos <= fenwick_size; pos += pos & -pos)
+        fenwick[pos - 1] += delta;
+}
+
+static uint64_t fenwick_prefix(size_t pos) { // [0, pos]的和
+    uint64_t sum = 0;
+    for (++pos; pos > 0; pos -= pos & -pos)
+        sum += fenwick[pos - 1];
+    return sum;
+}
+
+// 模拟结果
+typedef struct sim_result {
+    uint64_t accesses; // 采样的访问数
+    uint64_t compulsory; // 首次访问
+    uint64_t expired; // 元素已过期
+    uint64_t uncacheable; // 回复不可缓存或未得到回复
+    uint64_t *distances; // 未过期时各栈距离的次数
+    uint64_t max_distance;
+} Sim_Result;
+
+/**
+ * @brief 按时间顺序模拟所有访问
+ * @param rate SHARDS采样率，为1时模拟全部元素
+ * @param result 输出
+ */
+static void simulate(double rate, Sim_Result *result) {
+    uint32_t threshold = rate >= 1 ? SHARDS_MODULUS : (uint32_t) (rate * SHARDS_MODULUS);
+    fenwick_size = access_count;
+    fenwick = (uint32_t *) calloc(fenwick_size + 1, sizeof(uint32_t));
+    result->distances = (uint64_t *) calloc(access_count + 1, sizeof(uint64_t));
+    if (!fenwick || !result->distances) {
+        fprintf(stderr, "内存分配错误\n");
+        exit(1);
+    }
+    uint64_t markers = 0; // 树状数组中1的个数
+    size_t next = 0; // 下一个位置
+    for (size_t i = 0; i < access_count; ++i) {
+        const Sim_Access *a = &accesses[i];
+        Sim_Object *o = &objects[a->object];
+        if ((o->hash & (SHARDS_MODULUS - 1)) >= threshold)
+            continue;
+        ++result->accesses;
+        if (o->marker >= 0 && a->time < o->expire) {
+            uint64_t distance = markers - fenwick_prefix(o->marker);
+            ++result->distances[distance];
+            if (distance > result->max_distance)
+                result->max_distance = distance;
+            fenwick_add(o->marker, -1);
+            fenwick_add(next, 1);
+            o->marker = next++;
+            continue;
+        }
+        double ttl = o->ttl_known ? o->ttl : default_ttl;
+        if (!a->cacheable || ttl < 0) {
+            ++result->uncacheable;
+            continue;
+        }
+        if (o->marker >= 0)
+            ++result->expired;
+        else
+            ++result->compulsory;
+        // 旧元素已过期时仍留在原位置，像服务器的LRU链表一样占据容量
+        fenwick_add(next, 1);
+        ++markers;
+        o->marker = next++;
+        o->expire = a->time + ttl;
+    }
+    free(fenwick);
+}
+
+/**
+ * @brief LRU链表容量为capacity时的命中数
+ */
+static uint64_t lru_hits(const Sim_Result *result, double rate, uint64_t capacity) {
+    uint64_t limit = (uint64_t) ceil(capacity * (rate < 1 ? rate : 1)), hits = 0;
+    for (uint64_t d = 0; d < limit && d <= result->max_distance; ++d)
+        hits += result->distances[d];
+    return hits;
+}
+
+// W-TinyLFU模拟中LRU链表的段，与服务器的Cache_Segment对应
+enum {
+    SEG_WINDOW, SEG_PROBATION, SEG_PROTECTED, SEG_COUNT
+};
+
+// W-TinyLFU模拟中LRU链表的元素，下标0到SEG_COUNT-1为各段的头结点
+typedef struct sim_node {
+    uint32_t prev, next;
+    uint32_t object;
+    uint8_t segment;
+    bool alive; // 仍在LRU链表中
+    double expire;
+} Sim_Node;
+
+static Sim_Node *nodes;
+static size_t node_count, node_capacity;
+static size_t segment_size[SEG_COUNT], segment_capacity[SEG_COUNT];
+
+static void node_unlink(uint32_t n) {
+    nodes[nodes[n].prev].next = nodes[n].next;
+    nodes[nodes[n].next].prev = nodes[n].prev;
+    --segment_size[nodes[n].segment];
+}
+
+static void node_push(uint32_t n, uint8_t segment) { // 放到段的尾部
+    uint32_t head = segment;
+    nodes[n].segment = segment;
+    nodes[n].prev = nodes[head].prev;
+    nodes[n].next = head;
+    nodes[nodes[head].prev].next = n;
+    nodes[head].prev = n;
+    ++segment_size[segment];
+}
+
+/**
+ * @brief 与服务器的tinylfu_admit相同：分段LRU未满时进入试用段，否则与最久未访问的元素比较频次
+ */
+static void sim_admit(Frequency_Sketch *sketch, uint32_t candidate, double now) {
+    bool candidate_expired = nodes[candidate].expire <= now;
+    if (segment_size[SEG_PROBATION] + segment_size[SEG_PROTECTED] <
+        segment_capacity[SEG_PROBATION] + segment_capacity[SEG_PROTECTED] && !candidate_expired) {
+        node_push(candidate, SEG_PROBATION);
+        return;
+    }
+    uint32_t head = segment_size[SEG_PROBATION] > 0 ? SEG_PROBATION : SEG_PROTECTED, victim = nodes[head].next;
+    if (victim == head || candidate_expired ||
+        (nodes[victim].expire > now && sketch->frequency(sketch, objects[nodes[candidate].object].hash) <=
+                                       sketch->frequency(sketch, objects[nodes[victim].object].hash))) {
+        nodes[candidate].alive = false;
+        return;
+    }
+    node_unlink(victim);
+    nodes[victim].alive = false;
+    node_push(candidate, SEG_PROBATION);
+}
+
+/**
+ * @brief 直接模拟W-TinyLFU策略下LRU链表的命中数，段的划分与服务器的new_cache相同
+ * @param capacity LRU链表的容量
+ * @param rate SHARDS采样率，模拟的容量按比例缩小
+ * @return LRU链表的命中数
+ */
+static uint64_t simulate_tinylfu(uint64_t capacity, double rate) {
+    uint32_t threshold = rate >= 1 ? SHARDS_MODULUS : (uint32_t) (rate * SHARDS_MODULUS);
+    if (rate < 1)
+        capacity = (uint64_t) ceil(capacity * rate);
+    uint64_t window = capacity / 100 > 0 ? capacity / 100 : 1, main = capacity - window;
+    segment_capacity[SEG_WINDOW] = window;
+    segment_capacity[SEG_PROTECTED] = main * 4 / 5;
+    segment_capacity[SEG_PROBATION] = main - main * 4 / 5;
+    Frequency_Sketch *sketch = new_frequency_sketch((int) capacity);
+    int64_t *current = (int64_t *) malloc(object_count * sizeof(int64_t)); // 各元素当前的链表元素
+    double *expire = (double *) calloc(object_count, sizeof(double)); // 各元素在红黑树中的过期时刻
+    if (!current || !expire) {
+        fprintf(stderr, "内存分配错误\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < object_count; ++i)
+        current[i] = -1;
+    if (node_capacity == 0) {
+        node_capacity = 1024;
+        nodes = (Sim_Node *) xrealloc(nodes, node_capacity * sizeof(Sim_Node));
+    }
+    node_count = SEG_COUNT;
+    for (uint32_t i = 0; i < SEG_COUNT; ++i) {
+        nodes[i].prev = nodes[i].next = i;
+        segment_size[i] = 0;
+    }
+
+    uint64_t hits = 0;
+    for (size_t i = 0; i < access_count; ++i) {
+        const Sim_Access *a = &accesses[i];
+        const Sim_Object *o = &objects[a->object];
+        if ((o->hash & (SHARDS_MODULUS - 1)) >= threshold)
+            continue;
+        sketch->increment(sketch, o->hash);
+        bool valid = current[a->object] >= 0 && a->time < expire[a->object];
+        if (valid && nodes[current[a->object]].alive) { // LRU链表命中
+            uint32_t n = current[a->object];
+            uint8_t segment = nodes[n].segment;
+            node_unlink(n);
+            if (segment != SEG_PROBATION) {
+                node_push(n, segment);
+            } else {
+                node_push(n, SEG_PROTECTED);
+                if (segment_size[SEG_PROTECTED] > segment_capacity[SEG_PROTECTED]) {
+                    uint32_t demoted = nodes[SEG_PROTECTED].next;
+                    node_unlink(demoted);
+                    node_push(demoted, SEG_PROBATION);
+                }
+            }
+            ++hits;
+            continue;
+        }
+        if (!valid) {
+            double ttl = o->ttl_known ? o->ttl : default_ttl;
+            if (!a->cacheable || ttl < 0)
+                continue;
+            expire[a->object] = a->time + ttl; // 从上游取得回复，已过期的旧元素留在链表中
+        }
+        // 从上游取得回复或由红黑树命中，插入窗口
+        if (node_count == node_capacity) {
+            node_capacity *= 2;
+            nodes = (Sim_Node *) xrealloc(nodes, node_capacity * sizeof(Sim_Node));
+        }
+        uint32_t n = node_count++;
+        nodes[n] = (Sim_Node) {.object = a->object, .alive = true, .expire = expire[a->object]};
+        current[a->object] = n;
+        node_push(n, SEG_WINDOW);
+        if (segment_size[SEG_WINDOW] > segment_capacity[SEG_WINDOW]) {
+            uint32_t oldest = nodes[SEG_WINDOW].next;
+            node_unlink(oldest);
+            sim_admit(sketch, oldest, a->time);
+        }
+    }
+    free(current);
+    free(expire);
+    free(sketch->table);
+    free(sketch);
+    return hits;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(void) {
+    fprintf(stderr, "用法：cache_sim [-p 抓包文件 | -q 查询日志] [-D 地址] [-T TTL] [-S 采样率] [-c 容量,...] [-P] [-C]\n"
+                    "  -p  pcap或pcapng文件，查询作为访问，回复确定TTL\n"
+                    "  -q  二进制查询日志（--qlog_path），可重复指定多个文件，按指定顺序读取\n"
+                    "  -D  只模拟发往该地址的查询，用于从服务器上的抓包中排除其发往上游的查询\n"
+                    "  -T  日志中的记录与抓包中没有回复的问题的TTL（秒），默认300\n"
+                    "  -S  SHARDS采样率（0-1），默认1，即不采样\n"
+                    "  -c  以逗号分隔的LRU容量，默认为16起的2的幂与300\n"
+                    "  -P  同时模拟W-TinyLFU策略，输出其LRU链表命中率\n"
+                    "  -C  以CSV输出命中率曲线\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    double rate = 1;
+    bool csv = false, loaded = false, tinylfu = false;
+    uint64_t capacities[MAX_CAPACITIES];
+    size_t capacity_count = 0;
+    Pcap_DNS_Packet dst = {0}, *filter = NULL;
+    const char *pcap_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:q:D:T:S:c:PC")) != -1) {
+        switch (opt) {
+            case 'p':
+                pcap_path = optarg;
+                break;
+            case 'q':
+                if (!load_qlog(optarg))
+                    return 1;
+                loaded = true;
+                break;
+            case 'D':
+                filter = &dst;
+                if (inet_pton(AF_INET, optarg, dst.dst) == 1)
+                    dst.family = AF_INET;
+                else if (inet_pton(AF_INET6, optarg, dst.dst) == 1)
+                    dst.family = AF_INET6;
+                else
+                    usage();
+                break;
+            case 'T':
+                default_ttl = strtod(optarg, NULL);
+                break;
+            case 'S':
+                rate = strtod(optarg, NULL);
+                if (rate <= 0 || rate > 1)
+                    usage();
+                break;
+            case 'c':
+                for (char *s = strtok(optarg, ","); s && capacity_count < MAX_CAPACITIES; s = strtok(NULL, ","))
+                    if (strtoull(s, NULL, 10) > 0)
+                        capacities[capacity_count++] = strtoull(s, NULL, 10);
+                break;
+            case 'P':
+                tinylfu = true;
+                break;
+            case 'C':
+                csv = true;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (pcap_path) {
+        if (!load_pcap(pcap_path, filter))
+            return 1;
+        loaded = true;
+    }
+    if (!loaded || optind != argc)
+        usage();
+    if (access_count == 0) {
+        fprintf(stderr, "没有读到查询\n");
+        return 1;
+    }
+
+    Sim_Result result = {0};
+    simulate(rate, &result);
+    uint64_t valid = result.accesses - result.compulsory - result.expired - result.uncacheable;
+    if (capacity_count == 0) {
+        for (uint64_t c = 16; c <= result.max_distance / (rate < 1 ? rate : 1) * 2 + 16 &&
+                              capacity_count + 1 < MAX_CAPACITIES; c *= 2)
+            capacities[capacity_count++] = c;
+        capacities[capacity_count++] = 300; // 默认的--cache_size
+    }
+    qsort(capacities, capacity_count, sizeof(uint64_t), compare_u64);
+
+    if (csv) {
+        printf("capacity,lru_hit_ratio,tree_hit_ratio,upstream_ratio%s\n", tinylfu ? ",tinylfu_hit_ratio" : "");
+        for (size_t i = 0; i < capacity_count; ++i) {
+            if (i > 0 && capacities[i] == capacities[i - 1])
+                continue;
+            uint64_t hits = lru_hits(&result, rate, capacities[i]);
+            printf("%llu,%.6f,%.6f,%.6f", (unsigned long long) capacities[i], (double) hits / result.accesses,
+                   (double) (valid - hits) / result.accesses, 1 - (double) valid / result.accesses);
+            if (tinylfu)
+                printf(",%.6f", (double) simulate_tinylfu(capacities[i], rate) / result.accesses);
+            printf("\n");
+        }
+        return 0;
+    }
+
+    printf("查询 %zu 个，不同的问题 %zu 个", access_count, object_count);
+    if (rate < 1)
+        printf("，采样率 %g，模拟 %llu 个查询", rate, (unsigned long long) result.accesses);
+    printf("\n未命中（发往上游）%.2f%%：首次查询 %.2f%%，已过期 %.2f%%，不可缓存 %.2f%%\n",
+           100.0 * (result.accesses - valid) / result.accesses, 100.0 * result.compulsory / result.accesses,
+           100.0 * result.expired / result.accesses, 100.0 * result.uncacheable / result.accesses);
+    printf("缓存命中率上限（LRU与红黑树合计，与LRU容量无关）%.2f%%\n", 100.0 * valid / result.accesses);
+    printf("%12s %10s %12s%s\n", "LRU容量", "LRU命中率", "红黑树命中率", tinylfu ? "  W-TinyLFU命中率" : "");
+    for (size_t i = 0; i < capacity_count; ++i) {
+        if (i > 0 && capacities[i] == capacities[i - 1])
+            continue;
+        uint64_t hits = lru_hits(&result, rate, capacities[i]);
+        printf("%12llu %9.2f%% %11.2f%%", (unsigned long long) capacities[i], 100.0 * hits / result.accesses,
+               100.0 * (valid - hits) / result.accesses);
+        if (tinylfu)
+            printf(" %15.2f%%", 100.0 * simulate_tinylfu(capacities[i], rate) / result.accesses);
+        printf("\n");
+    }
+    // LRU命中占命中率上限一定比例所需的容量
+    const double targets[] = {0.9, 0.95, 0.99, 1};
+    uint64_t hits = 0, d = 0;
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]) && valid > 0; ++t) {
+        while (hits < targets[t] * valid && d <= result.max_distance)
+            hits += result.distances[d++];
+        printf("LRU命中达到上限的 %g%% 需要容量 %.0f\n", targets[t] * 100, ceil(d / (rate < 1 ? rate : 1)));
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * @file      qlog_decode.c
+ * @brief     二进制查询日志解码工具
+ * @details   读取一个或多个查询日志文件，每条记录输出一行文本；使用-s时只输出按结果分类的查询数与延迟分位数。
+ *            用法：qlog_decode [-s] 文件...
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "../include/dns_metrics.h"
+#include "../include/dns_name.h"
+#include "../include/query_log.h"
+
+static const char *RCODE_NAME[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED"};
+
+// 解码后的记录
+typedef struct qlog_entry {
+    uint64_t time; // Unix纳秒
+    uint32_t latency; // 微秒
+    uint16_t id;
+    uint16_t qtype;
+    uint16_t qclass;
+    uint8_t rcode;
+    uint8_t outcome;
+    char addr[INET6_ADDRSTRLEN];
+    uint16_t port;
+    char qname[DNS_NAME_TEXT_MAX_SIZE + 1];
+} QLog_Entry;
+
+// 一类结果的延迟样本
+typedef struct latency_samples {
+    uint32_t *data;
+    size_t count;
+    size_t capacity;
+} Latency_Samples;
+
+static uint16_t get16(const uint8_t *p) {
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t) get16(p + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+static const char *type_name(uint16_t qtype, char *buf) {
+    switch (qtype) {
+        case 1: return "A";
+        case 2: return "NS";
+        case 5: return "CNAME";
+        case 6: return "SOA";
+        case 12: return "PTR";
+        case 15: return "MX";
+        case 16: return "TXT";
+        case 28: return "AAAA";
+        case 33: return "SRV";
+        case 65: return "HTTPS";
+        case 255: return "ANY";
+        default:
+            sprintf(buf, "TYPE%u", qtype);
+            return buf;
+    }
+}
+
+static const char *rcode_name(uint8_t rcode, char *buf) {
+    if (rcode == QLOG_NO_RCODE)
+        return "-";
+    if (rcode < sizeof(RCODE_NAME) / sizeof(RCODE_NAME[0]))
+        return RCODE_NAME[rcode];
+    sprintf(buf, "RCODE%u", rcode);
+    return buf;
+}
+
+/**
+ * @brief 解码一条记录
+ * @param body 记录内容，不含长度字段
+ * @param len 记录长度
+ * @param entry 解码结果
+ * @return 如果记录完整，返回true
+ */
+static bool decode(const uint8_t *body, size_t len, QLog_Entry *entry) {
+    if (len < 22)
+        return false;
+    entry->time = get64(body);
+    entry->latency = get32(body + 8);
+    entry->id = get16(body + 12);
+    entry->qtype = get16(body + 14);
+    entry->qclass = get16(body + 16);
+    entry->rcode = body[18];
+    entry->outcome = body[19];
+    uint8_t family = body[20];
+    size_t addr_len = family == 6 ? 16 : 4;
+    const uint8_t *p = body + 21;
+    if (p + addr_len + 3 > body + len)
+        return false;
+    inet_ntop(family == 6 ? AF_INET6 : AF_INET, p, entry->addr, sizeof(entry->addr));
+    p += addr_len;
+    entry->port = get16(p);
+    p += 2;
+    size_t name_len = *p++;
+    if (p + name_len > body + len)
+        return false;
+    memcpy(entry->qname, p, name_len);
+    entry->qname[name_len] = 0;
+    return true;
+}
+
+static void print_entry(const QLog_Entry *entry) {
+    char when[32], type_buf[16], rcode_buf[16];
+    time_t sec = entry->time / 1000000000;
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &tm);
+    printf("%s.%06uZ %s%s%s:%u 0x%04x %s %s %u %s %s %uus\n", when, (unsigned) (entry->time % 1000000000 / 1000),
+           strchr(entry->addr, ':') ? "[" : "", entry->addr, strchr(entry->addr, ':') ? "]" : "", entry->port,
+           entry->id, entry->qname, type_name(entry->qtype, type_buf), entry->qclass,
+           rcode_name(entry->rcode, rcode_buf),
+           entry->outcome < QUERY_OUTCOME_COUNT ? OUTCOME_LABEL[entry->outcome] : "unknown", entry->latency);
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void add_sample(Latency_Samples *samples, uint32_t latency) {
+    if (samples->count == samples->capacity) {
+        samples->capacity = samples->capacity ? samples->capacity * 2 : 1024;
+        samples->data = realloc(samples->data, samples->capacity * sizeof(uint32_t));
+        if (!samples->data) {
+            fprintf(stderr, "内存分配错误\n");
+            exit(1);
+        }
+    }
+    samples->data[samples->count++] = latency;
+}
+
+static void print_summary(Latency_Samples *samples) {
+    size_t total = 0;
+    for (int i = 0; i < QUERY_OUTCOME_COUNT; ++i)
+        total += samples[i].count;
+    printf("%-10s %10s %8s %10s %10s %10s %10s\n", "outcome", "queries", "share", "p50(us)", "p99(us)", "p999(us)",
+           "max(us)");
+    for (int i = 0; i < QUERY_OUTCOME_COUNT; ++i) {
+        Latency_Samples *s = &samples[i];
+        if (s->count == 0)
+            continue;
+        qsort(s->data, s->count, sizeof(uint32_t), compare_u32);
+        printf("%-10s %10zu %7.2f%% %10u %10u %10u %10u\n", OUTCOME_LABEL[i], s->count, 100.0 * s->count / total,
+               s->data[s->count / 2], s->data[s->count * 99 / 100], s->data[s->count * 999 / 1000],
+               s->data[s->count - 1]);
+    }
+    printf("%-10s %10zu\n", "total", total);
+}
+
+/**
+ * @brief 解码一个文件
+ * @param path 文件路径
+ * @param samples 汇总时的延迟样本，为NULL时逐条输出
+ * @return 如果文件格式正确，返回true
+ */
+static bool decode_file(const char *path, Latency_Samples *samples) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "%s: 无法打开\n", path);
+        return false;
+    }
+    uint8_t header[QLOG_HEADER_SIZE], body[UINT16_MAX];
+    if (fread(header, 1, QLOG_HEADER_SIZE, file) != QLOG_HEADER_SIZE || memcmp(header, QLOG_MAGIC, 4) != 0 ||
+        get16(header + 4) != QLOG_VERSION) {
+        fprintf(stderr, "%s: 不是查询日志文件或版本不支持\n", path);
+        fclose(file);
+        return false;
+    }
+    bool ok = true;
+    uint8_t prefix[2];
+    while (fread(prefix, 1, 2, file) == 2) {
+        size_t len = get16(prefix);
+        QLog_Entry entry;
+        if (fread(body, 1, len, file) != len || !decode(body, len, &entry)) { // 写入中断时最后一条记录可能不完整
+            fprintf(stderr, "%s: 记录不完整\n", path);
+            ok = false;
+            break;
+        }
+        if (samples == NULL)
+            print_entry(&entry);
+        else if (entry.outcome < QUERY_OUTCOME_COUNT)
+            add_sample(&samples[entry.outcome], entry.latency);
+    }
+    fclose(file);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    bool summary = argc > 1 && strcmp(argv[1], "-s") == 0;
+    int first = summary ? 2 : 1;
+    if (first >= argc) {
+        fprintf(stderr, "用法：qlog_decode [-s] 文件...\n");
+        return 2;
+    }
+    Latency_Samples samples[QUERY_OUTCOME_COUNT] = {0};
+    bool ok = true;
+    for (int i = first; i < argc; ++i)
+        ok &= decode_file(argv[i], summary ? samples : NULL);
+    if (summary)
+        print_summary(samples);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# 用perf记录探针并输出收到查询到发出回复的平均延迟
+# 用法：sudo tools/trace/perf_latency.sh <main的路径> [秒数]
+# perf不会设置USDT信号量，main需以 --trace_force 1 启动
+
+set -e
+
+BINARY=${1:?用法：$0 <main的路径> [秒数]}
+SECONDS_TO_RECORD=${2:-10}
+PROBES="query__receive query__reply upstream__send upstream__answer"
+
+perf buildid-cache --add "$BINARY"
+for probe in $PROBES; do
+    perf probe -d "sdt_nodns:$probe" >/dev/null 2>&1 || true
+    perf probe "sdt_nodns:$probe" >/dev/null
+done
+
+EVENTS=$(for probe in $PROBES; do printf -- "-e sdt_nodns:%s " "$probe"; done)
+# shellcheck disable=SC2086
+perf record -q $EVENTS -a -o /tmp/nodns.perf.data -- sleep "$SECONDS_TO_RECORD"
+
+# perf按arg1、arg2……输出探针参数（对应README中的arg0、arg1……），值为十六进制；按报文ID配对
+perf script -i /tmp/nodns.perf.data -F event,trace | gawk '
+    function arg(n,    v) { v = $(n + 2); sub(/.*=/, "", v); return strtonum(v) }
+    /query__receive/ { recv[arg(1)] = arg(3) }
+    /query__reply/ { id = arg(1); if (id in recv) { total += arg(3) - recv[id]; n++; delete recv[id] } }
+    /upstream__send/ { sent[arg(1)] = arg(3) }
+    /upstream__answer/ { uid = arg(5); if (uid in sent) { rtt += arg(3) - sent[uid]; m++; delete sent[uid] } }
+    END {
+        if (n) printf "queries: %d  mean latency: %.1f us\n", n, total / n / 1000
+        if (m) printf "upstream answers: %d  mean upstream rtt: %.1f us\n", m, rtt / m / 1000
+    }'